@@ -86,8 +86,8 @@ _get_bus_connection (
 
     /* get dbus connection for specific user only */
     gchar address[128];
-    g_snprintf (address, 127, "unix:path=%s/%s-%d", TLM_DBUS_SOCKET_PATH,
-            seat_id, ui_user_id);
+    g_snprintf (address, 127, "unix:path=%s/%s", TLM_DBUS_SOCKET_PATH,
+            seat_id);
     return g_dbus_connection_new_for_address_sync (address,
             G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL, error);
 }
@@ -56,8 +56,8 @@ tlm_dbus_utils_dispose_request (
 {
     if (!request) return;
 
-    g_object_unref (request->dbus_adapter);
-    g_object_unref (request->invocation);
+    if (request->dbus_adapter) g_object_unref (request->dbus_adapter);
+    if (request->invocation) g_object_unref (request->invocation);
     g_free (request->seat_id);
     g_free (request->username);
     g_free (request->password);
@@ -28,6 +28,7 @@
 
 #include <glib.h>
 #include <gio/gio.h>
+#include <sys/types.h>
 
 G_BEGIN_DECLS
 
@@ -38,11 +39,23 @@ typedef enum
     TLM_DBUS_REQUEST_TYPE_SWITCH_USER
 } TlmDbusRequestType;
 
+/* credentials of a dbus peer, read once when its connection is accepted */
+typedef struct
+{
+    pid_t pid;
+    uid_t uid;
+    gid_t gid;
+    gint pidfd; /* -1 if not supported, owned by the login adapter */
+} TlmDbusPeerCredentials;
+
 typedef struct
 {
     TlmDbusRequestType type;
     GObject* dbus_adapter;
-    GDBusMethodInvocation *invocation;
+    GDBusMethodInvocation *invocation; /* NULL for jobs */
+    guint job_id; /* non-zero if progress is reported with signals */
+    gpointer batch; /* batch call the request is part of, or NULL */
+    guint batch_index;
     gchar *seat_id;
     gchar *username;
     gchar *password;
@@ -36,6 +36,10 @@
 #define TLM_LOGIN_OBJECTPATH     "/org/O1/Tlm/Login"
 #define TLM_SESSION_OBJECTPATH   "/org/O1/Tlm/Session"
 
+/* environment key of login/switch requests carrying the seconds the daemon
+ * may take to complete them, it is not passed on to the session */
+#define TLM_DBUS_REQUEST_TIMEOUT_KEY "TLM_REQUEST_TIMEOUT"
+
 #define TLM_DBUS_FREEDESKTOP_SERVICE    "org.freedesktop.DBus"
 #define TLM_DBUS_FREEDESKTOP_PATH       "/org/freedesktop/DBus"
 #define TLM_DBUS_FREEDESKTOP_INTERFACE  "org.freedesktop.DBus"
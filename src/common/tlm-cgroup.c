@@ -0,0 +1,251 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "tlm-log.h"
+#include "tlm-cgroup.h"
+
+/* Returns the path of the new cgroup, which may also be left over from an
+ * earlier session of the same name. */
+gchar *
+tlm_cgroup_create (const gchar *base, const gchar *seat_id,
+                   const gchar *name)
+{
+    gchar *cgroup = NULL;
+
+    g_return_val_if_fail (base && seat_id && name, NULL);
+
+    cgroup = g_build_filename (base, seat_id, name, NULL);
+    if (g_mkdir_with_parents (cgroup, 0755) < 0) {
+        WARN ("Could not create cgroup '%s': %s", cgroup, strerror (errno));
+        g_free (cgroup);
+        return NULL;
+    }
+    DBG ("created cgroup %s", cgroup);
+    return cgroup;
+}
+
+void
+tlm_cgroup_remove (const gchar *cgroup)
+{
+    if (!cgroup)
+        return;
+
+    if (g_rmdir (cgroup) < 0 && errno != ENOENT)
+        WARN ("Could not remove cgroup '%s': %s", cgroup, strerror (errno));
+}
+
+static gint
+_open_file (const gchar *cgroup, const gchar *file, gint flags)
+{
+    gchar *path = g_build_filename (cgroup, file, NULL);
+    gint fd = open (path, flags | O_CLOEXEC);
+
+    if (fd < 0 && errno != ENOENT)
+        WARN ("open(%s): %s", path, strerror (errno));
+    g_free (path);
+    return fd;
+}
+
+/* A process writing "0" to it moves itself into the cgroup */
+gint
+tlm_cgroup_open_procs (const gchar *cgroup)
+{
+    g_return_val_if_fail (cgroup, -1);
+
+    return _open_file (cgroup, "cgroup.procs", O_WRONLY);
+}
+
+/* Polls for G_IO_PRI whenever cgroup.events changes */
+gint
+tlm_cgroup_open_events (const gchar *cgroup)
+{
+    g_return_val_if_fail (cgroup, -1);
+
+    return _open_file (cgroup, "cgroup.events", O_RDONLY);
+}
+
+/* Reading it also acknowledges the pending change on the descriptor */
+gboolean
+tlm_cgroup_read_populated (gint events_fd)
+{
+    gchar buf[256];
+    gchar *populated = NULL;
+    ssize_t len;
+
+    len = pread (events_fd, buf, sizeof (buf) - 1, 0);
+    if (len < 0) {
+        WARN ("reading cgroup.events failed: %s", strerror (errno));
+        return FALSE;
+    }
+    buf[len] = '\0';
+
+    populated = strstr (buf, "populated ");
+    return populated && populated[10] == '1';
+}
+
+gboolean
+tlm_cgroup_is_populated (const gchar *cgroup)
+{
+    gboolean populated;
+    gint fd;
+
+    g_return_val_if_fail (cgroup, FALSE);
+
+    if ((fd = tlm_cgroup_open_events (cgroup)) < 0)
+        return FALSE;
+    populated = tlm_cgroup_read_populated (fd);
+    close (fd);
+    return populated;
+}
+
+static gboolean
+_kill_procs (const gchar *cgroup)
+{
+    gchar *path = g_build_filename (cgroup, "cgroup.procs", NULL);
+    gchar *contents = NULL;
+    gchar **pids = NULL;
+    gchar **pid;
+
+    if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+        WARN ("Could not read '%s'", path);
+        g_free (path);
+        return FALSE;
+    }
+    g_free (path);
+
+    pids = g_strsplit (contents, "\n", -1);
+    for (pid = pids; *pid; pid++) {
+        if (**pid && kill ((pid_t) atoi (*pid), SIGKILL) < 0 &&
+            errno != ESRCH)
+            WARN ("kill(%s, SIGKILL): %s", *pid, strerror (errno));
+    }
+    g_strfreev (pids);
+    g_free (contents);
+    return TRUE;
+}
+
+/* SIGKILLs everything in the cgroup and below it */
+gboolean
+tlm_cgroup_kill (const gchar *cgroup)
+{
+    gint fd;
+    gboolean ret;
+
+    g_return_val_if_fail (cgroup, FALSE);
+
+    DBG ("killing cgroup %s", cgroup);
+    if ((fd = _open_file (cgroup, "cgroup.kill", O_WRONLY)) < 0) {
+        /* cgroup.kill came with linux 5.14, a process forking while its
+         * siblings are killed can escape this */
+        return _kill_procs (cgroup);
+    }
+
+    ret = write (fd, "1", 1) == 1;
+    if (!ret)
+        WARN ("writing cgroup.kill of '%s' failed: %s", cgroup,
+              strerror (errno));
+    close (fd);
+    return ret;
+}
+
+/* Kills what is in @cgroup and waits up to @timeout_ms for it to empty,
+ * returns FALSE if it is still populated */
+gboolean
+tlm_cgroup_clear (const gchar *cgroup, guint timeout_ms)
+{
+    struct pollfd pfd;
+    gint64 deadline;
+    gint64 left;
+    gboolean populated;
+
+    g_return_val_if_fail (cgroup, FALSE);
+
+    if ((pfd.fd = tlm_cgroup_open_events (cgroup)) < 0)
+        return FALSE;
+    pfd.events = POLLPRI;
+
+    populated = tlm_cgroup_read_populated (pfd.fd);
+    if (populated && tlm_cgroup_kill (cgroup)) {
+        deadline = g_get_monotonic_time () + (gint64) timeout_ms * 1000;
+        while (populated) {
+            left = (deadline - g_get_monotonic_time ()) / 1000;
+            if (left <= 0 || (poll (&pfd, 1, (gint) left) < 0 &&
+                              errno != EINTR))
+                break;
+            populated = tlm_cgroup_read_populated (pfd.fd);
+        }
+    }
+    close (pfd.fd);
+    return !populated;
+}
+
+/* Writes @value to the @attribute file of @cgroup */
+gboolean
+tlm_cgroup_set_attribute (const gchar *cgroup, const gchar *attribute,
+                          const gchar *value)
+{
+    gsize len;
+    gint fd;
+    gboolean ret;
+
+    g_return_val_if_fail (cgroup && attribute && value, FALSE);
+
+    if ((fd = _open_file (cgroup, attribute, O_WRONLY)) < 0) {
+        WARN ("cgroup '%s' has no '%s'", cgroup, attribute);
+        return FALSE;
+    }
+
+    len = strlen (value);
+    ret = write (fd, value, len) == (ssize_t) len;
+    if (!ret)
+        WARN ("setting %s of '%s' to '%s' failed: %s", attribute, cgroup,
+              value, strerror (errno));
+    close (fd);
+    return ret;
+}
+
+/* Makes @controller available to the children of @cgroup */
+gboolean
+tlm_cgroup_enable_controller (const gchar *cgroup, const gchar *controller)
+{
+    gchar *value = NULL;
+    gboolean ret;
+
+    g_return_val_if_fail (cgroup && controller, FALSE);
+
+    value = g_strconcat ("+", controller, NULL);
+    ret = tlm_cgroup_set_attribute (cgroup, "cgroup.subtree_control", value);
+    g_free (value);
+    return ret;
+}
@@ -0,0 +1,70 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_CGROUP_H
+#define _TLM_CGROUP_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Sessions in a delegated cgroup v2 tree, laid out as
+ * <base>/<seat id>/<session name> */
+
+gchar *
+tlm_cgroup_create (const gchar *base, const gchar *seat_id,
+                   const gchar *name);
+
+void
+tlm_cgroup_remove (const gchar *cgroup);
+
+gint
+tlm_cgroup_open_procs (const gchar *cgroup);
+
+gint
+tlm_cgroup_open_events (const gchar *cgroup);
+
+gboolean
+tlm_cgroup_read_populated (gint events_fd);
+
+gboolean
+tlm_cgroup_is_populated (const gchar *cgroup);
+
+gboolean
+tlm_cgroup_kill (const gchar *cgroup);
+
+gboolean
+tlm_cgroup_clear (const gchar *cgroup, guint timeout_ms);
+
+gboolean
+tlm_cgroup_enable_controller (const gchar *cgroup, const gchar *controller);
+
+gboolean
+tlm_cgroup_set_attribute (const gchar *cgroup, const gchar *attribute,
+                          const gchar *value);
+
+G_END_DECLS
+
+#endif /* _TLM_CGROUP_H */
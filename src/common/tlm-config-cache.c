@@ -0,0 +1,439 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "tlm-config-cache.h"
+#include "tlm-log.h"
+
+/*
+ * Compiled form of tlm.conf, mapped read-only and searched in place:
+ *
+ *   CacheHeader
+ *   CacheGroup[n_groups]   sorted by name
+ *   CacheEntry[n_entries]  sorted by key within each group
+ *   string table           NUL terminated strings
+ *
+ * All offsets are relative to the string table. The cache is only used
+ * while the modification time and size of its source file still match.
+ */
+
+#define TLM_CONFIG_CACHE_MAGIC   0x434d4c54 /* "TLMC" */
+#define TLM_CONFIG_CACHE_VERSION 1
+
+typedef struct _CacheHeader
+{
+    guint32 magic;
+    guint32 version;
+    guint64 source_mtime;
+    guint32 source_mtime_nsec;
+    guint32 source_path;
+    guint64 source_size;
+    guint32 n_groups;
+    guint32 n_entries;
+    guint32 strtab_size;
+    guint32 padding;
+} CacheHeader;
+
+typedef struct _CacheGroup
+{
+    guint32 name;
+    guint32 first_entry;
+    guint32 n_entries;
+} CacheGroup;
+
+typedef struct _CacheEntry
+{
+    guint32 key;
+    guint32 value;
+} CacheEntry;
+
+struct _TlmConfigCache
+{
+    GMappedFile *file;
+    const CacheHeader *header;
+    const CacheGroup *groups;
+    const CacheEntry *entries;
+    const gchar *strtab;
+};
+
+#define CACHE_STR(cache, off) ((cache)->strtab + (off))
+
+static gboolean
+_source_matches (
+        const CacheHeader *header,
+        const gchar *source_path)
+{
+    struct stat st;
+
+    if (g_stat (source_path, &st) != 0)
+        return FALSE;
+
+    return header->source_mtime == (guint64) st.st_mtim.tv_sec &&
+           header->source_mtime_nsec == (guint32) st.st_mtim.tv_nsec &&
+           header->source_size == (guint64) st.st_size;
+}
+
+static gboolean
+_validate (
+        TlmConfigCache *cache,
+        gsize length)
+{
+    const CacheHeader *header = cache->header;
+    gsize expected;
+    guint32 i;
+
+    if (length < sizeof (CacheHeader) ||
+        header->magic != TLM_CONFIG_CACHE_MAGIC ||
+        header->version != TLM_CONFIG_CACHE_VERSION)
+        return FALSE;
+
+    expected = sizeof (CacheHeader) +
+               (gsize) header->n_groups * sizeof (CacheGroup) +
+               (gsize) header->n_entries * sizeof (CacheEntry) +
+               header->strtab_size;
+    if (expected != length || header->strtab_size == 0 ||
+        cache->strtab[header->strtab_size - 1] != '\0' ||
+        header->source_path >= header->strtab_size)
+        return FALSE;
+
+    for (i = 0; i < header->n_groups; i++) {
+        const CacheGroup *group = &cache->groups[i];
+        if (group->name >= header->strtab_size ||
+            group->first_entry > header->n_entries ||
+            group->n_entries > header->n_entries - group->first_entry)
+            return FALSE;
+    }
+    for (i = 0; i < header->n_entries; i++) {
+        if (cache->entries[i].key >= header->strtab_size ||
+            cache->entries[i].value >= header->strtab_size)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Maps the cache at @cache_path. Returns NULL if there is no usable cache,
+ * it is corrupt, or it was not compiled from the current contents of
+ * @source_path. With a NULL @source_path the source recorded in the cache
+ * is checked instead.
+ */
+TlmConfigCache *
+tlm_config_cache_open (
+        const gchar *cache_path,
+        const gchar *source_path)
+{
+    TlmConfigCache *cache = NULL;
+    GMappedFile *file = NULL;
+    const gchar *contents;
+    gsize length;
+
+    g_return_val_if_fail (cache_path, NULL);
+
+    file = g_mapped_file_new (cache_path, FALSE, NULL);
+    if (!file)
+        return NULL;
+
+    contents = g_mapped_file_get_contents (file);
+    length = g_mapped_file_get_length (file);
+
+    cache = g_slice_new0 (TlmConfigCache);
+    cache->file = file;
+    cache->header = (const CacheHeader *) contents;
+    if (length >= sizeof (CacheHeader)) {
+        cache->groups = (const CacheGroup *) (contents + sizeof (CacheHeader));
+        cache->entries = (const CacheEntry *) (cache->groups +
+                                               cache->header->n_groups);
+        cache->strtab = (const gchar *) (cache->entries +
+                                         cache->header->n_entries);
+    }
+
+    if (!_validate (cache, length)) {
+        DBG ("ignoring invalid config cache '%s'", cache_path);
+        tlm_config_cache_free (cache);
+        return NULL;
+    }
+    if (source_path &&
+        g_strcmp0 (source_path,
+                   CACHE_STR (cache, cache->header->source_path)) != 0) {
+        tlm_config_cache_free (cache);
+        return NULL;
+    }
+    if (!_source_matches (cache->header,
+                          CACHE_STR (cache, cache->header->source_path))) {
+        DBG ("config cache '%s' is stale", cache_path);
+        tlm_config_cache_free (cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void
+tlm_config_cache_free (
+        TlmConfigCache *cache)
+{
+    if (!cache)
+        return;
+
+    g_mapped_file_unref (cache->file);
+    g_slice_free (TlmConfigCache, cache);
+}
+
+const gchar *
+tlm_config_cache_get_source (
+        TlmConfigCache *cache)
+{
+    g_return_val_if_fail (cache, NULL);
+
+    return CACHE_STR (cache, cache->header->source_path);
+}
+
+guint
+tlm_config_cache_get_n_groups (
+        TlmConfigCache *cache)
+{
+    g_return_val_if_fail (cache, 0);
+
+    return cache->header->n_groups;
+}
+
+const gchar *
+tlm_config_cache_get_group_name (
+        TlmConfigCache *cache,
+        guint index)
+{
+    g_return_val_if_fail (cache, NULL);
+    g_return_val_if_fail (index < cache->header->n_groups, NULL);
+
+    return CACHE_STR (cache, cache->groups[index].name);
+}
+
+static const CacheGroup *
+_find_group (
+        TlmConfigCache *cache,
+        const gchar *name)
+{
+    guint32 low = 0, high = cache->header->n_groups;
+
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        int cmp = strcmp (name, CACHE_STR (cache, cache->groups[mid].name));
+        if (cmp == 0)
+            return &cache->groups[mid];
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return NULL;
+}
+
+gboolean
+tlm_config_cache_has_group (
+        TlmConfigCache *cache,
+        const gchar *group)
+{
+    g_return_val_if_fail (cache && group, FALSE);
+
+    return _find_group (cache, group) != NULL;
+}
+
+const gchar *
+tlm_config_cache_lookup (
+        TlmConfigCache *cache,
+        const gchar *group,
+        const gchar *key)
+{
+    const CacheGroup *cache_group;
+    const CacheEntry *entries;
+    guint32 low = 0, high;
+
+    g_return_val_if_fail (cache && group && key, NULL);
+
+    cache_group = _find_group (cache, group);
+    if (!cache_group)
+        return NULL;
+
+    entries = cache->entries + cache_group->first_entry;
+    high = cache_group->n_entries;
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        int cmp = strcmp (key, CACHE_STR (cache, entries[mid].key));
+        if (cmp == 0)
+            return CACHE_STR (cache, entries[mid].value);
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return NULL;
+}
+
+void
+tlm_config_cache_foreach (
+        TlmConfigCache *cache,
+        const gchar *group,
+        TlmConfigCacheFunc func,
+        gpointer user_data)
+{
+    const CacheGroup *cache_group;
+    guint32 i;
+
+    g_return_if_fail (cache && group && func);
+
+    cache_group = _find_group (cache, group);
+    if (!cache_group)
+        return;
+
+    for (i = 0; i < cache_group->n_entries; i++) {
+        const CacheEntry *entry =
+            &cache->entries[cache_group->first_entry + i];
+        func (CACHE_STR (cache, entry->key), CACHE_STR (cache, entry->value),
+              user_data);
+    }
+}
+
+static gint
+_compare_strings (
+        gconstpointer a,
+        gconstpointer b)
+{
+    return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+static guint32
+_add_string (
+        GString *strtab,
+        const gchar *str)
+{
+    guint32 offset = strtab->len;
+
+    g_string_append_len (strtab, str ? str : "", str ? strlen (str) + 1 : 1);
+    return offset;
+}
+
+/*
+ * Compiles @config_table (group name -> { key -> value }) loaded from
+ * @source_path into @cache_path. @source_stat is the status of the source
+ * taken before it was parsed. The file is replaced atomically.
+ */
+gboolean
+tlm_config_cache_write (
+        const gchar *cache_path,
+        const gchar *source_path,
+        const struct stat *source_stat,
+        GHashTable *config_table,
+        GError **error)
+{
+    CacheHeader header;
+    GArray *groups = g_array_new (FALSE, TRUE, sizeof (CacheGroup));
+    GArray *entries = g_array_new (FALSE, TRUE, sizeof (CacheEntry));
+    GString *strtab = g_string_new (NULL);
+    GPtrArray *group_names = NULL;
+    GByteArray *data = NULL;
+    gchar *dir = NULL;
+    GHashTableIter iter;
+    gpointer group_name;
+    gboolean res = FALSE;
+    guint i;
+
+    g_return_val_if_fail (cache_path && source_path && source_stat &&
+                          config_table, FALSE);
+
+    memset (&header, 0, sizeof (header));
+    header.magic = TLM_CONFIG_CACHE_MAGIC;
+    header.version = TLM_CONFIG_CACHE_VERSION;
+    header.source_mtime = source_stat->st_mtim.tv_sec;
+    header.source_mtime_nsec = source_stat->st_mtim.tv_nsec;
+    header.source_size = source_stat->st_size;
+    header.source_path = _add_string (strtab, source_path);
+
+    group_names = g_ptr_array_new ();
+    g_hash_table_iter_init (&iter, config_table);
+    while (g_hash_table_iter_next (&iter, &group_name, NULL))
+        g_ptr_array_add (group_names, group_name);
+    g_ptr_array_sort (group_names, _compare_strings);
+
+    for (i = 0; i < group_names->len; i++) {
+        const gchar *name = g_ptr_array_index (group_names, i);
+        GHashTable *group_table = g_hash_table_lookup (config_table, name);
+        GList *keys = g_list_sort (g_hash_table_get_keys (group_table),
+                                   (GCompareFunc) strcmp);
+        GList *key;
+        CacheGroup group;
+
+        group.name = _add_string (strtab, name);
+        group.first_entry = entries->len;
+        group.n_entries = 0;
+        for (key = keys; key; key = key->next) {
+            CacheEntry entry;
+            entry.key = _add_string (strtab, key->data);
+            entry.value = _add_string (strtab,
+                    g_hash_table_lookup (group_table, key->data));
+            g_array_append_val (entries, entry);
+            group.n_entries++;
+        }
+        g_list_free (keys);
+        g_array_append_val (groups, group);
+    }
+
+    header.n_groups = groups->len;
+    header.n_entries = entries->len;
+    header.strtab_size = strtab->len;
+
+    data = g_byte_array_sized_new (sizeof (header) +
+            groups->len * sizeof (CacheGroup) +
+            entries->len * sizeof (CacheEntry) + strtab->len);
+    g_byte_array_append (data, (const guint8 *) &header, sizeof (header));
+    g_byte_array_append (data, (const guint8 *) groups->data,
+                         groups->len * sizeof (CacheGroup));
+    g_byte_array_append (data, (const guint8 *) entries->data,
+                         entries->len * sizeof (CacheEntry));
+    g_byte_array_append (data, (const guint8 *) strtab->str, strtab->len);
+
+    dir = g_path_get_dirname (cache_path);
+    if (g_mkdir_with_parents (dir, 0755) != 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Cannot create '%s'", dir);
+        goto out;
+    }
+    res = g_file_set_contents (cache_path, (const gchar *) data->data,
+                               data->len, error);
+
+out:
+    g_free (dir);
+    if (data)
+        g_byte_array_unref (data);
+    if (group_names)
+        g_ptr_array_unref (group_names);
+    g_array_unref (groups);
+    g_array_unref (entries);
+    g_string_free (strtab, TRUE);
+    return res;
+}
@@ -0,0 +1,90 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __TLM_CONFIG_CACHE_H_
+#define __TLM_CONFIG_CACHE_H_
+
+#include <glib.h>
+#include <sys/stat.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TlmConfigCache TlmConfigCache;
+
+typedef void (*TlmConfigCacheFunc) (const gchar *key,
+                                    const gchar *value,
+                                    gpointer user_data);
+
+TlmConfigCache *
+tlm_config_cache_open (
+        const gchar *cache_path,
+        const gchar *source_path);
+
+void
+tlm_config_cache_free (
+        TlmConfigCache *cache);
+
+const gchar *
+tlm_config_cache_get_source (
+        TlmConfigCache *cache);
+
+guint
+tlm_config_cache_get_n_groups (
+        TlmConfigCache *cache);
+
+const gchar *
+tlm_config_cache_get_group_name (
+        TlmConfigCache *cache,
+        guint index);
+
+gboolean
+tlm_config_cache_has_group (
+        TlmConfigCache *cache,
+        const gchar *group);
+
+const gchar *
+tlm_config_cache_lookup (
+        TlmConfigCache *cache,
+        const gchar *group,
+        const gchar *key);
+
+void
+tlm_config_cache_foreach (
+        TlmConfigCache *cache,
+        const gchar *group,
+        TlmConfigCacheFunc func,
+        gpointer user_data);
+
+gboolean
+tlm_config_cache_write (
+        const gchar *cache_path,
+        const gchar *source_path,
+        const struct stat *source_stat,
+        GHashTable *config_table,
+        GError **error);
+
+G_END_DECLS
+
+#endif /* __TLM_CONFIG_CACHE_H_ */
@@ -159,10 +159,117 @@
  * Timeout for session termination in seconds. Default value: 10
  *
  * Specifies timeout between sending different termination signals in case
- * the previous signal wasn't obeyed.
+ * the previous signal wasn't obeyed. Only used when
+ * TLM_CONFIG_GENERAL_TERMINATE_STEP is not set.
  */
 #define TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT "TERMINATE_TIMEOUT" 
 
+/**
+ * TLM_CONFIG_GENERAL_TERMINATE_STEP
+ *
+ * Time between termination signals in milliseconds. Default value: 200, or
+ * TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT in milliseconds when only that is set
+ *
+ * A session that ignores SIGHUP and SIGTERM is killed after two steps. The
+ * daemon kills tlm-sessiond itself only if it is still there after four
+ * steps. Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_TERMINATE_STEP   "TERMINATE_STEP"
+
+/**
+ * TLM_CONFIG_GENERAL_CGROUP_PATH
+ *
+ * Delegated cgroup v2 directory to place sessions in. Default value: none
+ *
+ * When set, every session gets its own cgroup under a per-seat cgroup, e.g.
+ * CGROUP_PATH/seat0/session-1234. The session is moved there before exec
+ * and on termination everything left in the cgroup is killed, including
+ * processes that left the session's process group. Can be overridden in
+ * the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_CGROUP_PATH      "CGROUP_PATH"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_NICE
+ *
+ * Nice level of the session, from -20 to 19. Default value: inherited
+ *
+ * Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_NICE     "SESSION_NICE"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_SCHED_POLICY
+ *
+ * Scheduling policy of the session: "other", "batch" or "idle".
+ * Default value: inherited
+ *
+ * Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_SCHED_POLICY "SESSION_SCHED_POLICY"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_CPU_AFFINITY
+ *
+ * CPUs the session may run on, as a list of CPU numbers and ranges like
+ * "0-3,6". Default value: inherited
+ *
+ * Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_CPU_AFFINITY "SESSION_CPU_AFFINITY"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_IO_PRIORITY
+ *
+ * I/O scheduling class and level of the session: "realtime:LEVEL",
+ * "best-effort:LEVEL" or "idle", with LEVEL from 0 (highest) to 7.
+ * Default value: inherited
+ *
+ * Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_IO_PRIORITY "SESSION_IO_PRIORITY"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_OOM_SCORE_ADJ
+ *
+ * oom_score_adj of the session, from -1000 to 1000. Default value: inherited
+ *
+ * Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_OOM_SCORE_ADJ "SESSION_OOM_SCORE_ADJ"
+
+/**
+ * TLM_CONFIG_GENERAL_CPU_WEIGHT
+ *
+ * cpu.weight of the seat cgroup, from 1 to 10000. Default value: none
+ *
+ * Only used with #TLM_CONFIG_GENERAL_CGROUP_PATH. The seats compete for CPU
+ * time in proportion to their weights. Can be overridden in the seat
+ * specific group.
+ */
+#define TLM_CONFIG_GENERAL_CPU_WEIGHT       "CPU_WEIGHT"
+
+/**
+ * TLM_CONFIG_GENERAL_MEMORY_MAX
+ *
+ * memory.max of the seat cgroup, in bytes with an optional K, M or G
+ * suffix, or "max". Default value: none
+ *
+ * Only used with #TLM_CONFIG_GENERAL_CGROUP_PATH. Can be overridden in the
+ * seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_MEMORY_MAX       "MEMORY_MAX"
+
+/**
+ * TLM_CONFIG_GENERAL_IO_WEIGHT
+ *
+ * io.weight of the seat cgroup, from 1 to 10000. Default value: none
+ *
+ * Only used with #TLM_CONFIG_GENERAL_CGROUP_PATH. Can be overridden in the
+ * seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_IO_WEIGHT        "IO_WEIGHT"
+
 /**
  * TLM_CONFIG_GENERAL_X11_SESSION
  *
@@ -189,4 +296,74 @@
  */
 #define TLM_CONFIG_GENERAL_SESSION_TYPE     "SESSION_TYPE"
 
+/**
+ * TLM_CONFIG_GENERAL_SESSIOND_POOL_SIZE
+ *
+ * Number of idle tlm-sessiond processes kept ready per seat. Default value: 0
+ *
+ * Pooled sessiond processes are spawned and connected in advance, so that
+ * creating a session does not have to wait for the spawn and the D-Bus
+ * handshake. Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_SESSIOND_POOL_SIZE "SESSIOND_POOL_SIZE"
+
+/**
+ * TLM_CONFIG_GENERAL_REQUEST_TIMEOUT
+ *
+ * Deadline for D-Bus login, logout and switch requests in seconds, 0 for
+ * none. Default value: 0
+ *
+ * A request not completed in time, including the time it waited in the
+ * queue, fails with a timeout error and a login in progress is aborted.
+ * Clients can override it per request with TLM_REQUEST_TIMEOUT in the
+ * environment. Can be overridden in the seat specific group.
+ */
+#define TLM_CONFIG_GENERAL_REQUEST_TIMEOUT  "REQUEST_TIMEOUT"
+
+/**
+ * TLM_CONFIG_GENERAL_USER_CACHE_TTL
+ *
+ * Number of seconds a resolved user database entry is cached by the daemon.
+ * Default value: 60
+ *
+ * Local changes to /etc/passwd and /etc/group invalidate the cache
+ * immediately; the timeout bounds staleness for other NSS sources.
+ * 0 disables the cache.
+ */
+#define TLM_CONFIG_GENERAL_USER_CACHE_TTL   "USER_CACHE_TTL"
+
+/**
+ * TLM_CONFIG_GENERAL_LOG_DEBUG
+ *
+ * Log debug messages, in builds with debug messages. Default value: TRUE
+ *
+ * tlm applies changes on SIGHUP, tlm-sessiond when it starts a session.
+ */
+#define TLM_CONFIG_GENERAL_LOG_DEBUG        "LOG_DEBUG"
+
+/**
+ * TLM_CONFIG_GENERAL_LOGIND_TIMEOUT
+ *
+ * Timeout in milliseconds for listing the seats from logind at startup.
+ * Default value: 2000
+ */
+#define TLM_CONFIG_GENERAL_LOGIND_TIMEOUT   "LOGIND_TIMEOUT"
+
+/**
+ * TLM_CONFIG_GENERAL_LOGIND_RETRIES
+ *
+ * Number of times listing the seats from logind is retried, with an
+ * increasing delay, when logind does not answer. Default value: 5
+ */
+#define TLM_CONFIG_GENERAL_LOGIND_RETRIES   "LOGIND_RETRIES"
+
+/**
+ * TLM_CONFIG_GENERAL_LOGIND_ADDRESS
+ *
+ * D-Bus address of the message bus on which tlm and tlm-sessiond talk to
+ * logind, for running against a mock logind on a private bus.
+ * Default value: the system bus
+ */
+#define TLM_CONFIG_GENERAL_LOGIND_ADDRESS   "LOGIND_ADDRESS"
+
 #endif /* __TLM_GENERAL_CONFIG_H_ */
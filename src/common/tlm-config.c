@@ -26,12 +26,16 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <glib/gstdio.h>
 
 #include "config.h"
 #include "tlm-config.h"
+#include "tlm-config-cache.h"
 #include "tlm-config-general.h"
+#include "tlm-config-seat.h"
 #include "tlm-log.h"
+#include "tlm-utils.h"
 
 /**
  * SECTION:tlm-config
@@ -70,6 +74,16 @@
  * Otherwise, the config file location is determined at compilation time as
  * $(sysconfdir) + "tlm.conf"
  *
+ * <refsect1><title>Configuration cache</title></refsect1>
+ *
+ * A parsed configuration file is compiled into a binary cache, by default
+ * $(localstatedir)/cache/tlm/tlm.conf.cache, or the file named by the
+ * TLM_CONF_CACHE environment variable (an empty value disables the cache).
+ * As long as the modification time and size of the configuration file
+ * match, later instances map the cache read-only and look values up in
+ * place instead of parsing the file again. Only instances created with
+ * tlm_config_new_writing_cache(), which the daemon uses, write the cache.
+ *
  * <refsect1><title>Example configuration file</title></refsect1>
  *
  * See example configuration file here:
@@ -91,17 +105,128 @@
  * Opaque structure for the class.
  */
 
+/**
+ * TlmSeatConfig:
+ * @active: whether the seat is used, see #TLM_CONFIG_SEAT_ACTIVE
+ * @vtnr: virtual terminal number, see #TLM_CONFIG_SEAT_VTNR
+ * @watch_items: NULL terminated list of seat-ready watch items
+ * @pam_service: PAM service for user logins
+ * @default_pam_service: PAM service for the default user
+ * @default_user: default user name template
+ * @auto_login: whether to log in the default user automatically
+ * @prepare_default: whether to prepare the default user account
+ * @setup_terminal: whether to set up the terminal for the session
+ * @setup_runtime_dir: whether to create XDG_RUNTIME_DIR
+ * @runtime_mode: access mode of XDG_RUNTIME_DIR
+ * @pause_session: whether to only open the PAM session
+ * @x11_session: whether the session is an X11 session
+ * @terminate_timeout: seconds to wait for a session to terminate
+ * @terminate_step: milliseconds between termination signals
+ * @cgroup_path: delegated cgroup v2 directory for sessions, or NULL
+ * @session_nice: nice level of the session, G_MAXINT if inherited
+ * @session_sched_policy: scheduling policy of the session, or NULL
+ * @session_cpu_affinity: CPU list of the session, or NULL
+ * @session_io_priority: I/O priority of the session, or NULL
+ * @session_oom_score_adj: oom_score_adj of the session, G_MAXINT if
+ * inherited
+ * @cpu_weight: cpu.weight of the seat cgroup, 0 if not set
+ * @memory_max: memory.max of the seat cgroup, or NULL
+ * @io_weight: io.weight of the seat cgroup, 0 if not set
+ * @sessiond_pool_size: number of idle tlm-sessiond processes to keep
+ * @request_timeout: seconds a D-Bus request may take, 0 for no deadline
+ * @session_argv: session command split into arguments, or NULL
+ * @session_path: PATH for the session
+ * @session_type: XDG_SESSION_TYPE, or NULL
+ * @xdg_data_dirs: XDG_DATA_DIRS for the session
+ * @set_xdg_seat: whether XDG_SEAT is set for the session
+ *
+ * Effective configuration of a seat. Every key is looked up in the seat
+ * group first, then in the General group, and then falls back to the
+ * built-in default.
+ */
+
 struct _TlmConfigPrivate
 {
     gchar *config_file_path;
+    TlmConfigCache *cache; /* read-only groups, unless in config_table */
     GHashTable *config_table;
+    GVariant *snapshot;
+    gboolean write_cache;
+    GHashTable *seat_configs; /* seat id -> TlmSeatConfig */
+};
+
+enum
+{
+    PROP_0,
+    PROP_SNAPSHOT,
+    PROP_WRITE_CACHE,
+    N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+enum
+{
+    SIG_CHANGED,
+    SIG_MAX
 };
 
+static guint signals[SIG_MAX];
+
 #define TLM_CONFIG_PRIV(obj) G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
         TLM_TYPE_CONFIG, TlmConfigPrivate)
 
 G_DEFINE_TYPE (TlmConfig, tlm_config, G_TYPE_OBJECT);
 
+static void
+_invalidate_seat_configs (TlmConfig *self)
+{
+    if (self->priv->seat_configs)
+        g_hash_table_remove_all (self->priv->seat_configs);
+}
+
+static const gchar *
+_get_cache_path ()
+{
+    const gchar *path = g_getenv ("TLM_CONF_CACHE");
+
+    if (!path)
+        return TLM_CONFIG_CACHE_FILE;
+    return path[0] ? path : NULL;
+}
+
+static void
+_copy_entry (
+        const gchar *key,
+        const gchar *value,
+        gpointer user_data)
+{
+    g_hash_table_insert ((GHashTable *) user_data, g_strdup (key),
+                         g_strdup (value));
+}
+
+/* copies a cached group to config_table, where it can be modified */
+static GHashTable *
+_materialize_group (
+        TlmConfig *self,
+        const gchar *group)
+{
+    GHashTable *group_table = g_hash_table_lookup (self->priv->config_table,
+                                                   group);
+
+    if (group_table || !self->priv->cache ||
+        !tlm_config_cache_has_group (self->priv->cache, group))
+        return group_table;
+
+    group_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         g_free);
+    tlm_config_cache_foreach (self->priv->cache, group, _copy_entry,
+                              group_table);
+    g_hash_table_insert (self->priv->config_table, g_strdup (group),
+                         group_table);
+    return group_table;
+}
+
 static gchar *
 _check_config_file (const gchar *path)
 {
@@ -124,6 +249,9 @@ _load_config (TlmConfig *self)
     GKeyFile *settings = g_key_file_new ();
 
     const gchar * const *sysconfdirs;
+    const gchar *cache_path = _get_cache_path ();
+    struct stat source_stat;
+    gboolean have_stat = FALSE;
 
     if (!priv->config_file_path) {
         const gchar *cfg_env = g_getenv ("TLM_CONF_FILE");
@@ -132,6 +260,15 @@ _load_config (TlmConfig *self)
                 priv->config_file_path = g_strdup (cfg_env);
         }
     }
+    if (!priv->config_file_path && cache_path) {
+        /* an up to date cache of the default file spares the lookup */
+        gchar *path = g_build_filename (TLM_SYSCONF_DIR, "tlm.conf", NULL);
+        priv->cache = tlm_config_cache_open (cache_path, path);
+        if (priv->cache)
+            priv->config_file_path = path;
+        else
+            g_free (path);
+    }
     if (!priv->config_file_path) {
         priv->config_file_path = _check_config_file (TLM_SYSCONF_DIR);
     }
@@ -147,8 +284,21 @@ _load_config (TlmConfig *self)
         }
     }
 
+    if (!priv->cache && priv->config_file_path && cache_path)
+        priv->cache = tlm_config_cache_open (cache_path,
+                                             priv->config_file_path);
+    if (priv->cache) {
+        DBG ("using TLM config cache %s for %s", cache_path,
+             priv->config_file_path);
+        g_key_file_free (settings);
+        return TRUE;
+    }
+
     if (priv->config_file_path) {
         DBG ("loading TLM config from %s", priv->config_file_path);
+        /* the cache records the file as it was before parsing, an edit
+         * during parsing then leaves it stale rather than wrong */
+        have_stat = g_stat (priv->config_file_path, &source_stat) == 0;
         if (!g_key_file_load_from_file (settings,
                                         priv->config_file_path,
                                         G_KEY_FILE_NONE, &err)) {
@@ -220,9 +370,40 @@ _load_config (TlmConfig *self)
 
     g_key_file_free (settings);
 
+    if (priv->write_cache && cache_path && have_stat &&
+        !tlm_config_cache_write (cache_path, priv->config_file_path,
+                                 &source_stat, priv->config_table, &err)) {
+        DBG ("cannot write config cache: %s", err->message);
+        g_error_free (err);
+    }
+
     return TRUE;
 }
 
+static void
+_load_snapshot (TlmConfig *self)
+{
+    GVariantIter group_iter;
+    GVariantIter *key_iter = NULL;
+    gchar *group = NULL;
+    gchar *key = NULL;
+    gchar *value = NULL;
+
+    DBG ("loading TLM config from snapshot");
+    g_variant_iter_init (&group_iter, self->priv->snapshot);
+    while (g_variant_iter_next (&group_iter, "{sa{ss}}", &group, &key_iter)) {
+        GHashTable *group_table = g_hash_table_new_full (g_str_hash,
+                                                         g_str_equal,
+                                                         g_free,
+                                                         g_free);
+        while (g_variant_iter_next (key_iter, "{ss}", &key, &value))
+            g_hash_table_insert (group_table, key, value);
+        g_variant_iter_free (key_iter);
+
+        g_hash_table_insert (self->priv->config_table, group, group_table);
+    }
+}
+
 #ifdef ENABLE_DEBUG
 static void
 _load_environment (
@@ -256,8 +437,7 @@ tlm_config_get_group (
     g_return_val_if_fail (self && TLM_IS_CONFIG(self), NULL);
     g_return_val_if_fail (group && group[0], NULL);
 
-    return (GHashTable *) g_hash_table_lookup (self->priv->config_table,
-                                                  group);
+    return _materialize_group (self, group);
 }
 
 /**
@@ -280,10 +460,15 @@ tlm_config_get_string (
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
     g_return_val_if_fail (key && key[0], NULL);
 
-    GHashTable *group_table = tlm_config_get_group (self, group);
-    if (!group_table) return NULL;
+    if (!group) group = TLM_CONFIG_GENERAL;
 
-    return (const gchar *) g_hash_table_lookup (group_table, key);
+    GHashTable *group_table = g_hash_table_lookup (self->priv->config_table,
+                                                   group);
+    if (group_table)
+        return (const gchar *) g_hash_table_lookup (group_table, key);
+    if (self->priv->cache)
+        return tlm_config_cache_lookup (self->priv->cache, group, key);
+    return NULL;
 }
 
 /**
@@ -309,10 +494,10 @@ tlm_config_get_string_default (
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
     g_return_val_if_fail (key && key[0], NULL);
 
-    GHashTable *group_table = tlm_config_get_group (self, group);
-    if (!group_table) return NULL;
+    if (!group) group = TLM_CONFIG_GENERAL;
+    if (!tlm_config_has_group (self, group)) return NULL;
 
-    res = g_hash_table_lookup (group_table, key);
+    res = tlm_config_get_string (self, group, key);
     if (!res)
         return value;
     return res;
@@ -339,7 +524,7 @@ tlm_config_set_string (
 
     if (!group) group = TLM_CONFIG_GENERAL;
 
-    GHashTable *group_table = tlm_config_get_group (self, group);
+    GHashTable *group_table = _materialize_group (self, group);
     if (!group_table) {
         group_table = g_hash_table_new_full (g_str_hash,
                                              g_str_equal,
@@ -354,6 +539,7 @@ tlm_config_set_string (
                          (gpointer) g_strdup (key),
                          (gpointer) g_strdup (value));
 
+    _invalidate_seat_configs (self);
 }
 /**
  * tlm_config_get_int:
@@ -457,6 +643,30 @@ tlm_config_set_uint (
     g_free (s_value);
 }
 
+static gboolean
+_parse_boolean (
+        const gchar *str_value,
+        gboolean retval)
+{
+    gint value = 0;
+
+    if (!str_value)
+        return retval;
+
+    if (g_ascii_strncasecmp (str_value, "false", 5) == 0 ||
+        g_ascii_strncasecmp (str_value, "no", 2) == 0)
+        return FALSE;
+
+    if (g_ascii_strncasecmp (str_value, "true", 4) == 0 ||
+        g_ascii_strncasecmp (str_value, "yes", 3) == 0)
+        return TRUE;
+
+    if (sscanf (str_value, "%d", &value) <= 0)
+        return retval;
+
+    return (gboolean) value;
+}
+
 /**
  * tlm_config_get_boolean:
  * @self: (transfer none): an instance of #TlmConfig
@@ -476,26 +686,9 @@ tlm_config_get_boolean (
         const gchar *key,
         gboolean retval)
 {
-    const gchar *str_value = NULL;
-    gint value = 0;
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), retval);
 
-    str_value = tlm_config_get_string (self, group, key);
-    if (!str_value)
-        return retval;
-
-    if (g_ascii_strncasecmp (str_value, "false", 5) == 0 ||
-        g_ascii_strncasecmp (str_value, "no", 2) == 0)
-        return FALSE;
-
-    if (g_ascii_strncasecmp (str_value, "true", 4) == 0 ||
-        g_ascii_strncasecmp (str_value, "yes", 3) == 0)
-        return TRUE;
-
-    if (sscanf (str_value, "%d", &value) <= 0)
-        return retval;
-
-    return (gboolean) value;
+    return _parse_boolean (tlm_config_get_string (self, group, key), retval);
 }
 
 /**
@@ -535,8 +728,11 @@ tlm_config_has_group (
     g_return_val_if_fail (self && TLM_IS_CONFIG (self), FALSE);
     g_return_val_if_fail (group, FALSE);
 
-    return g_hash_table_contains (self->priv->config_table,
-                                  (gconstpointer)group);
+    if (g_hash_table_contains (self->priv->config_table,
+                               (gconstpointer)group))
+        return TRUE;
+    return self->priv->cache &&
+           tlm_config_cache_has_group (self->priv->cache, group);
 }
 
 /**
@@ -562,15 +758,210 @@ tlm_config_has_key (
 
     if (!group) group = TLM_CONFIG_GENERAL;
 
-    group_table = tlm_config_get_group (self, group);
-    if (!group_table) return FALSE;
+    group_table = g_hash_table_lookup (self->priv->config_table, group);
+    if (group_table)
+        return g_hash_table_contains (group_table, (gconstpointer)key);
+    return self->priv->cache &&
+           tlm_config_cache_lookup (self->priv->cache, group, key) != NULL;
+}
+
+static void
+_seat_config_free (TlmSeatConfig *seat_config)
+{
+    g_strfreev (seat_config->watch_items);
+    g_strfreev (seat_config->session_argv);
+    g_slice_free (TlmSeatConfig, seat_config);
+}
+
+/* seat group first, then General */
+static const gchar *
+_lookup (
+        TlmConfig *self,
+        const gchar *seat_id,
+        const gchar *key)
+{
+    const gchar *value = NULL;
+
+    if (seat_id)
+        value = tlm_config_get_string (self, seat_id, key);
+    if (!value)
+        value = tlm_config_get_string (self, TLM_CONFIG_GENERAL, key);
+    return value;
+}
+
+static guint
+_lookup_uint (
+        TlmConfig *self,
+        const gchar *seat_id,
+        const gchar *key,
+        guint retval)
+{
+    guint value;
+    const gchar *str_value = _lookup (self, seat_id, key);
+    if (!str_value || sscanf (str_value, "%u", &value) <= 0) value = retval;
+
+    return value;
+}
+
+static gint
+_lookup_int (
+        TlmConfig *self,
+        const gchar *seat_id,
+        const gchar *key,
+        gint retval)
+{
+    gint value;
+    const gchar *str_value = _lookup (self, seat_id, key);
+    if (!str_value || sscanf (str_value, "%d", &value) <= 0) value = retval;
+
+    return value;
+}
+
+static TlmSeatConfig *
+_build_seat_config (
+        TlmConfig *self,
+        const gchar *seat_id)
+{
+    TlmSeatConfig *sc = g_slice_new0 (TlmSeatConfig);
+    const gchar *value;
+    guint nwatch, i;
+
+    /* seat only keys */
+    sc->active = seat_id ? tlm_config_get_boolean (self, seat_id,
+            TLM_CONFIG_SEAT_ACTIVE, TRUE) : TRUE;
+    sc->vtnr = seat_id ? tlm_config_get_uint (self, seat_id,
+            TLM_CONFIG_SEAT_VTNR, 0) : 0;
+    nwatch = seat_id ? tlm_config_get_uint (self, seat_id,
+            TLM_CONFIG_SEAT_NWATCH, 0) : 0;
+    sc->watch_items = g_new0 (gchar *, nwatch + 1);
+    for (i = 0; i < nwatch; i++) {
+        gchar *watchx = g_strdup_printf ("%s%u", TLM_CONFIG_SEAT_WATCHX, i);
+        sc->watch_items[i] = g_strdup (tlm_config_get_string (self, seat_id,
+                                                              watchx));
+        g_free (watchx);
+        if (!sc->watch_items[i])
+            break;
+    }
+
+    sc->pam_service = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_PAM_SERVICE);
+    if (!sc->pam_service)
+        sc->pam_service = "tlm-login";
+    sc->default_pam_service = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE);
+    if (!sc->default_pam_service)
+        sc->default_pam_service = "tlm-default-login";
+    sc->default_user = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_DEFAULT_USER);
+    if (!sc->default_user)
+        sc->default_user = "guest";
+
+    sc->auto_login = _parse_boolean (_lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_AUTO_LOGIN), TRUE);
+    sc->prepare_default = _parse_boolean (_lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_PREPARE_DEFAULT), FALSE);
+    sc->setup_terminal = _parse_boolean (_lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_SETUP_TERMINAL), FALSE);
+    sc->setup_runtime_dir = _parse_boolean (_lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR), FALSE);
+    sc->pause_session = _parse_boolean (_lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_PAUSE_SESSION), FALSE);
+    sc->x11_session = _parse_boolean (_lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_X11_SESSION), FALSE);
+
+    sc->runtime_mode = 0700;
+    value = _lookup (self, seat_id, TLM_CONFIG_GENERAL_RUNTIME_MODE);
+    if (value && sscanf (value, "%o", &sc->runtime_mode) <= 0)
+        sc->runtime_mode = 0700;
+    sc->terminate_timeout = _lookup_uint (self, seat_id,
+            TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3);
+    /* an explicit TERMINATE_TIMEOUT keeps its old whole second steps */
+    sc->terminate_step = _lookup_uint (self, seat_id,
+            TLM_CONFIG_GENERAL_TERMINATE_STEP,
+            _lookup (self, seat_id, TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT) ?
+            sc->terminate_timeout * 1000 : 200);
+    sc->cgroup_path = _lookup (self, seat_id, TLM_CONFIG_GENERAL_CGROUP_PATH);
+    if (sc->cgroup_path && !*sc->cgroup_path)
+        sc->cgroup_path = NULL;
+    sc->session_nice = _lookup_int (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSION_NICE, G_MAXINT);
+    sc->session_sched_policy = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSION_SCHED_POLICY);
+    sc->session_cpu_affinity = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSION_CPU_AFFINITY);
+    sc->session_io_priority = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSION_IO_PRIORITY);
+    sc->session_oom_score_adj = _lookup_int (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSION_OOM_SCORE_ADJ, G_MAXINT);
+    sc->cpu_weight = _lookup_uint (self, seat_id,
+            TLM_CONFIG_GENERAL_CPU_WEIGHT, 0);
+    sc->memory_max = _lookup (self, seat_id, TLM_CONFIG_GENERAL_MEMORY_MAX);
+    sc->io_weight = _lookup_uint (self, seat_id,
+            TLM_CONFIG_GENERAL_IO_WEIGHT, 0);
+    sc->sessiond_pool_size = _lookup_uint (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSIOND_POOL_SIZE, 0);
+    sc->request_timeout = _lookup_uint (self, seat_id,
+            TLM_CONFIG_GENERAL_REQUEST_TIMEOUT, 0);
+
+    value = _lookup (self, seat_id, TLM_CONFIG_GENERAL_SESSION_CMD);
+    if (value)
+        sc->session_argv = tlm_utils_split_command_line (value);
+    sc->session_path = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSION_PATH);
+    if (!sc->session_path)
+        sc->session_path = "/usr/local/bin:/usr/bin:/bin";
+    sc->session_type = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_SESSION_TYPE);
+    sc->xdg_data_dirs = _lookup (self, seat_id,
+            TLM_CONFIG_GENERAL_DATA_DIRS);
+    if (!sc->xdg_data_dirs)
+        sc->xdg_data_dirs = "/usr/share:/usr/local/share";
+    sc->set_xdg_seat = !tlm_config_has_key (self, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_NSEATS);
+
+    return sc;
+}
+
+/**
+ * tlm_config_get_seat_config:
+ * @self: (transfer none): an instance of #TlmConfig
+ * @seat_id: (allow-none): the seat id, NULL refers to General only
+ *
+ * Retrieves the effective configuration of a seat. It is computed once and
+ * then cached until the configuration is modified or reloaded.
+ *
+ * Returns: (transfer none): the #TlmSeatConfig of the seat, valid until the
+ * configuration changes.
+ */
+const TlmSeatConfig *
+tlm_config_get_seat_config (
+        TlmConfig *self,
+        const gchar *seat_id)
+{
+    TlmSeatConfig *seat_config;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
 
-    return g_hash_table_contains (group_table, (gconstpointer)key);
+    seat_config = g_hash_table_lookup (self->priv->seat_configs,
+                                       seat_id ? seat_id : "");
+    if (!seat_config) {
+        seat_config = _build_seat_config (self, seat_id);
+        g_hash_table_insert (self->priv->seat_configs,
+                             g_strdup (seat_id ? seat_id : ""), seat_config);
+    }
+    return seat_config;
 }
 
 static void
 _cleanup (TlmConfig *self)
 {
+    _invalidate_seat_configs (self);
+
+    if (self->priv->cache) {
+        tlm_config_cache_free (self->priv->cache);
+        self->priv->cache = NULL;
+    }
+
     if (self->priv->config_table) {
         g_hash_table_unref (self->priv->config_table);
         self->priv->config_table = NULL;
@@ -582,6 +973,48 @@ _cleanup (TlmConfig *self)
     }
 }
 
+static void
+tlm_config_set_property (
+        GObject *object,
+        guint property_id,
+        const GValue *value,
+        GParamSpec *pspec)
+{
+    TlmConfig *self = TLM_CONFIG (object);
+
+    switch (property_id) {
+        case PROP_SNAPSHOT:
+            self->priv->snapshot = g_value_dup_variant (value);
+            break;
+        case PROP_WRITE_CACHE:
+            self->priv->write_cache = g_value_get_boolean (value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+tlm_config_get_property (
+        GObject *object,
+        guint property_id,
+        GValue *value,
+        GParamSpec *pspec)
+{
+    TlmConfig *self = TLM_CONFIG (object);
+
+    switch (property_id) {
+        case PROP_SNAPSHOT:
+            g_value_set_variant (value, self->priv->snapshot);
+            break;
+        case PROP_WRITE_CACHE:
+            g_value_set_boolean (value, self->priv->write_cache);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
 static void
 tlm_config_dispose (
         GObject *object)
@@ -593,6 +1026,16 @@ tlm_config_dispose (
 
     _cleanup (self);
 
+    if (self->priv->snapshot) {
+        g_variant_unref (self->priv->snapshot);
+        self->priv->snapshot = NULL;
+    }
+
+    if (self->priv->seat_configs) {
+        g_hash_table_unref (self->priv->seat_configs);
+        self->priv->seat_configs = NULL;
+    }
+
     G_OBJECT_CLASS (tlm_config_parent_class)->dispose (object);
 }
 
@@ -605,6 +1048,10 @@ tlm_config_finalize (
     G_OBJECT_CLASS (tlm_config_parent_class)->finalize (object);
 }
 
+static void
+tlm_config_constructed (
+        GObject *object);
+
 static void
 tlm_config_class_init (
         TlmConfigClass *klass)
@@ -613,8 +1060,41 @@ tlm_config_class_init (
 
     g_type_class_add_private (object_class, sizeof (TlmConfigPrivate));
 
+    object_class->set_property = tlm_config_set_property;
+    object_class->get_property = tlm_config_get_property;
+    object_class->constructed = tlm_config_constructed;
     object_class->dispose = tlm_config_dispose;
     object_class->finalize = tlm_config_finalize;
+
+    properties[PROP_SNAPSHOT] = g_param_spec_variant ("snapshot",
+            "Snapshot",
+            "Configuration snapshot to use instead of the configuration file",
+            G_VARIANT_TYPE ("a{sa{ss}}"),
+            NULL /* default value */,
+            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+            G_PARAM_STATIC_STRINGS);
+
+    properties[PROP_WRITE_CACHE] = g_param_spec_boolean ("write-cache",
+            "Write cache",
+            "Compile the parsed configuration file into the cache",
+            FALSE,
+            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+            G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+
+    /**
+     * TlmConfig::changed:
+     * @config: the #TlmConfig that was reloaded
+     * @groups: NULL terminated list of groups that were added, removed or
+     * had any of their keys changed
+     *
+     * Emitted by tlm_config_reload() when the reloaded configuration differs
+     * from the previous one.
+     */
+    signals[SIG_CHANGED] = g_signal_new ("changed",
+            TLM_TYPE_CONFIG, G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+            G_TYPE_NONE, 1, G_TYPE_STRV);
 }
 
 static void
@@ -627,6 +1107,10 @@ _initialize (TlmConfig *self)
                                     g_free,
                                     (GDestroyNotify)g_hash_table_unref);
 
+    if (self->priv->snapshot) {
+        _load_snapshot (self);
+        return;
+    }
 
     if (!_load_config (self))
         WARN ("load configuration failed, using default settings");
@@ -636,30 +1120,164 @@ _initialize (TlmConfig *self)
 #endif
 }
 
+static void
+tlm_config_constructed (
+        GObject *object)
+{
+    _initialize (TLM_CONFIG (object));
+
+    G_OBJECT_CLASS (tlm_config_parent_class)->constructed (object);
+}
+
 static void
 tlm_config_init (
         TlmConfig *self)
 {
     self->priv = TLM_CONFIG_PRIV (self);
-    _initialize (self);
+    self->priv->config_file_path = NULL;
+    self->priv->config_table = NULL;
+    self->priv->cache = NULL;
+    self->priv->snapshot = NULL;
+    self->priv->write_cache = FALSE;
+    self->priv->seat_configs = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, (GDestroyNotify) _seat_config_free);
+}
+
+static gboolean
+_group_equal (
+        GHashTable *old_group,
+        GHashTable *new_group)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    if (!old_group || !new_group)
+        return old_group == new_group;
+    if (g_hash_table_size (old_group) != g_hash_table_size (new_group))
+        return FALSE;
+
+    g_hash_table_iter_init (&iter, old_group);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        if (g_strcmp0 (value, g_hash_table_lookup (new_group, key)) != 0)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* all groups, whether cached or in config_table */
+static GHashTable *
+_collect_groups (
+        TlmConfig *self)
+{
+    GHashTable *table = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, (GDestroyNotify) g_hash_table_unref);
+    GHashTableIter iter;
+    gpointer group, group_table;
+    guint i, n_groups;
+
+    g_hash_table_iter_init (&iter, self->priv->config_table);
+    while (g_hash_table_iter_next (&iter, &group, &group_table))
+        g_hash_table_insert (table, g_strdup (group),
+                             g_hash_table_ref (group_table));
+
+    n_groups = self->priv->cache ?
+        tlm_config_cache_get_n_groups (self->priv->cache) : 0;
+    for (i = 0; i < n_groups; i++) {
+        const gchar *name = tlm_config_cache_get_group_name (self->priv->cache,
+                                                             i);
+        if (g_hash_table_contains (table, name))
+            continue;
+        group_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             g_free);
+        tlm_config_cache_foreach (self->priv->cache, name, _copy_entry,
+                                  group_table);
+        g_hash_table_insert (table, g_strdup (name), group_table);
+    }
+
+    return table;
+}
+
+static gchar **
+_diff_groups (
+        GHashTable *old_table,
+        GHashTable *new_table)
+{
+    GPtrArray *changed = g_ptr_array_new ();
+    GHashTableIter iter;
+    gpointer group, group_table;
+
+    g_hash_table_iter_init (&iter, old_table);
+    while (g_hash_table_iter_next (&iter, &group, &group_table)) {
+        if (!_group_equal (group_table,
+                           g_hash_table_lookup (new_table, group)))
+            g_ptr_array_add (changed, g_strdup (group));
+    }
+    g_hash_table_iter_init (&iter, new_table);
+    while (g_hash_table_iter_next (&iter, &group, NULL)) {
+        if (!g_hash_table_contains (old_table, group))
+            g_ptr_array_add (changed, g_strdup (group));
+    }
+    g_ptr_array_add (changed, NULL);
+
+    return (gchar **) g_ptr_array_free (changed, FALSE);
 }
 
 /**
  * tlm_config_reload:
  * @self: (transfer none): an instance of #TlmConfig
  *
- * Reloads the configuration.
+ * Reloads the configuration. A configuration created from a snapshot is
+ * rebuilt from the same snapshot. #TlmConfig::changed is emitted with the
+ * groups that differ from the previous configuration, if any.
  *
  */
 void
 tlm_config_reload (
         TlmConfig *self)
 {
+    GHashTable *old_table = NULL;
+    GHashTable *new_table = NULL;
+    gchar **changed = NULL;
+
     g_return_if_fail (self && TLM_IS_CONFIG (self));
 
     DBG ("reload configuration");
+    old_table = _collect_groups (self);
     _cleanup (self);
     _initialize (self);
+
+    new_table = _collect_groups (self);
+    changed = _diff_groups (old_table, new_table);
+    g_hash_table_unref (old_table);
+    g_hash_table_unref (new_table);
+    if (changed[0]) {
+        DBG ("%u configuration group(s) changed", g_strv_length (changed));
+        g_signal_emit (self, signals[SIG_CHANGED], 0, changed);
+    }
+    g_strfreev (changed);
+}
+
+/**
+ * tlm_config_group_changed:
+ * @groups: the groups passed to a #TlmConfig::changed handler
+ * @group: the group name
+ *
+ * Checks whether @group is among the changed @groups.
+ *
+ * Returns: TRUE if @group changed, FALSE otherwise.
+ */
+gboolean
+tlm_config_group_changed (
+        gchar **groups,
+        const gchar *group)
+{
+    g_return_val_if_fail (groups, FALSE);
+
+    for (; *groups; groups++) {
+        if (g_strcmp0 (*groups, group) == 0)
+            return TRUE;
+    }
+    return FALSE;
 }
 
 /**
@@ -675,3 +1293,106 @@ tlm_config_new ()
     return TLM_CONFIG (g_object_new (TLM_TYPE_CONFIG, NULL));
 }
 
+/**
+ * tlm_config_new_writing_cache:
+ *
+ * Create a #TlmConfig object that compiles the configuration file into the
+ * cache whenever it has to parse it. Only the daemon does this, other
+ * processes only read the cache.
+ *
+ * Returns: an instance of #TlmConfig.
+ */
+TlmConfig *
+tlm_config_new_writing_cache ()
+{
+    return TLM_CONFIG (g_object_new (TLM_TYPE_CONFIG, "write-cache", TRUE,
+                                     NULL));
+}
+
+
+/**
+ * tlm_config_new_from_snapshot:
+ * @snapshot: (transfer none): a #GVariant of type a{sa{ss}} as returned by
+ * tlm_config_get_snapshot()
+ *
+ * Create a #TlmConfig object from a configuration snapshot. The configuration
+ * file is not looked up or parsed.
+ *
+ * Returns: an instance of #TlmConfig.
+ */
+TlmConfig *
+tlm_config_new_from_snapshot (
+        GVariant *snapshot)
+{
+    g_return_val_if_fail (snapshot, NULL);
+
+    return TLM_CONFIG (g_object_new (TLM_TYPE_CONFIG, "snapshot", snapshot,
+                                     NULL));
+}
+
+static void
+_add_snapshot_entry (
+        const gchar *key,
+        const gchar *value,
+        gpointer user_data)
+{
+    g_variant_builder_add ((GVariantBuilder *) user_data, "{ss}", key, value);
+}
+
+/**
+ * tlm_config_get_snapshot:
+ * @self: (transfer none): an instance of #TlmConfig
+ *
+ * Serializes the current configuration, so that it can be handed over to
+ * another process and loaded with tlm_config_new_from_snapshot().
+ *
+ * Returns: (transfer floating): the configuration as a #GVariant of type
+ * a{sa{ss}}.
+ */
+GVariant *
+tlm_config_get_snapshot (
+        TlmConfig *self)
+{
+    GVariantBuilder builder;
+    GHashTableIter group_iter;
+    GHashTableIter key_iter;
+    const gchar *group = NULL;
+    GHashTable *group_table = NULL;
+    const gchar *key = NULL;
+    const gchar *value = NULL;
+    guint i, n_groups;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{ss}}"));
+    g_hash_table_iter_init (&group_iter, self->priv->config_table);
+    while (g_hash_table_iter_next (&group_iter, (gpointer)&group,
+                                   (gpointer)&group_table)) {
+        g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sa{ss}}"));
+        g_variant_builder_add (&builder, "s", group);
+        g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{ss}"));
+        g_hash_table_iter_init (&key_iter, group_table);
+        while (g_hash_table_iter_next (&key_iter, (gpointer)&key,
+                                       (gpointer)&value))
+            g_variant_builder_add (&builder, "{ss}", key, value);
+        g_variant_builder_close (&builder);
+        g_variant_builder_close (&builder);
+    }
+
+    n_groups = self->priv->cache ?
+        tlm_config_cache_get_n_groups (self->priv->cache) : 0;
+    for (i = 0; i < n_groups; i++) {
+        group = tlm_config_cache_get_group_name (self->priv->cache, i);
+        if (g_hash_table_contains (self->priv->config_table, group))
+            continue;
+        g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sa{ss}}"));
+        g_variant_builder_add (&builder, "s", group);
+        g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{ss}"));
+        tlm_config_cache_foreach (self->priv->cache, group,
+                                  _add_snapshot_entry, &builder);
+        g_variant_builder_close (&builder);
+        g_variant_builder_close (&builder);
+    }
+
+    return g_variant_builder_end (&builder);
+}
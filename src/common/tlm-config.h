@@ -62,12 +62,58 @@ struct _TlmConfigClass
     GObjectClass parent_class;
 };
 
+typedef struct _TlmSeatConfig
+{
+    gboolean active;
+    guint vtnr;
+    gchar **watch_items;
+    const gchar *pam_service;
+    const gchar *default_pam_service;
+    const gchar *default_user;
+    gboolean auto_login;
+    gboolean prepare_default;
+    gboolean setup_terminal;
+    gboolean setup_runtime_dir;
+    guint runtime_mode;
+    gboolean pause_session;
+    gboolean x11_session;
+    guint terminate_timeout;
+    guint terminate_step;
+    const gchar *cgroup_path;
+    gint session_nice;
+    const gchar *session_sched_policy;
+    const gchar *session_cpu_affinity;
+    const gchar *session_io_priority;
+    gint session_oom_score_adj;
+    guint cpu_weight;
+    const gchar *memory_max;
+    guint io_weight;
+    guint sessiond_pool_size;
+    guint request_timeout;
+    gchar **session_argv;
+    const gchar *session_path;
+    const gchar *session_type;
+    const gchar *xdg_data_dirs;
+    gboolean set_xdg_seat;
+} TlmSeatConfig;
+
 GType
 tlm_config_get_type (void) G_GNUC_CONST;
 
 TlmConfig *
 tlm_config_new ();
 
+TlmConfig *
+tlm_config_new_writing_cache ();
+
+TlmConfig *
+tlm_config_new_from_snapshot (
+        GVariant *snapshot);
+
+GVariant *
+tlm_config_get_snapshot (
+        TlmConfig *self);
+
 gint
 tlm_config_get_int (
         TlmConfig *self,
@@ -146,10 +192,20 @@ tlm_config_get_group (
         TlmConfig *self,
         const gchar *group);
 
+const TlmSeatConfig *
+tlm_config_get_seat_config (
+        TlmConfig *self,
+        const gchar *seat_id);
+
 void
 tlm_config_reload (
         TlmConfig *self);
 
+gboolean
+tlm_config_group_changed (
+        gchar **groups,
+        const gchar *group);
+
 G_END_DECLS
 
 #endif /* __TLM_CONFIG_H_ */
@@ -65,9 +65,15 @@
  * @TLM_ERROR_SESSION_TERMINATION_FAILURE: Session termination failed
  * @TLM_ERROR_DBUS_SERVER_START_FAILURE: dbus-server startup failed
  * @TLM_ERROR_PAM_AUTH_FAILURE: PAM authentication failed
+ * @TLM_ERROR_SESSION_THROTTLED: Session refused, logins on the seat follow
+ * each other too fast
  * @TLM_ERROR_DBUS_REQ_ABORTED: Dbus request aborted
  * @TLM_ERROR_DBUS_REQ_NOT_SUPPORTED: Dbus request not supported
  * @TLM_ERROR_DBUS_REQ_UNKNOWN: Dbus request failed with unknown error
+ * @TLM_ERROR_DBUS_REQ_SUPERSEDED: Dbus request dropped in favour of a later
+ * request for the same seat
+ * @TLM_ERROR_DBUS_REQ_TIMEOUT: Dbus request not completed before its deadline
+ * @TLM_ERROR_DBUS_REQ_CANCELLED: Dbus request cancelled by the client
  * @TLM_ERROR_LAST_ERR: Placeholder to rearrange enumeration
  *
  * This enumeration provides a list of errors
@@ -109,9 +115,13 @@ GDBusErrorEntry _tlm_errors[] =
             _ERROR_PREFIX".DBusServerStartFailure"},
     {TLM_ERROR_PAM_AUTH_FAILURE,
             _ERROR_PREFIX".PamAuthFailure"},
+    {TLM_ERROR_SESSION_THROTTLED, _ERROR_PREFIX".SessionThrottled"},
     {TLM_ERROR_DBUS_REQ_ABORTED, _ERROR_PREFIX".DBusRequestAborted"},
     {TLM_ERROR_DBUS_REQ_NOT_SUPPORTED, _ERROR_PREFIX".DBusRequestNotSupported"},
     {TLM_ERROR_DBUS_REQ_UNKNOWN, _ERROR_PREFIX".DBusRequestUknown"},
+    {TLM_ERROR_DBUS_REQ_SUPERSEDED, _ERROR_PREFIX".DBusRequestSuperseded"},
+    {TLM_ERROR_DBUS_REQ_TIMEOUT, _ERROR_PREFIX".DBusRequestTimeout"},
+    {TLM_ERROR_DBUS_REQ_CANCELLED, _ERROR_PREFIX".DBusRequestCancelled"},
 } ;
 
  /**
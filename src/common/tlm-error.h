@@ -48,10 +48,14 @@ typedef enum {
     TLM_ERROR_SESSION_TERMINATION_FAILURE,
     TLM_ERROR_DBUS_SERVER_START_FAILURE,
     TLM_ERROR_PAM_AUTH_FAILURE,
+    TLM_ERROR_SESSION_THROTTLED,
 
     TLM_ERROR_DBUS_REQ_ABORTED = 50,
     TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
     TLM_ERROR_DBUS_REQ_UNKNOWN,
+    TLM_ERROR_DBUS_REQ_SUPERSEDED,
+    TLM_ERROR_DBUS_REQ_TIMEOUT,
+    TLM_ERROR_DBUS_REQ_CANCELLED,
 
     TLM_ERROR_LAST_ERR = 400
 
@@ -26,7 +26,13 @@
 
 #include "tlm-log.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 
 /**
@@ -87,12 +93,47 @@
  */
 
 
+#define TLM_LOG_RING_SIZE     256 /* power of two */
+#define TLM_LOG_DOMAIN_SIZE   32
+#define TLM_LOG_MESSAGE_SIZE  1024
+
+#define TLM_LOG_DEFAULT_LEVELS (G_LOG_LEVEL_ERROR | \
+                                G_LOG_LEVEL_CRITICAL | \
+                                G_LOG_LEVEL_WARNING | \
+                                G_LOG_LEVEL_DEBUG)
+
+/* A slot of the ring. Producers claim a position by moving _head and
+ * publish the slot by bumping its sequence; the single flusher consumes
+ * it and hands it back for the next round. */
+typedef struct {
+    volatile gint sequence;
+    gint priority;
+    gchar domain[TLM_LOG_DOMAIN_SIZE];
+    gchar message[TLM_LOG_MESSAGE_SIZE];
+} TlmLogSlot;
+
+typedef struct {
+    guint handler_id;
+    volatile gint levels;
+} TlmLogDomain;
+
+static TlmLogSlot *_ring = NULL;
+static volatile gint _head = 0;
+static guint _tail = 0; /* flusher only */
+static volatile gint _dropped = 0;
+static volatile gint _flusher_sleeping = 0;
+static volatile gint _flusher_running = 0;
+static GThread *_flusher = NULL;
+static pid_t _flusher_pid = 0;
+static int _wakeup_fd = -1;
+static FILE *_log_file = NULL;
+static int _log_fd = STDERR_FILENO; /* for forked children */
+static volatile gint _producers = 0;
+
 static gboolean _initialized = FALSE;
-static int _log_levels_enabled = (G_LOG_LEVEL_ERROR |
-                                 G_LOG_LEVEL_CRITICAL |
-                                 G_LOG_LEVEL_WARNING |
-                                 G_LOG_LEVEL_DEBUG);
-GHashTable *_log_handlers = NULL; /* log_domain:handler_id */
+static volatile gint _any_levels = TLM_LOG_DEFAULT_LEVELS;
+static GMutex _domains_lock;
+GHashTable *_log_handlers = NULL; /* log_domain:TlmLogDomain */
 
 static int
 _log_level_to_priority (GLogLevelFlags log_level)
@@ -108,30 +149,267 @@ _log_level_to_priority (GLogLevelFlags log_level)
     }
 }
 
+static void
+_log_write (int priority, const gchar *domain, const gchar *message)
+{
+    FILE *log_file = g_atomic_pointer_get (&_log_file);
+
+    if (log_file) {
+        fprintf (log_file, "%s[%d]: [%s] %s\n", g_get_prgname (),
+                 (int) getpid (), domain, message);
+    } else {
+        syslog (priority, "[%s] %s", domain, message);
+    }
+}
+
+/* A forked child may hold a copy of a syslog or stdio lock that another
+ * thread of the parent owned at fork time, so it only uses write(2) on a
+ * descriptor opened before the fork. */
+static void
+_log_write_raw (const gchar *domain, const gchar *message)
+{
+    gchar buffer[TLM_LOG_DOMAIN_SIZE + TLM_LOG_MESSAGE_SIZE + 8];
+    gsize len = 0, n;
+
+    buffer[len++] = '[';
+    if (domain) {
+        n = strnlen (domain, TLM_LOG_DOMAIN_SIZE);
+        memcpy (buffer + len, domain, n);
+        len += n;
+    }
+    buffer[len++] = ']';
+    buffer[len++] = ' ';
+    n = strnlen (message, TLM_LOG_MESSAGE_SIZE);
+    memcpy (buffer + len, message, n);
+    len += n;
+    buffer[len++] = '\n';
+
+    if (write (_log_fd, buffer, len) < 0)
+        return;
+}
+
+static gboolean
+_ring_push (int priority, const gchar *domain, const gchar *message)
+{
+    TlmLogSlot *slot;
+    guint pos = (guint) g_atomic_int_get (&_head);
+
+    for (;;) {
+        gint diff;
+
+        slot = &_ring[pos & (TLM_LOG_RING_SIZE - 1)];
+        diff = (gint) ((guint) g_atomic_int_get (&slot->sequence) - pos);
+        if (diff == 0) {
+            if (g_atomic_int_compare_and_exchange (&_head, (gint) pos,
+                                                   (gint) (pos + 1)))
+                break;
+            pos = (guint) g_atomic_int_get (&_head);
+        } else if (diff < 0) {
+            /* full, the flusher is behind */
+            g_atomic_int_inc (&_dropped);
+            return FALSE;
+        } else {
+            pos = (guint) g_atomic_int_get (&_head);
+        }
+    }
+
+    slot->priority = priority;
+    g_strlcpy (slot->domain, domain ? domain : "", sizeof (slot->domain));
+    g_strlcpy (slot->message, message, sizeof (slot->message));
+    g_atomic_int_set (&slot->sequence, (gint) (pos + 1));
+
+    if (g_atomic_int_get (&_flusher_sleeping)) {
+        guint64 one = 1;
+        if (write (_wakeup_fd, &one, sizeof (one)) < 0)
+            return TRUE; /* counter full, the flusher is awake anyway */
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_ring_flush (void)
+{
+    gboolean flushed = FALSE;
+    gint dropped;
+
+    for (;;) {
+        TlmLogSlot *slot = &_ring[_tail & (TLM_LOG_RING_SIZE - 1)];
+        guint seq = (guint) g_atomic_int_get (&slot->sequence);
+
+        if (seq != _tail + 1)
+            break;
+
+        _log_write (slot->priority, slot->domain, slot->message);
+        g_atomic_int_set (&slot->sequence, (gint) (_tail + TLM_LOG_RING_SIZE));
+        _tail++;
+        flushed = TRUE;
+    }
+
+    dropped = g_atomic_int_and ((volatile guint *) &_dropped, 0);
+    if (dropped) {
+        gchar *message = g_strdup_printf ("%d log messages dropped", dropped);
+        _log_write (LOG_WARNING, G_LOG_DOMAIN, message);
+        g_free (message);
+    }
+
+    if (flushed && _log_file)
+        fflush (_log_file);
+
+    return flushed;
+}
+
+static gpointer
+_flusher_thread (gpointer data)
+{
+    struct pollfd pfd = { _wakeup_fd, POLLIN, 0 };
+    guint64 count;
+
+    (void) data;
+
+    while (g_atomic_int_get (&_flusher_running)) {
+        if (_ring_flush ())
+            continue;
+
+        /* announce the sleep before the last look, see _ring_push */
+        g_atomic_int_set (&_flusher_sleeping, 1);
+        if (!_ring_flush ())
+            poll (&pfd, 1, 1000);
+        g_atomic_int_set (&_flusher_sleeping, 0);
+        if (read (_wakeup_fd, &count, sizeof (count)) < 0 &&
+            errno != EAGAIN && errno != EINTR)
+            break;
+    }
+    _ring_flush ();
+
+    return NULL;
+}
+
+static void
+_flusher_start (void)
+{
+    const gchar *log_file = g_getenv ("TLM_LOG_FILE");
+    guint i;
+
+    if (log_file && *log_file) {
+        _log_file = fopen (log_file, "ae");
+        if (!_log_file)
+            syslog (LOG_WARNING, "failed to open '%s': %s", log_file,
+                    strerror (errno));
+    }
+
+    _log_fd = _log_file ? fileno (_log_file) : STDERR_FILENO;
+
+    _wakeup_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_wakeup_fd < 0)
+        return;
+
+    _ring = g_new0 (TlmLogSlot, TLM_LOG_RING_SIZE);
+    for (i = 0; i < TLM_LOG_RING_SIZE; i++)
+        _ring[i].sequence = (gint) i;
+    _head = 0;
+    _tail = 0;
+
+    _flusher_pid = getpid ();
+    g_atomic_int_set (&_flusher_running, 1);
+    _flusher = g_thread_new ("tlm-log", _flusher_thread, NULL);
+}
+
+static void
+_wait_producers (void)
+{
+    while (g_atomic_int_get (&_producers) > 0)
+        g_thread_yield ();
+}
+
+static void
+_flusher_stop (void)
+{
+    FILE *log_file;
+
+    /* turn new producers away from the ring and wait for the ones already
+     * past the check, so that the last flush catches up with all of them
+     * and nobody touches the ring once it is freed */
+    g_atomic_int_set (&_flusher_running, 0);
+    _wait_producers ();
+
+    if (_flusher) {
+        guint64 one = 1;
+
+        if (write (_wakeup_fd, &one, sizeof (one)) < 0)
+            syslog (LOG_WARNING, "failed to wake log flusher");
+        g_thread_join (_flusher);
+        _flusher = NULL;
+    }
+    g_clear_pointer (&_ring, g_free);
+    if (_wakeup_fd >= 0) {
+        close (_wakeup_fd);
+        _wakeup_fd = -1;
+    }
+
+    log_file = g_atomic_pointer_get (&_log_file);
+    if (log_file) {
+        g_atomic_pointer_set (&_log_file, NULL);
+        _wait_producers ();
+        fclose (log_file);
+    }
+    _log_fd = STDERR_FILENO;
+    _flusher_pid = 0;
+}
+
 static void
 _log_handler (const gchar *log_domain,
               GLogLevelFlags log_level,
               const gchar *message,
               gpointer userdata)
 {
-    int priority ;
-    gboolean unint = FALSE;
+    TlmLogDomain *domain = userdata;
+    int priority;
 
-    if (! (log_level & _log_levels_enabled))
-        return; 
+    if (!(log_level & g_atomic_int_get (&domain->levels)))
+        return;
 
-    if (!_initialized) {
-        tlm_log_init (log_domain);
-        unint = TRUE;
+    if (_flusher_pid && getpid () != _flusher_pid) {
+        _log_write_raw (log_domain, message);
+        return;
     }
 
     priority = _log_level_to_priority (log_level);
 
-    syslog (priority, "[%s] %s", log_domain, message);
+    g_atomic_int_inc (&_producers);
+    /* fatal messages are not left behind in the ring */
+    if (g_atomic_int_get (&_flusher_running) &&
+        !(log_level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR)))
+        _ring_push (priority, log_domain, message);
+    else
+        _log_write (priority, log_domain, message);
+    g_atomic_int_dec_and_test (&_producers);
+}
+
+/* the handler gets every level and drops the disabled ones itself */
+static void
+_set_domain_levels (const gchar *domain,
+                    TlmLogDomain *log_domain,
+                    gint levels)
+{
+    g_atomic_int_set (&log_domain->levels, levels);
+}
+
+static void
+_update_any_levels (void)
+{
+    GHashTableIter iter;
+    gpointer value;
+    gint levels = 0;
 
-    if (unint) {
-        tlm_log_close (log_domain);
+    if (!_log_handlers) {
+        g_atomic_int_set (&_any_levels, TLM_LOG_DEFAULT_LEVELS);
+        return;
     }
+    g_hash_table_iter_init (&iter, _log_handlers);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        levels |= g_atomic_int_get (&((TlmLogDomain *) value)->levels);
+    g_atomic_int_set (&_any_levels, levels);
 }
 
 /**
@@ -139,37 +417,55 @@ _log_handler (const gchar *log_domain,
  * @domain: log message domain
  *
  * Call this function before logging any messages to initialize the logging system.
+ * Messages are queued to an in-memory ring and written to syslog, or to the
+ * file named by the TLM_LOG_FILE environment variable, by a background thread.
  */
 void tlm_log_init (const gchar *domain)
 {
+    TlmLogDomain *log_domain;
 
+    g_mutex_lock (&_domains_lock);
     if (!_log_handlers) {
          _log_handlers = g_hash_table_new_full (
-                    g_str_hash, g_str_equal, g_free, NULL);
+                    g_str_hash, g_str_equal, g_free, g_free);
     }
 
     if (!domain)
         domain = G_LOG_DOMAIN;
 
-    if (g_hash_table_contains (_log_handlers, domain))
+    if (g_hash_table_contains (_log_handlers, domain)) {
+        g_mutex_unlock (&_domains_lock);
         return;
+    }
 
-    guint id = g_log_set_handler (
-            domain, _log_levels_enabled, _log_handler, NULL);
-
-    g_hash_table_insert (_log_handlers, g_strdup(domain), GUINT_TO_POINTER(id));
-
-    if (_initialized) return ;
+    log_domain = g_new0 (TlmLogDomain, 1);
+    _set_domain_levels (domain, log_domain, TLM_LOG_DEFAULT_LEVELS);
+    log_domain->handler_id = g_log_set_handler (domain,
+            G_LOG_LEVEL_MASK | G_LOG_FLAG_FATAL | G_LOG_FLAG_RECURSION,
+            _log_handler, log_domain);
 
-    openlog (g_get_prgname(), LOG_PID | LOG_PERROR, LOG_DAEMON);
+    g_hash_table_insert (_log_handlers, g_strdup(domain), log_domain);
+    _update_any_levels ();
 
-    _initialized = TRUE;
+    if (!_initialized) {
+        openlog (g_get_prgname(), LOG_PID | LOG_PERROR, LOG_DAEMON);
+        _flusher_start ();
+        _initialized = TRUE;
+    }
+    g_mutex_unlock (&_domains_lock);
 }
 
-static void _remove_log_handler (gpointer key, gpointer value, gpointer udata)
+static gboolean _remove_log_handler (gpointer key, gpointer value, gpointer udata)
 {
-    if (!udata || g_strcmp0(udata, key) == 0) 
-        g_log_remove_handler ((const gchar *)key, GPOINTER_TO_UINT(value));
+    TlmLogDomain *log_domain = value;
+
+    if (!udata || g_strcmp0(udata, key) == 0) {
+        _set_domain_levels ((const gchar *)key, log_domain, 0);
+        g_log_remove_handler ((const gchar *)key, log_domain->handler_id);
+        log_domain->handler_id = 0;
+        return TRUE;
+    }
+    return FALSE;
 }
 
 /**
@@ -177,23 +473,125 @@ static void _remove_log_handler (gpointer key, gpointer value, gpointer udata)
  * @domain: log message domain
  *
  * Call this function to clean up the logging system (e.g. in an object destructor).
+ * Closing all the domains (@domain %NULL) writes out the queued messages.
  */
 void tlm_log_close (const gchar *domain)
 {
+    g_mutex_lock (&_domains_lock);
     if (_log_handlers) {
-        g_hash_table_foreach (_log_handlers, _remove_log_handler, (gpointer)domain);
+        g_hash_table_foreach_remove (_log_handlers, _remove_log_handler,
+                                     (gpointer)domain);
         if (!domain) {
             g_hash_table_unref (_log_handlers);
             _log_handlers = NULL;
         }
-        else {
-            g_hash_table_remove (_log_handlers, domain);
-        }
+        _update_any_levels ();
     }
 
-    if (_initialized) {
+    if (_initialized && !domain) {
+        _flusher_stop ();
         closelog();
         _initialized = FALSE;
     }
+    g_mutex_unlock (&_domains_lock);
+}
+
+/**
+ * tlm_log_set_levels:
+ * @domain: (allow-none): log message domain, %NULL for all domains
+ * @levels: the #GLogLevelFlags to log
+ *
+ * Changes at runtime which messages of an initialized domain get logged.
+ */
+void tlm_log_set_levels (const gchar *domain, GLogLevelFlags levels)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_mutex_lock (&_domains_lock);
+    if (_log_handlers) {
+        g_hash_table_iter_init (&iter, _log_handlers);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            if (!domain || g_strcmp0 (domain, key) == 0)
+                _set_domain_levels (key, value,
+                                    (gint) (levels & G_LOG_LEVEL_MASK));
+        }
+        _update_any_levels ();
+    }
+    g_mutex_unlock (&_domains_lock);
 }
 
+/**
+ * tlm_log_get_levels:
+ * @domain: (allow-none): log message domain, %NULL for all domains
+ *
+ * Returns: the levels logged for @domain, or for any domain if %NULL
+ */
+GLogLevelFlags tlm_log_get_levels (const gchar *domain)
+{
+    TlmLogDomain *log_domain = NULL;
+    GLogLevelFlags levels;
+
+    if (!domain)
+        return (GLogLevelFlags) g_atomic_int_get (&_any_levels);
+
+    g_mutex_lock (&_domains_lock);
+    if (_log_handlers)
+        log_domain = g_hash_table_lookup (_log_handlers, domain);
+    levels = log_domain ? (GLogLevelFlags) log_domain->levels : 0;
+    g_mutex_unlock (&_domains_lock);
+
+    return levels;
+}
+
+/**
+ * tlm_log_set_debug:
+ * @enable: whether to log debug messages
+ *
+ * Switches debug messages on or off for all the domains.
+ */
+void tlm_log_set_debug (gboolean enable)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_mutex_lock (&_domains_lock);
+    if (_log_handlers) {
+        g_hash_table_iter_init (&iter, _log_handlers);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            TlmLogDomain *log_domain = value;
+            if (enable)
+                _set_domain_levels (key, log_domain,
+                                    log_domain->levels | G_LOG_LEVEL_DEBUG);
+            else
+                _set_domain_levels (key, log_domain,
+                                    log_domain->levels & ~G_LOG_LEVEL_DEBUG);
+        }
+        _update_any_levels ();
+    }
+    g_mutex_unlock (&_domains_lock);
+}
+
+/**
+ * tlm_log_toggle_debug:
+ *
+ * Switches debug messages on or off for all the domains, e.g. on a signal.
+ */
+void tlm_log_toggle_debug (void)
+{
+    tlm_log_set_debug (!tlm_log_level_enabled (G_LOG_LEVEL_DEBUG));
+}
+
+/**
+ * tlm_log_level_enabled:
+ * @level: a #GLogLevelFlags
+ *
+ * Used by the logging macros to skip formatting messages that no domain
+ * would log.
+ *
+ * Returns: whether @level is logged by at least one domain
+ */
+gboolean tlm_log_level_enabled (GLogLevelFlags level)
+{
+    return (g_atomic_int_get (&_any_levels) & level) != 0;
+}
@@ -35,6 +35,11 @@ G_BEGIN_DECLS
 
 void tlm_log_init (const gchar *domain);
 void tlm_log_close (const gchar *domain);
+void tlm_log_set_levels (const gchar *domain, GLogLevelFlags levels);
+GLogLevelFlags tlm_log_get_levels (const gchar *domain);
+void tlm_log_set_debug (gboolean enable);
+void tlm_log_toggle_debug (void);
+gboolean tlm_log_level_enabled (GLogLevelFlags level);
 
 #define EXPAND_LOG_MSG(frmt, args...) "%f %s +%d %s :" frmt, \
     g_get_monotonic_time()*1.0e-6, __FILE__, __LINE__, __PRETTY_FUNCTION__, \
@@ -42,7 +47,10 @@ void tlm_log_close (const gchar *domain);
 
 #ifdef ENABLE_DEBUG
 # define INFO(frmt, args...)     g_print(EXPAND_LOG_MSG(frmt, ##args))
-# define DBG(frmt, args...)      g_debug("debug:"EXPAND_LOG_MSG(frmt, ##args))
+# define DBG(frmt, args...) do { \
+    if (tlm_log_level_enabled (G_LOG_LEVEL_DEBUG)) \
+        g_debug("debug:"EXPAND_LOG_MSG(frmt, ##args)); \
+} while (0)
 #else
 # define INFO(frmt, args...)
 # define DBG(frmt, args...)
@@ -0,0 +1,349 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <glib-unix.h>
+
+#include "tlm-log.h"
+#include "tlm-cgroup.h"
+#include "tlm-proc-watch.h"
+
+/* Termination goes SIGHUP, SIGTERM and SIGKILL. SIGTERM follows SIGHUP after
+ * the grace period, every later step takes one step period. */
+
+/* ms to wait for a killed cgroup to empty when no step is set */
+#define TLM_PROC_WATCH_CGROUP_TIMEOUT 1000
+
+struct _TlmProcWatch
+{
+    pid_t pid;
+    pid_t pgid; /* non-zero if the whole process group is signalled */
+    gint pidfd; /* -1 if pidfds are not supported */
+    guint watch_id;
+    guint timer_id;
+    gboolean terminating; /* from the first SIGHUP until the exit report */
+    gint last_sig;
+    guint step; /* ms */
+    gchar *cgroup; /* emptied before the exit is reported, or NULL */
+    gint events_fd;
+    guint events_id;
+    gint status;
+    TlmProcWatchExitedFunc exited;
+    TlmProcWatchStuckFunc stuck;
+    gpointer user_data;
+};
+
+static gint
+_pidfd_open (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (gint) syscall (SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static gint
+_pidfd_send_signal (gint pidfd, gint sig)
+{
+#ifdef SYS_pidfd_send_signal
+    return (gint) syscall (SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static void
+_send_signal (TlmProcWatch *watch, gint sig)
+{
+    gint ret;
+
+    if (sig == SIGKILL && watch->cgroup && tlm_cgroup_kill (watch->cgroup))
+        ret = 0;
+    else if (watch->pgid)
+        ret = killpg (watch->pgid, sig);
+    else if (watch->pidfd >= 0)
+        ret = _pidfd_send_signal (watch->pidfd, sig);
+    else
+        ret = kill (watch->pid, sig);
+
+    if (ret < 0)
+        WARN ("failed to send signal %d to %s %u: %s", sig,
+              watch->pgid ? "process group" : "process",
+              watch->pgid ? watch->pgid : watch->pid, strerror (errno));
+    watch->last_sig = sig;
+}
+
+static void
+_finish (TlmProcWatch *watch)
+{
+    if (watch->timer_id) {
+        g_source_remove (watch->timer_id);
+        watch->timer_id = 0;
+    }
+    if (watch->events_id) {
+        g_source_remove (watch->events_id);
+        watch->events_id = 0;
+    }
+    watch->terminating = FALSE;
+
+    watch->exited (watch->pid, watch->status, watch->user_data);
+}
+
+static gboolean
+_on_cgroup_event (gint fd, GIOCondition condition, gpointer user_data)
+{
+    TlmProcWatch *watch = (TlmProcWatch *) user_data;
+
+    if (tlm_cgroup_read_populated (fd))
+        return G_SOURCE_CONTINUE;
+
+    DBG ("cgroup %s is empty", watch->cgroup);
+    watch->events_id = 0;
+    _finish (watch);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_on_cgroup_timeout (gpointer user_data)
+{
+    TlmProcWatch *watch = (TlmProcWatch *) user_data;
+
+    WARN ("cgroup %s didn't empty, processes are stuck in kernel",
+          watch->cgroup);
+    watch->timer_id = 0;
+    _finish (watch);
+    return G_SOURCE_REMOVE;
+}
+
+/* Kills whatever outlived the leader in the cgroup, returns FALSE if there
+ * is nothing to wait for */
+static gboolean
+_empty_cgroup (TlmProcWatch *watch)
+{
+    if (watch->events_fd < 0)
+        watch->events_fd = tlm_cgroup_open_events (watch->cgroup);
+    if (watch->events_fd < 0 || !tlm_cgroup_read_populated (watch->events_fd))
+        return FALSE;
+
+    DBG ("cgroup %s still populated, killing it", watch->cgroup);
+    if (!tlm_cgroup_kill (watch->cgroup))
+        return FALSE;
+
+    /* a change after the read above is still pending on the descriptor */
+    watch->events_id = g_unix_fd_add (watch->events_fd, G_IO_PRI | G_IO_ERR,
+                                      _on_cgroup_event, watch);
+    watch->timer_id = g_timeout_add (
+            watch->step ? watch->step : TLM_PROC_WATCH_CGROUP_TIMEOUT,
+            _on_cgroup_timeout, watch);
+    return TRUE;
+}
+
+static void
+_on_exited (TlmProcWatch *watch, gint status)
+{
+    DBG ("process %u exited with status %d", watch->pid, status);
+
+    watch->status = status;
+    if (watch->timer_id) {
+        g_source_remove (watch->timer_id);
+        watch->timer_id = 0;
+    }
+
+    if (watch->cgroup) {
+        /* the session ends with its leader, descendants that left the
+         * process group included */
+        if (_empty_cgroup (watch))
+            return;
+    } else if (watch->pgid && watch->last_sig &&
+               killpg (watch->pgid, 0) == 0) {
+        /* the leader is gone, what is left of a group being terminated is
+         * not waited for */
+        DBG ("process group %u not empty, killing it", watch->pgid);
+        killpg (watch->pgid, SIGKILL);
+    }
+
+    _finish (watch);
+}
+
+static gboolean
+_on_pidfd_readable (gint fd, GIOCondition condition, gpointer user_data)
+{
+    TlmProcWatch *watch = (TlmProcWatch *) user_data;
+    gint status = 0;
+    pid_t ret;
+
+    do {
+        ret = waitpid (watch->pid, &status, WNOHANG);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret == 0)
+        return G_SOURCE_CONTINUE;
+    if (ret < 0)
+        WARN ("waitpid(%u): %s", watch->pid, strerror (errno));
+
+    watch->watch_id = 0;
+    _on_exited (watch, status);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_on_child_down (GPid pid, gint status, gpointer user_data)
+{
+    TlmProcWatch *watch = (TlmProcWatch *) user_data;
+
+    g_spawn_close_pid (pid);
+    watch->watch_id = 0;
+    _on_exited (watch, status);
+}
+
+static gboolean
+_on_step_timeout (gpointer user_data)
+{
+    TlmProcWatch *watch = (TlmProcWatch *) user_data;
+    gint next_sig = 0;
+
+    watch->timer_id = 0;
+    if (watch->last_sig == SIGHUP)
+        next_sig = SIGTERM;
+    else if (watch->last_sig == SIGTERM)
+        next_sig = SIGKILL;
+
+    if (!next_sig) {
+        DBG ("process %u didn't respond to SIGKILL, it is stuck in kernel",
+             watch->pid);
+        if (watch->stuck)
+            watch->stuck (watch->pid, watch->user_data);
+        return G_SOURCE_REMOVE;
+    }
+
+    DBG ("process %u didn't respond to signal %d, sending %d", watch->pid,
+         watch->last_sig, next_sig);
+    _send_signal (watch, next_sig);
+    watch->timer_id = g_timeout_add (watch->step, _on_step_timeout, watch);
+    return G_SOURCE_REMOVE;
+}
+
+TlmProcWatch *
+tlm_proc_watch_new (pid_t pid, gboolean group,
+                    TlmProcWatchExitedFunc exited, gpointer user_data)
+{
+    TlmProcWatch *watch = NULL;
+
+    g_return_val_if_fail (pid > 0 && exited, NULL);
+
+    watch = g_slice_new0 (TlmProcWatch);
+    watch->pid = pid;
+    watch->exited = exited;
+    watch->user_data = user_data;
+    watch->events_fd = -1;
+    if (group && (watch->pgid = getpgid (pid)) < 0) {
+        WARN ("getpgid(%u): %s", pid, strerror (errno));
+        watch->pgid = 0;
+    }
+
+    watch->pidfd = _pidfd_open (pid);
+    if (watch->pidfd >= 0) {
+        watch->watch_id = g_unix_fd_add (watch->pidfd, G_IO_IN,
+                                         _on_pidfd_readable, watch);
+    } else {
+        DBG ("pidfd_open(%u): %s, falling back to SIGCHLD", pid,
+             strerror (errno));
+        watch->watch_id = g_child_watch_add (pid, _on_child_down, watch);
+    }
+
+    return watch;
+}
+
+void
+tlm_proc_watch_free (TlmProcWatch *watch)
+{
+    if (!watch)
+        return;
+
+    if (watch->timer_id)
+        g_source_remove (watch->timer_id);
+    if (watch->watch_id)
+        g_source_remove (watch->watch_id);
+    if (watch->events_id)
+        g_source_remove (watch->events_id);
+    if (watch->pidfd >= 0)
+        close (watch->pidfd);
+    if (watch->events_fd >= 0)
+        close (watch->events_fd);
+    g_free (watch->cgroup);
+    g_slice_free (TlmProcWatch, watch);
+}
+
+void
+tlm_proc_watch_set_cgroup (TlmProcWatch *watch, const gchar *cgroup)
+{
+    g_return_if_fail (watch);
+
+    g_free (watch->cgroup);
+    watch->cgroup = g_strdup (cgroup);
+}
+
+gboolean
+tlm_proc_watch_is_running (const TlmProcWatch *watch)
+{
+    return watch && (watch->watch_id != 0 || watch->events_id != 0);
+}
+
+gboolean
+tlm_proc_watch_is_terminating (const TlmProcWatch *watch)
+{
+    return watch && watch->terminating;
+}
+
+gboolean
+tlm_proc_watch_terminate (TlmProcWatch *watch, guint grace, guint step,
+                          TlmProcWatchStuckFunc stuck)
+{
+    g_return_val_if_fail (watch, FALSE);
+
+    /* also once the ladder has run out and the process is reported
+     * stuck, starting over would only signal it again */
+    if (watch->terminating) {
+        DBG ("termination of %u already in progress", watch->pid);
+        return TRUE;
+    }
+    if (!watch->watch_id)
+        return FALSE;
+
+    watch->terminating = TRUE;
+    watch->step = step;
+    watch->stuck = stuck;
+    _send_signal (watch, SIGHUP);
+    watch->timer_id = g_timeout_add (grace, _on_step_timeout, watch);
+    return TRUE;
+}
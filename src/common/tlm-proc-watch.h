@@ -0,0 +1,75 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_PROC_WATCH_H
+#define _TLM_PROC_WATCH_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+/* Watches a child process and terminates it on request. The process is
+ * followed through a pidfd where the kernel supports it, so its exit is seen
+ * as soon as it happens and signals can not reach a recycled pid. */
+
+typedef struct _TlmProcWatch TlmProcWatch;
+
+/* called once the process is reaped, the watch may be freed from it */
+typedef void (*TlmProcWatchExitedFunc) (pid_t pid, gint status,
+                                        gpointer user_data);
+
+/* called when the process outlived SIGKILL, the watch may be freed from it */
+typedef void (*TlmProcWatchStuckFunc) (pid_t pid, gpointer user_data);
+
+TlmProcWatch *
+tlm_proc_watch_new (pid_t pid, gboolean group,
+                    TlmProcWatchExitedFunc exited, gpointer user_data);
+
+void
+tlm_proc_watch_free (TlmProcWatch *watch);
+
+/* the exit is reported once the cgroup is empty, SIGKILL goes to all of it */
+void
+tlm_proc_watch_set_cgroup (TlmProcWatch *watch, const gchar *cgroup);
+
+gboolean
+tlm_proc_watch_is_running (const TlmProcWatch *watch);
+
+gboolean
+tlm_proc_watch_is_terminating (const TlmProcWatch *watch);
+
+/* SIGHUP at once, SIGTERM after @grace, SIGKILL and the stuck report one
+ * @step apart each. With a grace of one step, the ladder takes
+ * TLM_PROC_WATCH_LADDER_STEPS steps. */
+#define TLM_PROC_WATCH_LADDER_STEPS 3
+
+gboolean
+tlm_proc_watch_terminate (TlmProcWatch *watch, guint grace, guint step,
+                          TlmProcWatchStuckFunc stuck);
+
+G_END_DECLS
+
+#endif /* _TLM_PROC_WATCH_H */
@@ -0,0 +1,353 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "tlm-spawn.h"
+#include "tlm-log.h"
+#include "tlm-error.h"
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+extern char **environ;
+
+/* record written by the child to the error pipe */
+typedef struct _TlmSpawnReport
+{
+    gint err;
+    gboolean fatal;
+    gchar what[56];
+} TlmSpawnReport;
+
+/* the layout getdents64() fills in, glibc does not export it */
+typedef struct _TlmDirent64
+{
+    guint64 d_ino;
+    gint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    gchar d_name[];
+} TlmDirent64;
+
+/* only ever set in a forked child, see tlm_spawn() */
+static gint _report_fd = -1;
+static gboolean _reported_fatal = FALSE;
+
+static int
+_close_range_cloexec (gint lowfd)
+{
+#ifdef __NR_close_range
+    return syscall (__NR_close_range, (unsigned int) lowfd, ~0U,
+                    CLOSE_RANGE_CLOEXEC);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static gboolean
+_has_close_range (void)
+{
+    static gint supported = -1;
+
+    /* empty range, only tells whether the kernel knows the call */
+    if (supported < 0)
+        supported = (_close_range_cloexec (G_MAXINT) == 0) ? 1 : 0;
+    return supported == 1;
+}
+
+static gint
+_parse_fd (const gchar *name)
+{
+    gint fd = 0;
+
+    if (!*name)
+        return -1;
+    for (; *name; name++) {
+        if (*name < '0' || *name > '9' || fd > (G_MAXINT - 9) / 10)
+            return -1;
+        fd = fd * 10 + (*name - '0');
+    }
+    return fd;
+}
+
+/*
+ * Marks every descriptor from @lowfd upwards close-on-exec. Uses a single
+ * close_range() call where available, otherwise walks /proc/self/fd with
+ * raw getdents64() so that only actually open descriptors are touched.
+ * Async-signal-safe, called between fork and exec.
+ */
+void
+tlm_spawn_set_cloexec_from (gint lowfd)
+{
+    guint64 buf[512];
+    TlmDirent64 *entry;
+    struct rlimit limit;
+    gint dir_fd, fd;
+    long len = -1, pos;
+
+    if (_close_range_cloexec (lowfd) == 0)
+        return;
+
+    dir_fd = open ("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        while ((len = syscall (SYS_getdents64, dir_fd, buf,
+                               sizeof (buf))) > 0) {
+            for (pos = 0; pos < len; pos += entry->d_reclen) {
+                entry = (TlmDirent64 *) ((gchar *) buf + pos);
+                fd = _parse_fd (entry->d_name);
+                if (fd >= lowfd && fd != dir_fd)
+                    fcntl (fd, F_SETFD, FD_CLOEXEC);
+            }
+        }
+        close (dir_fd);
+        if (len == 0)
+            return;
+    }
+
+    if (getrlimit (RLIMIT_NOFILE, &limit) < 0 ||
+        limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > G_MAXINT)
+        limit.rlim_cur = 4096;
+    for (fd = lowfd; fd < (gint) limit.rlim_cur; fd++)
+        fcntl (fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void
+_write_report (gint fd, const gchar *what, gint err, gboolean fatal)
+{
+    TlmSpawnReport report;
+    gsize i;
+
+    memset (&report, 0, sizeof (report));
+    report.err = err;
+    report.fatal = fatal;
+    for (i = 0; what && what[i] && i < sizeof (report.what) - 1; i++)
+        report.what[i] = what[i];
+    /* a single write below PIPE_BUF is atomic */
+    if (write (fd, &report, sizeof (report)) < 0) {
+        /* nothing left to report to */
+    }
+}
+
+/*
+ * Passes a failure in the child setup to the parent, which logs it. Only
+ * valid within a TlmSpawnChildSetupFunc.
+ */
+void
+tlm_spawn_child_report (const gchar *what, gint err, gboolean fatal)
+{
+    if (_report_fd < 0)
+        return;
+    _write_report (_report_fd, what, err, fatal);
+    if (fatal)
+        _reported_fatal = TRUE;
+}
+
+/* looks @name up in the PATH of @envp, like execvpe() would in the child */
+static gchar *
+_find_program (const gchar *name, const gchar * const *envp)
+{
+    const gchar *path;
+    gchar **dirs, **dir;
+    gchar *found = NULL;
+
+    if (strchr (name, '/'))
+        return g_strdup (name);
+
+    path = g_environ_getenv ((gchar **) envp, "PATH");
+    if (!path)
+        path = "/bin:/usr/bin";
+
+    dirs = g_strsplit (path, ":", -1);
+    for (dir = dirs; *dir && !found; dir++) {
+        gchar *file = g_build_filename (**dir ? *dir : ".", name, NULL);
+        if (g_file_test (file, G_FILE_TEST_IS_REGULAR) &&
+            access (file, X_OK) == 0)
+            found = file;
+        else
+            g_free (file);
+    }
+    g_strfreev (dirs);
+
+    return found;
+}
+
+static void
+_close_pipe (gint fds[2])
+{
+    if (fds[0] >= 0) close (fds[0]);
+    if (fds[1] >= 0) close (fds[1]);
+    fds[0] = fds[1] = -1;
+}
+
+/*
+ * Spawns @argv with @envp, or the current environment if NULL. A bare
+ * program name is searched in the PATH of @envp before forking.
+ * @stdin_fd/@stdout_fd, if given, receive the parent ends of pipes
+ * connected to the child's stdin/stdout. The child is not reaped.
+ *
+ * Without @child_setup the child is created with vfork() semantics; the
+ * parent is blocked only until the exec. Exec failures and whatever
+ * @child_setup reports are passed back through a close-on-exec pipe.
+ */
+gboolean
+tlm_spawn (const gchar * const *argv,
+           const gchar * const *envp,
+           TlmSpawnChildSetupFunc child_setup,
+           gpointer user_data,
+           gint *stdin_fd,
+           gint *stdout_fd,
+           GPid *child_pid,
+           GError **error)
+{
+    gint in_pipe[2] = { -1, -1 };
+    gint out_pipe[2] = { -1, -1 };
+    gint err_pipe[2] = { -1, -1 };
+    TlmSpawnReport report;
+    gboolean use_vfork;
+    gboolean failed = FALSE;
+    gchar *program;
+    ssize_t len;
+    pid_t pid;
+
+    g_return_val_if_fail (argv && argv[0], FALSE);
+
+    if (!envp)
+        envp = (const gchar * const *) environ;
+
+    program = _find_program (argv[0], envp);
+    if (!program) {
+        if (error)
+            *error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INTERNAL_SERVER,
+                    "Failed to execute '%s': %s", argv[0], strerror (ENOENT));
+        return FALSE;
+    }
+
+    if ((stdin_fd && pipe2 (in_pipe, O_CLOEXEC) < 0) ||
+        (stdout_fd && pipe2 (out_pipe, O_CLOEXEC) < 0) ||
+        pipe2 (err_pipe, O_CLOEXEC) < 0) {
+        if (error)
+            *error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INTERNAL_SERVER,
+                    "pipe() failed: %s", strerror (errno));
+        _close_pipe (in_pipe);
+        _close_pipe (out_pipe);
+        _close_pipe (err_pipe);
+        g_free (program);
+        return FALSE;
+    }
+
+    /* vfork is only safe if the child does nothing but async-signal-safe
+     * system calls before exec and does not touch the parent's memory,
+     * which rules out a child setup and the /proc/self/fd walk */
+    use_vfork = !child_setup && _has_close_range ();
+    pid = use_vfork ? vfork () : fork ();
+    if (pid == 0) {
+        if (in_pipe[0] >= 0 && dup2 (in_pipe[0], 0) < 0)
+            goto child_error;
+        if (out_pipe[1] >= 0 && dup2 (out_pipe[1], 1) < 0)
+            goto child_error;
+
+        if (use_vfork)
+            _close_range_cloexec (3);
+        else
+            tlm_spawn_set_cloexec_from (3);
+
+        if (child_setup) {
+            _report_fd = err_pipe[1];
+            if (!child_setup (user_data)) {
+                if (!_reported_fatal)
+                    _write_report (err_pipe[1], "child setup", errno, TRUE);
+                _exit (127);
+            }
+        }
+
+        execve (program, (char * const *) argv, (char * const *) envp);
+
+child_error:
+        _write_report (err_pipe[1], "exec", errno, TRUE);
+        _exit (127);
+    }
+
+    close (err_pipe[1]);
+    if (in_pipe[0] >= 0) close (in_pipe[0]);
+    if (out_pipe[1] >= 0) close (out_pipe[1]);
+
+    if (pid < 0) {
+        if (error)
+            *error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INTERNAL_SERVER,
+                    "fork() failed: %s", strerror (errno));
+        close (err_pipe[0]);
+        if (in_pipe[1] >= 0) close (in_pipe[1]);
+        if (out_pipe[0] >= 0) close (out_pipe[0]);
+        g_free (program);
+        return FALSE;
+    }
+
+    /* EOF once the child has exec'd or exited */
+    for (;;) {
+        len = read (err_pipe[0], &report, sizeof (report));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len != sizeof (report))
+            break;
+        report.what[sizeof (report.what) - 1] = '\0';
+        if (!report.fatal) {
+            WARN ("%s: %s failed: %s", argv[0], report.what,
+                  strerror (report.err));
+            continue;
+        }
+        DBG ("%s of '%s' failed: %s", report.what, program,
+             strerror (report.err));
+        if (error && !failed)
+            *error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INTERNAL_SERVER,
+                    "Failed to execute '%s': %s failed: %s", argv[0],
+                    report.what, strerror (report.err));
+        failed = TRUE;
+    }
+    close (err_pipe[0]);
+    g_free (program);
+
+    if (failed) {
+        waitpid (pid, NULL, 0);
+        if (in_pipe[1] >= 0) close (in_pipe[1]);
+        if (out_pipe[0] >= 0) close (out_pipe[0]);
+        return FALSE;
+    }
+
+    if (stdin_fd) *stdin_fd = in_pipe[1];
+    if (stdout_fd) *stdout_fd = out_pipe[0];
+    if (child_pid) *child_pid = pid;
+    return TRUE;
+}
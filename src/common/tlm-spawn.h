@@ -0,0 +1,57 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_SPAWN_H
+#define _TLM_SPAWN_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Runs in the child between fork and exec, so only async-signal-safe
+ * calls are allowed: no logging, no allocation, no NSS lookups. Failures
+ * are passed to the parent with tlm_spawn_child_report(); returning FALSE
+ * aborts the spawn. */
+typedef gboolean (*TlmSpawnChildSetupFunc) (gpointer user_data);
+
+void
+tlm_spawn_child_report (const gchar *what, gint err, gboolean fatal);
+
+void
+tlm_spawn_set_cloexec_from (gint lowfd);
+
+gboolean
+tlm_spawn (const gchar * const *argv,
+           const gchar * const *envp,
+           TlmSpawnChildSetupFunc child_setup,
+           gpointer user_data,
+           gint *stdin_fd,
+           gint *stdout_fd,
+           GPid *child_pid,
+           GError **error);
+
+G_END_DECLS
+
+#endif /* _TLM_SPAWN_H */
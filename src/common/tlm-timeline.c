@@ -0,0 +1,213 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <string.h>
+
+#include "tlm-timeline.h"
+
+/* Timestamps come from g_get_monotonic_time(), CLOCK_MONOTONIC, so marks
+ * taken by tlm and by tlm-sessiond can be put on one timeline. */
+
+typedef struct {
+    const gchar *phase; /* interned */
+    gint64 time;
+} TlmTimelineMark;
+
+struct _TlmTimeline
+{
+    gchar *seat_id;
+    gchar *username;
+    GArray *marks; /* sorted by time */
+};
+
+TlmTimeline *
+tlm_timeline_new (const gchar *seat_id, const gchar *username)
+{
+    TlmTimeline *timeline = g_slice_new0 (TlmTimeline);
+
+    timeline->seat_id = g_strdup (seat_id);
+    timeline->username = g_strdup (username);
+    timeline->marks = g_array_new (FALSE, FALSE, sizeof (TlmTimelineMark));
+
+    return timeline;
+}
+
+void
+tlm_timeline_free (TlmTimeline *timeline)
+{
+    if (!timeline)
+        return;
+
+    g_free (timeline->seat_id);
+    g_free (timeline->username);
+    g_array_unref (timeline->marks);
+    g_slice_free (TlmTimeline, timeline);
+}
+
+void
+tlm_timeline_mark_at (TlmTimeline *timeline, const gchar *phase, gint64 time)
+{
+    TlmTimelineMark mark;
+    guint i;
+
+    g_return_if_fail (timeline && phase);
+
+    mark.phase = g_intern_string (phase);
+    mark.time = time;
+
+    /* marks mostly arrive in order, look for the place from the end */
+    for (i = timeline->marks->len; i > 0; i--) {
+        if (g_array_index (timeline->marks, TlmTimelineMark, i - 1).time <=
+            time)
+            break;
+    }
+    g_array_insert_val (timeline->marks, i, mark);
+}
+
+void
+tlm_timeline_mark (TlmTimeline *timeline, const gchar *phase)
+{
+    tlm_timeline_mark_at (timeline, phase, g_get_monotonic_time ());
+}
+
+/* Adds the a(sx) @phases, as reported by another process */
+void
+tlm_timeline_merge (TlmTimeline *timeline, GVariant *phases)
+{
+    GVariantIter iter;
+    const gchar *phase;
+    gint64 time;
+
+    g_return_if_fail (timeline);
+
+    if (!phases || !g_variant_is_of_type (phases, G_VARIANT_TYPE ("a(sx)")))
+        return;
+
+    g_variant_iter_init (&iter, phases);
+    while (g_variant_iter_next (&iter, "(&sx)", &phase, &time))
+        tlm_timeline_mark_at (timeline, phase, time);
+}
+
+GVariant *
+tlm_timeline_get_phases (const TlmTimeline *timeline)
+{
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sx)"));
+    for (i = 0; timeline && i < timeline->marks->len; i++) {
+        TlmTimelineMark *mark = &g_array_index (timeline->marks,
+                                                TlmTimelineMark, i);
+        g_variant_builder_add (&builder, "(sx)", mark->phase, mark->time);
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+GVariant *
+tlm_timeline_to_variant (const TlmTimeline *timeline)
+{
+    g_return_val_if_fail (timeline, NULL);
+
+    return g_variant_new ("(ss@a(sx))",
+                          timeline->seat_id ? timeline->seat_id : "",
+                          timeline->username ? timeline->username : "",
+                          tlm_timeline_get_phases (timeline));
+}
+
+static void
+_append_json_string (GString *str, const gchar *value)
+{
+    const gchar *c;
+
+    g_string_append_c (str, '"');
+    for (c = value; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            g_string_append_printf (str, "\\%c", *c);
+        else if ((guchar) *c < 0x20)
+            g_string_append_printf (str, "\\u%04x", (guchar) *c);
+        else
+            g_string_append_c (str, *c);
+    }
+    g_string_append_c (str, '"');
+}
+
+/* Renders the a(ssa(sx)) @timelines in the Chrome trace event format, one
+ * row per login and one span per phase, ending at the phase's mark. */
+gchar *
+tlm_timeline_to_trace (GVariant *timelines)
+{
+    GString *str;
+    GVariantIter iter;
+    const gchar *seat_id, *username;
+    GVariant *phases;
+    gboolean first = TRUE;
+    guint tid = 0;
+
+    g_return_val_if_fail (timelines && g_variant_is_of_type (timelines,
+            G_VARIANT_TYPE ("a(ssa(sx))")), NULL);
+
+    str = g_string_new ("{\"traceEvents\":[");
+    g_variant_iter_init (&iter, timelines);
+    while (g_variant_iter_next (&iter, "(&s&s@a(sx))", &seat_id, &username,
+                                &phases)) {
+        GVariantIter phase_iter;
+        const gchar *phase;
+        gint64 time, prev_time = -1;
+
+        tid++;
+        g_variant_iter_init (&phase_iter, phases);
+        while (g_variant_iter_next (&phase_iter, "(&sx)", &phase, &time)) {
+            if (!first)
+                g_string_append_c (str, ',');
+            first = FALSE;
+
+            g_string_append (str, "{\"name\":");
+            _append_json_string (str, phase);
+            g_string_append (str, ",\"cat\":\"login\"");
+            if (prev_time < 0)
+                g_string_append_printf (str,
+                        ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%" G_GINT64_FORMAT,
+                        time);
+            else
+                g_string_append_printf (str,
+                        ",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT
+                        ",\"dur\":%" G_GINT64_FORMAT, prev_time,
+                        time - prev_time);
+            g_string_append_printf (str, ",\"pid\":1,\"tid\":%u,\"args\":{"
+                                    "\"seat\":", tid);
+            _append_json_string (str, seat_id);
+            g_string_append (str, ",\"user\":");
+            _append_json_string (str, username);
+            g_string_append (str, "}}");
+            prev_time = time;
+        }
+        g_variant_unref (phases);
+    }
+    g_string_append (str, "]}");
+
+    return g_string_free (str, FALSE);
+}
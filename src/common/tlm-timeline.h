@@ -0,0 +1,77 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef _TLM_TIMELINE_H
+#define _TLM_TIMELINE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* login phases, each mark is taken when the phase is done */
+#define TLM_PHASE_REQUEST_RECEIVED  "request-received"
+#define TLM_PHASE_LOGIN_STARTED     "login-started"
+#define TLM_PHASE_SESSIOND_SPAWNED  "sessiond-spawned"
+#define TLM_PHASE_HANDSHAKE_DONE    "handshake-done"
+#define TLM_PHASE_PAM_START         "pam-start"
+#define TLM_PHASE_PAM_AUTHENTICATE  "pam-authenticate"
+#define TLM_PHASE_PAM_OPEN_SESSION  "pam-open-session"
+#define TLM_PHASE_FORK              "fork"
+#define TLM_PHASE_EXEC              "exec"
+#define TLM_PHASE_SESSION_CREATED   "session-created"
+#define TLM_PHASE_LOGIN_DONE        "login-done"
+#define TLM_PHASE_LOGIN_FAILED      "login-failed"
+
+typedef struct _TlmTimeline TlmTimeline;
+
+TlmTimeline *
+tlm_timeline_new (const gchar *seat_id, const gchar *username);
+
+void
+tlm_timeline_free (TlmTimeline *timeline);
+
+void
+tlm_timeline_mark (TlmTimeline *timeline, const gchar *phase);
+
+void
+tlm_timeline_mark_at (TlmTimeline *timeline, const gchar *phase,
+                      gint64 time);
+
+void
+tlm_timeline_merge (TlmTimeline *timeline, GVariant *phases);
+
+GVariant *
+tlm_timeline_get_phases (const TlmTimeline *timeline);
+
+GVariant *
+tlm_timeline_to_variant (const TlmTimeline *timeline);
+
+gchar *
+tlm_timeline_to_trace (GVariant *timelines);
+
+G_END_DECLS
+
+#endif /* _TLM_TIMELINE_H */
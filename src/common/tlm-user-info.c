@@ -0,0 +1,311 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <string.h>
+#include <gio/gio.h>
+
+#include "tlm-user-info.h"
+#include "tlm-log.h"
+
+#define TLM_USER_INFO_DEFAULT_TTL 60 /* seconds */
+
+typedef struct _UserInfoCache
+{
+    GHashTable *by_name; /* name -> TlmUserInfo */
+    GHashTable *by_uid;  /* uid -> TlmUserInfo */
+    GFileMonitor *passwd_monitor;
+    GFileMonitor *group_monitor;
+    guint ttl;
+} UserInfoCache;
+
+static UserInfoCache *_cache = NULL;
+
+G_DEFINE_BOXED_TYPE (TlmUserInfo, tlm_user_info, tlm_user_info_ref,
+                     tlm_user_info_unref);
+
+static TlmUserInfo *
+_user_info_new_from_passwd (struct passwd *pwent)
+{
+    TlmUserInfo *info = g_slice_new0 (TlmUserInfo);
+
+    info->ref_count = 1;
+    info->name = g_strdup (pwent->pw_name);
+    info->uid = pwent->pw_uid;
+    info->gid = pwent->pw_gid;
+    info->home_dir = g_strdup (pwent->pw_dir ? pwent->pw_dir : "");
+    info->shell = g_strdup (pwent->pw_shell ? pwent->pw_shell : "");
+    info->resolved_at = g_get_monotonic_time ();
+
+    return info;
+}
+
+static gchar *
+_alloc_pw_buffer (gsize *size)
+{
+    long len = sysconf (_SC_GETPW_R_SIZE_MAX);
+
+    *size = len > 0 ? (gsize) len : 1024;
+    return g_malloc (*size);
+}
+
+TlmUserInfo *
+tlm_user_info_new_from_name (const gchar *username)
+{
+    struct passwd pwent, *result = NULL;
+    TlmUserInfo *info = NULL;
+    gsize size;
+    gchar *buf;
+    int res;
+
+    g_return_val_if_fail (username, NULL);
+
+    buf = _alloc_pw_buffer (&size);
+    while ((res = getpwnam_r (username, &pwent, buf, size, &result)) == ERANGE) {
+        size *= 2;
+        buf = g_realloc (buf, size);
+    }
+    if (res == 0 && result)
+        info = _user_info_new_from_passwd (result);
+    else
+        DBG ("no passwd entry for '%s': %s", username,
+             res ? strerror (res) : "not found");
+    g_free (buf);
+
+    return info;
+}
+
+TlmUserInfo *
+tlm_user_info_new_from_uid (uid_t uid)
+{
+    struct passwd pwent, *result = NULL;
+    TlmUserInfo *info = NULL;
+    gsize size;
+    gchar *buf;
+    int res;
+
+    buf = _alloc_pw_buffer (&size);
+    while ((res = getpwuid_r (uid, &pwent, buf, size, &result)) == ERANGE) {
+        size *= 2;
+        buf = g_realloc (buf, size);
+    }
+    if (res == 0 && result)
+        info = _user_info_new_from_passwd (result);
+    else
+        DBG ("no passwd entry for uid %u: %s", uid,
+             res ? strerror (res) : "not found");
+    g_free (buf);
+
+    return info;
+}
+
+/* (suuss): name, uid, gid, home directory, shell */
+TlmUserInfo *
+tlm_user_info_new_from_variant (GVariant *variant)
+{
+    TlmUserInfo *info = NULL;
+    guint32 uid, gid;
+
+    g_return_val_if_fail (variant, NULL);
+
+    info = g_slice_new0 (TlmUserInfo);
+    info->ref_count = 1;
+    g_variant_get (variant, "(suuss)", &info->name, &uid, &gid,
+                   &info->home_dir, &info->shell);
+    info->uid = uid;
+    info->gid = gid;
+    info->resolved_at = g_get_monotonic_time ();
+
+    if (!info->name[0]) {
+        tlm_user_info_unref (info);
+        return NULL;
+    }
+    return info;
+}
+
+GVariant *
+tlm_user_info_to_variant (TlmUserInfo *info)
+{
+    if (!info)
+        return g_variant_new ("(suuss)", "", (guint32) -1, (guint32) -1,
+                              "", "");
+
+    return g_variant_new ("(suuss)", info->name, (guint32) info->uid,
+                          (guint32) info->gid,
+                          info->home_dir, info->shell);
+}
+
+TlmUserInfo *
+tlm_user_info_ref (TlmUserInfo *info)
+{
+    g_return_val_if_fail (info, NULL);
+
+    g_atomic_int_inc (&info->ref_count);
+    return info;
+}
+
+void
+tlm_user_info_unref (TlmUserInfo *info)
+{
+    if (!info || !g_atomic_int_dec_and_test (&info->ref_count))
+        return;
+
+    g_free (info->name);
+    g_free (info->home_dir);
+    g_free (info->shell);
+    g_slice_free (TlmUserInfo, info);
+}
+
+static void
+_on_user_db_changed (
+        GFileMonitor *monitor,
+        GFile *file,
+        GFile *other_file,
+        GFileMonitorEvent event,
+        gpointer user_data)
+{
+    if (event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+        event == G_FILE_MONITOR_EVENT_CREATED ||
+        event == G_FILE_MONITOR_EVENT_DELETED) {
+        DBG ("user database changed");
+        tlm_user_info_cache_invalidate ();
+    }
+}
+
+static GFileMonitor *
+_monitor_file (const gchar *path)
+{
+    GFile *file = g_file_new_for_path (path);
+    GFileMonitor *monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE,
+                                                 NULL, NULL);
+    g_object_unref (file);
+    if (!monitor) {
+        WARN ("failed to monitor '%s'", path);
+        return NULL;
+    }
+    g_signal_connect (monitor, "changed", G_CALLBACK (_on_user_db_changed),
+                      NULL);
+    return monitor;
+}
+
+static UserInfoCache *
+_get_cache (void)
+{
+    if (_cache)
+        return _cache;
+
+    _cache = g_slice_new0 (UserInfoCache);
+    _cache->by_name = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+            (GDestroyNotify) tlm_user_info_unref);
+    _cache->by_uid = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+            NULL, (GDestroyNotify) tlm_user_info_unref);
+    _cache->ttl = TLM_USER_INFO_DEFAULT_TTL;
+    /* local changes are noticed right away, the TTL covers remote NSS */
+    _cache->passwd_monitor = _monitor_file ("/etc/passwd");
+    _cache->group_monitor = _monitor_file ("/etc/group");
+
+    return _cache;
+}
+
+static void
+_cache_insert (UserInfoCache *cache, TlmUserInfo *info)
+{
+    g_hash_table_replace (cache->by_name, info->name,
+                          tlm_user_info_ref (info));
+    g_hash_table_replace (cache->by_uid, GUINT_TO_POINTER (info->uid),
+                          tlm_user_info_ref (info));
+}
+
+static TlmUserInfo *
+_cache_get_valid (UserInfoCache *cache, TlmUserInfo *info)
+{
+    if (!info)
+        return NULL;
+    if (g_get_monotonic_time () - info->resolved_at >
+        (gint64) cache->ttl * G_USEC_PER_SEC)
+        return NULL;
+    return tlm_user_info_ref (info);
+}
+
+/*
+ * Looks up @username through the daemon-side cache, resolving it on a miss
+ * or when the entry is older than the cache TTL. A TTL of 0 disables
+ * caching.
+ */
+TlmUserInfo *
+tlm_user_info_lookup (const gchar *username)
+{
+    UserInfoCache *cache = _get_cache ();
+    TlmUserInfo *info;
+
+    g_return_val_if_fail (username, NULL);
+
+    info = _cache_get_valid (cache,
+                             g_hash_table_lookup (cache->by_name, username));
+    if (info)
+        return info;
+
+    info = tlm_user_info_new_from_name (username);
+    if (info && cache->ttl)
+        _cache_insert (cache, info);
+    return info;
+}
+
+TlmUserInfo *
+tlm_user_info_lookup_uid (uid_t uid)
+{
+    UserInfoCache *cache = _get_cache ();
+    TlmUserInfo *info;
+
+    info = _cache_get_valid (cache, g_hash_table_lookup (cache->by_uid,
+                                                        GUINT_TO_POINTER (uid)));
+    if (info)
+        return info;
+
+    info = tlm_user_info_new_from_uid (uid);
+    if (info && cache->ttl)
+        _cache_insert (cache, info);
+    return info;
+}
+
+void
+tlm_user_info_cache_set_ttl (guint ttl)
+{
+    _get_cache ()->ttl = ttl;
+    if (!ttl)
+        tlm_user_info_cache_invalidate ();
+}
+
+void
+tlm_user_info_cache_invalidate (void)
+{
+    if (!_cache)
+        return;
+
+    g_hash_table_remove_all (_cache->by_name);
+    g_hash_table_remove_all (_cache->by_uid);
+}
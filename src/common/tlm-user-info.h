@@ -0,0 +1,82 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_USER_INFO_H
+#define _TLM_USER_INFO_H
+
+#include <sys/types.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TLM_TYPE_USER_INFO (tlm_user_info_get_type ())
+
+typedef struct _TlmUserInfo
+{
+    gint ref_count;
+    gchar *name;
+    uid_t uid;
+    gid_t gid;
+    gchar *home_dir;
+    gchar *shell;
+    gint64 resolved_at; /* monotonic time of the lookup */
+} TlmUserInfo;
+
+GType
+tlm_user_info_get_type (void) G_GNUC_CONST;
+
+TlmUserInfo *
+tlm_user_info_new_from_name (const gchar *username);
+
+TlmUserInfo *
+tlm_user_info_new_from_uid (uid_t uid);
+
+TlmUserInfo *
+tlm_user_info_new_from_variant (GVariant *variant);
+
+GVariant *
+tlm_user_info_to_variant (TlmUserInfo *info);
+
+TlmUserInfo *
+tlm_user_info_ref (TlmUserInfo *info);
+
+void
+tlm_user_info_unref (TlmUserInfo *info);
+
+TlmUserInfo *
+tlm_user_info_lookup (const gchar *username);
+
+TlmUserInfo *
+tlm_user_info_lookup_uid (uid_t uid);
+
+void
+tlm_user_info_cache_set_ttl (guint ttl);
+
+void
+tlm_user_info_cache_invalidate (void);
+
+G_END_DECLS
+
+#endif /* _TLM_USER_INFO_H */
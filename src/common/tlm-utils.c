@@ -28,13 +28,8 @@
 #include <pwd.h>
 #include <sys/stat.h>
 #include <glib/gstdio.h>
-#include <utmp.h>
-#include <paths.h>
-#include <ctype.h>
 #include <sys/types.h>
-#include <sys/socket.h>
 #include <sys/inotify.h>
-#include <netdb.h>
 #include <string.h>
 #include <unistd.h>
 #include <glib/gstdio.h>
@@ -44,7 +39,6 @@
 #include "tlm-utils.h"
 #include "tlm-log.h"
 
-#define HOST_NAME_SIZE 256
 
 void
 g_clear_string (gchar **str)
@@ -162,156 +156,171 @@ tlm_utils_delete_dir (
     return TRUE;
 }
 
-static gchar *
-_get_tty_id (
-        const gchar *tty_name)
+/* Validates a logind session id, the same way sd_pid_get_session() does */
+static gboolean
+_is_session_id_valid (const gchar *id, gsize len)
 {
-    gchar *id = NULL;
-    const gchar *tmp = tty_name;
+    gsize i;
 
-    while (tmp) {
-        if (isdigit (*tmp)) {
-            id = g_strdup (tmp);
-            break;
-        }
-        tmp++;
+    if (len == 0)
+        return FALSE;
+    for (i = 0; i < len; i++) {
+        if (!g_ascii_isalnum (id[i]))
+            return FALSE;
     }
-    return id;
+    return TRUE;
 }
 
+/* Picks the session from a cgroup path such as
+ * /user.slice/user-1000.slice/session-3.scope: slices are skipped and the
+ * first unit below them has to be a session scope. */
 static gchar *
-_get_host_address (
-        const gchar *hostname)
+_get_session_from_cgroup_path (const gchar *path)
 {
-    gchar *hostaddress = NULL;
-    struct addrinfo hints, *info = NULL;
-
-    if (!hostname) return NULL;
-
-    memset (&hints, 0, sizeof (hints));
-    hints.ai_flags = AI_ADDRCONFIG;
-
-    if (getaddrinfo (hostname, NULL, &hints, &info) == 0) {
-        if (info) {
-            if (info->ai_family == AF_INET) {
-                struct sockaddr_in *sa = (struct sockaddr_in *) info->ai_addr;
-                hostaddress = g_malloc0 (sizeof(struct in_addr));
-                memcpy (hostaddress, &(sa->sin_addr), sizeof (struct in_addr));
-            } else if (info->ai_family == AF_INET6) {
-                struct sockaddr_in6 *sa = (struct sockaddr_in6 *) info->ai_addr;
-                hostaddress = g_malloc0 (sizeof(struct in6_addr));
-                memcpy (hostaddress, &(sa->sin6_addr),
-                        sizeof (struct in6_addr));
-            }
-            freeaddrinfo (info);
-        }
+    gchar **components = g_strsplit (path, "/", -1);
+    gchar **iter;
+    gchar *session_id = NULL;
+
+    for (iter = components; *iter; iter++) {
+        const gchar *unit = *iter;
+        gsize len = strlen (unit);
+
+        if (len == 0 || g_str_has_suffix (unit, ".slice"))
+            continue;
+        if (g_str_has_prefix (unit, "session-") &&
+            g_str_has_suffix (unit, ".scope") &&
+            _is_session_id_valid (unit + 8, len - 8 - 6))
+            session_id = g_strndup (unit + 8, len - 8 - 6);
+        break;
     }
-    return hostaddress;
+    g_strfreev (components);
+
+    return session_id;
 }
 
-static gboolean
-_is_tty_same (
-        const gchar *tty1_name,
-        const gchar *tty2_name)
+/* Resolves the logind session of @pid from <proc_root>/<pid>/cgroup without
+ * talking to logind. @proc_root defaults to $TLM_PROC_ROOT or /proc. */
+gchar *
+tlm_utils_get_logind_session_id (const gchar *proc_root, pid_t pid)
+{
+    gchar *path, *contents = NULL;
+    gchar **lines, **iter;
+    gchar *session_id = NULL;
+
+    if (!proc_root)
+        proc_root = g_getenv ("TLM_PROC_ROOT");
+    if (!proc_root || !*proc_root)
+        proc_root = "/proc";
+
+    path = g_strdup_printf ("%s/%d/cgroup", proc_root, (int) pid);
+    if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+        g_free (path);
+        return NULL;
+    }
+    g_free (path);
+
+    /* hierarchy-id:controllers:path, systemd owns either the named v1
+     * hierarchy or the unified one */
+    lines = g_strsplit (contents, "\n", -1);
+    for (iter = lines; *iter && !session_id; iter++) {
+        gchar **fields = g_strsplit (*iter, ":", 3);
+
+        if (g_strv_length (fields) == 3 &&
+            (g_strcmp0 (fields[1], "name=systemd") == 0 ||
+             (g_strcmp0 (fields[0], "0") == 0 && fields[1][0] == '\0')))
+            session_id = _get_session_from_cgroup_path (fields[2]);
+        g_strfreev (fields);
+    }
+    g_strfreev (lines);
+    g_free (contents);
+
+    return session_id;
+}
+
+/* Builds the object path logind exports for @session_id */
+gchar *
+tlm_utils_logind_session_path (const gchar *session_id)
 {
-    gchar *tty1 = NULL, *tty2 = NULL;
-    gboolean res = FALSE;
+    GString *path;
+    const gchar *c;
+
+    g_return_val_if_fail (session_id && *session_id, NULL);
+
+    path = g_string_new ("/org/freedesktop/login1/session/");
+    for (c = session_id; *c; c++) {
+        if (g_ascii_isalpha (*c) || (c != session_id && g_ascii_isdigit (*c)))
+            g_string_append_c (path, *c);
+        else
+            g_string_append_printf (path, "_%02x", (guchar) *c);
+    }
 
-    if (tty1_name == tty2_name) return TRUE;
-    if (!tty1_name || !tty2_name) return FALSE;
+    return g_string_free (path, FALSE);
+}
 
-    if (*tty1_name == '/') tty1 = g_strdup (tty1_name);
-    else tty1 = g_strdup_printf ("/dev/%s", tty1_name);
-    if (*tty2_name == '/') tty2 = g_strdup (tty2_name);
-    else tty2 = g_strdup_printf ("/dev/%s", tty2_name);
+#define LOGIND_BUS_FLAGS (G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | \
+                          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION)
 
-    res = (g_strcmp0 (tty1_name, tty2_name) == 0);
+/* Connects to the bus logind is on: the message bus at @address, or the
+ * system bus if @address is NULL or empty */
+GDBusConnection *
+tlm_utils_logind_bus_get_sync (const gchar *address, GError **error)
+{
+    if (!address || !*address)
+        return g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, error);
 
-    g_free (tty1);
-    g_free (tty2);
-    return res;
+    return g_dbus_connection_new_for_address_sync (address, LOGIND_BUS_FLAGS,
+                                                   NULL, NULL, error);
 }
 
-static gchar *
-_get_host_name ()
+static void
+_on_logind_bus_ready (GObject *object, GAsyncResult *res, gpointer user_data)
 {
-    gchar *name = g_malloc0 (HOST_NAME_SIZE);
-    if (gethostname (name, HOST_NAME_SIZE) != 0) {
-        g_free (name);
-        return NULL;
-    }
-    return name;
+    GTask *task = G_TASK (user_data);
+    GDBusConnection *bus;
+    GError *error = NULL;
+
+    (void) object;
+
+    if (g_task_get_source_tag (task) == (gpointer) g_bus_get)
+        bus = g_bus_get_finish (res, &error);
+    else
+        bus = g_dbus_connection_new_for_address_finish (res, &error);
+
+    if (bus)
+        g_task_return_pointer (task, bus, g_object_unref);
+    else
+        g_task_return_error (task, error);
+    g_object_unref (task);
 }
 
+/* Asynchronous version of tlm_utils_logind_bus_get_sync() */
 void
-tlm_utils_log_utmp_entry (const gchar *username)
+tlm_utils_logind_bus_get (const gchar *address,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data)
 {
-    struct timeval tv;
-    pid_t pid;
-    struct utmp ut_ent;
-    struct utmp *ut_tmp = NULL;
-    gchar *hostname = NULL, *hostaddress = NULL;
-    const gchar *tty_name = NULL;
-    gchar *tty_no_dev_name = NULL, *tty_id = NULL;
-
-    DBG ("Log session entry to utmp/wtmp");
-
-    hostname = _get_host_name ();
-    hostaddress = _get_host_address (hostname);
-    tty_name = ttyname (0);
-    if (tty_name) {
-        tty_no_dev_name = g_strdup (strncmp(tty_name, "/dev/", 5) == 0 ?
-            tty_name + 5 : tty_name);
-    }
-    tty_id = _get_tty_id (tty_no_dev_name);
-    pid = getpid ();
-    utmpname (_PATH_UTMP);
-
-    setutent ();
-    while ((ut_tmp = getutent())) {
-        if ( (ut_tmp->ut_pid == pid) &&
-             (ut_tmp->ut_id[0] != '\0') &&
-             (ut_tmp->ut_type == LOGIN_PROCESS ||
-                     ut_tmp->ut_type == USER_PROCESS) &&
-             (_is_tty_same (ut_tmp->ut_line, tty_name))) {
-            break;
-        }
+    GTask *task = g_task_new (NULL, cancellable, callback, user_data);
+
+    if (!address || !*address) {
+        g_task_set_source_tag (task, g_bus_get);
+        g_bus_get (G_BUS_TYPE_SYSTEM, cancellable, _on_logind_bus_ready,
+                   task);
+        return;
     }
 
-    if (ut_tmp) memcpy (&ut_ent, ut_tmp, sizeof (ut_ent));
-    else        memset (&ut_ent, 0, sizeof (ut_ent));
-
-    ut_ent.ut_type = USER_PROCESS;
-    ut_ent.ut_pid = pid;
-    if (tty_id)
-        strncpy (ut_ent.ut_id, tty_id, sizeof (ut_ent.ut_id));
-    if (username)
-        strncpy (ut_ent.ut_user, username, sizeof (ut_ent.ut_user));
-    if (tty_no_dev_name)
-        strncpy (ut_ent.ut_line, tty_no_dev_name, sizeof (ut_ent.ut_line));
-    if (hostname)
-        strncpy (ut_ent.ut_host, hostname, sizeof (ut_ent.ut_host));
-    if (hostaddress)
-        memcpy (&ut_ent.ut_addr_v6, hostaddress, sizeof (ut_ent.ut_addr_v6));
-
-    ut_ent.ut_session = getsid (0);
-    gettimeofday (&tv, NULL);
-#ifdef _HAVE_UT_TV
-    ut_ent.ut_tv.tv_sec = tv.tv_sec;
-    ut_ent.ut_tv.tv_usec = tv.tv_usec;
-#else
-    ut_ent.ut_time = tv.tv_sec;
-#endif
-
-    pututline (&ut_ent);
-    endutent ();
-
-    updwtmp (_PATH_WTMP, &ut_ent);
-
-    g_free (hostaddress);
-    g_free (hostname);
-    g_free (tty_no_dev_name);
-    g_free (tty_id);
+    g_task_set_source_tag (task, g_dbus_connection_new_for_address);
+    g_dbus_connection_new_for_address (address, LOGIND_BUS_FLAGS, NULL,
+                                       cancellable, _on_logind_bus_ready,
+                                       task);
+}
+
+GDBusConnection *
+tlm_utils_logind_bus_get_finish (GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+    return g_task_propagate_pointer (G_TASK (result), error);
 }
 
 static gchar **
@@ -29,6 +29,7 @@
 
 #include <sys/types.h>
 #include <glib.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -53,15 +54,30 @@ tlm_user_get_shell (const gchar *username);
 gboolean
 tlm_utils_delete_dir (const gchar *dir);
 
-void
-tlm_utils_log_utmp_entry (const gchar *username);
-
 gchar **
 tlm_utils_split_command_line (const gchar *command);
 
 GList *
 tlm_utils_split_command_lines (const GList const *commands_list);
 
+gchar *
+tlm_utils_get_logind_session_id (const gchar *proc_root, pid_t pid);
+
+gchar *
+tlm_utils_logind_session_path (const gchar *session_id);
+
+GDBusConnection *
+tlm_utils_logind_bus_get_sync (const gchar *address, GError **error);
+
+void
+tlm_utils_logind_bus_get (const gchar *address,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data);
+
+GDBusConnection *
+tlm_utils_logind_bus_get_finish (GAsyncResult *result, GError **error);
+
 typedef void (*WatchCb) (const gchar *found_item, gboolean is_final, GError *error, gpointer userdata);
 
 guint
@@ -0,0 +1,239 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <string.h>
+#include <unistd.h>
+#include <utmp.h>
+#include <paths.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include "tlm-utmp.h"
+#include "tlm-log.h"
+
+#define HOST_NAME_SIZE 256
+
+/* An accounting record, filled on the calling thread and written by the
+ * writer thread, so that neither the host lookup nor the utmp/wtmp i/o
+ * sits on the login path. */
+typedef struct {
+    short type;
+    pid_t pid;
+    pid_t sid;
+    gchar *user;
+    gchar *line;
+    gchar *id;
+    struct timeval tv;
+} TlmUtmpRecord;
+
+/* host identity, only touched by the writer thread */
+typedef struct {
+    gchar name[HOST_NAME_SIZE];
+    gboolean has_address;
+    guint8 address[16];
+} TlmUtmpHost;
+
+static GThreadPool *_writer = NULL;
+static TlmUtmpHost _host;
+G_LOCK_DEFINE_STATIC (_writer);
+
+static void
+_record_free (TlmUtmpRecord *record)
+{
+    g_free (record->user);
+    g_free (record->line);
+    g_free (record->id);
+    g_slice_free (TlmUtmpRecord, record);
+}
+
+static void
+_resolve_host_address (TlmUtmpHost *host)
+{
+    struct addrinfo hints, *info = NULL;
+
+    host->has_address = FALSE;
+    memset (host->address, 0, sizeof (host->address));
+
+    memset (&hints, 0, sizeof (hints));
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    if (getaddrinfo (host->name, NULL, &hints, &info) != 0 || !info)
+        return;
+
+    if (info->ai_family == AF_INET) {
+        struct sockaddr_in *sa = (struct sockaddr_in *) info->ai_addr;
+        memcpy (host->address, &sa->sin_addr, sizeof (struct in_addr));
+        host->has_address = TRUE;
+    } else if (info->ai_family == AF_INET6) {
+        struct sockaddr_in6 *sa = (struct sockaddr_in6 *) info->ai_addr;
+        memcpy (host->address, &sa->sin6_addr, sizeof (struct in6_addr));
+        host->has_address = TRUE;
+    }
+    freeaddrinfo (info);
+}
+
+/* The address is resolved once per host name: gethostname() is a cheap
+ * syscall, getaddrinfo() may have to ask a DNS server. */
+static const TlmUtmpHost *
+_get_host (void)
+{
+    gchar name[HOST_NAME_SIZE] = { 0 };
+
+    if (gethostname (name, sizeof (name) - 1) != 0)
+        return NULL;
+
+    if (strcmp (name, _host.name) != 0) {
+        DBG ("host name changed to '%s'", name);
+        strncpy (_host.name, name, sizeof (_host.name));
+        _resolve_host_address (&_host);
+    }
+
+    return &_host;
+}
+
+static void
+_write_record (gpointer data, gpointer user_data)
+{
+    TlmUtmpRecord *record = data;
+    const TlmUtmpHost *host = NULL;
+    struct utmp ut_ent;
+
+    (void) user_data;
+
+    memset (&ut_ent, 0, sizeof (ut_ent));
+    ut_ent.ut_type = record->type;
+    ut_ent.ut_pid = record->pid;
+    ut_ent.ut_session = record->sid;
+    if (record->id)
+        strncpy (ut_ent.ut_id, record->id, sizeof (ut_ent.ut_id));
+    if (record->line)
+        strncpy (ut_ent.ut_line, record->line, sizeof (ut_ent.ut_line));
+    if (record->user)
+        strncpy (ut_ent.ut_user, record->user, sizeof (ut_ent.ut_user));
+
+    if (record->type == USER_PROCESS)
+        host = _get_host ();
+    if (host) {
+        strncpy (ut_ent.ut_host, host->name, sizeof (ut_ent.ut_host));
+        if (host->has_address)
+            memcpy (&ut_ent.ut_addr_v6, host->address,
+                    sizeof (ut_ent.ut_addr_v6));
+    }
+
+#ifdef _HAVE_UT_TV
+    ut_ent.ut_tv.tv_sec = record->tv.tv_sec;
+    ut_ent.ut_tv.tv_usec = record->tv.tv_usec;
+#else
+    ut_ent.ut_time = record->tv.tv_sec;
+#endif
+
+    /* pututline() finds the slot of our ut_id itself, replacing the
+     * getty's LOGIN_PROCESS entry or our own USER_PROCESS one */
+    utmpname (_PATH_UTMP);
+    setutent ();
+    if (!pututline (&ut_ent))
+        WARN ("Failed to write utmp entry for '%s'", ut_ent.ut_line);
+    endutent ();
+
+    updwtmp (_PATH_WTMP, &ut_ent);
+
+    _record_free (record);
+}
+
+static void
+_queue_record (short type, const gchar *username)
+{
+    TlmUtmpRecord *record = g_slice_new0 (TlmUtmpRecord);
+    const gchar *tty_name = ttyname (0);
+    const gchar *tmp;
+
+    record->type = type;
+    record->pid = getpid ();
+    record->sid = getsid (0);
+    record->user = g_strdup (username);
+    if (tty_name) {
+        record->line = g_strdup (strncmp (tty_name, "/dev/", 5) == 0 ?
+                tty_name + 5 : tty_name);
+        for (tmp = record->line; *tmp; tmp++) {
+            if (g_ascii_isdigit (*tmp)) {
+                record->id = g_strdup (tmp);
+                break;
+            }
+        }
+    }
+    gettimeofday (&record->tv, NULL);
+
+    G_LOCK (_writer);
+    if (!_writer) {
+        GError *error = NULL;
+        _writer = g_thread_pool_new (_write_record, NULL, 1, FALSE, &error);
+        if (!_writer) {
+            WARN ("Failed to start utmp writer: %s", error->message);
+            g_error_free (error);
+        }
+    }
+    if (_writer) {
+        g_thread_pool_push (_writer, record, NULL);
+        record = NULL;
+    }
+    G_UNLOCK (_writer);
+
+    /* no thread, write in place rather than losing the record */
+    if (record)
+        _write_record (record, NULL);
+}
+
+void
+tlm_utmp_log_login (const gchar *username)
+{
+    DBG ("Log session entry to utmp/wtmp");
+    _queue_record (USER_PROCESS, username);
+}
+
+void
+tlm_utmp_log_logout (void)
+{
+    DBG ("Log session exit to utmp/wtmp");
+    _queue_record (DEAD_PROCESS, NULL);
+}
+
+/* Waits for the queued records to be written, to be called before the
+ * process exits. */
+void
+tlm_utmp_flush (void)
+{
+    GThreadPool *writer;
+
+    G_LOCK (_writer);
+    writer = _writer;
+    _writer = NULL;
+    G_UNLOCK (_writer);
+
+    if (writer)
+        g_thread_pool_free (writer, FALSE, TRUE);
+}
@@ -23,6 +23,8 @@
  * 02110-1301 USA
  */
 
+#include <unistd.h>
+
 #include "config.h"
 
 #include "common/tlm-log.h"
@@ -46,6 +48,8 @@ struct _TlmDbusLoginAdapterPrivate
 {
     GDBusConnection *connection;
     TlmDbusLogin *dbus_obj;
+    guint last_job_id;
+    TlmDbusPeerCredentials peer;
 };
 
 G_DEFINE_TYPE (TlmDbusLoginAdapter, tlm_dbus_login_adapter, G_TYPE_OBJECT)
@@ -58,12 +62,33 @@ enum {
     SIG_LOGIN_USER,
     SIG_LOGOUT_USER,
     SIG_SWITCH_USER,
+    SIG_GET_TIMELINES,
+    SIG_CANCEL_REQUEST,
+    SIG_QUEUE_REQUEST,
 
     SIG_MAX
 };
 
 static guint signals[SIG_MAX];
 
+typedef struct
+{
+    gchar *seat_id;
+    GError *error;
+} TlmDbusBatchResult;
+
+/* A loginUsers/logoutUsers/switchUsers call, answered once every request
+ * it was split into has completed */
+typedef struct
+{
+    TlmDbusLoginAdapter *adapter;
+    GDBusMethodInvocation *invocation;
+    TlmDbusRequestType type;
+    TlmDbusBatchResult *results;
+    guint n_results;
+    guint pending;
+} TlmDbusBatch;
+
 static gboolean
 _handle_login_user (
         TlmDbusLoginAdapter *self,
@@ -91,6 +116,61 @@ _handle_logout_user (
         const gchar *seat_id,
         gpointer user_data);
 
+static gboolean
+_handle_get_timelines (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        gpointer user_data);
+
+static gboolean
+_handle_cancel_request (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        gpointer user_data);
+
+static gboolean
+_handle_start_login (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        const gchar *username,
+        const gchar *password,
+        const GVariant *environ,
+        gpointer user_data);
+
+static gboolean
+_handle_login_users (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GVariant *logins,
+        gpointer user_data);
+
+static gboolean
+_handle_logout_users (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *const *seat_ids,
+        gpointer user_data);
+
+static gboolean
+_handle_switch_users (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GVariant *switches,
+        gpointer user_data);
+
+static gboolean
+_handle_start_switch (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        const gchar *username,
+        const gchar *password,
+        const GVariant *environ,
+        gpointer user_data);
+
 static void
 _set_property (
         GObject *object,
@@ -164,6 +244,12 @@ static void
 _finalize (
         GObject *object)
 {
+    TlmDbusLoginAdapter *self = TLM_DBUS_LOGIN_ADAPTER (object);
+
+    if (self->priv->peer.pidfd >= 0) {
+        close (self->priv->peer.pidfd);
+        self->priv->peer.pidfd = -1;
+    }
 
     G_OBJECT_CLASS (tlm_dbus_login_adapter_parent_class)->finalize (
             object);
@@ -192,6 +278,8 @@ tlm_dbus_login_adapter_class_init (
 
     g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 
+    /* invocation is NULL and job id non-zero for jobs, which report their
+     * progress with signals rather than a reply */
     signals[SIG_LOGIN_USER] = g_signal_new ("login-user",
             TLM_TYPE_LOGIN_ADAPTER,
             G_SIGNAL_RUN_LAST,
@@ -200,12 +288,13 @@ tlm_dbus_login_adapter_class_init (
             NULL,
             NULL,
             G_TYPE_NONE,
-            5,
+            6,
             G_TYPE_STRING,
             G_TYPE_STRING,
             G_TYPE_STRING,
             G_TYPE_VARIANT,
-            G_TYPE_DBUS_METHOD_INVOCATION);
+            G_TYPE_DBUS_METHOD_INVOCATION,
+            G_TYPE_UINT);
 
     signals[SIG_LOGOUT_USER] = g_signal_new ("logout-user",
             TLM_TYPE_LOGIN_ADAPTER,
@@ -227,12 +316,49 @@ tlm_dbus_login_adapter_class_init (
             NULL,
             NULL,
             G_TYPE_NONE,
-            5,
+            6,
             G_TYPE_STRING,
             G_TYPE_STRING,
             G_TYPE_STRING,
             G_TYPE_VARIANT,
-            G_TYPE_DBUS_METHOD_INVOCATION);
+            G_TYPE_DBUS_METHOD_INVOCATION,
+            G_TYPE_UINT);
+
+    /* answered right away, the handler returns the timelines */
+    signals[SIG_GET_TIMELINES] = g_signal_new ("get-timelines",
+            TLM_TYPE_LOGIN_ADAPTER,
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL,
+            NULL,
+            NULL,
+            G_TYPE_VARIANT,
+            1,
+            G_TYPE_STRING);
+
+    /* answered right away, the handler returns whether it is supported */
+    signals[SIG_CANCEL_REQUEST] = g_signal_new ("cancel-request",
+            TLM_TYPE_LOGIN_ADAPTER,
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL,
+            NULL,
+            NULL,
+            G_TYPE_BOOLEAN,
+            1,
+            G_TYPE_STRING);
+
+    /* ready made TlmDbusRequest of a batch call, owned by the handler */
+    signals[SIG_QUEUE_REQUEST] = g_signal_new ("queue-request",
+            TLM_TYPE_LOGIN_ADAPTER,
+            G_SIGNAL_RUN_LAST,
+            0,
+            NULL,
+            NULL,
+            NULL,
+            G_TYPE_NONE,
+            1,
+            G_TYPE_POINTER);
 }
 
 static void
@@ -242,6 +368,11 @@ tlm_dbus_login_adapter_init (TlmDbusLoginAdapter *self)
 
     self->priv->connection = 0;
     self->priv->dbus_obj = tlm_dbus_login_skeleton_new ();
+    self->priv->last_job_id = 0;
+    self->priv->peer.pid = 0;
+    self->priv->peer.uid = (uid_t)-1;
+    self->priv->peer.gid = (gid_t)-1;
+    self->priv->peer.pidfd = -1;
 }
 
 static gboolean
@@ -268,7 +399,7 @@ _handle_login_user (
     DBG ("seat_id %s username %s", seat_id, username);
 
     g_signal_emit (self, signals[SIG_LOGIN_USER], 0, seat_id, username,
-            password, environment, invocation);
+            password, environment, invocation, 0);
 
     return TRUE;
 }
@@ -324,19 +455,339 @@ _handle_switch_user (
     DBG ("seat_id %s username %s", seat_id, username);
 
     g_signal_emit (self, signals[SIG_SWITCH_USER], 0, seat_id, username,
-            password, environment, invocation);
+            password, environment, invocation, 0);
 
     return TRUE;
 }
 
+static gboolean
+_handle_get_timelines (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        gpointer emitter)
+{
+    GError *error = NULL;
+    GVariant *timelines = NULL;
+
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self),
+            FALSE);
+
+    DBG ("seat_id %s", seat_id);
+
+    g_signal_emit (self, signals[SIG_GET_TIMELINES], 0, seat_id, &timelines);
+    if (!timelines) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
+                "Dbus request not supported");
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    tlm_dbus_login_complete_get_timelines (self->priv->dbus_obj, invocation,
+            timelines);
+    g_variant_unref (timelines);
+
+    return TRUE;
+}
+
+static gboolean
+_handle_cancel_request (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        gpointer emitter)
+{
+    GError *error = NULL;
+    gboolean handled = FALSE;
+
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self),
+            FALSE);
+
+    if (!seat_id) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INVALID_INPUT,
+                "Invalid input");
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+        return TRUE;
+    }
+    DBG ("seat_id %s", seat_id);
+
+    g_signal_emit (self, signals[SIG_CANCEL_REQUEST], 0, seat_id, &handled);
+    if (!handled) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
+                "Dbus request not supported");
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    tlm_dbus_login_complete_cancel_request (self->priv->dbus_obj, invocation);
+
+    return TRUE;
+}
+
+static gboolean
+_start_job (
+        TlmDbusLoginAdapter *self,
+        guint sig,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        const gchar *username,
+        const gchar *password,
+        const GVariant *environment)
+{
+    GError *error = NULL;
+    guint job_id;
+
+    if (!seat_id || !username || !password) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_INVALID_INPUT,
+                "Invalid input");
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+        return TRUE;
+    }
+    /* the job id promises signals, so refuse what nobody would handle */
+    if (!g_signal_has_handler_pending (self, signals[sig], 0, FALSE)) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
+                "Dbus request not supported");
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    job_id = ++self->priv->last_job_id;
+    if (job_id == 0)
+        job_id = ++self->priv->last_job_id;
+    DBG ("seat_id %s username %s job %u", seat_id, username, job_id);
+
+    if (sig == SIG_LOGIN_USER)
+        tlm_dbus_login_complete_start_login (self->priv->dbus_obj,
+                invocation, job_id);
+    else
+        tlm_dbus_login_complete_start_switch (self->priv->dbus_obj,
+                invocation, job_id);
+
+    g_signal_emit (self, signals[sig], 0, seat_id, username,
+            password, environment, NULL, job_id);
+
+    return TRUE;
+}
+
+static gboolean
+_handle_start_login (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        const gchar *username,
+        const gchar *password,
+        const GVariant *environment,
+        gpointer emitter)
+{
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self), FALSE);
+
+    return _start_job (self, SIG_LOGIN_USER, invocation, seat_id, username,
+            password, environment);
+}
+
+static gboolean
+_handle_start_switch (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *seat_id,
+        const gchar *username,
+        const gchar *password,
+        const GVariant *environment,
+        gpointer emitter)
+{
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self), FALSE);
+
+    return _start_job (self, SIG_SWITCH_USER, invocation, seat_id, username,
+            password, environment);
+}
+
+static void
+_batch_complete (
+        TlmDbusBatch *batch)
+{
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sss)"));
+    for (i = 0; i < batch->n_results; i++) {
+        TlmDbusBatchResult *result = &batch->results[i];
+        gchar *name = NULL;
+
+        if (result->error)
+            name = g_dbus_error_encode_gerror (result->error);
+        g_variant_builder_add (&builder, "(sss)",
+                result->seat_id ? result->seat_id : "",
+                name ? name : "",
+                result->error ? result->error->message : "");
+        g_free (name);
+        g_free (result->seat_id);
+        g_clear_error (&result->error);
+    }
+
+    switch (batch->type) {
+    case TLM_DBUS_REQUEST_TYPE_LOGIN_USER:
+        tlm_dbus_login_complete_login_users (batch->adapter->priv->dbus_obj,
+                batch->invocation, g_variant_builder_end (&builder));
+        break;
+    case TLM_DBUS_REQUEST_TYPE_LOGOUT_USER:
+        tlm_dbus_login_complete_logout_users (batch->adapter->priv->dbus_obj,
+                batch->invocation, g_variant_builder_end (&builder));
+        break;
+    case TLM_DBUS_REQUEST_TYPE_SWITCH_USER:
+        tlm_dbus_login_complete_switch_users (batch->adapter->priv->dbus_obj,
+                batch->invocation, g_variant_builder_end (&builder));
+        break;
+    }
+
+    g_object_unref (batch->invocation);
+    g_object_unref (batch->adapter);
+    g_free (batch->results);
+    g_slice_free (TlmDbusBatch, batch);
+}
+
+static void
+_batch_set_result (
+        TlmDbusBatch *batch,
+        guint index,
+        const gchar *seat_id,
+        const GError *error)
+{
+    TlmDbusBatchResult *result = &batch->results[index];
+
+    result->seat_id = g_strdup (seat_id);
+    if (error)
+        result->error = g_error_copy (error);
+
+    if (--batch->pending == 0)
+        _batch_complete (batch);
+}
+
+/* Splits a batch call into one request per entry of @entries, which are
+ * (sssa{ss}) tuples for logins and switches, or seat id strings */
+static gboolean
+_start_batch (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        TlmDbusRequestType type,
+        GVariant *entries)
+{
+    GError *error = NULL;
+    TlmDbusBatch *batch = NULL;
+    GVariantIter iter;
+    GVariant *entry = NULL;
+    guint i = 0;
+
+    if (!g_signal_has_handler_pending (self, signals[SIG_QUEUE_REQUEST], 0,
+                FALSE)) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
+                "Dbus request not supported");
+        g_dbus_method_invocation_return_gerror (invocation, error);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    batch = g_slice_new0 (TlmDbusBatch);
+    batch->adapter = g_object_ref (self);
+    batch->invocation = g_object_ref (invocation);
+    batch->type = type;
+    batch->n_results = g_variant_n_children (entries);
+    batch->results = g_new0 (TlmDbusBatchResult, batch->n_results);
+    /* held until every request is queued, so that requests completing
+     * right away do not finish the batch early */
+    batch->pending = batch->n_results + 1;
+    DBG ("batch of %u requests of type %d", batch->n_results, type);
+
+    g_variant_iter_init (&iter, entries);
+    while ((entry = g_variant_iter_next_value (&iter))) {
+        const gchar *seat_id = NULL, *username = NULL, *password = NULL;
+        GVariant *environment = NULL;
+        TlmDbusRequest *request = NULL;
+
+        if (type == TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
+            seat_id = g_variant_get_string (entry, NULL);
+        else
+            g_variant_get (entry, "(&s&s&s@a{ss})", &seat_id, &username,
+                    &password, &environment);
+
+        request = tlm_dbus_utils_create_request (G_OBJECT (self), NULL,
+                type, seat_id, username, password, environment);
+        request->batch = batch;
+        request->batch_index = i;
+        g_signal_emit (self, signals[SIG_QUEUE_REQUEST], 0, request);
+
+        if (environment) g_variant_unref (environment);
+        g_variant_unref (entry);
+        i++;
+    }
+
+    if (--batch->pending == 0)
+        _batch_complete (batch);
+
+    return TRUE;
+}
+
+static gboolean
+_handle_login_users (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GVariant *logins,
+        gpointer emitter)
+{
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self), FALSE);
+
+    return _start_batch (self, invocation, TLM_DBUS_REQUEST_TYPE_LOGIN_USER,
+            logins);
+}
+
+static gboolean
+_handle_logout_users (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        const gchar *const *seat_ids,
+        gpointer emitter)
+{
+    GVariant *entries = NULL;
+    gboolean ret;
+
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self), FALSE);
+
+    entries = g_variant_ref_sink (g_variant_new_strv (seat_ids, -1));
+    ret = _start_batch (self, invocation, TLM_DBUS_REQUEST_TYPE_LOGOUT_USER,
+            entries);
+    g_variant_unref (entries);
+    return ret;
+}
+
+static gboolean
+_handle_switch_users (
+        TlmDbusLoginAdapter *self,
+        GDBusMethodInvocation *invocation,
+        GVariant *switches,
+        gpointer emitter)
+{
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self), FALSE);
+
+    return _start_batch (self, invocation, TLM_DBUS_REQUEST_TYPE_SWITCH_USER,
+            switches);
+}
+
 TlmDbusLoginAdapter *
 tlm_dbus_login_adapter_new_with_connection (
-        GDBusConnection *bus_connection)
+        GDBusConnection *bus_connection,
+        const TlmDbusPeerCredentials *peer)
 {
     GError *err = NULL;
     TlmDbusLoginAdapter *adapter = TLM_DBUS_LOGIN_ADAPTER (g_object_new (
             TLM_TYPE_LOGIN_ADAPTER, "connection", bus_connection, NULL));
 
+    /* the pidfd is owned by the adapter from here on */
+    if (peer) adapter->priv->peer = *peer;
+
     if (!g_dbus_interface_skeleton_export (
             G_DBUS_INTERFACE_SKELETON(adapter->priv->dbus_obj),
             adapter->priv->connection, TLM_LOGIN_OBJECTPATH, &err)) {
@@ -355,6 +806,20 @@ tlm_dbus_login_adapter_new_with_connection (
         "handle-logout-user", G_CALLBACK(_handle_logout_user), adapter);
     g_signal_connect_swapped (adapter->priv->dbus_obj,
         "handle-switch-user", G_CALLBACK(_handle_switch_user), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-get-timelines", G_CALLBACK(_handle_get_timelines), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-cancel-request", G_CALLBACK(_handle_cancel_request), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-start-login", G_CALLBACK(_handle_start_login), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-start-switch", G_CALLBACK(_handle_start_switch), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-login-users", G_CALLBACK(_handle_login_users), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-logout-users", G_CALLBACK(_handle_logout_users), adapter);
+    g_signal_connect_swapped (adapter->priv->dbus_obj,
+        "handle-switch-users", G_CALLBACK(_handle_switch_users), adapter);
 
     return adapter;
 }
@@ -369,6 +834,29 @@ tlm_dbus_login_adapter_request_completed (
 
     TlmDbusLoginAdapter *adapter = TLM_DBUS_LOGIN_ADAPTER (
             request->dbus_adapter);
+
+    if (request->batch) {
+        _batch_set_result (request->batch, request->batch_index,
+                request->seat_id, error);
+        request->batch = NULL;
+        return;
+    }
+
+    if (request->job_id) {
+        if (!adapter->priv->dbus_obj)
+            return;
+        if (error) {
+            gchar *name = g_dbus_error_encode_gerror (error);
+            tlm_dbus_login_emit_failed (adapter->priv->dbus_obj,
+                    request->job_id, request->seat_id, name, error->message);
+            g_free (name);
+        } else {
+            tlm_dbus_login_emit_session_created (adapter->priv->dbus_obj,
+                    request->job_id, request->seat_id);
+        }
+        return;
+    }
+
     if (error) {
         g_dbus_method_invocation_return_gerror (request->invocation, error);
         return;
@@ -389,3 +877,28 @@ tlm_dbus_login_adapter_request_completed (
         break;
     }
 }
+
+void
+tlm_dbus_login_adapter_request_authenticated (
+        TlmDbusRequest *request)
+{
+    g_return_if_fail (request && request->dbus_adapter &&
+            TLM_IS_DBUS_LOGIN_ADAPTER(request->dbus_adapter));
+
+    TlmDbusLoginAdapter *adapter = TLM_DBUS_LOGIN_ADAPTER (
+            request->dbus_adapter);
+
+    if (!request->job_id || !adapter->priv->dbus_obj)
+        return;
+    tlm_dbus_login_emit_authenticated (adapter->priv->dbus_obj,
+            request->job_id, request->seat_id);
+}
+
+const TlmDbusPeerCredentials *
+tlm_dbus_login_adapter_get_peer_credentials (
+        TlmDbusLoginAdapter *self)
+{
+    g_return_val_if_fail (self && TLM_IS_DBUS_LOGIN_ADAPTER(self), NULL);
+
+    return &self->priv->peer;
+}
@@ -70,13 +70,22 @@ GType tlm_dbus_login_adapter_get_type (void) G_GNUC_CONST;
 
 TlmDbusLoginAdapter *
 tlm_dbus_login_adapter_new_with_connection (
-        GDBusConnection *connection);
+        GDBusConnection *connection,
+        const TlmDbusPeerCredentials *peer);
+
+const TlmDbusPeerCredentials *
+tlm_dbus_login_adapter_get_peer_credentials (
+        TlmDbusLoginAdapter *self);
 
 void
 tlm_dbus_login_adapter_request_completed (
         TlmDbusRequest *request,
         GError *error);
 
+void
+tlm_dbus_login_adapter_request_authenticated (
+        TlmDbusRequest *request);
+
 G_END_DECLS
 
 #endif /* __TLM_DBUS_LOGIN_ADAPTER_H_ */
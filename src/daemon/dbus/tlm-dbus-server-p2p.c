@@ -24,6 +24,8 @@
  */
 #include <errno.h>
 #include <string.h>
+#include <signal.h>
+#include <poll.h>
 #include <glib/gstdio.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -62,7 +64,7 @@ struct _TlmDbusServerP2PPrivate
     GHashTable *login_object_adapters;
     GDBusServer *bus_server;
     gchar *address;
-    uid_t uid;
+    uid_t uid; /* peer allowed besides ourself, (uid_t)-1 for none */
 };
 
 static void
@@ -290,18 +292,87 @@ _on_connection_closed (
 static void
 _tlm_dbus_server_p2p_add_login_obj (
         TlmDbusServerP2P *server,
-        GDBusConnection *connection)
+        GDBusConnection *connection,
+        const TlmDbusPeerCredentials *peer)
 {
     TlmDbusLoginAdapter *login_object = NULL;
 
     DBG("export interfaces on connection %p", connection);
 
-    login_object = tlm_dbus_login_adapter_new_with_connection (connection);
+    login_object = tlm_dbus_login_adapter_new_with_connection (connection,
+            peer);
+    if (!login_object)
+        return;
 
     _add_login_object_watchers (connection, login_object, server);
     g_signal_emit (server, signals[SIG_CLIENT_ADDED], 0, login_object);
 }
 
+static gboolean
+_get_peer_credentials (
+        GDBusConnection *connection,
+        TlmDbusPeerCredentials *peer)
+{
+    gint peer_fd = -1;
+    struct ucred peer_cred;
+    socklen_t cred_size = sizeof(peer_cred);
+#ifdef SO_PEERPIDFD
+    gint pidfd = -1;
+    socklen_t pidfd_size = sizeof(pidfd);
+#endif
+
+    peer_fd = g_socket_get_fd (g_socket_connection_get_socket (
+            G_SOCKET_CONNECTION (g_dbus_connection_get_stream(connection))));
+    if (peer_fd < 0 || getsockopt (peer_fd, SOL_SOCKET, SO_PEERCRED,
+            &peer_cred, &cred_size) != 0) {
+        WARN ("getsockopt() for SO_PEERCRED failed");
+        return FALSE;
+    }
+    peer->pid = peer_cred.pid;
+    peer->uid = peer_cred.uid;
+    peer->gid = peer_cred.gid;
+    peer->pidfd = -1;
+
+#ifdef SO_PEERPIDFD
+    /* pins the peer process, so its pid can not be reused behind our back */
+    if (getsockopt (peer_fd, SOL_SOCKET, SO_PEERPIDFD, &pidfd,
+            &pidfd_size) == 0)
+        peer->pidfd = pidfd;
+    else
+        DBG ("getsockopt() for SO_PEERPIDFD failed: %s", strerror (errno));
+#endif
+
+    DBG ("remote p2p peer pid=%d uid=%d gid=%d pidfd=%d", peer->pid,
+            peer->uid, peer->gid, peer->pidfd);
+    return TRUE;
+}
+
+static gboolean
+_is_peer_allowed (
+        TlmDbusServerP2P *server,
+        const TlmDbusPeerCredentials *peer)
+{
+    return peer->uid == geteuid () ||
+           (server->priv->uid != (uid_t)-1 &&
+            peer->uid == server->priv->uid);
+}
+
+static gboolean
+_is_peer_alive (
+        const TlmDbusPeerCredentials *peer)
+{
+    struct pollfd pfd;
+
+    /* a pidfd turns readable once its process has exited */
+    if (peer->pidfd >= 0) {
+        pfd.fd = peer->pidfd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return poll (&pfd, 1, 0) == 0;
+    }
+    return kill (peer->pid, 0) == 0 || errno == EPERM;
+}
+
 static gboolean
 _on_client_request (
         GDBusServer *dbus_server,
@@ -309,14 +380,45 @@ _on_client_request (
         gpointer user_data)
 {
     TlmDbusServerP2P *server = TLM_DBUS_SERVER_P2P (user_data);
+    TlmDbusPeerCredentials peer;
+
     if (!server) {
         WARN ("memory corruption");
         return TRUE;
     }
-    _tlm_dbus_server_p2p_add_login_obj (server, connection);
+    if (!_get_peer_credentials (connection, &peer))
+        return FALSE;
+    if (!_is_peer_allowed (server, &peer)) {
+        WARN ("rejecting p2p dbus connection(%p) on '%s'", connection,
+                server->priv->address);
+        if (peer.pidfd >= 0) close (peer.pidfd);
+        return FALSE;
+    }
+    _tlm_dbus_server_p2p_add_login_obj (server, connection, &peer);
     return TRUE;
 }
 
+static void
+_set_socket_owner (
+        TlmDbusServerP2P *server)
+{
+    const gchar *path = NULL;
+    uid_t owner = server->priv->uid;
+
+    if (!g_str_has_prefix (server->priv->address, "unix:path="))
+        return;
+    path = server->priv->address + 10;
+
+    if (owner == (uid_t)-1)
+        owner = geteuid ();
+    if (chown (path, owner, -1) < 0) {
+        WARN("Unable to set ownership");
+    }
+    if (g_chmod (path, S_IRUSR | S_IWUSR) < 0) {
+        WARN("Unable to set mode '%d' for '%s'", S_IRUSR|S_IWUSR, path);
+    }
+}
+
 gboolean
 _tlm_dbus_server_p2p_start (
         TlmDbusServer *self)
@@ -346,18 +448,8 @@ _tlm_dbus_server_p2p_start (
     }
 
     if (!g_dbus_server_is_active (server->priv->bus_server)) {
-        const gchar *path = NULL;
         g_dbus_server_start (server->priv->bus_server);
-        path = g_strstr_len(server->priv->address, -1, "unix:path=") + 10;
-        if (path) {
-            if (chown (path, server->priv->uid, -1) < 0) {
-                WARN("Unable to set ownership");
-            }
-            if (g_chmod (path, S_IRUSR | S_IWUSR) < 0) {
-                WARN("Unable to set mode '%d' for '%s'",
-                    S_IRUSR|S_IWUSR, path);
-            }
-        }
+        _set_socket_owner (server);
     }
     DBG("dbus server started at : %s", server->priv->address);
 
@@ -400,26 +492,22 @@ _tlm_dbus_server_p2p_get_remote_pid (
         GDBusMethodInvocation *invocation)
 {
     pid_t remote_pid = 0;
-    GDBusConnection *connection = NULL;
-    gint peer_fd = -1;
-    struct ucred peer_cred;
-    socklen_t cred_size = sizeof(peer_cred);
+    TlmDbusServerP2P *server = NULL;
+    TlmDbusLoginAdapter *login_object = NULL;
 
     g_return_val_if_fail (invocation && TLM_IS_DBUS_SERVER_P2P (self),
             remote_pid);
-
-    connection = g_dbus_method_invocation_get_connection (invocation);
-    peer_fd = g_socket_get_fd (g_socket_connection_get_socket (
-            G_SOCKET_CONNECTION (g_dbus_connection_get_stream(connection))));
-    if (peer_fd < 0 || getsockopt (peer_fd, SOL_SOCKET, SO_PEERCRED,
-            &peer_cred, &cred_size) != 0) {
-        WARN ("getsockopt() for SO_PEERCRED failed");
+    server = TLM_DBUS_SERVER_P2P (self);
+
+    /* credentials were read once, when the connection was accepted */
+    if (server->priv->login_object_adapters)
+        login_object = g_hash_table_lookup (
+                server->priv->login_object_adapters,
+                g_dbus_method_invocation_get_connection (invocation));
+    if (!login_object)
         return remote_pid;
-    }
-    DBG ("remote p2p peer pid=%d uid=%d gid=%d", peer_cred.pid, peer_cred.uid,
-            peer_cred.gid);
 
-    return peer_cred.pid;
+    return tlm_dbus_login_adapter_get_peer_credentials (login_object)->pid;
 }
 
 static void
@@ -465,3 +553,58 @@ tlm_dbus_server_p2p_new (
 
     return server;
 }
+
+void
+tlm_dbus_server_p2p_set_uid (
+        TlmDbusServerP2P *self,
+        uid_t uid)
+{
+    g_return_if_fail (self && TLM_IS_DBUS_SERVER_P2P (self));
+
+    DBG ("allowed peer uid %d -> %d", self->priv->uid, uid);
+    if (self->priv->uid == uid)
+        return;
+
+    self->priv->uid = uid;
+    if (self->priv->bus_server &&
+        g_dbus_server_is_active (self->priv->bus_server))
+        _set_socket_owner (self);
+}
+
+/* The peer is still running and still allowed to talk to the server */
+gboolean
+tlm_dbus_server_p2p_is_peer_authorized (
+        TlmDbusServerP2P *self,
+        const TlmDbusPeerCredentials *peer)
+{
+    g_return_val_if_fail (self && TLM_IS_DBUS_SERVER_P2P (self), FALSE);
+    g_return_val_if_fail (peer, FALSE);
+
+    return _is_peer_allowed (self, peer) && _is_peer_alive (peer);
+}
+
+void
+tlm_dbus_server_p2p_close_unauthorized (
+        TlmDbusServerP2P *self)
+{
+    GHashTableIter iter;
+    gpointer connection = NULL;
+    gpointer login_object = NULL;
+
+    g_return_if_fail (self && TLM_IS_DBUS_SERVER_P2P (self));
+
+    if (!self->priv->login_object_adapters)
+        return;
+
+    /* removal from the table happens on "closed", once the close is done */
+    g_hash_table_iter_init (&iter, self->priv->login_object_adapters);
+    while (g_hash_table_iter_next (&iter, &connection, &login_object)) {
+        if (_is_peer_allowed (self,
+                tlm_dbus_login_adapter_get_peer_credentials (
+                        TLM_DBUS_LOGIN_ADAPTER (login_object))))
+            continue;
+        DBG ("closing p2p dbus connection(%p)", connection);
+        g_dbus_connection_close (G_DBUS_CONNECTION (connection), NULL, NULL,
+                NULL);
+    }
+}
@@ -30,6 +30,8 @@
 #include <glib-object.h>
 #include <pwd.h>
 
+#include "common/dbus/tlm-dbus-utils.h"
+
 G_BEGIN_DECLS
 
 #define TLM_TYPE_DBUS_SERVER_P2P            (tlm_dbus_server_p2p_get_type())
@@ -69,4 +71,18 @@ tlm_dbus_server_p2p_new (
         const gchar *address,
         uid_t uid);
 
+void
+tlm_dbus_server_p2p_set_uid (
+        TlmDbusServerP2P *self,
+        uid_t uid);
+
+gboolean
+tlm_dbus_server_p2p_is_peer_authorized (
+        TlmDbusServerP2P *self,
+        const TlmDbusPeerCredentials *peer);
+
+void
+tlm_dbus_server_p2p_close_unauthorized (
+        TlmDbusServerP2P *self);
+
 #endif /* __TLM_DBUS_SERVER_P2P_H_ */
@@ -40,6 +40,7 @@
 #include "dbus/tlm-dbus-server-p2p.h"
 #include "dbus/tlm-dbus-login-adapter.h"
 #include "dbus/tlm-dbus-utils.h"
+#include "common/dbus/tlm-dbus.h"
 #include "tlm-seat.h"
 #include "tlm-manager.h"
 #include "common/tlm-error.h"
@@ -49,20 +50,36 @@ G_DEFINE_TYPE (TlmDbusObserver, tlm_dbus_observer, G_TYPE_OBJECT);
 #define TLM_DBUS_OBSERVER_PRIV(obj) G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
             TLM_TYPE_DBUS_OBSERVER, TlmDbusObserverPrivate)
 
+typedef struct _TlmRequestQueue TlmRequestQueue;
+
 typedef struct
 {
     TlmDbusRequest *dbus_request;
-    TlmSeat *seat;
+    TlmRequestQueue *queue;
+    gint64 received_at;
+    guint deadline_id;
 } TlmRequest;
 
+/* Requests are queued per seat; each seat processes one request at a time,
+ * independently of the other seats served by the same observer */
+struct _TlmRequestQueue
+{
+    TlmDbusObserver *observer;
+    gchar *seat_id;
+    TlmSeat *seat; /* connected while a request is active */
+    GQueue *pending;
+    TlmRequest *active;
+    guint process_id;
+    gboolean processing; /* seat may signal back from within the call */
+    gboolean aborting; /* waiting for an aborted session to go away */
+};
+
 struct _TlmDbusObserverPrivate
 {
     TlmManager *manager;
     TlmSeat *seat;
     TlmDbusServer *dbus_server;
-    GQueue *request_queue;
-    guint request_id;
-    TlmRequest *active_request;
+    GHashTable *queues; /* seat id -> TlmRequestQueue */
     DbusObserverEnableFlags enable_flags;
 };
 
@@ -86,6 +103,7 @@ _handle_dbus_login_user (
         const gchar *password,
         GVariant *environment,
         GDBusMethodInvocation *invocation,
+        guint job_id,
         GObject *dbus_adapter);
 
 static void
@@ -103,6 +121,7 @@ _handle_dbus_switch_user (
         const gchar *password,
         GVariant *environment,
         GDBusMethodInvocation *invocation,
+        guint job_id,
         GObject *dbus_adapter);
 
 static void
@@ -110,6 +129,30 @@ _disconnect_dbus_adapter (
         TlmDbusObserver *self,
         TlmDbusLoginAdapter *adapter);
 
+static GVariant *
+_handle_dbus_get_timelines (
+        TlmDbusObserver *self,
+        const gchar *seat_id,
+        GObject *dbus_adapter);
+
+static gboolean
+_handle_dbus_cancel_request (
+        TlmDbusObserver *self,
+        const gchar *seat_id,
+        GObject *dbus_adapter);
+
+static void
+_handle_dbus_queue_request (
+        TlmDbusObserver *self,
+        TlmDbusRequest *request,
+        GObject *dbus_adapter);
+
+static void
+_handle_seat_session_authenticated (
+        TlmDbusObserver *self,
+        const gchar *seat_id,
+        GObject *seat);
+
 static void
 _handle_seat_session_created (
         TlmDbusObserver *self,
@@ -139,8 +182,12 @@ _connect_seat (
         TlmSeat *seat);
 
 static void
-_process_next_request_in_idle (
-        TlmDbusObserver *self);
+_queue_next (
+        TlmRequestQueue *queue);
+
+static void
+_clear_request (
+        TlmRequest *request);
 
 static void
 _on_seat_dispose (
@@ -150,11 +197,6 @@ _on_seat_dispose (
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self) && dead &&
                 TLM_IS_SEAT(dead));
     g_object_weak_unref (dead, (GWeakNotify)_on_seat_dispose, self);
-    _disconnect_seat (self, TLM_SEAT (dead));
-    if (self->priv->active_request &&
-        G_OBJECT(self->priv->active_request->seat) == dead) {
-        self->priv->active_request->seat = NULL;
-    }
     if (G_OBJECT(self->priv->seat) == dead)
         self->priv->seat = NULL;
 }
@@ -172,41 +214,31 @@ _on_manager_dispose (
 
 static TlmRequest *
 _create_request (
-        TlmDbusObserver *self,
-        TlmDbusRequest *dbus_req,
-        TlmSeat *seat)
+        TlmDbusRequest *dbus_req)
 {
     TlmRequest *request = g_malloc0 (sizeof (TlmRequest));
     if (!request) return NULL;
 
     request->dbus_request = dbus_req;
-    request->seat = seat;
-    if (request->seat) {
-        _connect_seat (self, request->seat);
-        g_object_weak_ref (G_OBJECT (request->seat),
-                (GWeakNotify)_on_seat_dispose, self);
-    }
+    request->received_at = g_get_monotonic_time ();
     return request;
 }
 
 static void
 _dispose_request (
-        TlmDbusObserver *self,
         TlmRequest *request)
 {
     if (!request) return;
 
+    if (request->deadline_id) {
+        g_source_remove (request->deadline_id);
+        request->deadline_id = 0;
+    }
     if (request->dbus_request) {
         tlm_dbus_login_adapter_request_completed (request->dbus_request, NULL);
         tlm_dbus_utils_dispose_request (request->dbus_request);
         request->dbus_request = NULL;
     }
-    if (request->seat) {
-        _disconnect_seat (self, request->seat);
-        g_object_weak_unref (G_OBJECT (request->seat),
-                (GWeakNotify)_on_seat_dispose, self);
-        request->seat = NULL;
-    }
     g_free (request);
 }
 
@@ -218,6 +250,8 @@ _disconnect_seat (
     DBG ("self %p seat %p", self, seat);
     if (!seat) return;
 
+    g_signal_handlers_disconnect_by_func (G_OBJECT (seat),
+            _handle_seat_session_authenticated, self);
     g_signal_handlers_disconnect_by_func (G_OBJECT (seat),
             _handle_seat_session_created, self);
     g_signal_handlers_disconnect_by_func (G_OBJECT (seat),
@@ -234,6 +268,8 @@ _connect_seat (
     DBG ("self %p seat %p", self, seat);
     if (!seat) return;
 
+    g_signal_connect_swapped (G_OBJECT (seat), "session-authenticated",
+            G_CALLBACK(_handle_seat_session_authenticated), self);
     g_signal_connect_swapped (G_OBJECT (seat), "session-created",
             G_CALLBACK(_handle_seat_session_created), self);
     g_signal_connect_swapped (G_OBJECT (seat), "session-terminated",
@@ -242,44 +278,122 @@ _connect_seat (
             G_CALLBACK(_handle_seat_session_error), self);
 }
 
+static void
+_on_queue_seat_dispose (
+        TlmRequestQueue *queue,
+        GObject *dead)
+{
+    /* signal handlers go away with the seat itself */
+    if (G_OBJECT (queue->seat) != dead)
+        return;
+    queue->seat = NULL;
+    if (queue->aborting) {
+        queue->aborting = FALSE;
+        _queue_next (queue);
+    }
+}
+
+static void
+_queue_attach_seat (
+        TlmRequestQueue *queue,
+        TlmSeat *seat)
+{
+    if (queue->seat == seat) return;
+
+    /* NOTE: seat signals are connected only while a request of the queue
+     * is active, and disconnected once the queue runs empty */
+    _connect_seat (queue->observer, seat);
+    g_object_weak_ref (G_OBJECT (seat), (GWeakNotify)_on_queue_seat_dispose,
+            queue);
+    queue->seat = seat;
+}
+
+static void
+_queue_detach_seat (
+        TlmRequestQueue *queue)
+{
+    if (!queue->seat) return;
+
+    _disconnect_seat (queue->observer, queue->seat);
+    g_object_weak_unref (G_OBJECT (queue->seat),
+            (GWeakNotify)_on_queue_seat_dispose, queue);
+    queue->seat = NULL;
+}
+
+static TlmRequestQueue *
+_queue_new (
+        TlmDbusObserver *self,
+        const gchar *seat_id)
+{
+    TlmRequestQueue *queue = g_slice_new0 (TlmRequestQueue);
+
+    queue->observer = self;
+    queue->seat_id = g_strdup (seat_id);
+    queue->pending = g_queue_new ();
+    return queue;
+}
+
+static void
+_queue_free (
+        TlmRequestQueue *queue)
+{
+    if (!queue) return;
+
+    if (queue->process_id) {
+        g_source_remove (queue->process_id);
+        queue->process_id = 0;
+    }
+    _queue_detach_seat (queue);
+    if (queue->active) {
+        _clear_request (queue->active);
+        queue->active = NULL;
+    }
+    g_queue_free_full (queue->pending, (GDestroyNotify) _clear_request);
+    g_free (queue->seat_id);
+    g_slice_free (TlmRequestQueue, queue);
+}
+
 static void
 _on_dbus_adapter_dispose (
         TlmDbusObserver *self,
         GObject *dead)
 {
-    GList *head=NULL, *elem=NULL, *next;
+    GList *queues, *item;
 
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self) && dead &&
                 TLM_IS_DBUS_LOGIN_ADAPTER(dead));
     _disconnect_dbus_adapter (self, TLM_DBUS_LOGIN_ADAPTER(dead));
 
-    if (self->priv->request_queue)
-        head = elem = g_queue_peek_head_link (self->priv->request_queue);
-    while (elem) {
-        TlmRequest *request = elem->data;
-        TlmDbusRequest *dbus_req = request->dbus_request;
-        next = g_list_next (elem);
-        if (dbus_req && G_OBJECT (dbus_req->dbus_adapter) == dead) {
-            DBG ("removing the request for dead dbus adapter");
-            head = g_list_delete_link (head, elem);
-            _dispose_request (self, request);
+    if (!self->priv->queues) return;
+
+    /* _queue_next() may drop queues from the table, so walk a copy */
+    queues = g_hash_table_get_values (self->priv->queues);
+    for (item = queues; item; item = g_list_next (item)) {
+        TlmRequestQueue *queue = item->data;
+        GList *elem = g_queue_peek_head_link (queue->pending), *next;
+
+        while (elem) {
+            TlmRequest *request = elem->data;
+            next = g_list_next (elem);
+            if (request->dbus_request &&
+                G_OBJECT (request->dbus_request->dbus_adapter) == dead) {
+                DBG ("removing the request for dead dbus adapter");
+                g_queue_delete_link (queue->pending, elem);
+                _dispose_request (request);
+            }
+            elem = next;
         }
-        elem = next;
-    }
 
-    /* check for active request */
-    if (self->priv->active_request &&
-        G_OBJECT (self->priv->active_request->dbus_request->dbus_adapter) ==
-                dead) {
-        DBG ("removing the request for dead dbus adapter");
-        _dispose_request (self, self->priv->active_request);
-        self->priv->active_request = NULL;
-        if (self->priv->request_id) {
-            g_source_remove (self->priv->request_id);
-            self->priv->request_id = 0;
+        /* check for active request */
+        if (queue->active && queue->active->dbus_request &&
+            G_OBJECT (queue->active->dbus_request->dbus_adapter) == dead) {
+            DBG ("removing the active request for dead dbus adapter");
+            _dispose_request (queue->active);
+            queue->active = NULL;
+            _queue_next (queue);
         }
-        _process_next_request_in_idle (self);
     }
+    g_list_free (queues);
 }
 
 static void
@@ -296,6 +410,15 @@ _connect_dbus_adapter (
     if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_SWITCH_USER)
         g_signal_connect_swapped (G_OBJECT (adapter),
                 "switch-user", G_CALLBACK(_handle_dbus_switch_user), self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_GET_TIMELINES)
+        g_signal_connect_swapped (G_OBJECT (adapter),
+                "get-timelines", G_CALLBACK(_handle_dbus_get_timelines), self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_CANCEL_REQUEST)
+        g_signal_connect_swapped (G_OBJECT (adapter), "cancel-request",
+                G_CALLBACK(_handle_dbus_cancel_request), self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_BATCH)
+        g_signal_connect_swapped (G_OBJECT (adapter), "queue-request",
+                G_CALLBACK(_handle_dbus_queue_request), self);
 }
 
 static void
@@ -312,6 +435,15 @@ _disconnect_dbus_adapter (
     if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_SWITCH_USER)
         g_signal_handlers_disconnect_by_func (G_OBJECT(adapter),
                 _handle_dbus_switch_user, self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_GET_TIMELINES)
+        g_signal_handlers_disconnect_by_func (G_OBJECT(adapter),
+                _handle_dbus_get_timelines, self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_CANCEL_REQUEST)
+        g_signal_handlers_disconnect_by_func (G_OBJECT(adapter),
+                _handle_dbus_cancel_request, self);
+    if (self->priv->enable_flags & DBUS_OBSERVER_ENABLE_BATCH)
+        g_signal_handlers_disconnect_by_func (G_OBJECT(adapter),
+                _handle_dbus_queue_request, self);
 }
 
 static void
@@ -365,25 +497,23 @@ _abort_dbus_request (
 
 static void
 _complete_request (
-		TlmDbusObserver *self,
         TlmRequest *request,
         GError *error)
 {
     _complete_dbus_request (request->dbus_request, error);
-	request->dbus_request = NULL;
-    _dispose_request (self, request);
+    request->dbus_request = NULL;
+    _dispose_request (request);
 }
 
 static void
 _clear_request (
-        TlmRequest *request,
-        TlmDbusObserver *self)
+        TlmRequest *request)
 {
-	if (!request) return;
+    if (!request) return;
 
-	_abort_dbus_request (request->dbus_request);
-	request->dbus_request = NULL;
-	_dispose_request (self, request);
+    _abort_dbus_request (request->dbus_request);
+    request->dbus_request = NULL;
+    _dispose_request (request);
 }
 
 static gboolean
@@ -402,95 +532,235 @@ _is_request_supported (
     return FALSE;
 }
 
+/* A queued request is only carried out while its requester is still
+ * running and still allowed on the server, by the credentials its login
+ * adapter read when the connection was accepted */
+static gboolean
+_is_requester_authorized (
+        TlmDbusObserver *self,
+        TlmDbusRequest *dbus_req)
+{
+    if (!dbus_req->dbus_adapter || !self->priv->dbus_server)
+        return TRUE;
+
+    return tlm_dbus_server_p2p_is_peer_authorized (
+            TLM_DBUS_SERVER_P2P (self->priv->dbus_server),
+            tlm_dbus_login_adapter_get_peer_credentials (
+                    TLM_DBUS_LOGIN_ADAPTER (dbus_req->dbus_adapter)));
+}
+
 static gboolean
 _process_request (
-        TlmDbusObserver *self)
+        TlmRequestQueue *queue)
 {
-    g_return_val_if_fail (self && TLM_IS_DBUS_OBSERVER(self), FALSE);
+    TlmDbusObserver *self = queue->observer;
     GError *err = NULL;
     TlmRequest* req = NULL;
     TlmDbusRequest* dbus_req = NULL;
     TlmSeat *seat = NULL;
+    gboolean ret = FALSE;
 
-    self->priv->request_id = 0;
+    queue->process_id = 0;
+    if (queue->active)
+        return FALSE;
 
-    if (!self->priv->active_request) {
-        gboolean ret = FALSE;
+    req = g_queue_pop_head (queue->pending);
+    if (!req) {
+        DBG ("request queue of seat %s is empty", queue->seat_id);
+        _queue_next (queue);
+        return FALSE;
+    }
+    dbus_req = req->dbus_request;
+    if (!_is_request_supported (self, dbus_req->type)) {
+        WARN ("Request not supported -- req-type %d flags %d",
+                dbus_req->type, self->priv->enable_flags);
+        err = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
+                "Dbus request not supported");
+        goto _finished;
+    }
+    if (!_is_requester_authorized (self, dbus_req)) {
+        WARN ("requester is gone or no longer allowed on seat %s",
+                queue->seat_id);
+        err = TLM_GET_ERROR_FOR_ID (TLM_ERROR_PERMISSION_DENIED,
+                "Requester not authorized");
+        goto _finished;
+    }
 
-        req = g_queue_pop_head (self->priv->request_queue);
-        if (!req) {
-            DBG ("request queue is empty");
-            goto _finished;
-        }
-        dbus_req = req->dbus_request;
-        if (!_is_request_supported (self, dbus_req->type)) {
-            WARN ("Request not supported -- req-type %d flags %d",
-                    dbus_req->type, self->priv->enable_flags);
-            err = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_NOT_SUPPORTED,
-                    "Dbus request not supported");
-            goto _finished;
-        }
+    seat = self->priv->seat;
+    if (!seat && self->priv->manager)
+        seat = tlm_manager_get_seat (self->priv->manager, queue->seat_id);
+    if (!seat) {
+        WARN ("Cannot find the seat");
+        err = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SEAT_NOT_FOUND,
+                "Seat not found");
+        goto _finished;
+    }
 
-        seat = self->priv->seat;
-        if (!seat && self->priv->manager) {
-            seat = tlm_manager_get_seat (self->priv->manager,
-                    dbus_req->seat_id);
-            req->seat = seat;
-            /* NOTE: When no seat is set at dbus object creation time,
-             * seat is connected on per dbus request basis and then
-             * disconnected when the dbus request is completed or aborted */
-            if (seat) {
-                _connect_seat (self, seat);
-                g_object_weak_ref (G_OBJECT (seat),
-                        (GWeakNotify)_on_seat_dispose, self);
-            }
-        }
+    _queue_attach_seat (queue, seat);
+    queue->active = req;
+    if (dbus_req->type != TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
+        tlm_seat_set_login_requested_at (seat, req->received_at);
+    queue->processing = TRUE;
+    g_object_ref (self);
+    switch(dbus_req->type) {
+    case TLM_DBUS_REQUEST_TYPE_LOGIN_USER:
+        ret = tlm_seat_create_session (seat, NULL, dbus_req->username,
+                dbus_req->password, dbus_req->environment);
+        break;
+    case TLM_DBUS_REQUEST_TYPE_LOGOUT_USER:
+        ret = tlm_seat_terminate_session (seat);
+        break;
+    case TLM_DBUS_REQUEST_TYPE_SWITCH_USER:
+        ret = tlm_seat_switch_user (seat, NULL, dbus_req->username,
+                dbus_req->password, dbus_req->environment);
+        break;
+    }
+    if (!self->priv->queues) {
+        /* observer was disposed by the seat, along with the queue */
+        g_object_unref (self);
+        return FALSE;
+    }
+    g_object_unref (self);
+    queue->processing = FALSE;
+    /* a failing seat has normally completed the request already through
+     * the session-error signal */
+    if (!ret && queue->active == req) {
+        _dispose_request (req);
+        queue->active = NULL;
+    }
+    _queue_next (queue);
+    return FALSE;
 
-        if (!seat) {
-            WARN ("Cannot find the seat");
-            err = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SEAT_NOT_FOUND,
-                    "Seat not found");
-            goto _finished;
-        }
+_finished:
+    _complete_request (req, err);
+    _queue_next (queue);
+    return FALSE;
+}
 
-        self->priv->active_request = req;
-        switch(dbus_req->type) {
-        case TLM_DBUS_REQUEST_TYPE_LOGIN_USER:
-            ret = tlm_seat_create_session (seat, NULL, dbus_req->username,
-                    dbus_req->password, dbus_req->environment);
-            break;
-        case TLM_DBUS_REQUEST_TYPE_LOGOUT_USER:
-            ret = tlm_seat_terminate_session (seat);
-            break;
-        case TLM_DBUS_REQUEST_TYPE_SWITCH_USER:
-            ret = tlm_seat_switch_user (seat, NULL, dbus_req->username,
-                    dbus_req->password, dbus_req->environment);
-            break;
-        }
-        if (!ret) {
-            _dispose_request (self, self->priv->active_request);
-            self->priv->active_request = NULL;
+/* Completes the active request with @error and rolls back the login or
+ * switch it started; the queue resumes once the seat is done with it */
+static void
+_abort_active_request (
+        TlmRequestQueue *queue,
+        GError *error)
+{
+    TlmDbusObserver *self = queue->observer;
+    TlmRequest *req = queue->active;
+    gboolean rollback, aborted;
+
+    queue->active = NULL;
+    rollback = req->dbus_request &&
+        req->dbus_request->type != TLM_DBUS_REQUEST_TYPE_LOGOUT_USER;
+    _complete_request (req, error);
+
+    if (rollback && queue->seat) {
+        queue->aborting = TRUE;
+        queue->processing = TRUE;
+        g_object_ref (self);
+        aborted = tlm_seat_abort_session (queue->seat);
+        if (!self->priv->queues) {
+            /* observer was disposed by the seat, along with the queue */
+            g_object_unref (self);
+            return;
         }
+        g_object_unref (self);
+        queue->processing = FALSE;
+        if (!aborted)
+            queue->aborting = FALSE;
     }
+    _queue_next (queue);
+}
 
-_finished:
-    if (req && err) {
-        _complete_request (self, req, err);
+static gboolean
+_on_request_deadline (
+        TlmRequest *request)
+{
+    TlmRequestQueue *queue = request->queue;
+    GError *error = NULL;
+
+    request->deadline_id = 0;
+    WARN ("request type %d on seat %s timed out",
+            request->dbus_request->type, queue->seat_id);
+    error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_TIMEOUT,
+            "Dbus request timed out");
+
+    if (queue->active == request) {
+        _abort_active_request (queue, error);
+    } else {
+        g_queue_remove (queue->pending, request);
+        _complete_request (request, error);
+        _queue_next (queue);
+    }
+    return FALSE;
+}
+
+/* Seconds @request may take, from its environment or else the seat
+ * configuration. The environment entry is not passed on to the session. */
+static guint
+_get_request_timeout (
+        TlmDbusObserver *self,
+        TlmDbusRequest *request,
+        const gchar *seat_id)
+{
+    TlmSeat *seat = self->priv->seat;
+    const gchar *value = NULL;
+    guint64 timeout = 0;
+    gchar *end = NULL;
+
+    if (request->environment)
+        value = g_hash_table_lookup (request->environment,
+                TLM_DBUS_REQUEST_TIMEOUT_KEY);
+    if (value) {
+        timeout = g_ascii_strtoull (value, &end, 10);
+        if (end == value || *end != '\0' || timeout > G_MAXUINT) {
+            WARN ("Invalid %s '%s'", TLM_DBUS_REQUEST_TIMEOUT_KEY, value);
+            timeout = 0;
+            value = NULL;
+        }
+        g_hash_table_remove (request->environment,
+                TLM_DBUS_REQUEST_TIMEOUT_KEY);
+        if (value)
+            return (guint) timeout;
     }
 
-    return self->priv->active_request != NULL ? FALSE : TRUE;
+    if (!seat && self->priv->manager)
+        seat = tlm_manager_get_seat (self->priv->manager, seat_id);
+    return seat ? tlm_seat_get_request_timeout (seat) : 0;
 }
 
 static void
-_process_next_request_in_idle (
-        TlmDbusObserver *self)
+_queue_next (
+        TlmRequestQueue *queue)
+{
+    if (queue->active || queue->process_id || queue->processing ||
+        queue->aborting)
+        return;
+
+    if (g_queue_is_empty (queue->pending)) {
+        DBG ("request queue of seat %s drained", queue->seat_id);
+        g_hash_table_remove (queue->observer->priv->queues, queue->seat_id);
+        return;
+    }
+    DBG ("request queue of seat %s has request(s) to be processed",
+            queue->seat_id);
+    queue->process_id = g_idle_add ((GSourceFunc)_process_request, queue);
+}
+
+static gboolean
+_supersedes (
+        TlmDbusRequestType later,
+        TlmDbusRequestType earlier)
 {
-    if (!self->priv->request_id &&
-        !g_queue_is_empty (self->priv->request_queue)) {
-        DBG ("request queue has request(s) to be processed");
-        self->priv->request_id = g_idle_add ((GSourceFunc)_process_request,
-                self);
+    switch (later) {
+    case TLM_DBUS_REQUEST_TYPE_LOGIN_USER:
+        return earlier == TLM_DBUS_REQUEST_TYPE_LOGIN_USER;
+    case TLM_DBUS_REQUEST_TYPE_LOGOUT_USER:
+        return earlier == TLM_DBUS_REQUEST_TYPE_LOGOUT_USER;
+    case TLM_DBUS_REQUEST_TYPE_SWITCH_USER:
+        /* switching creates the session if there is none to replace */
+        return earlier != TLM_DBUS_REQUEST_TYPE_LOGOUT_USER;
     }
+    return FALSE;
 }
 
 static void
@@ -498,8 +768,122 @@ _add_request (
         TlmDbusObserver *self,
         TlmRequest *request)
 {
-    g_queue_push_tail (self->priv->request_queue, request);
-    _process_next_request_in_idle (self);
+    TlmDbusRequestType type = request->dbus_request->type;
+    TlmRequestQueue *queue = NULL;
+    const gchar *seat_id = NULL;
+    GList *elem, *next;
+    GError *error = NULL;
+    guint timeout;
+
+    if (self->priv->seat)
+        seat_id = tlm_seat_get_id (self->priv->seat);
+    if (!seat_id)
+        seat_id = request->dbus_request->seat_id;
+    if (!seat_id)
+        seat_id = "";
+
+    queue = g_hash_table_lookup (self->priv->queues, seat_id);
+    if (!queue) {
+        queue = _queue_new (self, seat_id);
+        g_hash_table_insert (self->priv->queues, queue->seat_id, queue);
+    }
+    request->queue = queue;
+
+    timeout = _get_request_timeout (self, request->dbus_request, seat_id);
+    if (timeout)
+        request->deadline_id = g_timeout_add_seconds (timeout,
+                (GSourceFunc)_on_request_deadline, request);
+
+    /* only the outcome of the latest request matters for a seat, so the
+     * callers of pending requests it replaces are told so right away; the
+     * active request is left to complete */
+    elem = g_queue_peek_head_link (queue->pending);
+    while (elem) {
+        TlmRequest *pending = elem->data;
+        next = g_list_next (elem);
+        if (_supersedes (type, pending->dbus_request->type)) {
+            DBG ("request type %d superseded on seat %s",
+                    pending->dbus_request->type, queue->seat_id);
+            g_queue_delete_link (queue->pending, elem);
+            error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_SUPERSEDED,
+                    "Dbus request superseded");
+            _complete_request (pending, error);
+        }
+        elem = next;
+    }
+
+    /* logout goes ahead of pending logins and switches */
+    elem = NULL;
+    if (type == TLM_DBUS_REQUEST_TYPE_LOGOUT_USER) {
+        for (elem = g_queue_peek_head_link (queue->pending); elem;
+             elem = g_list_next (elem)) {
+            TlmRequest *pending = elem->data;
+            if (pending->dbus_request->type !=
+                    TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
+                break;
+        }
+    }
+    if (elem)
+        g_queue_insert_before (queue->pending, elem, request);
+    else
+        g_queue_push_tail (queue->pending, request);
+
+    _queue_next (queue);
+}
+
+/* Resumes a queue that waited for the seat to get rid of an aborted
+ * session, returns FALSE if it was not waiting */
+static gboolean
+_finish_abort (
+        TlmDbusObserver *self,
+        GObject *seat)
+{
+    TlmRequestQueue *queue = g_hash_table_lookup (self->priv->queues,
+            tlm_seat_get_id (TLM_SEAT (seat)));
+
+    if (!queue || !queue->aborting)
+        return FALSE;
+
+    DBG ("aborted session gone on seat %s", queue->seat_id);
+    queue->aborting = FALSE;
+    _queue_next (queue);
+    return TRUE;
+}
+
+static TlmRequestQueue *
+_active_queue_for_seat (
+        TlmDbusObserver *self,
+        GObject *seat)
+{
+    TlmRequestQueue *queue = g_hash_table_lookup (self->priv->queues,
+            tlm_seat_get_id (TLM_SEAT (seat)));
+
+    if (!queue || !queue->active || !queue->active->dbus_request)
+        return NULL;
+    return queue;
+}
+
+static void
+_handle_seat_session_authenticated (
+        TlmDbusObserver *self,
+        const gchar *seat_id,
+        GObject *seat)
+{
+    TlmRequestQueue *queue = NULL;
+
+    DBG ("self %p seat %p", self, seat);
+
+    g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
+    g_return_if_fail (seat && TLM_IS_SEAT(seat));
+
+    /* progress of login/switch jobs */
+    queue = _active_queue_for_seat (self, seat);
+    if (!queue ||
+        queue->active->dbus_request->type == TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
+        return;
+
+    tlm_dbus_login_adapter_request_authenticated (
+            queue->active->dbus_request);
 }
 
 static void
@@ -508,6 +892,9 @@ _handle_seat_session_created (
         const gchar *seat_id,
         GObject *seat)
 {
+    TlmRequestQueue *queue = NULL;
+    TlmRequest *req = NULL;
+
     DBG ("self %p seat %p", self, seat);
 
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
@@ -515,16 +902,16 @@ _handle_seat_session_created (
 
     /* Login/switch request should only be completed on session created
      * signal from seat */
-    if (!self->priv->active_request ||
-        !self->priv->active_request->dbus_request ||
-        self->priv->active_request->dbus_request->type ==
-                TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
+    queue = _active_queue_for_seat (self, seat);
+    if (!queue ||
+        queue->active->dbus_request->type == TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
         return;
 
-    _complete_request (self, self->priv->active_request, NULL);
-    self->priv->active_request = NULL;
+    req = queue->active;
+    queue->active = NULL;
+    _complete_request (req, NULL);
 
-    _process_next_request_in_idle (self);
+    _queue_next (queue);
 }
 
 static gboolean
@@ -533,26 +920,35 @@ _handle_seat_session_terminated (
         const gchar *seat_id,
         GObject *seat)
 {
+    TlmRequestQueue *queue = NULL;
+    TlmRequest *req = NULL;
+
     DBG ("self %p seat %p", self, seat);
 
     g_return_val_if_fail (self && TLM_IS_DBUS_OBSERVER(self), FALSE);
     g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
 
+    if (_finish_abort (self, seat))
+        return FALSE;
+
     /* Logout request should only be completed on session terminated signal
      * from seat */
-    if (!self->priv->active_request ||
-        !self->priv->active_request->dbus_request ||
-        self->priv->active_request->dbus_request->type !=
-                TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
+    queue = _active_queue_for_seat (self, seat);
+    if (!queue ||
+        queue->active->dbus_request->type != TLM_DBUS_REQUEST_TYPE_LOGOUT_USER)
         return FALSE;
 
-    _disconnect_dbus_adapter (self, TLM_DBUS_LOGIN_ADAPTER (
-            self->priv->active_request->dbus_request->dbus_adapter));
+    req = queue->active;
+    queue->active = NULL;
+    /* a user logged out through its own socket makes no further requests
+     * there, while the root socket keeps serving the connection, e.g. for
+     * the other entries of a batch */
+    if (self->priv->seat)
+        _disconnect_dbus_adapter (self, TLM_DBUS_LOGIN_ADAPTER (
+                req->dbus_request->dbus_adapter));
+    _complete_request (req, NULL);
 
-    _complete_request (self, self->priv->active_request, NULL);
-    self->priv->active_request = NULL;
-
-    _process_next_request_in_idle (self);
+    _queue_next (queue);
 
     return FALSE;
 }
@@ -563,20 +959,28 @@ _handle_seat_session_error (
         TlmError error_code,
         GObject *seat)
 {
-    DBG ("self %p seat %p", self, seat);
+    TlmRequestQueue *queue = NULL;
+    TlmRequest *req = NULL;
     GError *error = NULL;
 
+    DBG ("self %p seat %p", self, seat);
+
     g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
     g_return_if_fail (seat && TLM_IS_SEAT(seat));
 
-    if (!self->priv->active_request)
+    if (_finish_abort (self, seat))
+        return;
+
+    queue = _active_queue_for_seat (self, seat);
+    if (!queue)
         return;
 
+    req = queue->active;
+    queue->active = NULL;
     error = TLM_GET_ERROR_FOR_ID (error_code, "Dbus request failed");
-    _complete_request (self, self->priv->active_request, error);
-    self->priv->active_request = NULL;
+    _complete_request (req, error);
 
-    _process_next_request_in_idle (self);
+    _queue_next (queue);
 }
 
 static void
@@ -587,6 +991,7 @@ _handle_dbus_login_user (
         const gchar *password,
         GVariant *environment,
         GDBusMethodInvocation *invocation,
+        guint job_id,
         GObject *dbus_adapter)
 {
     TlmDbusRequest *request = NULL;
@@ -597,7 +1002,8 @@ _handle_dbus_login_user (
     request = tlm_dbus_utils_create_request (dbus_adapter, invocation,
             TLM_DBUS_REQUEST_TYPE_LOGIN_USER, seat_id, username, password,
             environment);
-    _add_request (self, _create_request (self, request, NULL));
+    request->job_id = job_id;
+    _add_request (self, _create_request (request));
 }
 
 static void
@@ -614,7 +1020,7 @@ _handle_dbus_logout_user (
 
     request = tlm_dbus_utils_create_request (dbus_adapter, invocation,
             TLM_DBUS_REQUEST_TYPE_LOGOUT_USER, seat_id, NULL, NULL, NULL);
-    _add_request (self, _create_request (self, request, NULL));
+    _add_request (self, _create_request (request));
 }
 
 static void
@@ -625,6 +1031,7 @@ _handle_dbus_switch_user (
         const gchar *password,
         GVariant *environment,
         GDBusMethodInvocation *invocation,
+        guint job_id,
         GObject *dbus_adapter)
 {
     TlmDbusRequest *request = NULL;
@@ -635,21 +1042,97 @@ _handle_dbus_switch_user (
     request = tlm_dbus_utils_create_request (dbus_adapter, invocation,
             TLM_DBUS_REQUEST_TYPE_SWITCH_USER, seat_id, username, password,
             environment);
-    _add_request (self, _create_request (self, request, NULL));
+    request->job_id = job_id;
+    _add_request (self, _create_request (request));
+}
+
+static void
+_handle_dbus_queue_request (
+        TlmDbusObserver *self,
+        TlmDbusRequest *request,
+        GObject *dbus_adapter)
+{
+    DBG ("seat id %s, type %d", request->seat_id, request->type);
+    g_return_if_fail (self && TLM_IS_DBUS_OBSERVER(self));
+
+    /* entries of a batch go to the queues of their seats, which run in
+     * parallel */
+    _add_request (self, _create_request (request));
+}
+
+static GVariant *
+_handle_dbus_get_timelines (
+        TlmDbusObserver *self,
+        const gchar *seat_id,
+        GObject *dbus_adapter)
+{
+    GVariantBuilder builder;
+
+    DBG ("seat id %s", seat_id);
+    g_return_val_if_fail (self && TLM_IS_DBUS_OBSERVER(self), NULL);
+
+    if (self->priv->manager)
+        return tlm_manager_get_timelines (self->priv->manager, seat_id);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssa(sx))"));
+    if (self->priv->seat)
+        tlm_seat_add_timelines (self->priv->seat, &builder);
+    return g_variant_builder_end (&builder);
+}
+
+static gboolean
+_handle_dbus_cancel_request (
+        TlmDbusObserver *self,
+        const gchar *seat_id,
+        GObject *dbus_adapter)
+{
+    TlmRequestQueue *queue = NULL;
+    TlmRequest *req = NULL;
+    GError *error = NULL;
+    GList *elem, *next;
+
+    DBG ("seat id %s", seat_id);
+    g_return_val_if_fail (self && TLM_IS_DBUS_OBSERVER(self), FALSE);
+
+    if (self->priv->seat)
+        seat_id = tlm_seat_get_id (self->priv->seat);
+    queue = g_hash_table_lookup (self->priv->queues, seat_id);
+    if (!queue)
+        return TRUE;
+
+    /* only the requests made through the calling connection */
+    elem = g_queue_peek_head_link (queue->pending);
+    while (elem) {
+        req = elem->data;
+        next = g_list_next (elem);
+        if (req->dbus_request->dbus_adapter == dbus_adapter) {
+            g_queue_delete_link (queue->pending, elem);
+            error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_CANCELLED,
+                    "Dbus request cancelled");
+            _complete_request (req, error);
+        }
+        elem = next;
+    }
+
+    if (queue->active && queue->active->dbus_request &&
+        queue->active->dbus_request->dbus_adapter == dbus_adapter) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_DBUS_REQ_CANCELLED,
+                "Dbus request cancelled");
+        _abort_active_request (queue, error);
+    } else {
+        _queue_next (queue);
+    }
+
+    return TRUE;
 }
 
 static void
 _stop_dbus_server (TlmDbusObserver *self)
 {
     DBG("self %p", self);
-    _clear_request (self->priv->active_request, self);
-    self->priv->active_request = NULL;
-
-    if (self->priv->request_queue) {
-        g_queue_foreach (self->priv->request_queue,
-                           (GFunc) _clear_request, self);
-        g_queue_free (self->priv->request_queue);
-        self->priv->request_queue = NULL;
+    if (self->priv->queues) {
+        g_hash_table_unref (self->priv->queues);
+        self->priv->queues = NULL;
     }
 
     if (self->priv->dbus_server) {
@@ -677,11 +1160,6 @@ tlm_dbus_observer_dispose (GObject *object)
     TlmDbusObserver *self = TLM_DBUS_OBSERVER(object);
     DBG("disposing dbus_observer: %p", self);
 
-    if (self->priv->request_id) {
-        g_source_remove (self->priv->request_id);
-        self->priv->request_id = 0;
-    }
-
     _stop_dbus_server (self);
     if (self->priv->manager) {
         g_object_weak_unref (G_OBJECT (self->priv->manager),
@@ -726,9 +1204,8 @@ tlm_dbus_observer_init (TlmDbusObserver *dbus_observer)
     priv->manager = NULL;
     priv->seat = NULL;
     priv->enable_flags = DBUS_OBSERVER_ENABLE_ALL;
-    priv->request_queue = g_queue_new ();
-    priv->request_id = 0;
-    priv->active_request = NULL;
+    priv->queues = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+            (GDestroyNotify) _queue_free);
     dbus_observer->priv = priv;
 }
 
@@ -773,3 +1250,30 @@ tlm_dbus_observer_new (
             dbus_observer);
     return dbus_observer;
 }
+
+/* Changes which user, besides tlm itself, may connect to the observer socket.
+ * Connections already established are kept until
+ * tlm_dbus_observer_close_unauthorized() is called, so that a request of the
+ * previous user can still be replied. */
+void
+tlm_dbus_observer_set_uid (
+        TlmDbusObserver *self,
+        uid_t uid)
+{
+    g_return_if_fail (self && TLM_IS_DBUS_OBSERVER (self));
+
+    if (self->priv->dbus_server)
+        tlm_dbus_server_p2p_set_uid (
+                TLM_DBUS_SERVER_P2P (self->priv->dbus_server), uid);
+}
+
+void
+tlm_dbus_observer_close_unauthorized (
+        TlmDbusObserver *self)
+{
+    g_return_if_fail (self && TLM_IS_DBUS_OBSERVER (self));
+
+    if (self->priv->dbus_server)
+        tlm_dbus_server_p2p_close_unauthorized (
+                TLM_DBUS_SERVER_P2P (self->priv->dbus_server));
+}
@@ -62,7 +62,10 @@ typedef enum {
     DBUS_OBSERVER_ENABLE_LOGIN_USER = 0x01,
     DBUS_OBSERVER_ENABLE_LOGOUT_USER = 0x02,
     DBUS_OBSERVER_ENABLE_SWITCH_USER = 0x04,
-    DBUS_OBSERVER_ENABLE_ALL = 0x0F,
+    DBUS_OBSERVER_ENABLE_GET_TIMELINES = 0x08,
+    DBUS_OBSERVER_ENABLE_CANCEL_REQUEST = 0x10,
+    DBUS_OBSERVER_ENABLE_BATCH = 0x20,
+    DBUS_OBSERVER_ENABLE_ALL = 0x3F,
 } DbusObserverEnableFlags;
 
 GType tlm_dbus_observer_get_type(void);
@@ -75,6 +78,15 @@ tlm_dbus_observer_new (
         uid_t uid,
         DbusObserverEnableFlags enable_flags);
 
+void
+tlm_dbus_observer_set_uid (
+        TlmDbusObserver *self,
+        uid_t uid);
+
+void
+tlm_dbus_observer_close_unauthorized (
+        TlmDbusObserver *self);
+
 G_END_DECLS
 
 #endif /* _TLM_DBUS_OBSERVER_H */
@@ -32,6 +32,7 @@
 #include "tlm-config.h"
 #include "tlm-config-general.h"
 #include "tlm-config-seat.h"
+#include "tlm-user-info.h"
 #include "tlm-dbus-observer.h"
 #include "tlm-utils.h"
 #include "config.h"
@@ -60,14 +61,20 @@ struct _TlmManagerPrivate
     GDBusConnection *connection;
     TlmConfig *config;
     GHashTable *seats; /* { gchar*:TlmSeat* } */
+    GHashTable *seat_paths; /* { gchar*:gchar* } all known seats */
+    GHashTable *seat_watches; /* { gchar*:TlmSeatWatchClosure* } */
     TlmDbusObserver *dbus_observer; /* dbus observer accessed by root only */
     TlmAccountPlugin *account_plugin;
+    gchar *account_plugin_name;
     GList *auth_plugins;
     gboolean is_started;
     gchar *initial_user;
 
     guint seat_added_id;
     guint seat_removed_id;
+    GCancellable *sync_cancellable; /* set while ListSeats is pending */
+    guint sync_retry_id;
+    guint sync_attempts;
 };
 
 enum {
@@ -86,13 +93,27 @@ enum {
 
 static guint signals[SIG_MAX];
 
+/* owned by seat_watches, so the manager outlives it and its source */
 typedef struct _TlmSeatWatchClosure
 {
     TlmManager *manager;
     gchar *seat_id;
     gchar *seat_path;
+    gchar **watch_items;
+    guint source_id;
 } TlmSeatWatchClosure;
 
+static void
+_seat_watch_closure_free (TlmSeatWatchClosure *closure)
+{
+    if (closure->source_id)
+        g_source_remove (closure->source_id);
+    g_free (closure->seat_id);
+    g_free (closure->seat_path);
+    g_strfreev (closure->watch_items);
+    g_free (closure);
+}
+
 static void
 _unref_auth_plugins (gpointer data)
 {
@@ -121,8 +142,19 @@ tlm_manager_dispose (GObject *self)
         g_hash_table_unref (manager->priv->seats);
         manager->priv->seats = NULL;
     }
+    if (manager->priv->seat_watches) {
+        g_hash_table_unref (manager->priv->seat_watches);
+        manager->priv->seat_watches = NULL;
+    }
+    if (manager->priv->seat_paths) {
+        g_hash_table_unref (manager->priv->seat_paths);
+        manager->priv->seat_paths = NULL;
+    }
 
     g_clear_object (&manager->priv->account_plugin);
+    g_clear_string (&manager->priv->account_plugin_name);
+    if (manager->priv->config)
+        g_signal_handlers_disconnect_by_data (manager->priv->config, manager);
     g_clear_object (&manager->priv->config);
 
     if (manager->priv->auth_plugins) {
@@ -337,6 +369,8 @@ _load_accounts_plugin (TlmManager *self, const gchar *name)
 
     self->priv->account_plugin =  TLM_ACCOUNT_PLUGIN(
         _load_plugin_file (plugin_file, name, "account", accounts_config));
+    g_free (self->priv->account_plugin_name);
+    self->priv->account_plugin_name = g_strdup (name);
 
     g_free (plugin_file);
 }
@@ -408,22 +442,99 @@ _load_auth_plugins (TlmManager *self)
 
 }
 
+static void
+_apply_user_cache_ttl (TlmManager *manager)
+{
+    tlm_user_info_cache_set_ttl (
+            tlm_config_get_uint (manager->priv->config, TLM_CONFIG_GENERAL,
+                                 TLM_CONFIG_GENERAL_USER_CACHE_TTL, 60));
+    tlm_user_info_cache_invalidate ();
+}
+
+static void
+_apply_log_debug (TlmManager *manager)
+{
+    tlm_log_set_debug (tlm_config_get_boolean (manager->priv->config,
+                                               TLM_CONFIG_GENERAL,
+                                               TLM_CONFIG_GENERAL_LOG_DEBUG,
+                                               TRUE));
+}
+
+static gboolean
+_strv_equal (gchar **a, gchar **b)
+{
+    for (; *a && *b; a++, b++) {
+        if (g_strcmp0 (*a, *b) != 0)
+            return FALSE;
+    }
+    return *a == *b;
+}
+
+static void
+_apply_seat_config (TlmManager *manager, const gchar *seat_id);
+
+static void
+_on_config_changed (TlmManager *manager, gchar **groups, TlmConfig *config)
+{
+    TlmManagerPrivate *priv = TLM_MANAGER_PRIV (manager);
+    gboolean general = tlm_config_group_changed (groups, TLM_CONFIG_GENERAL);
+    const gchar *plugin_name;
+    GList *seat_ids, *item;
+
+    plugin_name = tlm_config_get_string_default (priv->config,
+            TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN, "default");
+    if (!plugin_name)
+        plugin_name = "default";
+    if (g_strcmp0 (plugin_name, priv->account_plugin_name) != 0 ||
+        tlm_config_group_changed (groups, plugin_name)) {
+        DBG ("reloading accounts plugin '%s'", plugin_name);
+        g_clear_object (&priv->account_plugin);
+        _load_accounts_plugin (manager, plugin_name);
+    }
+
+    if (general) {
+        _apply_user_cache_ttl (manager);
+        _apply_log_debug (manager);
+    }
+
+    if (!priv->is_started)
+        return;
+
+    /* the seats follow their own changes, activation and watches are
+     * handled here */
+    seat_ids = g_hash_table_get_keys (priv->seat_paths);
+    for (item = seat_ids; item; item = item->next) {
+        gchar *seat_id = g_strdup (item->data);
+        if (general || tlm_config_group_changed (groups, seat_id))
+            _apply_seat_config (manager, seat_id);
+        g_free (seat_id);
+    }
+    g_list_free (seat_ids);
+}
+
 static void
 tlm_manager_init (TlmManager *manager)
 {
     GError *error = NULL;
     TlmManagerPrivate *priv = TLM_MANAGER_PRIV (manager);
     
-    priv->config = tlm_config_new ();
-    priv->connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+    priv->config = tlm_config_new_writing_cache ();
+    priv->connection = tlm_utils_logind_bus_get_sync (
+            tlm_config_get_string (priv->config, TLM_CONFIG_GENERAL,
+                                   TLM_CONFIG_GENERAL_LOGIND_ADDRESS),
+            &error);
     if (!priv->connection) {
-        CRITICAL ("error getting system bus: %s", error->message);
+        CRITICAL ("error getting logind bus: %s", error->message);
         g_error_free (error);
         return;
     }
 
     priv->seats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
                                          (GDestroyNotify)g_object_unref);
+    priv->seat_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                              g_free);
+    priv->seat_watches = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, (GDestroyNotify) _seat_watch_closure_free);
 
     priv->account_plugin = NULL;
     priv->auth_plugins = NULL;
@@ -436,6 +547,10 @@ tlm_manager_init (TlmManager *manager)
                                                           TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN,
                                                           "default"));
     _load_auth_plugins (manager);
+    _apply_user_cache_ttl (manager);
+    _apply_log_debug (manager);
+    g_signal_connect_swapped (priv->config, "changed",
+                              G_CALLBACK (_on_config_changed), manager);
 
     /* delete tlm runtime directory */
     tlm_utils_delete_dir (TLM_DBUS_SOCKET_PATH);
@@ -451,10 +566,8 @@ _prepare_user_login_cb (TlmSeat *seat, const gchar *user_name, gpointer user_dat
 
     g_return_if_fail (user_data && TLM_IS_MANAGER(manager));
 
-    if (tlm_config_get_boolean (manager->priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_PREPARE_DEFAULT,
-                                FALSE)) {
+    if (tlm_config_get_seat_config (manager->priv->config,
+                                    tlm_seat_get_id (seat))->prepare_default) {
         DBG ("prepare for login for '%s'", user_name);
         if (!tlm_manager_setup_guest_user (manager, user_name)) {
             WARN ("failed to prepare for '%s'", user_name);
@@ -469,10 +582,8 @@ _prepare_user_logout_cb (TlmSeat *seat, const gchar *user_name, gpointer user_da
 
     g_return_if_fail (user_data && TLM_IS_MANAGER(manager));
 
-    if (tlm_config_get_boolean (manager->priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_PREPARE_DEFAULT,
-                                FALSE)) {
+    if (tlm_config_get_seat_config (manager->priv->config,
+                                    tlm_seat_get_id (seat))->prepare_default) {
         DBG ("prepare for logout for '%s'", user_name);
         if (!tlm_account_plugin_cleanup_guest_user (
                 manager->priv->account_plugin, user_name, FALSE)) {
@@ -503,10 +614,7 @@ _create_seat (TlmManager *manager,
     g_hash_table_insert (priv->seats, g_strdup (seat_id), seat);
     g_signal_emit (manager, signals[SIG_SEAT_ADDED], 0, seat, NULL);
 
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_AUTO_LOGIN,
-                                TRUE) ||
+    if (tlm_config_get_seat_config (priv->config, seat_id)->auto_login ||
         priv->initial_user) {
         DBG("intial auto-login for user '%s'", priv->initial_user);
         if (!tlm_seat_create_session (seat,
@@ -538,12 +646,19 @@ _seat_watch_cb (
 
     DBG ("seat %s notify for %s", closure->seat_id, watch_item);
 
-    if (is_final) {
-        _create_seat (closure->manager, closure->seat_id, closure->seat_path);
-        g_object_unref (closure->manager);
-        g_free (closure->seat_id);
-        g_free (closure->seat_path);
-        g_free (closure);
+    /* a final notification while the watch is being set up is handled
+     * by _add_seat() */
+    if (is_final && closure->source_id) {
+        TlmManager *manager = closure->manager;
+        gchar *seat_id = g_strdup (closure->seat_id);
+        gchar *seat_path = g_strdup (closure->seat_path);
+
+        /* the source removes itself after the last watch fired */
+        closure->source_id = 0;
+        g_hash_table_remove (manager->priv->seat_watches, seat_id);
+        _create_seat (manager, seat_id, seat_path);
+        g_free (seat_id);
+        g_free (seat_path);
     }
 }
 
@@ -553,40 +668,33 @@ _add_seat (TlmManager *manager, const gchar *seat_id, const gchar *seat_path)
     g_return_if_fail (manager && TLM_IS_MANAGER (manager));
 
     TlmManagerPrivate *priv = TLM_MANAGER_PRIV (manager);
+    const TlmSeatConfig *seat_config = tlm_config_get_seat_config (
+            priv->config, seat_id);
+
+    g_hash_table_replace (priv->seat_paths, g_strdup (seat_id),
+                          g_strdup (seat_path));
+    g_hash_table_remove (priv->seat_watches, seat_id);
 
-    if (!tlm_config_get_boolean (priv->config,
-                                 seat_id,
-                                 TLM_CONFIG_SEAT_ACTIVE,
-                                 TRUE))
+    if (!seat_config->active || g_hash_table_contains (priv->seats, seat_id))
         return;
 
-    guint nwatch = tlm_config_get_uint (priv->config,
-                                        seat_id,
-                                        TLM_CONFIG_SEAT_NWATCH,
-                                        0);
-    if (nwatch) {
-        int x;
-        int watch_id = 0;
-        gchar **watch_items = g_new0 (gchar *, nwatch + 1);
-        for (x = 0; x < nwatch; x++) {
-          gchar *watchx = g_strdup_printf ("%s%u", TLM_CONFIG_SEAT_WATCHX, x);
-          watch_items[x] = (char *)tlm_config_get_string (
-              priv->config, seat_id, watchx);
-          g_free (watchx);
-        }
-        watch_items[nwatch] = NULL;
+    if (seat_config->watch_items[0]) {
         TlmSeatWatchClosure *watch_closure = 
             g_new0 (TlmSeatWatchClosure, 1);
-        watch_closure->manager = g_object_ref (manager);
+        watch_closure->manager = manager;
         watch_closure->seat_id = g_strdup (seat_id);
         watch_closure->seat_path = g_strdup (seat_path);
+        watch_closure->watch_items = g_strdupv (seat_config->watch_items);
 
-        watch_id = tlm_utils_watch_for_files (
-            (const gchar **)watch_items, _seat_watch_cb, watch_closure);
-        g_free (watch_items);
-        if (watch_id <= 0) {
+        watch_closure->source_id = tlm_utils_watch_for_files (
+            (const gchar **)watch_closure->watch_items, _seat_watch_cb,
+            watch_closure);
+        if (watch_closure->source_id == 0) {
             WARN ("Failed to add watch on seat %s", seat_id);
+            _seat_watch_closure_free (watch_closure);
         } else {
+            g_hash_table_insert (priv->seat_watches, g_strdup (seat_id),
+                                 watch_closure);
             return;
         }
     }
@@ -594,6 +702,63 @@ _add_seat (TlmManager *manager, const gchar *seat_id, const gchar *seat_path)
     _create_seat (manager, seat_id, seat_path);
 }
 
+static void
+_remove_seat (TlmManager *manager, const gchar *seat_id)
+{
+    TlmManagerPrivate *priv = TLM_MANAGER_PRIV (manager);
+
+    g_hash_table_remove (priv->seat_watches, seat_id);
+    if (g_hash_table_remove (priv->seats, seat_id))
+        g_signal_emit (manager, signals[SIG_SEAT_REMOVED], 0, seat_id, NULL);
+}
+
+static gboolean
+_deactivated_seat_terminated_cb (
+        TlmSeat *seat,
+        const gchar *seat_id,
+        TlmManager *manager)
+{
+    DBG ("seat %s deactivated", seat_id);
+    _remove_seat (manager, seat_id);
+    return TRUE;
+}
+
+static void
+_apply_seat_config (TlmManager *manager, const gchar *seat_id)
+{
+    TlmManagerPrivate *priv = TLM_MANAGER_PRIV (manager);
+    const TlmSeatConfig *seat_config = tlm_config_get_seat_config (
+            priv->config, seat_id);
+    TlmSeatWatchClosure *watch_closure = NULL;
+    TlmSeat *seat = NULL;
+    gchar *seat_path = NULL;
+
+    seat = g_hash_table_lookup (priv->seats, seat_id);
+    if (seat) {
+        /* reactivated, or deactivated again, before its session is gone */
+        g_signal_handlers_disconnect_by_func (seat,
+                _deactivated_seat_terminated_cb, manager);
+        if (seat_config->active)
+            return;
+        DBG ("deactivating seat %s", seat_id);
+        g_signal_connect_after (seat, "session-terminated",
+                G_CALLBACK (_deactivated_seat_terminated_cb), manager);
+        if (!tlm_seat_terminate_session (seat))
+            _remove_seat (manager, seat_id);
+        return;
+    }
+
+    /* re-arm a pending watch only if the watch items changed */
+    watch_closure = g_hash_table_lookup (priv->seat_watches, seat_id);
+    if (watch_closure && seat_config->active &&
+        _strv_equal (watch_closure->watch_items, seat_config->watch_items))
+        return;
+
+    seat_path = g_strdup (g_hash_table_lookup (priv->seat_paths, seat_id));
+    _add_seat (manager, seat_id, seat_path);
+    g_free (seat_path);
+}
+
 static void
 _manager_hashify_seats (TlmManager *manager, GVariant *hash_map)
 {
@@ -606,35 +771,65 @@ _manager_hashify_seats (TlmManager *manager, GVariant *hash_map)
     g_variant_iter_init (&iter, hash_map);
     while (g_variant_iter_next (&iter, "(so)", &id, &path)) {
         DBG("found seat %s:%s", id, path);
-        _add_seat (manager, id, path);
+        /* SeatNew may have been seen while the list was pending */
+        if (!g_hash_table_contains (manager->priv->seat_paths, id))
+            _add_seat (manager, id, path);
         g_free (id);
         g_free (path);
     }
 }
 
 static void
-_manager_sync_seats (TlmManager *manager)
+_manager_sync_seats (TlmManager *manager);
+
+static gboolean
+_manager_retry_sync_seats (gpointer user_data)
 {
+    TlmManager *manager = TLM_MANAGER (user_data);
+
+    manager->priv->sync_retry_id = 0;
+    _manager_sync_seats (manager);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_manager_on_seats_listed (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    TlmManager *manager = NULL;
     GError *error = NULL;
     GVariant *reply = NULL;
     GVariant *hash_map = NULL;
+    guint retries;
 
-    g_return_if_fail (manager && manager->priv->connection);
+    reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res,
+                                           &error);
+    if (!reply && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free (error);
+        return;
+    }
+
+    manager = TLM_MANAGER (user_data);
+    g_clear_object (&manager->priv->sync_cancellable);
 
-    reply = g_dbus_connection_call_sync (manager->priv->connection,
-                                         LOGIND_BUS_NAME,
-                                         LOGIND_OBJECT_PATH,
-                                         LOGIND_MANAGER_IFACE,
-                                         "ListSeats",
-                                         g_variant_new("()"),
-                                         G_VARIANT_TYPE_TUPLE,
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1,
-                                         NULL,
-                                         &error);
     if (!reply) {
-        WARN ("failed to get attached seats: %s", error->message);
+        retries = tlm_config_get_uint (manager->priv->config,
+                                       TLM_CONFIG_GENERAL,
+                                       TLM_CONFIG_GENERAL_LOGIND_RETRIES, 5);
+        if (manager->priv->sync_attempts > retries) {
+            WARN ("failed to get attached seats: %s", error->message);
+            g_error_free (error);
+            return;
+        }
+        DBG ("ListSeats attempt %u failed: %s", manager->priv->sync_attempts,
+             error->message);
         g_error_free (error);
+        /* logind might still be starting up */
+        manager->priv->sync_retry_id = g_timeout_add (
+                100 << MIN (manager->priv->sync_attempts, 4),
+                _manager_retry_sync_seats, manager);
         return;
     }
 
@@ -646,6 +841,45 @@ _manager_sync_seats (TlmManager *manager)
     g_variant_unref (hash_map);
 }
 
+static void
+_manager_sync_seats (TlmManager *manager)
+{
+    TlmManagerPrivate *priv = NULL;
+
+    g_return_if_fail (manager && manager->priv->connection);
+    priv = manager->priv;
+
+    priv->sync_attempts++;
+    priv->sync_cancellable = g_cancellable_new ();
+    g_dbus_connection_call (priv->connection,
+                            LOGIND_BUS_NAME,
+                            LOGIND_OBJECT_PATH,
+                            LOGIND_MANAGER_IFACE,
+                            "ListSeats",
+                            g_variant_new("()"),
+                            G_VARIANT_TYPE ("(a(so))"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            tlm_config_get_int (priv->config,
+                                    TLM_CONFIG_GENERAL,
+                                    TLM_CONFIG_GENERAL_LOGIND_TIMEOUT, 2000),
+                            priv->sync_cancellable,
+                            _manager_on_seats_listed,
+                            manager);
+}
+
+static void
+_manager_cancel_sync_seats (TlmManager *manager)
+{
+    if (manager->priv->sync_cancellable) {
+        g_cancellable_cancel (manager->priv->sync_cancellable);
+        g_clear_object (&manager->priv->sync_cancellable);
+    }
+    if (manager->priv->sync_retry_id) {
+        g_source_remove (manager->priv->sync_retry_id);
+        manager->priv->sync_retry_id = 0;
+    }
+}
+
 static void
 _manager_on_seat_added (GDBusConnection *connection,
                         const gchar *sender,
@@ -661,8 +895,7 @@ _manager_on_seat_added (GDBusConnection *connection,
     g_return_if_fail (manager);
     g_return_if_fail (params);
 
-    g_variant_get (params, "(&s&o)", &id, &path);
-    g_variant_unref (params);
+    g_variant_get (params, "(so)", &id, &path);
 
     DBG("Seat added: %s:%s", id, path);
 
@@ -688,16 +921,12 @@ _manager_on_seat_removed (GDBusConnection *connection,
     g_return_if_fail (manager);
     g_return_if_fail (params);
 
-    g_variant_get (params, "(&s&o)", &id, path);
-    g_variant_unref (params);
+    g_variant_get (params, "(so)", &id, &path);
 
     DBG("Seat removed: %s:%s", id, path);
 
-    if (!g_hash_table_contains (manager->priv->seats, id)) {
-        g_hash_table_remove (manager->priv->seats, id);
-        g_signal_emit (manager, signals[SIG_SEAT_REMOVED], 0, id, NULL);
-
-    } 
+    g_hash_table_remove (manager->priv->seat_paths, id);
+    _remove_seat (manager, id);
     g_free (id);
     g_free (path);
 }
@@ -764,8 +993,11 @@ tlm_manager_start (TlmManager *manager)
             g_free (id);
         }
     } else {
-        _manager_sync_seats (manager);
+        /* subscribe first so that no seat goes unnoticed while the list
+         * is pending */
         _manager_subscribe_seat_changes (manager);
+        manager->priv->sync_attempts = 0;
+        _manager_sync_seats (manager);
     }
 
     manager->priv->is_started = TRUE;
@@ -796,6 +1028,8 @@ tlm_manager_stop (TlmManager *manager)
     g_return_val_if_fail (manager && TLM_IS_MANAGER (manager), FALSE);
 
     _manager_unsubsribe_seat_changes (manager);
+    _manager_cancel_sync_seats (manager);
+    g_hash_table_remove_all (manager->priv->seat_watches);
 
     GHashTableIter iter;
     gpointer key, value;
@@ -859,18 +1093,38 @@ tlm_manager_get_seat (TlmManager *manager, const gchar *seat_id)
     return g_hash_table_lookup (manager->priv->seats, seat_id);
 }
 
+/* a(ssa(sx)) timelines of the latest logins on @seat_id, or on all the
+ * seats if @seat_id is NULL or empty */
+GVariant *
+tlm_manager_get_timelines (TlmManager *manager, const gchar *seat_id)
+{
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    gpointer value;
+
+    g_return_val_if_fail (manager && TLM_IS_MANAGER (manager), NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssa(sx))"));
+    if (seat_id && *seat_id) {
+        TlmSeat *seat = g_hash_table_lookup (manager->priv->seats, seat_id);
+        if (seat)
+            tlm_seat_add_timelines (seat, &builder);
+    } else {
+        g_hash_table_iter_init (&iter, manager->priv->seats);
+        while (g_hash_table_iter_next (&iter, NULL, &value))
+            tlm_seat_add_timelines (TLM_SEAT (value), &builder);
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
 void
 tlm_manager_sighup_received (TlmManager *manager)
 {
     g_return_if_fail (manager && TLM_IS_MANAGER (manager));
 
-    DBG ("sighup recvd. reload configuration and account plugin");
+    DBG ("sighup recvd. reload configuration");
+    /* changes are applied from the config's "changed" signal */
     tlm_config_reload (manager->priv->config);
-    g_clear_object (&manager->priv->account_plugin);
-    _load_accounts_plugin (manager,
-                           tlm_config_get_string_default (manager->priv->config,
-                                                          TLM_CONFIG_GENERAL,
-                                                          TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN,
-                                                          "default"));
 }
 
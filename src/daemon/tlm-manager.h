@@ -71,6 +71,9 @@ tlm_manager_setup_guest_user (TlmManager *manager, const gchar *name);
 TlmSeat *
 tlm_manager_get_seat (TlmManager *manager, const gchar *seat_id);
 
+GVariant *
+tlm_manager_get_timelines (TlmManager *manager, const gchar *seat_id);
+
 void
 tlm_manager_sighup_received (TlmManager *manager);
 
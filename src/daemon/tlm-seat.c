@@ -33,9 +33,12 @@
 
 #include "tlm-seat.h"
 #include "tlm-session-remote.h"
+#include "tlm-timeline.h"
 #include "tlm-log.h"
 #include "tlm-error.h"
 #include "tlm-utils.h"
+#include "tlm-cgroup.h"
+#include "tlm-user-info.h"
 #include "tlm-config-general.h"
 #include "tlm-dbus-observer.h"
 
@@ -56,6 +59,7 @@ static GParamSpec *pspecs[N_PROPERTIES];
 enum {
     SIG_PREPARE_USER_LOGIN,
     SIG_PREPARE_USER_LOGOUT,
+    SIG_SESSION_AUTHENTICATED,
     SIG_SESSION_CREATED,
     SIG_SESSION_TERMINATED,
     SIG_SESSION_ERROR,
@@ -78,10 +82,28 @@ struct _TlmSeatPrivate
     gboolean default_active;
     TlmSessionRemote *session;
     TlmDbusObserver *dbus_observer; /* dbus server accessed only by user who has
-    active session */
-    TlmDbusObserver *prev_dbus_observer;
+    active session, kept across sessions */
+    GQueue *sessiond_pool; /* idle, already connected sessiond processes */
+    guint pool_refill_id;
+    GCancellable *pool_refill; /* set while a pooled sessiond handshakes */
+    guint pool_refill_timeout_id;
+    GCancellable *pending_session; /* set while sessiond handshake is done */
+    gint64 login_requested_at;
+    TlmTimeline *timeline; /* login in progress */
+    GQueue *timelines; /* latest logins, newest last */
 };
 
+#define TLM_SEAT_TIMELINE_HISTORY 8
+#define TLM_SEAT_POOL_HANDSHAKE_TIMEOUT 5 /* seconds */
+
+typedef struct _SessionClosure
+{
+    TlmSeat *seat; /* weak, NULL once the seat is gone */
+    gchar *username;
+    gchar *password;
+    GHashTable *environment;
+} SessionClosure;
+
 typedef struct _DelayClosure
 {
     TlmSeat *seat;
@@ -95,6 +117,10 @@ static void
 _disconnect_session_signals (
         TlmSeat *seat);
 
+static void
+_revoke_dbus_observer (
+        TlmSeat *seat);
+
 static void
 _reset_next (TlmSeatPrivate *priv)
 {
@@ -107,6 +133,24 @@ _reset_next (TlmSeatPrivate *priv)
     }
 }
 
+static void
+_finish_timeline (TlmSeat *seat, const gchar *phase)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    if (!priv->timeline)
+        return;
+
+    if (priv->session)
+        tlm_session_remote_add_timeline (priv->session, priv->timeline);
+    tlm_timeline_mark (priv->timeline, phase);
+
+    g_queue_push_tail (priv->timelines, priv->timeline);
+    priv->timeline = NULL;
+    while (g_queue_get_length (priv->timelines) > TLM_SEAT_TIMELINE_HISTORY)
+        tlm_timeline_free (g_queue_pop_head (priv->timelines));
+}
+
 static void
 _handle_session_created (
         TlmSeat *self,
@@ -117,9 +161,24 @@ _handle_session_created (
 
     DBG ("sessionid: %s", sessionid);
 
+    _finish_timeline (self, TLM_PHASE_LOGIN_DONE);
     g_signal_emit (self, signals[SIG_SESSION_CREATED], 0, self->priv->id);
 
-    g_clear_object (&self->priv->prev_dbus_observer);
+    /* drop the clients of the previous user, if any */
+    if (self->priv->dbus_observer)
+        tlm_dbus_observer_close_unauthorized (self->priv->dbus_observer);
+}
+
+static void
+_handle_authenticated (
+        TlmSeat *self,
+        gpointer user_data)
+{
+    g_return_if_fail (self && TLM_IS_SEAT (self));
+
+    DBG ("seat %s", self->priv->id);
+    g_signal_emit (self, signals[SIG_SESSION_AUTHENTICATED], 0,
+            self->priv->id);
 }
 
 static void
@@ -140,6 +199,7 @@ _handle_session_terminated (
 
     TlmSeat *seat = TLM_SEAT(self);
     TlmSeatPrivate *priv = TLM_SEAT_PRIV(seat);
+    const TlmSeatConfig *seat_config = NULL;
     gboolean stop = FALSE;
 
     DBG ("seat %p session %p", self, priv->session);
@@ -154,23 +214,21 @@ _handle_session_terminated (
         DBG ("no relogin or switch user");
         return;
     }
-    g_clear_object (&priv->dbus_observer);
-
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_X11_SESSION,
-                                FALSE)) {
+    /* on switch, the previous user keeps its connections until the next
+     * session is created so that a switch requested through them can
+     * complete */
+    if (!priv->next_user)
+        _revoke_dbus_observer (seat);
+
+    seat_config = tlm_config_get_seat_config (priv->config, priv->id);
+    if (seat_config->x11_session) {
         DBG ("X11 session termination");
         if (kill (0, SIGTERM))
             WARN ("Failed to send TERM signal to process tree");
         return;
     }
 
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_AUTO_LOGIN,
-                                TRUE) ||
-                                seat->priv->next_user) {
+    if (seat_config->auto_login || seat->priv->next_user) {
         DBG ("auto re-login with '%s'", seat->priv->next_user);
         tlm_seat_create_session (seat,
                 seat->priv->next_service,
@@ -190,6 +248,7 @@ _handle_error (
     g_return_if_fail (self && TLM_IS_SEAT (self));
 
     DBG ("Error : %d:%s", error->code, error->message);
+    _finish_timeline (self, TLM_PHASE_LOGIN_FAILED);
     g_signal_emit (self, signals[SIG_SESSION_ERROR],  0, error->code);
 
     if (error->code == TLM_ERROR_PAM_AUTH_FAILURE ||
@@ -197,7 +256,7 @@ _handle_error (
         error->code == TLM_ERROR_SESSION_TERMINATION_FAILURE) {
         DBG ("Destroy the session in case of creation/termination failure");
         _close_active_session (self);
-        g_clear_object (&self->priv->dbus_observer);
+        _revoke_dbus_observer (self);
     }
 }
 
@@ -209,6 +268,8 @@ _disconnect_session_signals (
     if (!priv->session) return;
     DBG ("seat %p session %p", seat, priv->session);
 
+    g_signal_handlers_disconnect_by_func (G_OBJECT (priv->session),
+            _handle_authenticated, seat);
     g_signal_handlers_disconnect_by_func (G_OBJECT (priv->session),
             _handle_session_created, seat);
     g_signal_handlers_disconnect_by_func (G_OBJECT (priv->session),
@@ -224,6 +285,8 @@ _connect_session_signals (
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
     DBG ("seat %p", seat);
     /* Connect session signals to handlers */
+    g_signal_connect_swapped (priv->session, "authenticated",
+            G_CALLBACK (_handle_authenticated), seat);
     g_signal_connect_swapped (priv->session, "session-created",
             G_CALLBACK (_handle_session_created), seat);
     g_signal_connect_swapped (priv->session, "session-terminated",
@@ -233,29 +296,240 @@ _connect_session_signals (
 }
 
 static gboolean
-_create_dbus_observer (
+_grant_dbus_observer (
         TlmSeat *seat,
         const gchar *username)
 {
     gchar *address = NULL;
+    TlmUserInfo *info = NULL;
     uid_t uid = 0;
 
     if (!username) return FALSE;
 
-    uid = tlm_user_get_uid (username);
-    if (uid == -1) return FALSE;
+    info = tlm_user_info_lookup (username);
+    if (!info) return FALSE;
+    uid = info->uid;
+    tlm_user_info_unref (info);
 
-    address = g_strdup_printf ("unix:path=%s/%s-%d", TLM_DBUS_SOCKET_PATH,
-            seat->priv->id, uid);
+    /* the listener lives as long as the seat, a session change only changes
+     * which peer uid it accepts */
+    if (seat->priv->dbus_observer) {
+        tlm_dbus_observer_set_uid (seat->priv->dbus_observer, uid);
+        return TRUE;
+    }
+
+    address = g_strdup_printf ("unix:path=%s/%s", TLM_DBUS_SOCKET_PATH,
+            seat->priv->id);
     seat->priv->dbus_observer = TLM_DBUS_OBSERVER (tlm_dbus_observer_new (
             NULL, seat, address, uid,
             DBUS_OBSERVER_ENABLE_LOGOUT_USER |
-            DBUS_OBSERVER_ENABLE_SWITCH_USER));
+            DBUS_OBSERVER_ENABLE_SWITCH_USER |
+            DBUS_OBSERVER_ENABLE_CANCEL_REQUEST));
     g_free (address);
     DBG ("created dbus obs: %p", seat->priv->dbus_observer);
     return (seat->priv->dbus_observer != NULL);
 }
 
+static void
+_revoke_dbus_observer (
+        TlmSeat *seat)
+{
+    if (!seat->priv->dbus_observer) return;
+
+    tlm_dbus_observer_set_uid (seat->priv->dbus_observer, (uid_t)-1);
+    tlm_dbus_observer_close_unauthorized (seat->priv->dbus_observer);
+}
+
+static guint
+_get_pool_size (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    return tlm_config_get_seat_config (priv->config,
+                                       priv->id)->sessiond_pool_size;
+}
+
+static void
+_schedule_pool_refill (TlmSeat *seat);
+
+static gboolean
+_on_pool_refill_timeout (gpointer user_data)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (TLM_SEAT (user_data));
+
+    WARN ("pooled sessiond for seat %s did not answer in time", priv->id);
+    priv->pool_refill_timeout_id = 0;
+    g_cancellable_cancel (priv->pool_refill);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_on_pooled_session_ready (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    TlmSeat *seat = TLM_SEAT (user_data);
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    TlmSessionRemote *session = NULL;
+    GError *error = NULL;
+
+    if (priv->pool_refill_timeout_id) {
+        g_source_remove (priv->pool_refill_timeout_id);
+        priv->pool_refill_timeout_id = 0;
+    }
+    g_clear_object (&priv->pool_refill);
+
+    session = tlm_session_remote_new_finish (res, &error);
+    if (!session) {
+        /* do not retry right away, the next login refills the pool */
+        WARN ("failed to pre-spawn sessiond for seat %s: %s", priv->id,
+              error ? error->message : "(null)");
+        g_clear_error (&error);
+    } else if (!priv->sessiond_pool) {
+        g_object_unref (session);
+    } else {
+        DBG ("pooled sessiond %p for seat %s", session, priv->id);
+        g_queue_push_tail (priv->sessiond_pool, session);
+        _schedule_pool_refill (seat);
+    }
+
+    g_object_unref (seat);
+}
+
+static gboolean
+_refill_pool (gpointer user_data)
+{
+    TlmSeat *seat = TLM_SEAT (user_data);
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    priv->pool_refill_id = 0;
+    if (priv->pool_refill ||
+        g_queue_get_length (priv->sessiond_pool) >= _get_pool_size (seat))
+        return G_SOURCE_REMOVE;
+
+    /* one sessiond at a time, the next one is spawned once this one has
+     * answered; a sessiond that never answers is given up on */
+    priv->pool_refill = g_cancellable_new ();
+    priv->pool_refill_timeout_id = g_timeout_add_seconds (
+            TLM_SEAT_POOL_HANDSHAKE_TIMEOUT, _on_pool_refill_timeout, seat);
+    tlm_session_remote_new_async (priv->config, NULL, NULL, NULL,
+            priv->pool_refill, _on_pooled_session_ready, g_object_ref (seat));
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_schedule_pool_refill (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    if (priv->pool_refill_id || priv->pool_refill ||
+        _get_pool_size (seat) == 0)
+        return;
+    priv->pool_refill_id = g_idle_add_full (G_PRIORITY_LOW, _refill_pool,
+                                            seat, NULL);
+}
+
+static TlmSessionRemote *
+_take_pooled_session (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    TlmSessionRemote *session = NULL;
+
+    while ((session = g_queue_pop_head (priv->sessiond_pool))) {
+        if (tlm_session_remote_is_running (session))
+            break;
+        DBG ("dropping dead pooled sessiond %p", session);
+        g_object_unref (session);
+    }
+    _schedule_pool_refill (seat);
+
+    return session;
+}
+
+static gchar *
+_build_user_name (const gchar *template, const gchar *seat_id);
+
+/* Sets the resource limits the seat shares between its sessions, on the
+ * seat cgroup the sessions of the seat are created in */
+static void
+_apply_cgroup_policy (TlmSeat *seat)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    const TlmSeatConfig *seat_config = NULL;
+    gchar *seat_cgroup = NULL;
+    gchar *value = NULL;
+
+    seat_config = tlm_config_get_seat_config (priv->config, priv->id);
+    if (!seat_config->cgroup_path ||
+        (!seat_config->cpu_weight && !seat_config->memory_max &&
+         !seat_config->io_weight))
+        return;
+
+    seat_cgroup = g_build_filename (seat_config->cgroup_path, priv->id, NULL);
+    if (g_mkdir_with_parents (seat_cgroup, 0755) < 0) {
+        WARN ("Could not create cgroup '%s'", seat_cgroup);
+        g_free (seat_cgroup);
+        return;
+    }
+    if (seat_config->cpu_weight) {
+        tlm_cgroup_enable_controller (seat_config->cgroup_path, "cpu");
+        value = g_strdup_printf ("%u", seat_config->cpu_weight);
+        tlm_cgroup_set_attribute (seat_cgroup, "cpu.weight", value);
+        g_free (value);
+    }
+    if (seat_config->memory_max) {
+        tlm_cgroup_enable_controller (seat_config->cgroup_path, "memory");
+        tlm_cgroup_set_attribute (seat_cgroup, "memory.max",
+                                  seat_config->memory_max);
+    }
+    if (seat_config->io_weight) {
+        tlm_cgroup_enable_controller (seat_config->cgroup_path, "io");
+        value = g_strdup_printf ("default %u", seat_config->io_weight);
+        tlm_cgroup_set_attribute (seat_cgroup, "io.weight", value);
+        g_free (value);
+    }
+    g_free (seat_cgroup);
+}
+
+static void
+_on_config_changed (
+        TlmSeat *seat,
+        gchar **groups,
+        TlmConfig *config)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    guint pool_size;
+    gchar *default_user;
+
+    if (!tlm_config_group_changed (groups, priv->id) &&
+        !tlm_config_group_changed (groups, TLM_CONFIG_GENERAL))
+        return;
+
+    DBG ("configuration of seat %s changed", priv->id);
+
+    _apply_cgroup_policy (seat);
+
+    pool_size = _get_pool_size (seat);
+    while (g_queue_get_length (priv->sessiond_pool) > pool_size)
+        g_object_unref (g_queue_pop_tail (priv->sessiond_pool));
+    _schedule_pool_refill (seat);
+
+    /* log out a default user that is no longer the default, auto-login
+     * then brings up the new one */
+    if (priv->default_active) {
+        default_user = _build_user_name (
+                tlm_config_get_seat_config (config, priv->id)->default_user,
+                priv->id);
+        if (g_strcmp0 (default_user, priv->default_user) != 0) {
+            DBG ("default user changed to '%s'", default_user);
+            tlm_seat_terminate_session (seat);
+        }
+        g_free (default_user);
+    }
+}
+
 static void
 tlm_seat_dispose (GObject *self)
 {
@@ -263,13 +537,36 @@ tlm_seat_dispose (GObject *self)
 
     DBG("disposing seat: %s", seat->priv->id);
 
+    if (seat->priv->pool_refill_id) {
+        g_source_remove (seat->priv->pool_refill_id);
+        seat->priv->pool_refill_id = 0;
+    }
+    if (seat->priv->pool_refill)
+        g_cancellable_cancel (seat->priv->pool_refill);
+    if (seat->priv->sessiond_pool) {
+        g_queue_free_full (seat->priv->sessiond_pool, g_object_unref);
+        seat->priv->sessiond_pool = NULL;
+    }
+
     g_clear_object (&seat->priv->dbus_observer);
-    g_clear_object (&seat->priv->prev_dbus_observer);
+    /* the handshake then finishes without a seat to start the session on */
+    if (seat->priv->pending_session) {
+        g_cancellable_cancel (seat->priv->pending_session);
+        g_clear_object (&seat->priv->pending_session);
+    }
+    g_clear_pointer (&seat->priv->timeline, tlm_timeline_free);
+    if (seat->priv->timelines) {
+        g_queue_free_full (seat->priv->timelines,
+                           (GDestroyNotify) tlm_timeline_free);
+        seat->priv->timelines = NULL;
+    }
 
     _disconnect_session_signals (seat);
     if (seat->priv->session)
         g_clear_object (&seat->priv->session);
     if (seat->priv->config) {
+        g_signal_handlers_disconnect_by_func (seat->priv->config,
+                                              _on_config_changed, seat);
         g_object_unref (seat->priv->config);
         seat->priv->config = NULL;
     }
@@ -395,6 +692,17 @@ tlm_seat_class_init (TlmSeatClass *klass)
                                               G_TYPE_NONE,
                                               1,
                                               G_TYPE_STRING);
+    signals[SIG_SESSION_AUTHENTICATED] = g_signal_new (
+                                                    "session-authenticated",
+                                                    TLM_TYPE_SEAT,
+                                                    G_SIGNAL_RUN_LAST,
+                                                    0,
+                                                    NULL,
+                                                    NULL,
+                                                    NULL,
+                                                    G_TYPE_NONE,
+                                                    1,
+                                                    G_TYPE_STRING);
     signals[SIG_SESSION_CREATED] = g_signal_new ("session-created",
                                                     TLM_TYPE_SEAT,
                                                     G_SIGNAL_RUN_LAST,
@@ -433,8 +741,16 @@ tlm_seat_init (TlmSeat *seat)
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
     
     priv->id = priv->path = priv->default_user = NULL;
-    priv->dbus_observer = priv->prev_dbus_observer = NULL;
+    priv->dbus_observer = NULL;
     priv->default_active = FALSE;
+    priv->sessiond_pool = g_queue_new ();
+    priv->pool_refill_id = 0;
+    priv->pool_refill = NULL;
+    priv->pool_refill_timeout_id = 0;
+    priv->pending_session = NULL;
+    priv->login_requested_at = 0;
+    priv->timeline = NULL;
+    priv->timelines = g_queue_new ();
     seat->priv = priv;
 }
 
@@ -457,7 +773,7 @@ tlm_seat_switch_user (TlmSeat *seat,
 
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
 
-    if (!priv->session) {
+    if (!priv->session && !priv->pending_session) {
         return tlm_seat_create_session (seat, service, username, password,
                 environment);
     }
@@ -534,6 +850,82 @@ _delayed_session (gpointer user_data)
     return G_SOURCE_REMOVE;
 }
 
+static gboolean
+_start_session (TlmSeat *seat,
+                const gchar *username,
+                const gchar *password,
+                GHashTable *environment)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+
+    if (!_grant_dbus_observer (seat, username)) {
+        g_clear_object (&priv->session);
+        g_signal_emit (seat, signals[SIG_SESSION_ERROR],  0,
+                TLM_ERROR_DBUS_SERVER_START_FAILURE);
+        return FALSE;
+    }
+
+    _connect_session_signals (seat);
+    tlm_session_remote_create (priv->session, password, environment);
+    return TRUE;
+}
+
+static void
+_on_session_remote_ready (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    SessionClosure *closure = (SessionClosure *) user_data;
+    TlmSeat *seat = closure->seat;
+    TlmSeatPrivate *priv = NULL;
+    TlmSessionRemote *session = NULL;
+    GError *error = NULL;
+    gboolean cancelled;
+
+    session = tlm_session_remote_new_finish (res, &error);
+    if (!seat) {
+        DBG ("seat removed during sessiond handshake");
+        g_clear_object (&session);
+        g_clear_error (&error);
+        goto _free;
+    }
+    g_object_remove_weak_pointer (G_OBJECT (seat),
+                                  (gpointer *) &closure->seat);
+    g_object_ref (seat);
+    priv = TLM_SEAT_PRIV (seat);
+
+    cancelled = g_cancellable_is_cancelled (priv->pending_session);
+    g_clear_object (&priv->pending_session);
+
+    priv->session = session;
+    if (!priv->session) {
+        if (cancelled) {
+            DBG ("session creation cancelled on seat %s", priv->id);
+            _handle_session_terminated (seat, NULL);
+        } else {
+            WARN ("failed to start sessiond: %s",
+                  error ? error->message : "(null)");
+            _finish_timeline (seat, TLM_PHASE_LOGIN_FAILED);
+            g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
+                    TLM_ERROR_SESSION_CREATION_FAILURE);
+        }
+        g_clear_error (&error);
+    } else {
+        _start_session (seat, closure->username, closure->password,
+                closure->environment);
+    }
+
+    g_object_unref (seat);
+
+_free:
+    g_free (closure->username);
+    g_free (closure->password);
+    if (closure->environment)
+        g_hash_table_unref (closure->environment);
+    g_slice_free (SessionClosure, closure);
+}
+
 gboolean
 tlm_seat_create_session (TlmSeat *seat,
                          const gchar *service,
@@ -543,8 +935,10 @@ tlm_seat_create_session (TlmSeat *seat,
 {
     g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    const TlmSeatConfig *seat_config = tlm_config_get_seat_config (
+            priv->config, priv->id);
 
-    if (priv->session != NULL) {
+    if (priv->session != NULL || priv->pending_session != NULL) {
         g_signal_emit (seat, signals[SIG_SESSION_ERROR],  0,
                 TLM_ERROR_SESSION_ALREADY_EXISTS);
         return FALSE;
@@ -554,6 +948,15 @@ tlm_seat_create_session (TlmSeat *seat,
         DBG ("short time relogin");
         priv->prev_time = g_get_monotonic_time ();
         priv->prev_count++;
+        if (priv->prev_count > 3 && username) {
+            /* the requester gets to know instead of waiting for a login
+             * that nothing could cancel */
+            WARN ("relogins spinning too fast, refusing login of '%s'",
+                  username);
+            g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
+                    TLM_ERROR_SESSION_THROTTLED);
+            return FALSE;
+        }
         if (priv->prev_count > 3) {
             WARN ("relogins spinning too fast, delay...");
             DelayClosure *delay_closure = g_slice_new0 (DelayClosure);
@@ -573,33 +976,17 @@ tlm_seat_create_session (TlmSeat *seat,
 
     if (!service) {
         DBG ("PAM service not defined, looking up configuration");
-        service = tlm_config_get_string (priv->config,
-                                         priv->id,
-                                         username ? TLM_CONFIG_GENERAL_PAM_SERVICE : TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE);
-        if (!service)
-            service = tlm_config_get_string (priv->config,
-                                             TLM_CONFIG_GENERAL,
-                                             username ? TLM_CONFIG_GENERAL_PAM_SERVICE : TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE);
-        if (!service)
-            service = username ? "tlm-login" : "tlm-default-login";
+        service = username ? seat_config->pam_service :
+                             seat_config->default_pam_service;
     }
     DBG ("using PAM service %s for seat %s", service, priv->id);
 
     if (!username) {
-        if (!priv->default_user) {
-            const gchar *name_tmpl =
-                    tlm_config_get_string_default (priv->config,
-                            priv->id,
-                            TLM_CONFIG_GENERAL_DEFAULT_USER,
-                            "guest");
-            if (!name_tmpl)
-                name_tmpl = tlm_config_get_string_default (priv->config,
-                        TLM_CONFIG_GENERAL,
-                        TLM_CONFIG_GENERAL_DEFAULT_USER,
-                        "guest");
-            if (name_tmpl)
-                priv->default_user = _build_user_name (name_tmpl, priv->id);
-        }
+        /* rebuilt for every default login to follow configuration
+         * changes */
+        g_free (priv->default_user);
+        priv->default_user = _build_user_name (seat_config->default_user,
+                                               priv->id);
         if (priv->default_user) {
             priv->default_active = TRUE;
             g_signal_emit (seat,
@@ -609,33 +996,70 @@ tlm_seat_create_session (TlmSeat *seat,
         }
     }
 
-    priv->session = tlm_session_remote_new (priv->config,
-            priv->id,
-            service,
+    tlm_timeline_free (priv->timeline);
+    priv->timeline = tlm_timeline_new (priv->id,
             priv->default_active ? priv->default_user : username);
-    if (!priv->session) {
-        g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
-                TLM_ERROR_SESSION_CREATION_FAILURE);
-        return FALSE;
+    if (priv->login_requested_at)
+        tlm_timeline_mark_at (priv->timeline, TLM_PHASE_REQUEST_RECEIVED,
+                              priv->login_requested_at);
+    priv->login_requested_at = 0;
+    tlm_timeline_mark (priv->timeline, TLM_PHASE_LOGIN_STARTED);
+
+    priv->session = _take_pooled_session (seat);
+    if (priv->session) {
+        DBG ("using pooled sessiond %p", priv->session);
+        tlm_session_remote_setup (priv->session,
+                priv->id,
+                service,
+                priv->default_active ? priv->default_user : username);
+        return _start_session (seat,
+                priv->default_active ? priv->default_user : username,
+                password,
+                environment);
     }
 
-    /*It is needed to handle switch user case which completes after new session
-     *is created */
-    seat->priv->prev_dbus_observer = seat->priv->dbus_observer;
-    seat->priv->dbus_observer = NULL;
-    if (!_create_dbus_observer (seat,
-            priv->default_active ? priv->default_user : username)) {
-        g_object_unref (priv->session);
-        g_signal_emit (seat, signals[SIG_SESSION_ERROR],  0,
-                TLM_ERROR_DBUS_SERVER_START_FAILURE);
-        return FALSE;
-    }
+    SessionClosure *closure = g_slice_new0 (SessionClosure);
+    closure->seat = seat;
+    g_object_add_weak_pointer (G_OBJECT (seat), (gpointer *) &closure->seat);
+    closure->username = g_strdup (
+            priv->default_active ? priv->default_user : username);
+    closure->password = g_strdup (password);
+    if (environment)
+        closure->environment = g_hash_table_ref (environment);
 
-    _connect_session_signals (seat);
-    tlm_session_remote_create (priv->session, password, environment);
+    priv->pending_session = g_cancellable_new ();
+    tlm_session_remote_new_async (priv->config,
+            priv->id,
+            service,
+            closure->username,
+            priv->pending_session,
+            _on_session_remote_ready,
+            closure);
     return TRUE;
 }
 
+/* Time at which the next login was requested, for its timeline */
+void
+tlm_seat_set_login_requested_at (TlmSeat *seat, gint64 time)
+{
+    g_return_if_fail (seat && TLM_IS_SEAT (seat));
+
+    seat->priv->login_requested_at = time;
+}
+
+/* Adds the timelines of the latest logins to the a(ssa(sx)) @builder */
+void
+tlm_seat_add_timelines (TlmSeat *seat, GVariantBuilder *builder)
+{
+    GList *iter;
+
+    g_return_if_fail (seat && TLM_IS_SEAT (seat));
+
+    for (iter = seat->priv->timelines->head; iter; iter = iter->next)
+        g_variant_builder_add_value (builder,
+                tlm_timeline_to_variant (iter->data));
+}
+
 gboolean
 tlm_seat_terminate_session (TlmSeat *seat)
 {
@@ -650,6 +1074,12 @@ tlm_seat_terminate_session (TlmSeat *seat)
                 seat->priv->default_user);
     }
 
+    if (seat->priv->pending_session) {
+        DBG ("cancelling session creation on seat %s", seat->priv->id);
+        g_cancellable_cancel (seat->priv->pending_session);
+        return TRUE;
+    }
+
     if (!seat->priv->session ||
         !tlm_session_remote_terminate (seat->priv->session)) {
         WARN ("No active session to terminate");
@@ -661,6 +1091,31 @@ tlm_seat_terminate_session (TlmSeat *seat)
     return TRUE;
 }
 
+/* Gives up on the login or switch in progress, returns FALSE if there is
+ * nothing to abort */
+gboolean
+tlm_seat_abort_session (TlmSeat *seat)
+{
+    g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
+
+    _reset_next (seat->priv);
+    if (!seat->priv->session && !seat->priv->pending_session)
+        return FALSE;
+
+    DBG ("aborting session on seat %s", seat->priv->id);
+    return tlm_seat_terminate_session (seat);
+}
+
+/* Seconds D-Bus requests for the seat may take, 0 for no deadline */
+guint
+tlm_seat_get_request_timeout (TlmSeat *seat)
+{
+    g_return_val_if_fail (seat && TLM_IS_SEAT(seat), 0);
+
+    return tlm_config_get_seat_config (seat->priv->config,
+                                       seat->priv->id)->request_timeout;
+}
+
 TlmSeat *
 tlm_seat_new (TlmConfig *config,
               const gchar *id,
@@ -671,6 +1126,10 @@ tlm_seat_new (TlmConfig *config,
                          "id", id,
                          "path", path,
                          NULL);
+    g_signal_connect_swapped (config, "changed",
+                              G_CALLBACK (_on_config_changed), seat);
+    _apply_cgroup_policy (seat);
+    _schedule_pool_refill (seat);
     return seat;
 }
 
@@ -84,6 +84,18 @@ tlm_seat_create_session (TlmSeat *seat,
 gboolean
 tlm_seat_terminate_session (TlmSeat *seat);
 
+gboolean
+tlm_seat_abort_session (TlmSeat *seat);
+
+guint
+tlm_seat_get_request_timeout (TlmSeat *seat);
+
+void
+tlm_seat_set_login_requested_at (TlmSeat *seat, gint64 time);
+
+void
+tlm_seat_add_timelines (TlmSeat *seat, GVariantBuilder *builder);
+
 G_END_DECLS
 
 #endif /* _TLM_SEAT_H */
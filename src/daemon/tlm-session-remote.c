@@ -33,6 +33,10 @@
 #include "common/tlm-config.h"
 #include "common/tlm-config-general.h"
 #include "common/tlm-pipe-stream.h"
+#include "common/tlm-spawn.h"
+#include "common/tlm-proc-watch.h"
+#include "common/tlm-user-info.h"
+#include "common/tlm-timeline.h"
 #include "common/dbus/tlm-dbus.h"
 #include "common/dbus/tlm-dbus-utils.h"
 #include "common/dbus/tlm-dbus-session-gen.h"
@@ -58,18 +62,19 @@ struct _TlmSessionRemotePrivate
 	TlmConfig *config;
     GDBusConnection *connection;
     TlmDbusSession *dbus_session_proxy;
-    GPid cpid;
-    guint child_watch_id;
+    TlmProcWatch *watch; /* sessiond process */
     gboolean is_sessiond_up;
-    int last_sig;
-    guint timer_id;
     gboolean can_emit_signal;
+    gint64 spawned_at;
+    gint64 connected_at;
+    GVariant *sessiond_timeline; /* a(sx) reported by sessiond */
 
     /* Signals */
     gulong signal_session_created;
     gulong signal_session_terminated;
     gulong signal_authenticated;
     gulong signal_error;
+    gulong signal_timeline;
 };
 
 G_DEFINE_TYPE (TlmSessionRemote, tlm_session_remote, G_TYPE_OBJECT);
@@ -89,23 +94,16 @@ static guint signals[SIG_MAX];
 
 static void
 _on_child_down_cb (
-        GPid  pid,
+        pid_t pid,
         gint  status,
         gpointer data)
 {
-    g_spawn_close_pid (pid);
-
     TlmSessionRemote *session = TLM_SESSION_REMOTE (data);
 
     DBG ("Sessiond(%p) with pid (%d) closed with status %d", session, pid,
             status);
 
     session->priv->is_sessiond_up = FALSE;
-    session->priv->child_watch_id = 0;
-    if (session->priv->timer_id) {
-        g_source_remove (session->priv->timer_id);
-        session->priv->timer_id = 0;
-    }
     if (session->priv->can_emit_signal)
         g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
 }
@@ -165,51 +163,21 @@ tlm_session_remote_get_property (
 
 }
 
-static gboolean
-_terminate_timeout (gpointer user_data)
+static void
+_on_sessiond_stuck (
+        pid_t pid,
+        gpointer data)
 {
-    TlmSessionRemote *self = TLM_SESSION_REMOTE(user_data);
-    TlmSessionRemotePrivate *priv = TLM_SESSION_REMOTE_PRIV(self);
-
-    switch (priv->last_sig)
-    {
-        case SIGHUP:
-            DBG ("child %u didn't respond to SIGHUP, sending SIGTERM",
-                 priv->cpid);
-            if (kill (priv->cpid, SIGTERM))
-                WARN ("kill(%u, SIGTERM): %s",
-                      priv->cpid,
-                      strerror(errno));
-            priv->last_sig = SIGTERM;
-            return G_SOURCE_CONTINUE;
-        case SIGTERM:
-            DBG ("child %u didn't respond to SIGTERM, sending SIGKILL",
-                 priv->cpid);
-            if (kill (priv->cpid, SIGKILL))
-                WARN ("kill(%u, SIGKILL): %s",
-                      priv->cpid,
-                      strerror(errno));
-            priv->last_sig = SIGKILL;
-            return G_SOURCE_CONTINUE;
-        case SIGKILL:
-            DBG ("child %u didn't respond to SIGKILL, "
-                    "process is stuck in kernel",  priv->cpid);
-            priv->timer_id = 0;
-            if (self->priv->can_emit_signal) {
-                GError *error = TLM_GET_ERROR_FOR_ID (
-                        TLM_ERROR_SESSION_TERMINATION_FAILURE,
-                        "Unable to terminate session - process is stuck"
-                        " in kernel");
-                g_signal_emit (self, signals[SIG_SESSION_ERROR], 0, error);
-                g_error_free (error);
-            }
-            return G_SOURCE_REMOVE;
-        default:
-            WARN ("%d has unknown signaling state %d",
-                  priv->cpid,
-                  priv->last_sig);
+    TlmSessionRemote *self = TLM_SESSION_REMOTE (data);
+
+    if (self->priv->can_emit_signal) {
+        GError *error = TLM_GET_ERROR_FOR_ID (
+                TLM_ERROR_SESSION_TERMINATION_FAILURE,
+                "Unable to terminate session - process is stuck"
+                " in kernel");
+        g_signal_emit (self, signals[SIG_SESSION_ERROR], 0, error);
+        g_error_free (error);
     }
-    return G_SOURCE_REMOVE;
 }
 
 static void
@@ -226,18 +194,7 @@ tlm_session_remote_dispose (GObject *object)
         DBG ("Sessiond DESTROYED");
     }
 
-    if (self->priv->timer_id) {
-        g_source_remove (self->priv->timer_id);
-        self->priv->timer_id = 0;
-    }
-
-    self->priv->cpid = 0;
-    self->priv->last_sig = 0;
-
-    if (self->priv->child_watch_id > 0) {
-        g_source_remove (self->priv->child_watch_id);
-        self->priv->child_watch_id = 0;
-    }
+    g_clear_pointer (&self->priv->watch, tlm_proc_watch_free);
 
     g_clear_object (&self->priv->config);
 
@@ -250,6 +207,8 @@ tlm_session_remote_dispose (GObject *object)
                 self->priv->signal_error);
         g_signal_handler_disconnect (self->priv->dbus_session_proxy,
                 self->priv->signal_authenticated);
+        g_signal_handler_disconnect (self->priv->dbus_session_proxy,
+                self->priv->signal_timeline);
         g_object_unref (self->priv->dbus_session_proxy);
         self->priv->dbus_session_proxy = NULL;
     }
@@ -268,6 +227,8 @@ tlm_session_remote_dispose (GObject *object)
         self->priv->connection = NULL;
     }
 
+    g_clear_pointer (&self->priv->sessiond_timeline, g_variant_unref);
+
     DBG("done");
     G_OBJECT_CLASS (tlm_session_remote_parent_class)->dispose (object);
 }
@@ -354,11 +315,11 @@ tlm_session_remote_init (TlmSessionRemote *self)
 
     self->priv->connection = NULL;
     self->priv->dbus_session_proxy = NULL;
-    self->priv->cpid = 0;
-    self->priv->child_watch_id = 0;
+    self->priv->watch = NULL;
     self->priv->is_sessiond_up = FALSE;
-    self->priv->last_sig = 0;
-    self->priv->timer_id = 0;
+    self->priv->spawned_at = 0;
+    self->priv->connected_at = 0;
+    self->priv->sessiond_timeline = NULL;
 }
 
 static void
@@ -388,13 +349,26 @@ tlm_session_remote_create (
 {
     GVariant *data = NULL;
     gchar *pass = g_strdup (password);
+    gchar *username = NULL;
+    TlmUserInfo *user_info = NULL;
     if (environment) data = tlm_dbus_utils_hash_table_to_variant (environment);
     if (!data) data = g_variant_new ("a{ss}", NULL);
 
     if (!pass) pass = g_strdup ("");
+    /* sessiond falls back to its own lookup if the user did not resolve */
+    g_object_get (session, "username", &username, NULL);
+    if (username) user_info = tlm_user_info_lookup (username);
+
+    /* hand over the daemon's view of the configuration, so that sessiond
+     * neither has to parse the configuration file nor can see a different
+     * generation of it */
     tlm_dbus_session_call_session_create (
-            session->priv->dbus_session_proxy, pass, data, NULL,
+            session->priv->dbus_session_proxy, pass, data,
+            tlm_config_get_snapshot (session->priv->config),
+            tlm_user_info_to_variant (user_info), NULL,
             _session_created_async_cb, session);
+    tlm_user_info_unref (user_info);
+    g_free (username);
     g_free (pass);
 }
 
@@ -444,19 +418,29 @@ _on_error_cb (
     g_error_free (gerror);
 }
 
-TlmSessionRemote *
-tlm_session_remote_new (
+static void
+_on_timeline_cb (
+        TlmSessionRemote *self,
+        GVariant *phases,
+        gpointer user_data)
+{
+    g_return_if_fail (self && TLM_IS_SESSION_REMOTE (self));
+
+    if (self->priv->sessiond_timeline)
+        g_variant_unref (self->priv->sessiond_timeline);
+    self->priv->sessiond_timeline = g_variant_ref (phases);
+}
+
+static TlmSessionRemote *
+_spawn_sessiond (
         TlmConfig *config,
-        const gchar *seat_id,
-        const gchar *service,
-        const gchar *username)
+        GIOStream **stream)
 {
     GError *error = NULL;
     GPid cpid = 0;
     gchar **argv;
     gint cin_fd, cout_fd;
     TlmSessionRemote *session = NULL;
-    TlmPipeStream *stream = NULL;
     gboolean ret = FALSE;
     const gchar *bin_path = TLM_BIN_DIR;
 
@@ -479,9 +463,8 @@ tlm_session_remote_new (
     /* Spawn child process */
     argv = g_new0 (gchar *, 1 + 1);
     argv[0] = g_build_filename (bin_path, TLM_SESSIOND_NAME, NULL);
-    ret = g_spawn_async_with_pipes (NULL, argv, NULL,
-            G_SPAWN_DO_NOT_REAP_CHILD, NULL,
-            NULL, &cpid, &cin_fd, &cout_fd, NULL, &error);
+    ret = tlm_spawn ((const gchar * const *) argv, NULL, NULL, NULL,
+            &cin_fd, &cout_fd, &cpid, &error);
     g_strfreev (argv);
     if (ret == FALSE || (kill(cpid, 0) != 0)) {
         DBG ("failed to start sessiond: error %s(%d)",
@@ -494,15 +477,56 @@ tlm_session_remote_new (
     session = TLM_SESSION_REMOTE (g_object_new (TLM_TYPE_SESSION_REMOTE,
             "config", config, NULL));
 
-    session->priv->child_watch_id = g_child_watch_add (cpid,
-            (GChildWatchFunc)_on_child_down_cb, session);
-    session->priv->cpid = cpid;
+    session->priv->watch = tlm_proc_watch_new (cpid, FALSE,
+            _on_child_down_cb, session);
     session->priv->is_sessiond_up = TRUE;
+    session->priv->spawned_at = g_get_monotonic_time ();
+
+    *stream = G_IO_STREAM (tlm_pipe_stream_new (cout_fd, cin_fd, TRUE));
+    return session;
+}
+
+static void
+_connect_proxy_signals (
+        TlmSessionRemote *session)
+{
+    DBG("'%s' object exported(%p)", TLM_SESSION_OBJECTPATH, session);
+
+    session->priv->signal_session_created = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "session-created",
+            G_CALLBACK (_on_session_created_cb), session);
+    session->priv->signal_session_terminated = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "session-terminated",
+            G_CALLBACK(_on_session_terminated_cb), session);
+    session->priv->signal_authenticated = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "authenticated",
+            G_CALLBACK(_on_authenticated_cb), session);
+    session->priv->signal_error = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "error",
+            G_CALLBACK(_on_error_cb), session);
+    session->priv->signal_timeline = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "timeline",
+            G_CALLBACK(_on_timeline_cb), session);
+    session->priv->connected_at = g_get_monotonic_time ();
+
+    session->priv->can_emit_signal = TRUE;
+}
+
+TlmSessionRemote *
+tlm_session_remote_new_idle (
+        TlmConfig *config)
+{
+    GError *error = NULL;
+    TlmSessionRemote *session = NULL;
+    GIOStream *stream = NULL;
+
+    session = _spawn_sessiond (config, &stream);
+    if (!session)
+        return NULL;
 
     /* Create dbus connection */
-    stream = tlm_pipe_stream_new (cout_fd, cin_fd, TRUE);
     session->priv->connection = g_dbus_connection_new_sync (
-            G_IO_STREAM (stream), NULL, G_DBUS_CONNECTION_FLAGS_NONE, NULL,
+            stream, NULL, G_DBUS_CONNECTION_FLAGS_NONE, NULL,
             NULL, NULL);
     g_object_unref (stream);
 
@@ -521,48 +545,221 @@ tlm_session_remote_new (
         g_object_unref (session);
         return NULL;
     }
-    DBG("'%s' object exported(%p)", TLM_SESSION_OBJECTPATH, session);
 
-    session->priv->signal_session_created = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "session-created",
-            G_CALLBACK (_on_session_created_cb), session);
-    session->priv->signal_session_terminated = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "session-terminated",
-            G_CALLBACK(_on_session_terminated_cb), session);
-    session->priv->signal_authenticated = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "authenticated",
-            G_CALLBACK(_on_authenticated_cb), session);
-    session->priv->signal_error = g_signal_connect_swapped (
-            session->priv->dbus_session_proxy, "error",
-            G_CALLBACK(_on_error_cb), session);
+    _connect_proxy_signals (session);
+    return session;
+}
+
+typedef struct _SetupData
+{
+    gchar *seat_id;
+    gchar *service;
+    gchar *username;
+} SetupData;
+
+static void
+_setup_data_free (SetupData *data)
+{
+    g_free (data->seat_id);
+    g_free (data->service);
+    g_free (data->username);
+    g_slice_free (SetupData, data);
+}
+
+static void
+_proxy_ready_cb (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GError *error = NULL;
+    GTask *task = G_TASK (user_data);
+    TlmSessionRemote *session = TLM_SESSION_REMOTE (
+            g_task_get_source_object (task));
+    SetupData *data = g_task_get_task_data (task);
+
+    session->priv->dbus_session_proxy = tlm_dbus_session_proxy_new_finish (
+            res, &error);
+    if (!session->priv->dbus_session_proxy) {
+        DBG ("Failed to register object: %s", error->message);
+        g_task_return_error (task, error);
+        g_object_unref (task);
+        return;
+    }
+
+    _connect_proxy_signals (session);
+    if (data->seat_id)
+        tlm_session_remote_setup (session, data->seat_id, data->service,
+                data->username);
+
+    g_task_return_pointer (task, g_object_ref (session), g_object_unref);
+    g_object_unref (task);
+}
+
+static void
+_connection_ready_cb (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GError *error = NULL;
+    GTask *task = G_TASK (user_data);
+    TlmSessionRemote *session = TLM_SESSION_REMOTE (
+            g_task_get_source_object (task));
+
+    session->priv->connection = g_dbus_connection_new_finish (res, &error);
+    if (!session->priv->connection) {
+        DBG ("Failed to connect to sessiond: %s", error->message);
+        g_task_return_error (task, error);
+        g_object_unref (task);
+        return;
+    }
+
+    tlm_dbus_session_proxy_new (session->priv->connection,
+            G_DBUS_PROXY_FLAGS_NONE, NULL, TLM_SESSION_OBJECTPATH,
+            g_task_get_cancellable (task), _proxy_ready_cb, task);
+}
+
+/*
+ * Asynchronous variant of tlm_session_remote_new(): the sessiond is spawned
+ * right away, the D-Bus handshake completes in the background. If @seat_id
+ * is NULL the sessiond is left idle, as with tlm_session_remote_new_idle().
+ */
+void
+tlm_session_remote_new_async (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username,
+        GCancellable *cancellable,
+        GAsyncReadyCallback callback,
+        gpointer user_data)
+{
+    TlmSessionRemote *session = NULL;
+    GIOStream *stream = NULL;
+    GTask *task = NULL;
+    SetupData *data = NULL;
+
+    session = _spawn_sessiond (config, &stream);
+    if (!session) {
+        g_task_report_new_error (NULL, callback, user_data,
+                tlm_session_remote_new_async, TLM_ERROR,
+                TLM_ERROR_SESSION_CREATION_FAILURE,
+                "Failed to start sessiond");
+        return;
+    }
+
+    data = g_slice_new0 (SetupData);
+    data->seat_id = g_strdup (seat_id);
+    data->service = g_strdup (service);
+    data->username = g_strdup (username);
+
+    task = g_task_new (session, cancellable, callback, user_data);
+    g_task_set_source_tag (task, tlm_session_remote_new_async);
+    g_task_set_task_data (task, data, (GDestroyNotify)_setup_data_free);
+    /* the task keeps the session alive until the handshake is done */
+    g_object_unref (session);
+
+    g_dbus_connection_new (stream, NULL, G_DBUS_CONNECTION_FLAGS_NONE, NULL,
+            cancellable, _connection_ready_cb, task);
+    g_object_unref (stream);
+}
+
+TlmSessionRemote *
+tlm_session_remote_new_finish (
+        GAsyncResult *result,
+        GError **error)
+{
+    g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+void
+tlm_session_remote_setup (
+        TlmSessionRemote *session,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    g_return_if_fail (session && TLM_IS_SESSION_REMOTE (session));
 
     g_object_set (G_OBJECT (session), "seatid", seat_id, "service", service,
             "username", username, NULL);
+}
 
-    session->priv->can_emit_signal = TRUE;
+gboolean
+tlm_session_remote_is_running (
+        TlmSessionRemote *session)
+{
+    g_return_val_if_fail (session && TLM_IS_SESSION_REMOTE (session), FALSE);
+
+    return session->priv->is_sessiond_up;
+}
+
+TlmSessionRemote *
+tlm_session_remote_new (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    TlmSessionRemote *session = tlm_session_remote_new_idle (config);
+    if (!session)
+        return NULL;
+
+    tlm_session_remote_setup (session, seat_id, service, username);
     return session;
 }
 
+/* Adds the sessiond startup and the phases reported by sessiond for the
+ * latest login to @timeline. A pooled sessiond was started ahead of the
+ * request, which shows up as marks before the request. */
+void
+tlm_session_remote_add_timeline (
+        TlmSessionRemote *session,
+        TlmTimeline *timeline)
+{
+    g_return_if_fail (session && TLM_IS_SESSION_REMOTE (session));
+
+    if (session->priv->spawned_at)
+        tlm_timeline_mark_at (timeline, TLM_PHASE_SESSIOND_SPAWNED,
+                              session->priv->spawned_at);
+    if (session->priv->connected_at)
+        tlm_timeline_mark_at (timeline, TLM_PHASE_HANDSHAKE_DONE,
+                              session->priv->connected_at);
+    tlm_timeline_merge (timeline, session->priv->sessiond_timeline);
+}
+
 gboolean
 tlm_session_remote_terminate (
         TlmSessionRemote *self)
 {
     g_return_val_if_fail (self && TLM_IS_SESSION_REMOTE(self), FALSE);
     TlmSessionRemotePrivate *priv = TLM_SESSION_REMOTE_PRIV(self);
+    gchar *seat_id = NULL;
+    guint step;
 
     if (!priv->is_sessiond_up) {
         WARN ("sessiond is not running");
         return FALSE;
     }
+    if (tlm_proc_watch_is_terminating (priv->watch)) {
+        DBG ("termination already in progress");
+        return TRUE;
+    }
+
+    g_object_get (self, "seatid", &seat_id, NULL);
+    step = tlm_config_get_seat_config (priv->config,
+                                       seat_id)->terminate_step;
+    g_free (seat_id);
 
+    /* sessiond runs the same ladder against the user session on SIGHUP and
+     * exits with it. Escalating against sessiond is only a backstop once
+     * that ladder had all its time, plus one step to close the PAM session. */
     DBG ("Terminate child session process");
-    if (kill (priv->cpid, SIGHUP) < 0)
-        WARN ("kill(%u, SIGHUP): %s", priv->cpid, strerror(errno));
-    priv->last_sig = SIGHUP;
-    priv->timer_id = g_timeout_add_seconds (
-            tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
-                    TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3),
-            _terminate_timeout, self);
-    return TRUE;
+    return tlm_proc_watch_terminate (priv->watch,
+                                     (TLM_PROC_WATCH_LADDER_STEPS + 1) * step,
+                                     step, _on_sessiond_stuck);
 }
 
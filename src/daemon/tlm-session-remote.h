@@ -27,7 +27,9 @@
 #define __TLM_SESSION_REMOTE_H_
 
 #include <glib.h>
+#include <gio/gio.h>
 #include "common/tlm-config.h"
+#include "common/tlm-timeline.h"
 
 G_BEGIN_DECLS
 
@@ -65,6 +67,21 @@ struct _TlmSessionRemoteClass
 GType
 tlm_session_remote_get_type (void) G_GNUC_CONST;
 
+TlmSessionRemote *
+tlm_session_remote_new_idle (
+        TlmConfig *config);
+
+void
+tlm_session_remote_setup (
+        TlmSessionRemote *session,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username);
+
+gboolean
+tlm_session_remote_is_running (
+        TlmSessionRemote *session);
+
 TlmSessionRemote *
 tlm_session_remote_new (
         TlmConfig *config,
@@ -72,6 +89,21 @@ tlm_session_remote_new (
         const gchar *service,
         const gchar *username);
 
+void
+tlm_session_remote_new_async (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username,
+        GCancellable *cancellable,
+        GAsyncReadyCallback callback,
+        gpointer user_data);
+
+TlmSessionRemote *
+tlm_session_remote_new_finish (
+        GAsyncResult *result,
+        GError **error);
+
 void
 tlm_session_remote_create (
     TlmSessionRemote *session,
@@ -82,6 +114,11 @@ gboolean
 tlm_session_remote_terminate (
         TlmSessionRemote *session);
 
+void
+tlm_session_remote_add_timeline (
+        TlmSessionRemote *session,
+        TlmTimeline *timeline);
+
 G_END_DECLS
 
 #endif /* __TLM_SESSION_REMOTE_H_ */
@@ -35,10 +35,11 @@
 #include <sys/prctl.h>
 
 #include "common/tlm-log.h"
+#include "common/tlm-utmp.h"
 #include "tlm-session-daemon.h"
 
 static TlmSessionDaemon *_daemon = NULL;
-static guint _sig_source_id[2];
+static guint _sig_source_id[3];
 
 static void
 _on_daemon_closed (gpointer data, GObject *server)
@@ -60,6 +61,13 @@ _handle_quit_signal (gpointer user_data)
     return FALSE;
 }
 
+static gboolean
+_handle_debug_signal (gpointer user_data)
+{
+    tlm_log_toggle_debug ();
+    return TRUE;
+}
+
 static void
 _install_sighandlers (GMainLoop *main_loop)
 {
@@ -83,6 +91,14 @@ _install_sighandlers (GMainLoop *main_loop)
                            NULL);
     _sig_source_id[1] = g_source_attach (source, ctx);
 
+    /* unlike tlm, sessiond loads no auth plugin that could use SIGUSR1 */
+    source = g_unix_signal_source_new (SIGUSR1);
+    g_source_set_callback (source,
+                           _handle_debug_signal,
+                           NULL,
+                           NULL);
+    _sig_source_id[2] = g_source_attach (source, ctx);
+
     if (prctl(PR_SET_PDEATHSIG, SIGHUP))
         WARN ("failed to set parent death signal");
 }
@@ -145,6 +161,7 @@ int main (int argc, char **argv)
     if (main_loop) {
         g_main_loop_unref (main_loop);
     }
+    tlm_utmp_flush ();
     tlm_log_close (NULL);
     return 0;
 }
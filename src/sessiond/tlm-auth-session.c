@@ -40,6 +40,7 @@
 #include "tlm-auth-session.h"
 #include "common/tlm-log.h"
 #include "common/tlm-utils.h"
+#include "common/tlm-user-info.h"
 #include "common/tlm-error.h"
 
 G_DEFINE_TYPE (TlmAuthSession, tlm_auth_session, G_TYPE_OBJECT);
@@ -54,6 +55,7 @@ enum {
     PROP_USERNAME,
     PROP_PASSWORD,
     PROP_TTYNAME,
+    PROP_LOGIND_ADDRESS,
     N_PROPERTIES
 };
 static GParamSpec *pspecs[N_PROPERTIES];
@@ -64,10 +66,16 @@ struct _TlmAuthSessionPrivate
     gchar *username;
     gchar *password;
     gchar *tty_name;
+    gchar *logind_address; /* NULL for the system bus */
     gchar *session_id; /* logind session path */
     pam_handle_t *pam_handle;
+    GThreadPool *worker; /* all PAM calls of the pipeline run here */
+    GCancellable *cancellable; /* cancellable of the phase in progress */
 };
 
+typedef gboolean (*TlmAuthSessionPhase) (TlmAuthSession *auth_session,
+                                         GError **error);
+
 static void
 _auth_session_stop (TlmAuthSession *auth_session)
 {
@@ -102,6 +110,13 @@ tlm_auth_session_dispose (GObject *self)
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
     DBG ("disposing auth_session: %s:%s", priv->service, priv->username);
 
+    /* pending phases hold a reference, so the worker is idle here */
+    if (priv->worker) {
+        g_thread_pool_free (priv->worker, FALSE, TRUE);
+        priv->worker = NULL;
+    }
+    g_clear_object (&priv->cancellable);
+
     if (priv->pam_handle)
         _auth_session_stop (auth_session);
 
@@ -117,6 +132,7 @@ tlm_auth_session_finalize (GObject *self)
     g_clear_string (&priv->username);
     g_clear_string (&priv->password);
     g_clear_string (&priv->tty_name);
+    g_clear_string (&priv->logind_address);
     g_clear_string (&priv->session_id);
 
     G_OBJECT_CLASS (tlm_auth_session_parent_class)->finalize (self);
@@ -144,6 +160,10 @@ _auth_session_set_property (GObject *obj,
         case PROP_TTYNAME:
             priv->tty_name = g_value_dup_string (value);
             break;
+        case PROP_LOGIND_ADDRESS:
+            g_free (priv->logind_address);
+            priv->logind_address = g_value_dup_string (value);
+            break;
 
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
@@ -172,6 +192,9 @@ _auth_session_get_property (GObject *obj,
         case PROP_TTYNAME:
             g_value_set_string (value, priv->tty_name);
             break;
+        case PROP_LOGIND_ADDRESS:
+            g_value_set_string (value, priv->logind_address);
+            break;
 
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
@@ -218,6 +241,13 @@ tlm_auth_session_class_init (TlmAuthSessionClass *klass)
                              NULL,
                              G_PARAM_READWRITE|
                              G_PARAM_CONSTRUCT_ONLY|G_PARAM_STATIC_STRINGS);
+    pspecs[PROP_LOGIND_ADDRESS] =
+        g_param_spec_string ("logind-address",
+                             "logind address",
+                             "D-Bus address of the bus logind is on, "
+                             "NULL for the system bus",
+                             NULL,
+                             G_PARAM_READWRITE|G_PARAM_STATIC_STRINGS);
 
     g_object_class_install_properties (g_klass, N_PROPERTIES, pspecs);
 }
@@ -228,46 +258,107 @@ tlm_auth_session_init (TlmAuthSession *auth_session)
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
 
     priv->service = priv->username = NULL;
+    priv->worker = NULL;
+    priv->cancellable = NULL;
 
     auth_session->priv = priv;
 }
 
 
+/* Resolving the session from our own cgroup needs neither the bus nor
+ * logind; GetSessionByPID is only the fallback, see open_async. */
 static gchar *
-_auth_session_get_logind_session_id (GError **error)
+_auth_session_get_logind_session_id (void)
 {
-    GDBusConnection *bus;
-    GVariant *result;
+    gchar *id = tlm_utils_get_logind_session_id (NULL, getpid ());
     gchar *session_id;
 
-    bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, error);
-    if (!bus)
+    if (!id)
         return NULL;
 
-    DBG ("trying to get session id");
-    result = g_dbus_connection_call_sync (bus,
-                                          "org.freedesktop.login1",
-                                          "/org/freedesktop/login1",
-                                          "org.freedesktop.login1.Manager",
-                                          "GetSessionByPID",
-                                          g_variant_new("(u)", getpid()),
-                                          G_VARIANT_TYPE("(o)"),
-                                          G_DBUS_CALL_FLAGS_NONE,
-                                          -1,
-                                          NULL,
-                                          error);
-    g_object_unref (bus);
-    if (!result) {
-        DBG ("failed to get session id");
-        return NULL;
+    session_id = tlm_utils_logind_session_path (id);
+    g_free (id);
+    DBG ("logind session : %s", session_id);
+
+    return session_id;
+}
+
+/* kept for the lifetime of the process, as sessiond gets reused */
+static GDBusConnection *_logind_bus = NULL;
+static gchar *_logind_address = NULL;
+
+static void
+_auth_session_on_session_by_pid (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GTask *task = G_TASK (user_data);
+    TlmAuthSession *auth_session = TLM_AUTH_SESSION (
+            g_task_get_source_object (task));
+    GVariant *result;
+    GError *error = NULL;
+
+    result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (object), res,
+                                            &error);
+    if (result) {
+        g_variant_get (result, "(o)", &auth_session->priv->session_id);
+        g_variant_unref (result);
+        DBG ("logind session : %s", auth_session->priv->session_id);
+    } else {
+        /* the session id is informational, do not fail the login */
+        WARN ("failed to get session id: %s", error->message);
+        g_error_free (error);
     }
 
-    g_variant_get (result, "(o)", &session_id);
-    g_variant_unref (result);
+    if (!g_task_return_error_if_cancelled (task))
+        g_task_return_boolean (task, TRUE);
+    g_object_unref (task);
+}
+
+static void
+_auth_session_get_session_by_pid (GTask *task)
+{
+    g_dbus_connection_call (_logind_bus,
+                            "org.freedesktop.login1",
+                            "/org/freedesktop/login1",
+                            "org.freedesktop.login1.Manager",
+                            "GetSessionByPID",
+                            g_variant_new ("(u)", getpid ()),
+                            G_VARIANT_TYPE ("(o)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            g_task_get_cancellable (task),
+                            _auth_session_on_session_by_pid,
+                            task);
+}
 
-    DBG ("logind session : %s", session_id);
+static void
+_auth_session_on_bus_get (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GTask *task = G_TASK (user_data);
+    GDBusConnection *bus;
+    GError *error = NULL;
+
+    (void) object;
+
+    bus = tlm_utils_logind_bus_get_finish (res, &error);
+    if (!bus) {
+        WARN ("failed to get logind bus: %s", error->message);
+        g_error_free (error);
+        if (!g_task_return_error_if_cancelled (task))
+            g_task_return_boolean (task, TRUE);
+        g_object_unref (task);
+        return;
+    }
 
-    return session_id;
+    if (_logind_bus)
+        g_object_unref (_logind_bus);
+    _logind_bus = bus;
+    _auth_session_get_session_by_pid (task);
 }
 
 static int
@@ -279,9 +370,16 @@ _auth_session_pam_conversation_cb (int n_msgs,
     int i;
     TlmAuthSession *auth_session = TLM_AUTH_SESSION (appdata_ptr);
 
-    (void) auth_session;
     DBG (" n_msgs : %d", n_msgs);
 
+    /* let the PAM module bail out early if the phase has been cancelled */
+    if (auth_session->priv->cancellable &&
+        g_cancellable_is_cancelled (auth_session->priv->cancellable)) {
+        DBG (" conversation cancelled");
+        *resps = NULL;
+        return PAM_CONV_ERR;
+    }
+
     *resps = calloc (n_msgs, sizeof(struct pam_response));
     for (i=0; i < n_msgs; i++) {
         const struct pam_message *msg = msgs[i];
@@ -349,6 +447,7 @@ tlm_auth_session_authenticate (TlmAuthSession *auth_session, GError **error)
     int res;
     const char *pam_tty = NULL;
     const char *pam_ruser = NULL;
+    TlmUserInfo *ruser_info = NULL;
     g_return_val_if_fail (auth_session &&
                 TLM_IS_AUTH_SESSION(auth_session), FALSE);
 
@@ -366,10 +465,13 @@ tlm_auth_session_authenticate (TlmAuthSession *auth_session, GError **error)
         }
     }
 
-    pam_ruser = tlm_user_get_name (geteuid());
+    /* runs on the PAM worker thread, so use the reentrant lookup */
+    ruser_info = tlm_user_info_new_from_uid (geteuid ());
+    pam_ruser = ruser_info ? ruser_info->name : NULL;
     if (pam_set_item (priv->pam_handle, PAM_RUSER, pam_ruser) != PAM_SUCCESS) {
         WARN ("pam_set_item(PAM_RUSER, '%s')", pam_ruser);
     }
+    tlm_user_info_unref (ruser_info);
 
     if (pam_set_item (priv->pam_handle, PAM_RHOST, "localhost") !=
         PAM_SUCCESS) {
@@ -435,11 +537,166 @@ tlm_auth_session_open (TlmAuthSession *auth_session, GError **error)
         return FALSE;
     }
 
-    priv->session_id = _auth_session_get_logind_session_id (error);
+    priv->session_id = _auth_session_get_logind_session_id ();
 
     return TRUE;
 }
 
+static void
+_auth_session_worker_func (gpointer data, gpointer user_data)
+{
+    GTask *task = G_TASK (data);
+    TlmAuthSession *auth_session = TLM_AUTH_SESSION (
+            g_task_get_source_object (task));
+    TlmAuthSessionPhase phase = (TlmAuthSessionPhase) g_task_get_task_data (
+            task);
+    GError *error = NULL;
+
+    if (g_task_return_error_if_cancelled (task)) {
+        g_object_unref (task);
+        return;
+    }
+
+    if (!phase (auth_session, &error)) {
+        if (!error)
+            error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
+                    "PAM session setup failed");
+        g_task_return_error (task, error);
+    } else if (!g_task_return_error_if_cancelled (task)) {
+        g_task_return_boolean (task, TRUE);
+    }
+    g_object_unref (task);
+}
+
+static void
+_auth_session_run_phase (
+        TlmAuthSession *auth_session,
+        TlmAuthSessionPhase phase,
+        gpointer source_tag,
+        GCancellable *cancellable,
+        GAsyncReadyCallback callback,
+        gpointer user_data)
+{
+    TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
+    GError *error = NULL;
+    GTask *task = g_task_new (auth_session, cancellable, callback, user_data);
+
+    g_task_set_source_tag (task, source_tag);
+    g_task_set_task_data (task, (gpointer) phase, NULL);
+
+    if (!priv->worker) {
+        priv->worker = g_thread_pool_new (_auth_session_worker_func, NULL, 1,
+                                          TRUE, &error);
+        if (!priv->worker) {
+            g_task_return_error (task, error);
+            g_object_unref (task);
+            return;
+        }
+    }
+
+    g_clear_object (&priv->cancellable);
+    if (cancellable)
+        priv->cancellable = g_object_ref (cancellable);
+
+    g_thread_pool_push (priv->worker, task, NULL);
+}
+
+/* Cancelling fails pending PAM conversations, so that the authentication
+ * finishes as soon as the PAM stack gives control back. */
+void
+tlm_auth_session_authenticate_async (
+        TlmAuthSession *auth_session,
+        GCancellable *cancellable,
+        GAsyncReadyCallback callback,
+        gpointer user_data)
+{
+    g_return_if_fail (auth_session && TLM_IS_AUTH_SESSION (auth_session));
+
+    _auth_session_run_phase (auth_session,
+                             tlm_auth_session_authenticate,
+                             tlm_auth_session_authenticate_async,
+                             cancellable, callback, user_data);
+}
+
+gboolean
+tlm_auth_session_authenticate_finish (
+        TlmAuthSession *auth_session,
+        GAsyncResult *result,
+        GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, auth_session), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static void
+_auth_session_on_opened (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GTask *task = G_TASK (user_data);
+    TlmAuthSession *auth_session = TLM_AUTH_SESSION (object);
+    GError *error = NULL;
+
+    if (!g_task_propagate_boolean (G_TASK (res), &error)) {
+        g_task_return_error (task, error);
+        g_object_unref (task);
+        return;
+    }
+
+    if (auth_session->priv->session_id) {
+        g_task_return_boolean (task, TRUE);
+        g_object_unref (task);
+        return;
+    }
+
+    /* not in a logind scope we could see, ask logind itself */
+    DBG ("trying to get session id");
+    if (_logind_bus && !g_dbus_connection_is_closed (_logind_bus) &&
+        g_strcmp0 (_logind_address, auth_session->priv->logind_address) == 0) {
+        _auth_session_get_session_by_pid (task);
+        return;
+    }
+
+    g_free (_logind_address);
+    _logind_address = g_strdup (auth_session->priv->logind_address);
+    tlm_utils_logind_bus_get (_logind_address,
+                              g_task_get_cancellable (task),
+                              _auth_session_on_bus_get, task);
+}
+
+void
+tlm_auth_session_open_async (
+        TlmAuthSession *auth_session,
+        GCancellable *cancellable,
+        GAsyncReadyCallback callback,
+        gpointer user_data)
+{
+    GTask *task;
+
+    g_return_if_fail (auth_session && TLM_IS_AUTH_SESSION (auth_session));
+
+    task = g_task_new (auth_session, cancellable, callback, user_data);
+    g_task_set_source_tag (task, tlm_auth_session_open_async);
+
+    _auth_session_run_phase (auth_session,
+                             tlm_auth_session_open,
+                             tlm_auth_session_open_async,
+                             cancellable, _auth_session_on_opened, task);
+}
+
+gboolean
+tlm_auth_session_open_finish (
+        TlmAuthSession *auth_session,
+        GAsyncResult *result,
+        GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, auth_session), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 TlmAuthSession *
 tlm_auth_session_new (const gchar *service,
                       const gchar *username,
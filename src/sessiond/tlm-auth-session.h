@@ -28,6 +28,7 @@
 #define _TLM_AUTH_SESSION_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -76,6 +77,28 @@ tlm_auth_session_authenticate (TlmAuthSession *auth_session, GError **error);
 gboolean
 tlm_auth_session_open (TlmAuthSession *auth_session, GError **error);
 
+void
+tlm_auth_session_authenticate_async (TlmAuthSession *auth_session,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data);
+
+gboolean
+tlm_auth_session_authenticate_finish (TlmAuthSession *auth_session,
+                                      GAsyncResult *result,
+                                      GError **error);
+
+void
+tlm_auth_session_open_async (TlmAuthSession *auth_session,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data);
+
+gboolean
+tlm_auth_session_open_finish (TlmAuthSession *auth_session,
+                              GAsyncResult *result,
+                              GError **error);
+
 const gchar *
 tlm_auth_session_get_username (TlmAuthSession *auth_session);
 
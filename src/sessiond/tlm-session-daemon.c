@@ -25,7 +25,10 @@
 
 #include "common/tlm-log.h"
 #include "common/tlm-error.h"
+#include "common/tlm-config.h"
+#include "common/tlm-config-general.h"
 #include "common/tlm-pipe-stream.h"
+#include "common/tlm-user-info.h"
 #include "common/dbus/tlm-dbus-session-gen.h"
 #include "common/dbus/tlm-dbus-utils.h"
 #include "common/dbus/tlm-dbus.h"
@@ -125,6 +128,8 @@ _handle_session_create_from_dbus (
         GDBusMethodInvocation *invocation,
         const gchar *password,
         GVariant *environment,
+        GVariant *config,
+        GVariant *user,
         gpointer user_data)
 {
     g_return_val_if_fail (self && TLM_IS_SESSION_DAEMON (self), FALSE);
@@ -132,6 +137,8 @@ _handle_session_create_from_dbus (
     gchar *service = NULL;
     gchar *username = NULL;
     GHashTable *data = NULL;
+    TlmConfig *session_config = NULL;
+    TlmUserInfo *user_info = NULL;
 
     tlm_dbus_session_complete_session_create (
             self->priv->dbus_session, invocation);
@@ -144,6 +151,17 @@ _handle_session_create_from_dbus (
     g_object_get (self->priv->dbus_session, "seatid", &seatid,
             "username", &username, "service", &service, NULL);
 
+    session_config = tlm_config_new_from_snapshot (config);
+    tlm_log_set_debug (tlm_config_get_boolean (session_config,
+            TLM_CONFIG_GENERAL, TLM_CONFIG_GENERAL_LOG_DEBUG, TRUE));
+    g_object_set (self->priv->session, "config", session_config, NULL);
+    g_object_unref (session_config);
+
+    user_info = tlm_user_info_new_from_variant (user);
+    if (user_info)
+        g_object_set (self->priv->session, "user-info", user_info, NULL);
+    tlm_user_info_unref (user_info);
+
     tlm_session_start (self->priv->session, seatid, service, username,
             password, data);
 
@@ -181,6 +199,10 @@ _handle_session_created_from_session (
 
     g_object_set (G_OBJECT (self->priv->dbus_session), "sessionid", sessionid,
             NULL);
+    /* ahead of sessionCreated, so that the daemon has the complete
+     * timeline once the login is done */
+    tlm_dbus_session_emit_timeline (self->priv->dbus_session,
+            tlm_session_get_timeline (self->priv->session));
     tlm_dbus_session_emit_session_created (self->priv->dbus_session, sessionid);
 }
 
@@ -217,6 +239,8 @@ _handle_error_from_session (
     DBG("%s", data_str);
     g_free (data_str);
 
+    tlm_dbus_session_emit_timeline (self->priv->dbus_session,
+            tlm_session_get_timeline (self->priv->session));
     tlm_dbus_session_emit_error (self->priv->dbus_session, error);
 }
 
@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <grp.h>
+#include <limits.h>
 #include <stdio.h>
 #include <signal.h>
 #include <termios.h>
@@ -39,6 +40,9 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sched.h>
 #include <ctype.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -52,8 +56,21 @@
 #include "common/tlm-log.h"
 #include "common/tlm-utils.h"
 #include "common/tlm-error.h"
+#include "common/tlm-spawn.h"
+#include "common/tlm-proc-watch.h"
+#include "common/tlm-cgroup.h"
+#include "common/tlm-user-info.h"
+#include "common/tlm-utmp.h"
+#include "common/tlm-timeline.h"
 #include "common/tlm-config-general.h"
-#include "common/tlm-config-seat.h"
+
+#ifndef IOPRIO_CLASS_SHIFT
+#define IOPRIO_CLASS_SHIFT          13
+#endif
+#define TLM_IOPRIO_CLASS_RT         1
+#define TLM_IOPRIO_CLASS_BE         2
+#define TLM_IOPRIO_CLASS_IDLE       3
+#define TLM_IOPRIO_WHO_PROCESS      1
 
 G_DEFINE_TYPE (TlmSession, tlm_session, G_TYPE_OBJECT);
 
@@ -67,6 +84,7 @@ enum {
     PROP_SERVICE,
     PROP_USERNAME,
     PROP_ENVIRONMENT,
+    PROP_USER_INFO,
     N_PROPERTIES
 };
 static GParamSpec *pspecs[N_PROPERTIES];
@@ -92,17 +110,20 @@ struct _TlmSessionPrivate
     gchar *seat_id;
     gchar *service;
     gchar *username;
+    TlmUserInfo *user_info;
     GHashTable *env_hash;
     TlmAuthSession *auth_session;
-    int last_sig;
-    guint timer_id;
-    guint child_watch_id;
+    GCancellable *cancellable; /* set while PAM setup is in progress */
+    TlmProcWatch *watch; /* user session process group */
+    gchar *cgroup; /* cgroup of the user session, or NULL */
     gchar *sessionid;
     gchar *xdg_runtime_dir;
     gboolean setup_runtime_dir;
     gboolean can_emit_signal;
     gboolean is_child_up;
     gboolean session_pause;
+    gboolean utmp_logged; /* owes a logout record */
+    TlmTimeline *timeline; /* phases of the latest login */
     int kb_mode;
 };
 
@@ -119,6 +140,8 @@ tlm_session_dispose (GObject *self)
         g_main_context_iteration(NULL, TRUE);
 
     g_clear_object (&session->priv->config);
+    g_clear_pointer (&session->priv->user_info, tlm_user_info_unref);
+    g_clear_pointer (&session->priv->timeline, tlm_timeline_free);
 
     G_OBJECT_CLASS (tlm_session_parent_class)->dispose (self);
 }
@@ -141,6 +164,7 @@ _session_set_property (GObject *obj,
 
     switch (property_id) {
         case PROP_CONFIG:
+            g_clear_object (&priv->config);
             priv->config = g_value_dup_object (value);
             break;
         case PROP_SEAT:
@@ -158,6 +182,10 @@ _session_set_property (GObject *obj,
             if (priv->env_hash)
                 g_hash_table_ref (priv->env_hash);
             break;
+        case PROP_USER_INFO:
+            tlm_user_info_unref (priv->user_info);
+            priv->user_info = g_value_dup_boxed (value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
     }
@@ -188,6 +216,9 @@ _session_get_property (GObject *obj,
         case PROP_ENVIRONMENT:
             g_value_set_pointer (value, priv->env_hash);
             break;
+        case PROP_USER_INFO:
+            g_value_set_boxed (value, priv->user_info);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, property_id, pspec);
     }
@@ -235,6 +266,12 @@ tlm_session_class_init (TlmSessionClass *klass)
                               "environment variables",
                               "Environment variables for the session",
                               G_PARAM_READWRITE|G_PARAM_STATIC_STRINGS);
+    pspecs[PROP_USER_INFO] =
+        g_param_spec_boxed ("user-info",
+                            "user info",
+                            "Resolved passwd entry of the user to login",
+                            TLM_TYPE_USER_INFO,
+                            G_PARAM_READWRITE|G_PARAM_STATIC_STRINGS);
 
     g_object_class_install_properties (g_klass, N_PROPERTIES, pspecs);
 
@@ -269,27 +306,56 @@ tlm_session_init (TlmSession *session)
     priv->service = NULL;
     priv->env_hash = NULL;
     priv->auth_session = NULL;
+    priv->cancellable = NULL;
     priv->sessionid = NULL;
-    priv->child_watch_id = 0;
+    priv->watch = NULL;
+    priv->cgroup = NULL;
     priv->is_child_up = FALSE;
+    priv->utmp_logged = FALSE;
+    priv->timeline = NULL;
     priv->can_emit_signal = TRUE;
-    priv->config = tlm_config_new ();
+    priv->config = NULL;
     priv->kb_mode = -1;
 
     session->priv = priv;
 }
 
+typedef struct _SessionEnv
+{
+    TlmSessionPrivate *priv;
+    gchar **envp;
+} SessionEnv;
+
+typedef struct _ChildSetup
+{
+    int tty_fd;
+    int cgroup_fd;
+    uid_t uid;
+    gid_t gid;
+    /* supplementary groups, resolved before the fork */
+    gid_t *groups;
+    gint n_groups;
+    const gchar *home;
+    /* scheduling, parsed before the fork */
+    gint nice; /* G_MAXINT to inherit */
+    gint sched_policy; /* -1 to inherit */
+    gboolean set_affinity;
+    cpu_set_t affinity;
+    gint ioprio; /* -1 to inherit */
+    gchar oom_score_adj[16]; /* empty to inherit */
+} ChildSetup;
+
 static void
 _setenv_to_session (const gchar *key, const gchar *val,
-                    TlmSessionPrivate *user_data)
+                    SessionEnv *user_data)
 {
-    TlmSessionPrivate *priv = (TlmSessionPrivate *) user_data;
+    TlmSessionPrivate *priv = user_data->priv;
     if (priv->session_pause)
         tlm_auth_session_set_env (priv->auth_session,
                                   (const gchar *) key,
                                   (const gchar *) val);
     else
-        setenv ((const char *) key, (const char *) val, 1);
+        user_data->envp = g_environ_setenv (user_data->envp, key, val, TRUE);
 }
 
 static int
@@ -344,7 +410,7 @@ _prepare_terminal (TlmSessionPrivate *priv)
     if (ioctl (tty_fd, TCGETS, &priv->tty_state) < 0)
         WARN ("ioctl(TCGETS) failed: %s", strerror(errno));
 
-    if (fchown (tty_fd, tlm_user_get_uid (priv->username), -1)) {
+    if (fchown (tty_fd, priv->user_info->uid, -1)) {
         WARN ("Changing TTY access rights failed");
     }
 
@@ -361,21 +427,21 @@ term_exit:
     return -1;
 }
 
+/* runs in the forked child, see _setup_user_session() */
 static void
-_setup_terminal (TlmSessionPrivate *priv, int tty_fd)
+_setup_terminal (int tty_fd)
 {
     pid_t tty_pgid;
 
     if (ioctl (tty_fd, TIOCSCTTY, 1) < 0)
-        WARN ("ioctl(TIOCSCTTY) failed: %s", strerror(errno));
+        tlm_spawn_child_report ("ioctl(TIOCSCTTY)", errno, FALSE);
     tty_pgid = getpgid (getpid ());
     if (ioctl (tty_fd, TIOCSPGRP, &tty_pgid) < 0) {
-        WARN ("ioctl(TIOCSPGRP) failed: %s", strerror(errno));
+        tlm_spawn_child_report ("ioctl(TIOCSPGRP)", errno, FALSE);
     }
 
-    if (ioctl (tty_fd, KDSKBMODE, K_OFF) < 0) {
-        DBG ("ioctl(KDSKBMODE set) failed: %s", strerror(errno));
-    }
+    /* fails on anything but a VT, which is fine */
+    ioctl (tty_fd, KDSKBMODE, K_OFF);
 
     dup2 (tty_fd, 0);
     dup2 (tty_fd, 1);
@@ -416,58 +482,52 @@ reset_exit:
     g_clear_string (&priv->tty_dev);
 }
 
-static gboolean
-_set_environment (TlmSessionPrivate *priv)
+static gchar **
+_build_environment (TlmSessionPrivate *priv)
 {
 	gchar **envlist = tlm_auth_session_get_envlist(priv->auth_session);
-	const gchar *home_dir = NULL, *shell = NULL;
+    SessionEnv env = { priv, g_get_environ () };
+    const TlmSeatConfig *seat_config = tlm_config_get_seat_config (
+            priv->config, priv->seat_id);
 
     if (envlist) {
-        gchar **env = 0;
-        for (env = envlist; *env != NULL; ++env) {
-            DBG ("ENV : %s", *env);
-            putenv(*env);
-            g_free (*env);
+        gchar **item = 0;
+        for (item = envlist; *item != NULL; ++item) {
+            gchar *value = strchr (*item, '=');
+            DBG ("ENV : %s", *item);
+            if (value) {
+                *value++ = '\0';
+                env.envp = g_environ_setenv (env.envp, *item, value, TRUE);
+            }
+            g_free (*item);
         }
         g_free (envlist);
     }
 
-    const gchar *path = tlm_config_get_string (priv->config,
-                                               TLM_CONFIG_GENERAL,
-                                               TLM_CONFIG_GENERAL_SESSION_PATH);
-    if (!path)
-        path = "/usr/local/bin:/usr/bin:/bin";
-    _setenv_to_session ("PATH", path, priv);
-
-    _setenv_to_session ("USER", priv->username, priv);
-    _setenv_to_session ("LOGNAME", priv->username, priv);
-    home_dir = tlm_user_get_home_dir (priv->username);
-    if (home_dir) _setenv_to_session ("HOME", home_dir, priv);
-    shell = tlm_user_get_shell (priv->username);
-    if (shell) _setenv_to_session ("SHELL", shell, priv);
-
-    if (!tlm_config_has_key (priv->config,
-                             TLM_CONFIG_GENERAL,
-                             TLM_CONFIG_GENERAL_NSEATS))
-        _setenv_to_session ("XDG_SEAT", priv->seat_id, priv);
-
-    const gchar *xdg_data_dirs =
-        tlm_config_get_string (priv->config,
-                               TLM_CONFIG_GENERAL,
-                               TLM_CONFIG_GENERAL_DATA_DIRS);
-    if (!xdg_data_dirs)
-        xdg_data_dirs = "/usr/share:/usr/local/share";
-    _setenv_to_session ("XDG_DATA_DIRS", xdg_data_dirs, priv);
+    _setenv_to_session ("PATH", seat_config->session_path, &env);
+
+    _setenv_to_session ("USER", priv->username, &env);
+    _setenv_to_session ("LOGNAME", priv->username, &env);
+    if (priv->user_info->home_dir[0])
+        _setenv_to_session ("HOME", priv->user_info->home_dir, &env);
+    if (priv->user_info->shell[0])
+        _setenv_to_session ("SHELL", priv->user_info->shell, &env);
+
+    if (seat_config->set_xdg_seat)
+        _setenv_to_session ("XDG_SEAT", priv->seat_id, &env);
+
+    const gchar *xdg_data_dirs = seat_config->xdg_data_dirs;
+    _setenv_to_session ("XDG_DATA_DIRS", xdg_data_dirs, &env);
 
     if (priv->xdg_runtime_dir)
-        _setenv_to_session ("XDG_RUNTIME_DIR", priv->xdg_runtime_dir, priv);
+        _setenv_to_session ("XDG_RUNTIME_DIR", priv->xdg_runtime_dir, &env);
 
     if (priv->env_hash)
         g_hash_table_foreach (priv->env_hash,
                               (GHFunc) _setenv_to_session,
-                              priv);
+                              &env);
 
-    return TRUE;
+    return env.envp;
 }
 
 static void
@@ -475,19 +535,20 @@ _clear_session (TlmSession *session)
 {
     TlmSessionPrivate *priv = TLM_SESSION_PRIV (session);
 
+    if (priv->utmp_logged) {
+        tlm_utmp_log_logout ();
+        priv->utmp_logged = FALSE;
+    }
+
     _reset_terminal (priv);
 
     if (priv->setup_runtime_dir)
         tlm_utils_delete_dir (priv->xdg_runtime_dir);
 
-    if (priv->timer_id) {
-        g_source_remove (priv->timer_id);
-        priv->timer_id = 0;
-    }
-
-    if (priv->child_watch_id) {
-        g_source_remove (priv->child_watch_id);
-        priv->child_watch_id = 0;
+    g_clear_pointer (&priv->watch, tlm_proc_watch_free);
+    if (priv->cgroup) {
+        tlm_cgroup_remove (priv->cgroup);
+        g_clear_string (&priv->cgroup);
     }
 
     if (priv->auth_session)
@@ -500,18 +561,17 @@ _clear_session (TlmSession *session)
     g_clear_string (&priv->seat_id);
     g_clear_string (&priv->service);
     g_clear_string (&priv->username);
+    g_clear_pointer (&priv->user_info, tlm_user_info_unref);
     g_clear_string (&priv->sessionid);
     g_clear_string (&priv->xdg_runtime_dir);
 }
 
 static void
 _on_child_down_cb (
-        GPid  pid,
+        pid_t pid,
         gint  status,
         gpointer data)
 {
-    g_spawn_close_pid (pid);
-
     TlmSession *session = TLM_SESSION (data);
 
     DBG ("Sessiond(%p) with pid (%d) closed with status %d", session, pid,
@@ -524,49 +584,233 @@ _on_child_down_cb (
         g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
 }
 
+static gint
+_parse_sched_policy (const gchar *value)
+{
+    if (!value)
+        return -1;
+    if (g_strcmp0 (value, "other") == 0)
+        return SCHED_OTHER;
+    if (g_strcmp0 (value, "batch") == 0)
+        return SCHED_BATCH;
+    if (g_strcmp0 (value, "idle") == 0)
+        return SCHED_IDLE;
+
+    WARN ("unknown scheduling policy '%s'", value);
+    return -1;
+}
+
+/* parses CPU lists like "0-3,6" */
+static gboolean
+_parse_cpu_list (const gchar *value, cpu_set_t *set)
+{
+    gchar **ranges = NULL;
+    gchar **range;
+    gboolean ret = TRUE;
+
+    if (!value)
+        return FALSE;
+
+    CPU_ZERO (set);
+    ranges = g_strsplit (value, ",", -1);
+    for (range = ranges; *range && ret; range++) {
+        guint first = 0, last = 0, cpu;
+        gint n = sscanf (*range, "%u-%u", &first, &last);
+
+        if (n == 1)
+            last = first;
+        if (n < 1 || last < first || last >= CPU_SETSIZE) {
+            ret = FALSE;
+            break;
+        }
+        for (cpu = first; cpu <= last; cpu++)
+            CPU_SET (cpu, set);
+    }
+    g_strfreev (ranges);
+
+    if (!ret || CPU_COUNT (set) == 0) {
+        WARN ("invalid CPU list '%s'", value);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* parses "realtime:LEVEL", "best-effort:LEVEL" or "idle" */
+static gint
+_parse_io_priority (const gchar *value)
+{
+    gint klass = 0;
+    guint level = 4;
+    const gchar *level_str = NULL;
+
+    if (!value)
+        return -1;
+
+    if (g_str_has_prefix (value, "realtime")) {
+        klass = TLM_IOPRIO_CLASS_RT;
+        level_str = value + 8;
+    } else if (g_str_has_prefix (value, "best-effort")) {
+        klass = TLM_IOPRIO_CLASS_BE;
+        level_str = value + 11;
+    } else if (g_strcmp0 (value, "idle") == 0) {
+        return TLM_IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+    }
+
+    if (!klass || (*level_str && (sscanf (level_str, ":%u", &level) != 1 ||
+                                  level > 7))) {
+        WARN ("invalid I/O priority '%s'", value);
+        return -1;
+    }
+    return (klass << IOPRIO_CLASS_SHIFT) | level;
+}
+
 static void
+_prepare_session_policy (ChildSetup *setup, const TlmSeatConfig *seat_config)
+{
+    setup->nice = seat_config->session_nice;
+    setup->sched_policy = _parse_sched_policy (
+            seat_config->session_sched_policy);
+    setup->set_affinity = _parse_cpu_list (seat_config->session_cpu_affinity,
+                                           &setup->affinity);
+    setup->ioprio = _parse_io_priority (seat_config->session_io_priority);
+    setup->oom_score_adj[0] = '\0';
+    if (seat_config->session_oom_score_adj != G_MAXINT)
+        g_snprintf (setup->oom_score_adj, sizeof (setup->oom_score_adj),
+                    "%d", seat_config->session_oom_score_adj);
+}
+
+/* NSS lookups are not safe in the forked child */
+static gboolean
+_prepare_session_groups (ChildSetup *setup, const gchar *username)
+{
+    gint n_groups = 32;
+
+    setup->groups = g_new (gid_t, n_groups);
+    while (getgrouplist (username, setup->gid, setup->groups,
+                         &n_groups) < 0) {
+        if (n_groups > NGROUPS_MAX) {
+            WARN ("too many groups for '%s'", username);
+            g_clear_pointer (&setup->groups, g_free);
+            return FALSE;
+        }
+        setup->groups = g_renew (gid_t, setup->groups, n_groups);
+    }
+    setup->n_groups = n_groups;
+    return TRUE;
+}
+
+/* runs in the forked child while it still has root privileges */
+static void
+_apply_session_policy (const ChildSetup *setup)
+{
+    if (setup->sched_policy >= 0) {
+        struct sched_param param = { 0 };
+        if (sched_setscheduler (0, setup->sched_policy, &param) < 0)
+            tlm_spawn_child_report ("sched_setscheduler()", errno, FALSE);
+    }
+    if (setup->nice != G_MAXINT &&
+        setpriority (PRIO_PROCESS, 0, setup->nice) < 0)
+        tlm_spawn_child_report ("setpriority()", errno, FALSE);
+    if (setup->set_affinity &&
+        sched_setaffinity (0, sizeof (cpu_set_t), &setup->affinity) < 0)
+        tlm_spawn_child_report ("sched_setaffinity()", errno, FALSE);
+    if (setup->ioprio >= 0 &&
+        syscall (SYS_ioprio_set, TLM_IOPRIO_WHO_PROCESS, 0,
+                 setup->ioprio) < 0)
+        tlm_spawn_child_report ("ioprio_set()", errno, FALSE);
+    if (setup->oom_score_adj[0]) {
+        gssize len = strlen (setup->oom_score_adj);
+        gint fd = open ("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write (fd, setup->oom_score_adj, len) != len)
+            tlm_spawn_child_report ("setting oom_score_adj", errno, FALSE);
+        if (fd >= 0)
+            close (fd);
+    }
+}
+
+/* runs in the forked child, right before exec; the daemon has other
+ * threads whose locks may be held, so no logging, allocation or NSS */
+static gboolean
+_setup_user_session (gpointer user_data)
+{
+    ChildSetup *setup = (ChildSetup *) user_data;
+
+    /* join the session cgroup first, so that nothing runs outside of it */
+    if (setup->cgroup_fd >= 0 && write (setup->cgroup_fd, "0", 1) != 1)
+        tlm_spawn_child_report ("joining session cgroup", errno, FALSE);
+
+    if (setsid () == (pid_t) -1)
+        tlm_spawn_child_report ("setsid()", errno, FALSE);
+
+    if (setup->tty_fd >= 0) {
+        /* usually terminal settings are handled by PAM */
+        _setup_terminal (setup->tty_fd);
+    }
+
+    _apply_session_policy (setup);
+
+    /* never run the session with the daemon's identity */
+    if (setgroups (setup->n_groups, setup->groups) < 0) {
+        tlm_spawn_child_report ("setgroups()", errno, TRUE);
+        return FALSE;
+    }
+    if (setregid (setup->gid, setup->gid) < 0) {
+        tlm_spawn_child_report ("setregid()", errno, TRUE);
+        return FALSE;
+    }
+    if (setreuid (setup->uid, setup->uid) < 0) {
+        tlm_spawn_child_report ("setreuid()", errno, TRUE);
+        return FALSE;
+    }
+    umask(0077);
+
+    if (setup->home && chdir (setup->home) < 0)
+        tlm_spawn_child_report ("chdir() to home", errno, FALSE);
+
+    if (signal (SIGINT, SIG_DFL) == SIG_ERR)
+        tlm_spawn_child_report ("resetting SIGINT", errno, FALSE);
+
+    return TRUE;
+}
+
+static gboolean
 _exec_user_session (
 		TlmSession *session)
 {
     int tty_fd = -1;
-    gint i;
+    gint i = 0;
     guint rtdir_perm = 0700;
-    const gchar *rtdir_perm_str;
-    const char *home;
-    const char *shell = NULL;
     const char *env_shell = NULL;
+    const TlmSeatConfig *seat_config = NULL;
     gchar *uid_str;
     gchar **args = NULL;
     gchar **args_iter = NULL;
+    gchar **envp = NULL;
+    ChildSetup setup;
+    GError *error = NULL;
     TlmSessionPrivate *priv = session->priv;
 
     priv = session->priv;
     if (!priv->username)
         priv->username = g_strdup (tlm_auth_session_get_username (
                 priv->auth_session));
+    /* the daemon normally hands over the resolved entry, but PAM might
+     * have mapped the login to a different user */
+    if (priv->user_info &&
+        g_strcmp0 (priv->user_info->name, priv->username) != 0)
+        g_clear_pointer (&priv->user_info, tlm_user_info_unref);
+    if (!priv->user_info)
+        priv->user_info = tlm_user_info_new_from_name (priv->username);
+    if (!priv->user_info) {
+        WARN ("no such user '%s'", priv->username);
+        return FALSE;
+    }
     DBG ("session ID : %s", priv->sessionid);
 
-    if (tlm_config_has_key (priv->config,
-                            priv->seat_id,
-                            TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR)) {
-        priv->setup_runtime_dir = tlm_config_get_boolean (priv->config,
-                                           priv->seat_id,
-                                           TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR,
-                                           FALSE);
-    } else {
-        priv->setup_runtime_dir = tlm_config_get_boolean (priv->config,
-                                           TLM_CONFIG_GENERAL,
-                                           TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR,
-                                           FALSE);
-    }
-    rtdir_perm_str = tlm_config_get_string (priv->config,
-                                            priv->seat_id,
-                                            TLM_CONFIG_GENERAL_RUNTIME_MODE);
-    if (!rtdir_perm_str)
-        rtdir_perm_str = tlm_config_get_string (priv->config,
-                                               TLM_CONFIG_GENERAL,
-                                               TLM_CONFIG_GENERAL_RUNTIME_MODE);
-    uid_str = g_strdup_printf ("%u", tlm_user_get_uid (priv->username));
+    seat_config = tlm_config_get_seat_config (priv->config, priv->seat_id);
+    priv->setup_runtime_dir = seat_config->setup_runtime_dir;
+    rtdir_perm = seat_config->runtime_mode;
+    uid_str = g_strdup_printf ("%u", priv->user_info->uid);
     priv->xdg_runtime_dir = g_build_filename ("/run/user",
                                               uid_str,
                                               NULL);
@@ -575,15 +819,12 @@ _exec_user_session (
         tlm_utils_delete_dir (priv->xdg_runtime_dir);
         if (g_mkdir_with_parents ("/run/user", 0755))
             WARN ("g_mkdir_with_parents(\"/run/user\") failed");
-        if (rtdir_perm_str)
-            sscanf(rtdir_perm_str, "%o", &rtdir_perm);
         DBG ("setting up XDG_RUNTIME_DIR=%s mode=%o",
              priv->xdg_runtime_dir, rtdir_perm);
         if (g_mkdir (priv->xdg_runtime_dir, rtdir_perm))
             WARN ("g_mkdir(\"%s\") failed", priv->xdg_runtime_dir);
         if (chown (priv->xdg_runtime_dir,
-               tlm_user_get_uid (priv->username),
-               tlm_user_get_gid (priv->username)))
+               priv->user_info->uid, priv->user_info->gid))
             WARN ("chown(\"%s\"): %s", priv->xdg_runtime_dir, strerror(errno));
         if (chmod (priv->xdg_runtime_dir, rtdir_perm))
             WARN ("chmod(\"%s\"): %s", priv->xdg_runtime_dir, strerror(errno));
@@ -591,115 +832,20 @@ _exec_user_session (
         DBG ("not setting up XDG_RUNTIME_DIR");
     }
 
-    gboolean setup_terminal;
-    if (tlm_config_has_key (priv->config,
-                            priv->seat_id,
-                            TLM_CONFIG_GENERAL_SETUP_TERMINAL)) {
-        setup_terminal = tlm_config_get_boolean (priv->config,
-                                                 priv->seat_id,
-                                                 TLM_CONFIG_GENERAL_SETUP_TERMINAL,
-                                                 FALSE);
-    } else {
-        setup_terminal = tlm_config_get_boolean (priv->config,
-                                                 TLM_CONFIG_GENERAL,
-                                                 TLM_CONFIG_GENERAL_SETUP_TERMINAL,
-                                                 FALSE);
-    }
-    if (setup_terminal) {
+    if (seat_config->setup_terminal) {
         tty_fd = _prepare_terminal (priv);
         if (tty_fd < 0) {
             WARN ("Failed to prepare terminal");
-            return;
-        }
-    }
-
-    priv->child_pid = fork ();
-    if (priv->child_pid) {
-        if (tty_fd >= 0)
-            close (tty_fd);
-        DBG ("establish handler for the child pid %u", priv->child_pid);
-        session->priv->child_watch_id = g_child_watch_add (priv->child_pid,
-                    (GChildWatchFunc)_on_child_down_cb, session);
-        session->priv->is_child_up = TRUE;
-        return;
-    }
-
-    /* ==================================
-     * this is child process here onwards
-     * ================================== */
-
-    gint open_max;
-    gint fd;
-
-    //close all open descriptors other than stdin, stdout, stderr
-    open_max = sysconf (_SC_OPEN_MAX);
-    for (fd = 3; fd < open_max; fd++) {
-        if (fcntl (fd, F_SETFD, FD_CLOEXEC) < -1) {
-            WARN ("Failed to close desriptor '%d', error: %s",
-                fd, strerror(errno));
+            return FALSE;
         }
     }
 
-    uid_t target_uid = tlm_user_get_uid (priv->username);
-    gid_t target_gid = tlm_user_get_gid (priv->username);
+    envp = _build_environment (priv);
 
-    /*if (getppid() == 1) {
-        if (setsid () == (pid_t) -1)
-            WARN ("setsid() failed: %s", strerror (errno));
+    if (seat_config->session_argv) {
+        args = g_strdupv (seat_config->session_argv);
     } else {
-        if (setpgrp ())
-            WARN ("setpgrp() failed: %s", strerror (errno));
-    }*/
-
-    DBG ("old pgid=%u", getpgrp ());
-    if (setsid () == (pid_t) -1)
-        WARN ("setsid() failed: %s", strerror (errno));
-    DBG ("new pgid=%u", getpgrp());
-
-    if (setup_terminal) {
-        /* usually terminal settings are handled by PAM */
-        _setup_terminal (priv, tty_fd);
-    }
-
-    if (initgroups (priv->username, target_gid))
-        WARN ("initgroups() failed: %s", strerror(errno));
-    if (setregid (target_gid, target_gid))
-        WARN ("setregid() failed: %s", strerror(errno));
-    if (setreuid (target_uid, target_uid))
-        WARN ("setreuid() failed: %s", strerror(errno));
-
-    int grouplist_len = NGROUPS_MAX;
-    gid_t grouplist[NGROUPS_MAX];
-    grouplist_len = getgroups (grouplist_len, grouplist);
-    DBG ("group membership:");
-    for (i = 0; i < grouplist_len; i++)
-        DBG ("\t%s", getgrgid (grouplist[i])->gr_name);
-
-    DBG (" state:\n\truid=%d, euid=%d, rgid=%d, egid=%d (%s)",
-         getuid(), geteuid(), getgid(), getegid(), priv->username);
-    _set_environment (priv);
-    umask(0077);
-
-    home = getenv("HOME");
-    if (home) {
-        DBG ("changing directory to : %s", home);
-        if (chdir (home) < 0)
-            WARN ("Failed to change directroy : %s", strerror (errno));
-    } else WARN ("Could not get home directory");
-
-    shell = tlm_config_get_string (priv->config,
-                                   priv->seat_id,
-                                   TLM_CONFIG_GENERAL_SESSION_CMD);
-    if (!shell)
-        shell = tlm_config_get_string (priv->config,
-                                       TLM_CONFIG_GENERAL,
-                                       TLM_CONFIG_GENERAL_SESSION_CMD);
-    if (shell) {
-        args = tlm_utils_split_command_line (shell);
-    }
-
-    if (!args) {
-        if((env_shell = getenv("SHELL"))) {
+        if((env_shell = g_environ_getenv (envp, "SHELL"))) {
             /* use shell if no override configured */
             args = g_new0 (gchar *, 2);
             args[0] = g_strdup (env_shell);
@@ -711,20 +857,174 @@ _exec_user_session (
         }
     }
 
-    if (signal (SIGINT, SIG_DFL) == SIG_ERR)
-        WARN ("failed reset SIGINT: %s", strerror(errno));
-
     DBG ("executing: ");
     args_iter = args;
     while (args_iter && *args_iter) {
         DBG ("\targv[%d]: %s", i, *args_iter);
         args_iter++; i++;
     }
-    execvp (args[0], args);
-    /* we reach here only in case of error */
+
+    setup.tty_fd = tty_fd;
+    setup.cgroup_fd = -1;
+    if (seat_config->cgroup_path) {
+        gchar *name = g_strdup_printf ("session-%u", getpid ());
+        priv->cgroup = tlm_cgroup_create (seat_config->cgroup_path,
+                                          priv->seat_id, name);
+        g_free (name);
+        /* left over from an earlier session whose sessiond had our pid */
+        if (priv->cgroup && tlm_cgroup_is_populated (priv->cgroup) &&
+            !tlm_cgroup_clear (priv->cgroup, seat_config->terminate_step)) {
+            WARN ("cgroup %s stays populated, not using it", priv->cgroup);
+            g_clear_string (&priv->cgroup);
+        }
+        if (priv->cgroup) {
+            setup.cgroup_fd = tlm_cgroup_open_procs (priv->cgroup);
+        }
+    }
+    _prepare_session_policy (&setup, seat_config);
+    setup.uid = priv->user_info->uid;
+    setup.gid = priv->user_info->gid;
+    setup.home = g_environ_getenv (envp, "HOME");
+    if (!setup.home)
+        WARN ("Could not get home directory");
+    if (!_prepare_session_groups (&setup, priv->username)) {
+        if (setup.cgroup_fd >= 0)
+            close (setup.cgroup_fd);
+        if (tty_fd >= 0)
+            close (tty_fd);
+        g_strfreev (args);
+        g_strfreev (envp);
+        return FALSE;
+    }
+
+    tlm_timeline_mark (priv->timeline, TLM_PHASE_FORK);
+    if (!tlm_spawn ((const gchar * const *) args,
+                    (const gchar * const *) envp,
+                    _setup_user_session, &setup,
+                    NULL, NULL, &priv->child_pid, &error)) {
+        WARN ("failed to start user session: %s", error->message);
+        g_error_free (error);
+        priv->child_pid = 0;
+    } else {
+        /* tlm_spawn() returns once the child has exec'd */
+        tlm_timeline_mark (priv->timeline, TLM_PHASE_EXEC);
+    }
+    if (tty_fd >= 0)
+        close (tty_fd);
+    if (setup.cgroup_fd >= 0)
+        close (setup.cgroup_fd);
+    g_free (setup.groups);
     g_strfreev (args);
-    DBG ("execl(): %s", strerror(errno));
-    exit (0);
+    g_strfreev (envp);
+
+    if (!priv->child_pid)
+        return FALSE;
+
+    DBG ("establish handler for the child pid %u", priv->child_pid);
+    session->priv->watch = tlm_proc_watch_new (priv->child_pid, TRUE,
+                _on_child_down_cb, session);
+    if (priv->cgroup)
+        tlm_proc_watch_set_cgroup (session->priv->watch, priv->cgroup);
+    session->priv->is_child_up = TRUE;
+    return TRUE;
+}
+
+static void
+_on_setup_cancelled (TlmSession *session)
+{
+    DBG ("session setup cancelled");
+    g_clear_object (&session->priv->cancellable);
+    _clear_session (session);
+    if (session->priv->can_emit_signal)
+        g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
+}
+
+static void
+_on_open_done (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+    TlmSessionPrivate *priv = session->priv;
+    GError *error = NULL;
+
+    if (!tlm_auth_session_open_finish (TLM_AUTH_SESSION (object), res,
+                                       &error)) {
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_error_free (error);
+            _on_setup_cancelled (session);
+        } else {
+            g_clear_object (&priv->cancellable);
+            g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+            g_error_free (error);
+        }
+        g_object_unref (session);
+        return;
+    }
+    g_clear_object (&priv->cancellable);
+    tlm_timeline_mark (priv->timeline, TLM_PHASE_PAM_OPEN_SESSION);
+
+    priv->sessionid = g_strdup (tlm_auth_session_get_sessionid (
+            priv->auth_session));
+    tlm_utmp_log_login (priv->username);
+    priv->utmp_logged = TRUE;
+
+    priv->session_pause = tlm_config_get_seat_config (
+            priv->config, priv->seat_id)->pause_session;
+    if (!priv->session_pause) {
+        if (!_exec_user_session (session)) {
+            error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
+                    "Unable to start user session");
+            g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+            g_error_free (error);
+            g_object_unref (session);
+            return;
+        }
+        tlm_timeline_mark (priv->timeline, TLM_PHASE_SESSION_CREATED);
+        g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
+                       priv->sessionid ? priv->sessionid : "");
+    } else {
+        tlm_timeline_mark (priv->timeline, TLM_PHASE_SESSION_CREATED);
+        g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
+                       priv->sessionid ? priv->sessionid : "");
+        tlm_utmp_flush ();
+        pause ();
+        exit (0);
+    }
+    g_object_unref (session);
+}
+
+static void
+_on_authenticate_done (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+    TlmSessionPrivate *priv = session->priv;
+    GError *error = NULL;
+
+    if (!tlm_auth_session_authenticate_finish (TLM_AUTH_SESSION (object), res,
+                                               &error)) {
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_error_free (error);
+            _on_setup_cancelled (session);
+        } else {
+            //consistant error message flow
+            GError *err = TLM_GET_ERROR_FOR_ID (
+                    TLM_ERROR_SESSION_CREATION_FAILURE,
+                    "%d:%s", error->code, error->message);
+            g_error_free (error);
+            g_clear_object (&priv->cancellable);
+            g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, err);
+            g_error_free (err);
+        }
+        g_object_unref (session);
+        return;
+    }
+    tlm_timeline_mark (priv->timeline, TLM_PHASE_PAM_AUTHENTICATE);
+    g_signal_emit (session, signals[SIG_AUTHENTICATED], 0);
+
+    /* the reference is passed on to the next phase */
+    tlm_auth_session_open_async (priv->auth_session,
+                                 priv->cancellable,
+                                 _on_open_done,
+                                 session);
 }
 
 TlmSession *
@@ -743,7 +1043,7 @@ tlm_session_start (TlmSession *session,
 	GError *error = NULL;
 	g_return_val_if_fail (session && TLM_IS_SESSION(session), FALSE);
     TlmSessionPrivate *priv = TLM_SESSION_PRIV(session);
-    const gchar *session_type;
+    const TlmSeatConfig *seat_config = NULL;
 
     if (!seat_id || !service || !username) {
         error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
@@ -758,15 +1058,21 @@ tlm_session_start (TlmSession *session,
     g_object_set (G_OBJECT (session), "seat", seat_id, "service", service,
             "username", username, "environment", environment, NULL);
 
-    priv->vtnr = tlm_config_get_uint (priv->config,
-                                      priv->seat_id,
-                                      TLM_CONFIG_SEAT_VTNR,
-                                      0);
+    /* normally the daemon hands over its configuration */
+    if (!priv->config)
+        priv->config = tlm_config_new ();
+    seat_config = tlm_config_get_seat_config (priv->config, priv->seat_id);
+
+    g_clear_pointer (&priv->timeline, tlm_timeline_free);
+    priv->timeline = tlm_timeline_new (priv->seat_id, priv->username);
+
+    priv->vtnr = seat_config->vtnr;
     gchar *tty_name = priv->vtnr > 0 ?
         g_strdup_printf ("tty%u", priv->vtnr) : NULL;
     priv->auth_session = tlm_auth_session_new (priv->service, priv->username,
             password, tty_name);
     g_free (tty_name);
+    tlm_timeline_mark (priv->timeline, TLM_PHASE_PAM_START);
 
     if (!priv->auth_session) {
         error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
@@ -775,27 +1081,22 @@ tlm_session_start (TlmSession *session,
         g_error_free (error);
         return FALSE;
     }
+    g_object_set (priv->auth_session, "logind-address",
+                  tlm_config_get_string (priv->config, TLM_CONFIG_GENERAL,
+                                         TLM_CONFIG_GENERAL_LOGIND_ADDRESS),
+                  NULL);
 
-    session_type = tlm_config_get_string (priv->config,
-                                          priv->seat_id,
-                                          TLM_CONFIG_GENERAL_SESSION_TYPE);
-    if (!session_type)
-        session_type = tlm_config_get_string (priv->config,
-                                              TLM_CONFIG_GENERAL,
-                                              TLM_CONFIG_GENERAL_SESSION_TYPE);
-    if (!tlm_config_has_key (priv->config,
-                             TLM_CONFIG_GENERAL,
-                             TLM_CONFIG_GENERAL_NSEATS))
+    if (seat_config->set_xdg_seat)
         tlm_auth_session_putenv (priv->auth_session,
                                  "XDG_SEAT",
                                  priv->seat_id);
-    if (session_type) {
+    if (seat_config->session_type) {
         tlm_auth_session_putenv (priv->auth_session,
                                  "XDG_SESSION_CLASS",
                                  "user");
         tlm_auth_session_putenv (priv->auth_session,
                                  "XDG_SESSION_TYPE",
-                                 session_type);
+                                 seat_config->session_type);
     }
     if (priv->vtnr > 0) {
         gchar *vtnr_str = g_strdup_printf("%u", priv->vtnr);
@@ -805,100 +1106,39 @@ tlm_session_start (TlmSession *session,
         g_free (vtnr_str);
     }
 
-    if (!tlm_auth_session_authenticate (priv->auth_session, &error)) {
-        if (error) {
-            //consistant error message flow
-            GError *err = TLM_GET_ERROR_FOR_ID (
-                    TLM_ERROR_SESSION_CREATION_FAILURE,
-                    "%d:%s", error->code, error->message);
-            g_error_free (error);
-            error = err;
-        } else {
-            error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
-                    "Unable to authenticate PAM sesssion");
-        }
-        g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
-        g_error_free (error);
-        return FALSE;
-    }
-    g_signal_emit (session, signals[SIG_AUTHENTICATED], 0);
+    priv->cancellable = g_cancellable_new ();
+    tlm_auth_session_authenticate_async (priv->auth_session,
+                                         priv->cancellable,
+                                         _on_authenticate_done,
+                                         g_object_ref (session));
+    return TRUE;
+}
 
-    if (!tlm_auth_session_open (priv->auth_session, &error)) {
-        if (!error) {
-            error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
-                    "Unable to open PAM sesssion");
-        }
-        g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
-        g_error_free (error);
-        return FALSE;
-    }
-    priv->sessionid = g_strdup (tlm_auth_session_get_sessionid (
-            priv->auth_session));
-    tlm_utils_log_utmp_entry (priv->username);
+/* a(sx) phases of the latest login, as seen by this process */
+GVariant *
+tlm_session_get_timeline (TlmSession *session)
+{
+    g_return_val_if_fail (session && TLM_IS_SESSION (session), NULL);
 
-    priv->session_pause =  tlm_config_get_boolean (priv->config,
-                                             TLM_CONFIG_GENERAL,
-                                             TLM_CONFIG_GENERAL_PAUSE_SESSION,
-                                             FALSE);
-    if (!priv->session_pause) {
-        _exec_user_session (session);
-        g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
-                       priv->sessionid ? priv->sessionid : "");
-    } else {
-        g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
-                       priv->sessionid ? priv->sessionid : "");
-        pause ();
-        exit (0);
-    }
-    return TRUE;
+    return tlm_timeline_get_phases (session->priv->timeline);
 }
 
-static gboolean
-_terminate_timeout (gpointer user_data)
+static void
+_on_child_stuck (
+        pid_t pid,
+        gpointer data)
 {
-    TlmSession *session = TLM_SESSION(user_data);
-    TlmSessionPrivate *priv = TLM_SESSION_PRIV(session);
+    TlmSession *session = TLM_SESSION (data);
 
-    switch (priv->last_sig)
-    {
-        case SIGHUP:
-            DBG ("child %u didn't respond to SIGHUP, sending SIGTERM",
-                 priv->child_pid);
-            if (killpg (getpgid (priv->child_pid), SIGTERM))
-                WARN ("killpg(%u, SIGTERM): %s",
-                      getpgid (priv->child_pid),
-                      strerror(errno));
-            priv->last_sig = SIGTERM;
-            return G_SOURCE_CONTINUE;
-        case SIGTERM:
-            DBG ("child %u didn't respond to SIGTERM, sending SIGKILL",
-                 priv->child_pid);
-            if (killpg (getpgid (priv->child_pid), SIGKILL))
-                WARN ("killpg(%u, SIGKILL): %s",
-                      getpgid (priv->child_pid),
-                      strerror(errno));
-            priv->last_sig = SIGKILL;
-            return G_SOURCE_CONTINUE;
-        case SIGKILL:
-            DBG ("child %u didn't respond to SIGKILL, process is stuck in kernel",
-                 priv->child_pid);
-            priv->timer_id = 0;
-            _clear_session (session);
-            if (session->priv->can_emit_signal) {
-                GError *error = TLM_GET_ERROR_FOR_ID (
-                        TLM_ERROR_SESSION_TERMINATION_FAILURE,
-                        "Unable to terminate session - process is stuck"
-                        " in kernel");
-                g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
-                g_error_free (error);
-            }
-            return G_SOURCE_REMOVE;
-        default:
-            WARN ("%d has unknown signaling state %d",
-                  priv->child_pid,
-                  priv->last_sig);
+    _clear_session (session);
+    if (session->priv->can_emit_signal) {
+        GError *error = TLM_GET_ERROR_FOR_ID (
+                TLM_ERROR_SESSION_TERMINATION_FAILURE,
+                "Unable to terminate session - process is stuck"
+                " in kernel");
+        g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+        g_error_free (error);
     }
-    return G_SOURCE_REMOVE;
 }
 
 void
@@ -906,9 +1146,16 @@ tlm_session_terminate (TlmSession *session)
 {
     g_return_if_fail (session && TLM_IS_SESSION(session));
     TlmSessionPrivate *priv = TLM_SESSION_PRIV(session);
+    guint step;
 
     DBG ("Session Terminate");
 
+    if (priv->cancellable) {
+        DBG ("PAM setup in progress - cancelling");
+        g_cancellable_cancel (priv->cancellable);
+        return;
+    }
+
     if (!priv->is_child_up) {
         DBG ("no child process is running - closing pam session");
         _clear_session (session);
@@ -917,15 +1164,9 @@ tlm_session_terminate (TlmSession *session)
         return;
     }
 
-    if (killpg (getpgid (priv->child_pid), SIGHUP) < 0)
-        WARN ("kill(%u, SIGHUP): %s",
-              getpgid (priv->child_pid),
-              strerror(errno));
-    priv->last_sig = SIGHUP;
-    priv->timer_id = g_timeout_add_seconds (
-            tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
-                    TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3),
-            _terminate_timeout,
-            session);
+    /* the daemon holds back for TLM_PROC_WATCH_LADDER_STEPS of these */
+    step = tlm_config_get_seat_config (priv->config,
+                                       priv->seat_id)->terminate_step;
+    tlm_proc_watch_terminate (priv->watch, step, step, _on_child_stuck);
 }
 
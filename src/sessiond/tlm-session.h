@@ -72,6 +72,9 @@ tlm_session_start (TlmSession *session,
 void
 tlm_session_terminate (TlmSession *session);
 
+GVariant *
+tlm_session_get_timeline (TlmSession *session);
+
 G_END_DECLS
 
 #endif /* _TLM_SESSION_H */
@@ -42,9 +42,11 @@
 #include "common/tlm-config.h"
 #include "common/dbus/tlm-dbus-login-gen.h"
 #include "common/tlm-utils.h"
+#include "common/tlm-timeline.h"
 #include "common/dbus/tlm-dbus-utils.h"
 
 static GPid daemon_pid = 0;
+static gboolean run_as_job = FALSE;
 
 //static GMainLoop *main_loop = NULL;
 
@@ -55,6 +57,12 @@ typedef struct {
     gchar **environment;
 } TlmUser;
 
+typedef struct {
+    GMainLoop *loop;
+    guint job_id;
+    gboolean finished;
+} TlmJob;
+
 static TlmUser *
 _create_tlm_user ()
 {
@@ -146,8 +154,8 @@ _get_bus_connection (
 
     /* get dbus connection for specific user only */
     gchar address[128];
-    g_snprintf (address, 127, "unix:path=%s/%s-%d", TLM_DBUS_SOCKET_PATH,
-            seat_id, user_id);
+    g_snprintf (address, 127, "unix:path=%s/%s", TLM_DBUS_SOCKET_PATH,
+            seat_id);
     return g_dbus_connection_new_for_address_sync (address,
             G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL, error);
 }
@@ -184,6 +192,91 @@ _convert_environ_to_variant (gchar **env) {
     return venv;
 }
 
+static void
+_on_job_authenticated (
+        TlmDbusLogin *login_object,
+        guint job_id,
+        const gchar *seat_id,
+        TlmJob *job)
+{
+    if (job_id != job->job_id) return;
+    DBG ("job %u authenticated on seat %s", job_id, seat_id);
+}
+
+static void
+_on_job_session_created (
+        TlmDbusLogin *login_object,
+        guint job_id,
+        const gchar *seat_id,
+        TlmJob *job)
+{
+    if (job_id != job->job_id) return;
+    DBG ("job %u created session on seat %s", job_id, seat_id);
+    job->finished = TRUE;
+    g_main_loop_quit (job->loop);
+}
+
+static void
+_on_job_failed (
+        TlmDbusLogin *login_object,
+        guint job_id,
+        const gchar *seat_id,
+        const gchar *error,
+        const gchar *message,
+        TlmJob *job)
+{
+    if (job_id != job->job_id) return;
+    WARN ("job %u failed on seat %s with error: %s:%s", job_id, seat_id,
+            error, message);
+    job->finished = TRUE;
+    g_main_loop_quit (job->loop);
+}
+
+/* Starts a login or switch job and follows its progress signals */
+static void
+_run_job (
+        TlmDbusLogin *login_object,
+        TlmUser *user,
+        GVariant *venv,
+        gboolean is_switch)
+{
+    GError *error = NULL;
+    TlmJob job = { NULL, 0, FALSE };
+
+    /* signals are only dispatched once the loop runs, so none is missed
+     * between the reply and the handlers being connected */
+    g_signal_connect (login_object, "authenticated",
+            G_CALLBACK (_on_job_authenticated), &job);
+    g_signal_connect (login_object, "session-created",
+            G_CALLBACK (_on_job_session_created), &job);
+    g_signal_connect (login_object, "failed",
+            G_CALLBACK (_on_job_failed), &job);
+
+    if (is_switch)
+        tlm_dbus_login_call_start_switch_sync (login_object, user->seatid,
+                user->username, user->password, venv, &job.job_id, NULL,
+                &error);
+    else
+        tlm_dbus_login_call_start_login_sync (login_object, user->seatid,
+                user->username, user->password, venv, &job.job_id, NULL,
+                &error);
+    if (error) {
+        WARN ("starting job failed with error: %d:%s", error->code,
+                error->message);
+        g_error_free (error);
+        goto _finished;
+    }
+    DBG ("started job %u", job.job_id);
+
+    job.loop = g_main_loop_new (NULL, FALSE);
+    if (!job.finished)
+        g_main_loop_run (job.loop);
+    g_main_loop_unref (job.loop);
+
+_finished:
+    g_signal_handlers_disconnect_by_data (login_object, &job);
+}
+
 static void
 _handle_user_login (
         TlmUser *user)
@@ -219,6 +312,11 @@ _handle_user_login (
         goto _finished;
     }
 
+    if (run_as_job) {
+        _run_job (login_object, user, venv, FALSE);
+        goto _finished;
+    }
+
     tlm_dbus_login_call_login_user_sync (login_object, user->seatid,
             user->username, user->password, venv, NULL, &error);
     if (error) {
@@ -312,6 +410,11 @@ _handle_user_switch (
         goto _finished;
     }
 
+    if (run_as_job) {
+        _run_job (login_object, user, venv, TRUE);
+        goto _finished;
+    }
+
     tlm_dbus_login_call_switch_user_sync (login_object, user->seatid,
             user->username, user->password, venv, NULL, &error);
     if (error) {
@@ -328,6 +431,93 @@ _finished:
     if (connection) g_object_unref (connection);
 }
 
+static void
+_handle_cancel_request (
+        TlmUser *user)
+{
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+
+    if (!user || !user->seatid) {
+        WARN("Invalid seatid");
+        return;
+    }
+    DBG ("seatid %s", user->seatid);
+
+    connection = _get_bus_connection (user->seatid, &error);
+    if (connection == NULL) {
+        WARN("failed to get bus connection : error %s",
+            error ? error->message : "(null)");
+        goto _finished;
+    }
+
+    login_object = _get_login_object (connection, &error);
+    if (login_object == NULL) {
+        WARN("failed to get login object : error %s",
+            error ? error->message : "(null)");
+        goto _finished;
+    }
+
+    tlm_dbus_login_call_cancel_request_sync (login_object, user->seatid,
+            NULL, &error);
+    if (error) {
+        WARN ("cancel request failed with error: %d:%s", error->code,
+                error->message);
+    } else {
+        DBG ("Requests cancelled successfully");
+    }
+
+_finished:
+    g_clear_error (&error);
+    if (login_object) g_object_unref (login_object);
+    if (connection) g_object_unref (connection);
+}
+
+static void
+_handle_timelines (
+        TlmUser *user)
+{
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    GVariant *timelines = NULL;
+    gchar *trace = NULL;
+
+    connection = _get_root_socket_bus_connection (&error);
+    if (connection == NULL) {
+        WARN("failed to get bus connection : error %s",
+            error ? error->message : "(null)");
+        goto _finished;
+    }
+
+    login_object = _get_login_object (connection, &error);
+    if (login_object == NULL) {
+        WARN("failed to get login object : error %s",
+            error ? error->message : "(null)");
+        goto _finished;
+    }
+
+    tlm_dbus_login_call_get_timelines_sync (login_object,
+            user->seatid ? user->seatid : "", &timelines, NULL, &error);
+    if (error) {
+        WARN ("getting timelines failed with error: %d:%s", error->code,
+                error->message);
+        goto _finished;
+    }
+
+    /* Chrome trace format, load it in chrome://tracing */
+    trace = tlm_timeline_to_trace (timelines);
+    g_print ("%s\n", trace);
+
+_finished:
+    g_clear_error (&error);
+    g_free (trace);
+    if (timelines) g_variant_unref (timelines);
+    if (login_object) g_object_unref (login_object);
+    if (connection) g_object_unref (connection);
+}
+
 int main (int argc, char *argv[])
 {
     GError *error = NULL;
@@ -336,6 +526,8 @@ int main (int argc, char *argv[])
 
     gboolean is_user_login_op = FALSE, is_user_logout_op = FALSE;
     gboolean is_user_switch_op = FALSE;
+    gboolean is_timelines_op = FALSE;
+    gboolean is_cancel_op = FALSE;
     gboolean run_tlm_daemon = FALSE;
     GOptionGroup* user_option = NULL;
     TlmUser *user = _create_tlm_user ();
@@ -351,6 +543,17 @@ int main (int argc, char *argv[])
         { "switch-user", 's', 0, G_OPTION_ARG_NONE, &is_user_switch_op,
                 "switch user -- username, password and seatid is mandatory",
                 NULL },
+        { "timelines", 't', 0, G_OPTION_ARG_NONE, &is_timelines_op,
+                "dump the latest login timelines as a Chrome trace -- "
+                "seatid is optional",
+                NULL },
+        { "cancel-request", 'c', 0, G_OPTION_ARG_NONE, &is_cancel_op,
+                "cancel the requests in progress on a seat -- "
+                "seatid is mandatory",
+                NULL },
+        { "job", 'j', 0, G_OPTION_ARG_NONE, &run_as_job,
+                "login/switch as a job and report its progress",
+                NULL },
         { "run-daemon", 'r', 0, G_OPTION_ARG_NONE, &run_tlm_daemon,
                 "run tlm daemon (by default tlm daemon is not run)",
                 NULL },
@@ -407,6 +610,10 @@ int main (int argc, char *argv[])
         _handle_user_logout (user);
     } else if (is_user_switch_op) {
         _handle_user_switch (user);
+    } else if (is_timelines_op) {
+        _handle_timelines (user);
+    } else if (is_cancel_op) {
+        _handle_cancel_request (user);
     } else {
         WARN ("No option specified");
     }
@@ -35,6 +35,7 @@
 
 #include "common/tlm-log.h"
 #include "common/tlm-utils.h"
+#include "common/tlm-spawn.h"
 
 typedef struct {
   GPid pid;
@@ -140,7 +141,8 @@ static void _tlm_launcher_process (TlmLauncher *l)
   char str[1024];
   gchar **argv = NULL;
   gint wait = 0;
-  pid_t child_pid = 0;
+  GPid child_pid = 0;
+  GError *error = NULL;
 
   if (!l || !l->fp) return;
 
@@ -158,22 +160,22 @@ static void _tlm_launcher_process (TlmLauncher *l)
       case 'M':
       case 'L':
         argv = tlm_utils_split_command_line (cmd);
-        if ((child_pid = fork()) < 0) {
-          ERR("fork() failed: %s", strerror (errno));
-        } else if (child_pid == 0) {
-            /* child process */
-            INFO("Launching command : %s, pid: %d, ppid: %d\n",
-                argv[0], getpid (), getppid ());
-            execvp(argv[0], argv);
-            WARN("exec failed: %s", strerror (errno));
-        } else if (control == 'M') {
-          ChildInfo *info = g_slice_new0 (ChildInfo);
-          info->pid = child_pid;
-          info->watcher = g_child_watch_add (child_pid,
-              (GChildWatchFunc)_on_child_down_cb, l);
-          g_hash_table_insert (l->childs,
-              GINT_TO_POINTER(child_pid), info);
+        if (!tlm_spawn ((const gchar * const *)argv, NULL, NULL, NULL,
+                        NULL, NULL, &child_pid, &error)) {
+          WARN("Launching command '%s' failed: %s", cmd, error->message);
+          g_clear_error (&error);
+        } else {
+          INFO("Launched command : %s, pid: %d\n", argv[0], child_pid);
+          if (control == 'M') {
+            ChildInfo *info = g_slice_new0 (ChildInfo);
+            info->pid = child_pid;
+            info->watcher = g_child_watch_add (child_pid,
+                (GChildWatchFunc)_on_child_down_cb, l);
+            g_hash_table_insert (l->childs,
+                GINT_TO_POINTER(child_pid), info);
+          }
         }
+        g_strfreev (argv);
         break;
       case 'W': {
         gchar **sockets = g_strsplit(cmd, ",", -1);
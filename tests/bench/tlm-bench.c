@@ -0,0 +1,639 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Login/logout throughput benchmark.
+ *
+ * Starts tlm on a private D-Bus daemon with NSEATS virtual seats, a PAM
+ * service that permits everything and a session command that just sleeps.
+ * The PAM service is not installed by the benchmark: copy tlm-bench.pam to
+ * /etc/pam.d/tlm-bench on a throwaway machine, or name an existing service
+ * with --pam-service.
+ * Every seat then runs its own loop of
+ *
+ *   loginUser (user)          on the root socket
+ *   switchUser (switch-user)  on the root socket
+ *   logoutUser ()             on the per-seat socket of switch-user
+ *
+ * concurrently with the other seats, and the latencies of the calls and of
+ * the whole cycles are reported.
+ *
+ * tlm refuses a fourth login on a seat that follows the one before within
+ * a second. A cycle logs in twice, so every seat starts its next cycle at
+ * least BENCH_CYCLE_PACE after its switch; the wait is not part of the
+ * cycle latency, but it does bound the cycles per second of a seat.
+ */
+
+#include "config.h"
+
+#include <pwd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/dbus/tlm-dbus.h"
+#include "common/dbus/tlm-dbus-login-gen.h"
+#include "common/tlm-log.h"
+#include "common/tlm-user-info.h"
+
+#define BENCH_PAM_SERVICE "tlm-bench"
+#define BENCH_CYCLE_PACE (G_USEC_PER_SEC + G_USEC_PER_SEC / 10)
+
+typedef enum {
+    BENCH_OP_LOGIN = 0,
+    BENCH_OP_SWITCH,
+    BENCH_OP_LOGOUT,
+    BENCH_OP_CYCLE,
+    BENCH_OP_MAX
+} BenchOp;
+
+static const gchar *op_names[BENCH_OP_MAX] = {
+    "loginUser", "switchUser", "logoutUser", "cycle"
+};
+
+typedef struct {
+    gchar *id;
+    guint cycles_left;
+    gint64 op_started;
+    gint64 cycle_started;
+    gint64 switched_at;
+    GDBusConnection *connection; /* per-seat socket */
+} BenchSeat;
+
+static guint opt_seats = 4;
+static guint opt_cycles = 50;
+static guint opt_pool_size = 0;
+static gchar *opt_user = NULL;
+static gchar *opt_switch_user = NULL;
+static gchar *opt_session_cmd = NULL;
+static gchar *opt_pam_service = NULL;
+
+static GMainLoop *main_loop = NULL;
+static TlmDbusLogin *root_login = NULL;
+static GArray *samples[BENCH_OP_MAX]; /* gint64, usecs */
+static guint seats_running = 0;
+static guint failures = 0;
+
+static GVariant *
+_empty_environment (void)
+{
+    return g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0);
+}
+
+static void
+_add_sample (BenchOp op, gint64 started)
+{
+    gint64 elapsed = g_get_monotonic_time () - started;
+    g_array_append_val (samples[op], elapsed);
+}
+
+static void
+_seat_done (BenchSeat *seat, GError *error)
+{
+    if (error) {
+        WARN ("seat %s: %s", seat->id, error->message);
+        g_error_free (error);
+        failures++;
+    }
+    g_clear_object (&seat->connection);
+    if (--seats_running == 0)
+        g_main_loop_quit (main_loop);
+}
+
+static void _seat_start_cycle (BenchSeat *seat);
+
+static gboolean
+_on_pace_timeout (gpointer user_data)
+{
+    _seat_start_cycle ((BenchSeat *) user_data);
+    return G_SOURCE_REMOVE;
+}
+
+/* keeps the seat out of the relogin throttle of tlm */
+static void
+_seat_schedule_cycle (BenchSeat *seat)
+{
+    gint64 wait = seat->switched_at + BENCH_CYCLE_PACE -
+                  g_get_monotonic_time ();
+
+    if (wait <= 0) {
+        _seat_start_cycle (seat);
+        return;
+    }
+    g_timeout_add ((guint) (wait / 1000) + 1, _on_pace_timeout, seat);
+}
+
+static void
+_on_logout_done (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    BenchSeat *seat = (BenchSeat *) user_data;
+    GError *error = NULL;
+
+    if (!tlm_dbus_login_call_logout_user_finish (TLM_DBUS_LOGIN (object),
+                                                 res, &error)) {
+        g_object_unref (object);
+        _seat_done (seat, error);
+        return;
+    }
+    g_object_unref (object);
+    g_clear_object (&seat->connection);
+
+    _add_sample (BENCH_OP_LOGOUT, seat->op_started);
+    _add_sample (BENCH_OP_CYCLE, seat->cycle_started);
+
+    if (--seat->cycles_left == 0) {
+        _seat_done (seat, NULL);
+        return;
+    }
+    _seat_schedule_cycle (seat);
+}
+
+static void
+_on_seat_proxy_ready (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    BenchSeat *seat = (BenchSeat *) user_data;
+    TlmDbusLogin *login;
+    GError *error = NULL;
+
+    (void) object;
+
+    login = tlm_dbus_login_proxy_new_finish (res, &error);
+    if (!login) {
+        _seat_done (seat, error);
+        return;
+    }
+    tlm_dbus_login_call_logout_user (login, seat->id, NULL,
+                                     _on_logout_done, seat);
+}
+
+static void
+_on_seat_connection_ready (GObject *object, GAsyncResult *res,
+                           gpointer user_data)
+{
+    BenchSeat *seat = (BenchSeat *) user_data;
+    GError *error = NULL;
+
+    (void) object;
+
+    seat->connection = g_dbus_connection_new_for_address_finish (res, &error);
+    if (!seat->connection) {
+        _seat_done (seat, error);
+        return;
+    }
+    tlm_dbus_login_proxy_new (seat->connection,
+            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
+            TLM_LOGIN_OBJECTPATH, NULL, _on_seat_proxy_ready, seat);
+}
+
+static void
+_on_switch_done (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    BenchSeat *seat = (BenchSeat *) user_data;
+    GError *error = NULL;
+    gchar *address;
+
+    if (!tlm_dbus_login_call_switch_user_finish (TLM_DBUS_LOGIN (object),
+                                                 res, &error)) {
+        _seat_done (seat, error);
+        return;
+    }
+    _add_sample (BENCH_OP_SWITCH, seat->op_started);
+    seat->switched_at = g_get_monotonic_time ();
+
+    /* connecting to the per-seat socket is part of what a client pays for
+     * the logout */
+    seat->op_started = g_get_monotonic_time ();
+    address = g_strdup_printf ("unix:path=%s/%s", TLM_DBUS_SOCKET_PATH,
+                               seat->id);
+    g_dbus_connection_new_for_address (address,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL,
+            _on_seat_connection_ready, seat);
+    g_free (address);
+}
+
+static void
+_on_login_done (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    BenchSeat *seat = (BenchSeat *) user_data;
+    GError *error = NULL;
+
+    if (!tlm_dbus_login_call_login_user_finish (TLM_DBUS_LOGIN (object),
+                                                res, &error)) {
+        _seat_done (seat, error);
+        return;
+    }
+    _add_sample (BENCH_OP_LOGIN, seat->op_started);
+
+    seat->op_started = g_get_monotonic_time ();
+    tlm_dbus_login_call_switch_user (root_login, seat->id, opt_switch_user,
+                                     "", _empty_environment (), NULL,
+                                     _on_switch_done, seat);
+}
+
+static void
+_seat_start_cycle (BenchSeat *seat)
+{
+    seat->cycle_started = seat->op_started = g_get_monotonic_time ();
+    tlm_dbus_login_call_login_user (root_login, seat->id, opt_user, "",
+                                    _empty_environment (), NULL,
+                                    _on_login_done, seat);
+}
+
+static gint
+_compare_samples (gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *) a;
+    gint64 y = *(const gint64 *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of sorted @array, in milliseconds */
+static gdouble
+_percentile (GArray *array, guint p)
+{
+    guint rank;
+
+    if (array->len == 0)
+        return 0.0;
+    rank = (p * array->len + 99) / 100;
+    if (rank > 0)
+        rank--;
+    return g_array_index (array, gint64, rank) / 1000.0;
+}
+
+static void
+_print_report (gint64 elapsed)
+{
+    guint i;
+    guint cycles = samples[BENCH_OP_CYCLE]->len;
+
+    g_print ("%-12s %8s %10s %10s %10s\n", "op", "count",
+             "p50 (ms)", "p95 (ms)", "p99 (ms)");
+    for (i = 0; i < BENCH_OP_MAX; i++) {
+        g_array_sort (samples[i], _compare_samples);
+        g_print ("%-12s %8u %10.2f %10.2f %10.2f\n", op_names[i],
+                 samples[i]->len, _percentile (samples[i], 50),
+                 _percentile (samples[i], 95), _percentile (samples[i], 99));
+    }
+    g_print ("%u cycles in %.2f s: %.2f cycles/s, %u failed seat(s)\n",
+             cycles, elapsed / 1.0e6,
+             elapsed > 0 ? cycles * 1.0e6 / elapsed : 0.0, failures);
+    g_print ("cycles of a seat start at least %.1f s apart\n",
+             BENCH_CYCLE_PACE / 1.0e6);
+}
+
+static gboolean
+_has_pam_service (const gchar *service)
+{
+    const gchar *dirs[] = { "/etc/pam.d", "/usr/lib/pam.d", NULL };
+    const gchar **dir;
+
+    for (dir = dirs; *dir; dir++) {
+        gchar *path = g_build_filename (*dir, service, NULL);
+        gboolean found = g_file_test (path, G_FILE_TEST_EXISTS);
+        g_free (path);
+        if (found)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static gchar *
+_write_config (const gchar *dir)
+{
+    gchar *path = g_build_filename (dir, "tlm-bench.conf", NULL);
+    gchar *contents;
+    GError *error = NULL;
+
+    contents = g_strdup_printf (
+            "[General]\n"
+            "ACCOUNTS_PLUGIN=default\n"
+            "NSEATS=%u\n"
+            "AUTO_LOGIN=0\n"
+            "PREPARE_DEFAULT=0\n"
+            "PAM_SERVICE=%s\n"
+            "DEFAULT_PAM_SERVICE=%s\n"
+            "SESSION_CMD=%s\n"
+            "SETUP_TERMINAL=0\n"
+            "SESSIOND_POOL_SIZE=%u\n",
+            opt_seats, opt_pam_service, opt_pam_service, opt_session_cmd,
+            opt_pool_size);
+    if (!g_file_set_contents (path, contents, -1, &error)) {
+        WARN ("cannot write '%s': %s", path, error->message);
+        g_error_free (error);
+        g_free (path);
+        path = NULL;
+    }
+    g_free (contents);
+
+    return path;
+}
+
+static TlmDbusLogin *
+_connect_root_socket (gint64 timeout)
+{
+    gint64 deadline = g_get_monotonic_time () + timeout;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login = NULL;
+    GError *error = NULL;
+
+    /* tlm has no readiness notification, poll for its socket */
+    while (!connection) {
+        connection = g_dbus_connection_new_for_address_sync (
+                TLM_DBUS_ROOT_SOCKET_ADDRESS,
+                G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL,
+                &error);
+        if (connection)
+            break;
+        if (g_get_monotonic_time () >= deadline) {
+            if (timeout)
+                WARN ("tlm did not come up: %s", error->message);
+            g_error_free (error);
+            return NULL;
+        }
+        g_clear_error (&error);
+        g_usleep (G_USEC_PER_SEC / 20);
+    }
+
+    login = tlm_dbus_login_proxy_new_sync (connection,
+            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
+            TLM_LOGIN_OBJECTPATH, NULL, &error);
+    g_object_unref (connection);
+    if (!login) {
+        WARN ("failed to get login object: %s", error->message);
+        g_error_free (error);
+    }
+    return login;
+}
+
+static GPid
+_start_daemon (const gchar *bus_address, const gchar *config_dir,
+               const gchar *config_path)
+{
+    const gchar *daemon_path = g_getenv ("TLM_BENCH_DAEMON");
+    gchar *argv[2];
+    gchar **envp;
+    gchar *cache_path;
+    GPid pid = 0;
+    GError *error = NULL;
+
+    if (!daemon_path)
+        daemon_path = TLM_BIN_DIR "/tlm";
+
+    cache_path = g_build_filename (config_dir, "tlm.conf.cache", NULL);
+    envp = g_get_environ ();
+    envp = g_environ_setenv (envp, "DBUS_SYSTEM_BUS_ADDRESS", bus_address,
+                             TRUE);
+    envp = g_environ_setenv (envp, "TLM_CONF_FILE", config_path, TRUE);
+    envp = g_environ_setenv (envp, "TLM_CONF_CACHE", cache_path, TRUE);
+    g_free (cache_path);
+
+    argv[0] = (gchar *) daemon_path;
+    argv[1] = NULL;
+    if (!g_spawn_async (NULL, argv, envp, G_SPAWN_DO_NOT_REAP_CHILD, NULL,
+                        NULL, &pid, &error)) {
+        WARN ("failed to spawn '%s': %s", daemon_path, error->message);
+        g_error_free (error);
+        pid = 0;
+    }
+    g_strfreev (envp);
+
+    return pid;
+}
+
+static void
+_stop_daemon (GPid pid)
+{
+    gint64 deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+    int status;
+
+    kill (pid, SIGTERM);
+    while (waitpid (pid, &status, WNOHANG) == 0) {
+        if (g_get_monotonic_time () >= deadline) {
+            WARN ("tlm did not stop, killing it");
+            kill (pid, SIGKILL);
+            waitpid (pid, &status, 0);
+            break;
+        }
+        g_usleep (G_USEC_PER_SEC / 20);
+    }
+    g_spawn_close_pid (pid);
+}
+
+static gboolean
+_resolve_users (void)
+{
+    TlmUserInfo *info;
+
+    if (!opt_user) {
+        struct passwd *pw = getpwuid (getuid ());
+        opt_user = g_strdup (pw ? pw->pw_name : "root");
+    }
+    if (!opt_switch_user)
+        opt_switch_user = g_strdup ("nobody");
+
+    /* both users would share one per-seat socket */
+    if (g_strcmp0 (opt_user, opt_switch_user) == 0) {
+        WARN ("--user and --switch-user must differ");
+        return FALSE;
+    }
+
+    if (!(info = tlm_user_info_lookup (opt_user))) {
+        WARN ("unknown user '%s'", opt_user);
+        return FALSE;
+    }
+    tlm_user_info_unref (info);
+
+    if (!(info = tlm_user_info_lookup (opt_switch_user))) {
+        WARN ("unknown user '%s'", opt_switch_user);
+        return FALSE;
+    }
+    tlm_user_info_unref (info);
+
+    return TRUE;
+}
+
+int main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GTestDBus *bus = NULL;
+    gchar *config_dir = NULL;
+    gchar *config_path = NULL;
+    BenchSeat *seats = NULL;
+    GPid daemon_pid = 0;
+    gint64 started;
+    guint i;
+    int ret = EXIT_FAILURE;
+
+    GOptionEntry entries[] = {
+        { "seats", 's', 0, G_OPTION_ARG_INT, &opt_seats,
+          "Number of virtual seats (NSEATS)", "N" },
+        { "cycles", 'c', 0, G_OPTION_ARG_INT, &opt_cycles,
+          "Login/switch/logout cycles per seat", "N" },
+        { "pool-size", 'p', 0, G_OPTION_ARG_INT, &opt_pool_size,
+          "Pre-spawned sessionds per seat (SESSIOND_POOL_SIZE)", "N" },
+        { "user", 'u', 0, G_OPTION_ARG_STRING, &opt_user,
+          "User to log in, defaults to the current user", "NAME" },
+        { "switch-user", 'w', 0, G_OPTION_ARG_STRING, &opt_switch_user,
+          "User to switch to, defaults to 'nobody'", "NAME" },
+        { "session-cmd", 0, 0, G_OPTION_ARG_STRING, &opt_session_cmd,
+          "Session command (SESSION_CMD)", "CMD" },
+        { "pam-service", 0, 0, G_OPTION_ARG_STRING, &opt_pam_service,
+          "Installed PAM service to log in with, defaults to "
+          "'" BENCH_PAM_SERVICE "'", "NAME" },
+        { NULL }
+    };
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- tlm login/logout benchmark");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free (context);
+
+    if (opt_seats == 0 || opt_cycles == 0) {
+        WARN ("--seats and --cycles must be positive");
+        return EXIT_FAILURE;
+    }
+    if (!opt_session_cmd)
+        opt_session_cmd = g_strdup ("sleep 3600");
+    if (!opt_pam_service)
+        opt_pam_service = g_strdup (BENCH_PAM_SERVICE);
+
+    if (geteuid () != 0) {
+        WARN ("tlm-bench can only be run with ROOT privileges");
+        return 77; /* skipped */
+    }
+
+    if (!_has_pam_service (opt_pam_service)) {
+        WARN ("PAM service '%s' is not installed, see tlm-bench.pam",
+              opt_pam_service);
+        return 77; /* skipped */
+    }
+
+    if (!_resolve_users ())
+        return EXIT_FAILURE;
+
+    /* do not benchmark, or log out users of, a tlm that is already up */
+    root_login = _connect_root_socket (0);
+    if (root_login) {
+        WARN ("tlm is already running at " TLM_DBUS_ROOT_SOCKET_ADDRESS);
+        g_clear_object (&root_login);
+        return EXIT_FAILURE;
+    }
+
+    config_dir = g_dir_make_tmp ("tlm-bench-XXXXXX", &error);
+    if (!config_dir) {
+        WARN ("cannot create config directory: %s", error->message);
+        g_error_free (error);
+        goto _finished;
+    }
+    if (!(config_path = _write_config (config_dir)))
+        goto _finished;
+
+    bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+    g_test_dbus_up (bus);
+
+    daemon_pid = _start_daemon (g_test_dbus_get_bus_address (bus),
+                                config_dir, config_path);
+    if (!daemon_pid)
+        goto _finished;
+
+    root_login = _connect_root_socket (10 * G_USEC_PER_SEC);
+    if (!root_login)
+        goto _finished;
+
+    g_print ("tlm-bench: %u seat(s), %u cycle(s) per seat, pool size %u, "
+             "%s -> %s\n", opt_seats, opt_cycles, opt_pool_size,
+             opt_user, opt_switch_user);
+
+    for (i = 0; i < BENCH_OP_MAX; i++)
+        samples[i] = g_array_sized_new (FALSE, FALSE, sizeof (gint64),
+                                        opt_seats * opt_cycles);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    seats = g_new0 (BenchSeat, opt_seats);
+    seats_running = opt_seats;
+    started = g_get_monotonic_time ();
+    for (i = 0; i < opt_seats; i++) {
+        seats[i].id = g_strdup_printf ("seat%u", i);
+        seats[i].cycles_left = opt_cycles;
+        _seat_start_cycle (&seats[i]);
+    }
+    g_main_loop_run (main_loop);
+
+    _print_report (g_get_monotonic_time () - started);
+    if (!failures)
+        ret = EXIT_SUCCESS;
+
+_finished:
+    g_clear_object (&root_login);
+    if (daemon_pid)
+        _stop_daemon (daemon_pid);
+    if (bus) {
+        g_test_dbus_down (bus);
+        g_object_unref (bus);
+    }
+    if (config_path) {
+        g_unlink (config_path);
+        g_free (config_path);
+    }
+    if (config_dir) {
+        gchar *cache_path = g_build_filename (config_dir, "tlm.conf.cache",
+                                              NULL);
+        g_unlink (cache_path);
+        g_free (cache_path);
+        g_rmdir (config_dir);
+        g_free (config_dir);
+    }
+    if (seats) {
+        for (i = 0; i < opt_seats; i++)
+            g_free (seats[i].id);
+        g_free (seats);
+    }
+    for (i = 0; i < BENCH_OP_MAX; i++)
+        if (samples[i])
+            g_array_unref (samples[i]);
+    if (main_loop)
+        g_main_loop_unref (main_loop);
+    g_free (opt_user);
+    g_free (opt_switch_user);
+    g_free (opt_session_cmd);
+    g_free (opt_pam_service);
+
+    return ret;
+}
@@ -0,0 +1,141 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <check.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <glib/gstdio.h>
+#include "tlm-cgroup.h"
+
+/* A cgroup v2 directory the test may create cgroups in: the delegated one
+ * named by TLM_TEST_CGROUP, or the cgroup of the test when it is writable */
+static gchar *
+_get_cgroup_root (void)
+{
+    const gchar *env = g_getenv ("TLM_TEST_CGROUP");
+    gchar *contents = NULL;
+    gchar *root = NULL;
+    gchar *path = NULL;
+
+    if (env)
+        return g_strdup (env);
+
+    if (!g_file_get_contents ("/proc/self/cgroup", &contents, NULL, NULL))
+        return NULL;
+    if (g_str_has_prefix (contents, "0::")) {
+        g_strchomp (contents);
+        root = g_build_filename ("/sys/fs/cgroup", contents + 3, NULL);
+        path = g_build_filename (root, "cgroup.events", NULL);
+        if (g_access (path, R_OK) != 0 || g_access (root, W_OK) != 0)
+            g_clear_pointer (&root, g_free);
+        g_free (path);
+    }
+    g_free (contents);
+    return root;
+}
+
+START_TEST(test_cgroup)
+{
+    gchar *root = _get_cgroup_root ();
+    gchar *base = NULL;
+    gchar *seat = NULL;
+    gchar *cgroup = NULL;
+    gint64 deadline;
+    gint status = 0;
+    pid_t pid;
+    gint fd;
+
+    fail_if (root == NULL);
+    base = g_strdup_printf ("%s/tlm-test-%u", root, getpid ());
+    seat = g_build_filename (base, "seat0", NULL);
+    cgroup = tlm_cgroup_create (base, "seat0", "session-1");
+    fail_if (cgroup == NULL, "Failed to create cgroup below %s", base);
+
+    /* nothing to clear in a new cgroup */
+    fail_if (tlm_cgroup_is_populated (cgroup));
+    fail_unless (tlm_cgroup_clear (cgroup, 1000));
+
+    pid = fork ();
+    fail_if (pid < 0);
+    if (pid == 0) {
+        fd = tlm_cgroup_open_procs (cgroup);
+        if (fd < 0 || write (fd, "0", 1) != 1)
+            _exit (1);
+        close (fd);
+        for (;;)
+            pause ();
+    }
+
+    deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+    while (!tlm_cgroup_is_populated (cgroup) &&
+           g_get_monotonic_time () < deadline)
+        g_usleep (10000);
+    fail_unless (tlm_cgroup_is_populated (cgroup), "child did not join");
+
+    /* killed through cgroup.kill, reported empty through cgroup.events */
+    fail_unless (tlm_cgroup_clear (cgroup, 5000));
+    fail_if (tlm_cgroup_is_populated (cgroup));
+    fail_if (waitpid (pid, &status, 0) != pid);
+    fail_unless (WIFSIGNALED (status) && WTERMSIG (status) == SIGKILL);
+
+    tlm_cgroup_remove (cgroup);
+    fail_if (g_file_test (cgroup, G_FILE_TEST_EXISTS));
+    fail_if (g_rmdir (seat) != 0);
+    fail_if (g_rmdir (base) != 0);
+
+    g_free (cgroup);
+    g_free (seat);
+    g_free (base);
+    g_free (root);
+}
+END_TEST
+
+int main (void)
+{
+    int number_failed;
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+    SRunner *sr = NULL;
+    gchar *cgroup_root = NULL;
+    Suite *s = suite_create ("tlm cgroup tests");
+    TCase *tc = NULL;
+
+    /* needs a writable cgroup v2 tree, such as a delegated one */
+    if ((cgroup_root = _get_cgroup_root ())) {
+        tc = tcase_create ("Cgroup");
+        tcase_add_test (tc, test_cgroup);
+        suite_add_tcase (s, tc);
+        g_free (cgroup_root);
+    }
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? 0 : -1;
+}
@@ -26,6 +26,8 @@
 #include <check.h>
 #include <stdlib.h>
 #include "tlm-config.h"
+#include "tlm-config-general.h"
+#include "tlm-config-seat.h"
 
 #define TLM_GROUP   "tlm-test"
 #define STR_KEY     "str_key"
@@ -116,6 +118,212 @@ START_TEST(test_config)
 }
 END_TEST
 
+START_TEST(test_config_snapshot)
+{
+    const gchar *tmp_str = NULL;
+    GVariant *snapshot = NULL;
+    TlmConfig *config = NULL;
+    TlmConfig *copy = NULL;
+
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    tlm_config_set_string (config, "other-group", STR_KEY, "other_value");
+
+    snapshot = g_variant_ref_sink (tlm_config_get_snapshot (config));
+    fail_if (snapshot == NULL, "Failed to create config snapshot");
+    g_object_unref (config);
+
+    copy = tlm_config_new_from_snapshot (snapshot);
+    fail_if (copy == NULL, "Failed to create config from snapshot");
+
+    tmp_str = tlm_config_get_string (copy, TLM_GROUP, STR_KEY);
+    fail_if (tmp_str == NULL || strcmp (tmp_str, STR_VALUE) != 0);
+    fail_if (tlm_config_get_int (copy, TLM_GROUP, INT_KEY, -1) != INT_VALUE);
+    tmp_str = tlm_config_get_string (copy, "other-group", STR_KEY);
+    fail_if (tmp_str == NULL || strcmp (tmp_str, "other_value") != 0);
+
+    /* reload keeps the snapshot contents */
+    tlm_config_reload (copy);
+    fail_if (tlm_config_has_key (copy, "other-group", STR_KEY) == FALSE);
+
+    g_object_unref (copy);
+    g_variant_unref (snapshot);
+}
+END_TEST
+
+START_TEST(test_seat_config)
+{
+    const TlmSeatConfig *seat_config = NULL;
+    TlmConfig *config = NULL;
+
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_PAUSE_SESSION, TRUE);
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+                           TLM_CONFIG_GENERAL_SESSION_CMD, "weston --tty=1");
+    tlm_config_set_string (config, "seat1", TLM_CONFIG_GENERAL_RUNTIME_MODE,
+                           "0750");
+    tlm_config_set_uint (config, "seat1", TLM_CONFIG_SEAT_VTNR, 7);
+
+    /* seat keys override General, General overrides defaults */
+    seat_config = tlm_config_get_seat_config (config, "seat1");
+    fail_if (seat_config == NULL, "Failed to get seat config");
+    fail_if (seat_config->vtnr != 7);
+    fail_if (seat_config->runtime_mode != 0750);
+    fail_if (seat_config->pause_session != TRUE);
+    fail_if (seat_config->auto_login != TRUE);
+    fail_if (seat_config->terminate_timeout != 3);
+    fail_if (seat_config->terminate_step != 200);
+    fail_if (seat_config->cgroup_path != NULL);
+    fail_if (seat_config->session_nice != G_MAXINT);
+    fail_if (seat_config->session_sched_policy != NULL);
+    fail_if (seat_config->session_cpu_affinity != NULL);
+    fail_if (seat_config->session_io_priority != NULL);
+    fail_if (seat_config->session_oom_score_adj != G_MAXINT);
+    fail_if (seat_config->cpu_weight != 0);
+    fail_if (seat_config->memory_max != NULL);
+    fail_if (seat_config->io_weight != 0);
+    fail_if (g_strcmp0 (seat_config->pam_service, "tlm-login") != 0);
+    fail_if (seat_config->session_argv == NULL ||
+             g_strv_length (seat_config->session_argv) != 2);
+    fail_if (g_strcmp0 (seat_config->session_argv[1], "--tty=1") != 0);
+
+    /* modifications invalidate the cached value */
+    tlm_config_set_boolean (config, "seat1",
+                            TLM_CONFIG_GENERAL_PAUSE_SESSION, FALSE);
+    seat_config = tlm_config_get_seat_config (config, "seat1");
+    fail_if (seat_config->pause_session != FALSE);
+
+    /* signed values */
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+                           TLM_CONFIG_GENERAL_SESSION_NICE, "10");
+    tlm_config_set_string (config, "seat1",
+                           TLM_CONFIG_GENERAL_SESSION_NICE, "-5");
+    seat_config = tlm_config_get_seat_config (config, "seat1");
+    fail_if (seat_config->session_nice != -5);
+
+    /* scheduling and resource policies */
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+                           TLM_CONFIG_GENERAL_SESSION_SCHED_POLICY, "batch");
+    tlm_config_set_string (config, "seat1",
+                           TLM_CONFIG_GENERAL_SESSION_CPU_AFFINITY, "0-3,6");
+    tlm_config_set_string (config, "seat1",
+                           TLM_CONFIG_GENERAL_SESSION_IO_PRIORITY,
+                           "best-effort:4");
+    tlm_config_set_int (config, "seat1",
+                        TLM_CONFIG_GENERAL_SESSION_OOM_SCORE_ADJ, -100);
+    tlm_config_set_uint (config, "seat1", TLM_CONFIG_GENERAL_CPU_WEIGHT, 200);
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+                           TLM_CONFIG_GENERAL_MEMORY_MAX, "1G");
+    tlm_config_set_uint (config, "seat1", TLM_CONFIG_GENERAL_IO_WEIGHT, 50);
+    seat_config = tlm_config_get_seat_config (config, "seat1");
+    fail_if (g_strcmp0 (seat_config->session_sched_policy, "batch") != 0);
+    fail_if (g_strcmp0 (seat_config->session_cpu_affinity, "0-3,6") != 0);
+    fail_if (g_strcmp0 (seat_config->session_io_priority,
+                        "best-effort:4") != 0);
+    fail_if (seat_config->session_oom_score_adj != -100);
+    fail_if (seat_config->cpu_weight != 200);
+    fail_if (g_strcmp0 (seat_config->memory_max, "1G") != 0);
+    fail_if (seat_config->io_weight != 50);
+
+    /* TERMINATE_TIMEOUT alone keeps whole second steps */
+    tlm_config_set_uint (config, TLM_CONFIG_GENERAL,
+                         TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 1);
+    seat_config = tlm_config_get_seat_config (config, "seat1");
+    fail_if (seat_config->terminate_step != 1000);
+    tlm_config_set_uint (config, "seat1",
+                         TLM_CONFIG_GENERAL_TERMINATE_STEP, 50);
+    seat_config = tlm_config_get_seat_config (config, "seat1");
+    fail_if (seat_config->terminate_step != 50);
+
+    seat_config = tlm_config_get_seat_config (config, NULL);
+    fail_if (seat_config->vtnr != 0);
+    fail_if (seat_config->runtime_mode != 0700);
+
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST(test_config_cache)
+{
+    const gchar *cache_path = g_getenv ("TLM_CONF_CACHE");
+    const gchar *tmp_str = NULL;
+    gchar *contents = NULL;
+    TlmConfig *config = NULL;
+
+    fail_if (cache_path == NULL, "TLM_CONF_CACHE not set");
+
+    /* a corrupt cache is ignored, only the daemon rewrites it */
+    fail_if (!g_file_set_contents (cache_path, "garbage", -1, NULL));
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    g_object_unref (config);
+    fail_if (!g_file_get_contents (cache_path, &contents, NULL, NULL));
+    fail_if (g_strcmp0 (contents, "garbage") != 0);
+    g_free (contents);
+
+    config = tlm_config_new_writing_cache ();
+    fail_if (config == NULL, "Failed to create config object");
+    g_object_unref (config);
+    fail_if (!g_file_get_contents (cache_path, &contents, NULL, NULL));
+    fail_if (g_strcmp0 (contents, "garbage") == 0);
+    g_free (contents);
+
+    /* loaded from the cache this time */
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    tmp_str = tlm_config_get_string (config, TLM_GROUP, STR_KEY);
+    fail_if (tmp_str == NULL || strcmp (tmp_str, STR_VALUE) != 0);
+    fail_if (tlm_config_get_uint (config, TLM_GROUP, UINT_KEY, 0) !=
+             UINT_VALUE);
+    fail_if (tlm_config_has_key (config, TLM_GROUP, "unknown"));
+    fail_if (tlm_config_has_group (config, "unknown"));
+
+    /* cached groups can still be modified */
+    tlm_config_set_string (config, TLM_GROUP, STR_KEY, "new_value");
+    tmp_str = tlm_config_get_string (config, TLM_GROUP, STR_KEY);
+    fail_if (tmp_str == NULL || strcmp (tmp_str, "new_value") != 0);
+    fail_if (g_hash_table_size (tlm_config_get_group (config, TLM_GROUP)) != 4);
+
+    g_object_unref (config);
+}
+END_TEST
+
+static void
+_on_config_changed (TlmConfig *config, gchar **groups, gpointer user_data)
+{
+    gchar ***result = user_data;
+    *result = g_strdupv (groups);
+}
+
+START_TEST(test_config_reload_changed)
+{
+    TlmConfig *config = NULL;
+    gchar **changed = NULL;
+
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    g_signal_connect (config, "changed", G_CALLBACK (_on_config_changed),
+                      &changed);
+
+    /* unchanged file, no notification */
+    tlm_config_reload (config);
+    fail_if (changed != NULL);
+
+    /* reload drops the runtime modification */
+    tlm_config_set_string (config, "other-group", STR_KEY, "other_value");
+    tlm_config_set_string (config, TLM_GROUP, STR_KEY, STR_VALUE);
+    tlm_config_reload (config);
+    fail_if (changed == NULL, "No change notification");
+    fail_if (g_strv_length (changed) != 1);
+    fail_if (g_strcmp0 (changed[0], "other-group") != 0);
+
+    g_strfreev (changed);
+    g_object_unref (config);
+}
+END_TEST
+
 int main (void)
 {
     int number_failed;
@@ -127,6 +335,10 @@ int main (void)
     TCase *tc = tcase_create ("Config");
 
     tcase_add_test (tc, test_config);
+    tcase_add_test (tc, test_config_snapshot);
+    tcase_add_test (tc, test_seat_config);
+    tcase_add_test (tc, test_config_reload_changed);
+    tcase_add_test (tc, test_config_cache);
     suite_add_tcase (s, tc);
 
     sr = srunner_create(s);
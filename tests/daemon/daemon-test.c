@@ -29,12 +29,15 @@
 #include <stdlib.h>
 #include <gio/gio.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <glib-unix.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "common/dbus/tlm-dbus.h"
 #include "common/tlm-log.h"
@@ -42,10 +45,24 @@
 #include "common/dbus/tlm-dbus-login-gen.h"
 #include "common/tlm-utils.h"
 #include "common/dbus/tlm-dbus-utils.h"
+#include "common/tlm-error.h"
 
 static gchar *exe_name = 0;
 static GPid daemon_pid = 0;
 
+/* tlm started against mock-logind, with a stand-in for tlm-sessiond */
+static gchar *mock_dir = NULL;
+static GPid mock_logind_pid = 0;
+static gint mock_logind_in = -1;
+static GIOChannel *mock_logind_out = NULL;
+
+/* The stand-in for tlm-sessiond never answers the D-Bus handshake while the
+ * file 'hang' is next to it, and otherwise fails it right away. */
+static const gchar fake_sessiond[] =
+    "#!/bin/sh\n"
+    "[ -e \"$(dirname \"$0\")/hang\" ] && exec sleep 60\n"
+    "exit 1\n";
+
 static GMainLoop *main_loop = NULL;
 
 static void
@@ -91,7 +108,11 @@ _setup_daemon (void)
 static void
 _teardown_daemon (void)
 {
-    if (daemon_pid) kill (daemon_pid, SIGTERM);
+    if (daemon_pid) {
+        kill (daemon_pid, SIGTERM);
+        waitpid (daemon_pid, NULL, 0);
+        daemon_pid = 0;
+    }
 }
 
 GDBusConnection *
@@ -117,8 +138,8 @@ _get_bus_connection (
 
     /* get dbus connection for specific user only */
     gchar address[128];
-    g_snprintf (address, 127, "unix:path=%s/%s-%d", TLM_DBUS_SOCKET_PATH,
-            seat_id, ui_user_id);
+    g_snprintf (address, 127, "unix:path=%s/%s", TLM_DBUS_SOCKET_PATH,
+            seat_id);
     return g_dbus_connection_new_for_address_sync (address,
             G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL, error);
 }
@@ -132,6 +153,268 @@ _get_login_object (
             NULL, TLM_LOGIN_OBJECTPATH, NULL, error);
 }
 
+static TlmDbusLogin *
+_get_root_login_object (void)
+{
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+
+    connection = _get_root_socket_bus_connection (&error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+    login_object = _get_login_object (connection, &error);
+    fail_if (login_object == NULL, "failed to get login object: %s",
+            error ? error->message : "");
+    g_object_unref (connection);
+
+    return login_object;
+}
+
+static GVariant *
+_request_environment (guint timeout)
+{
+    GVariantBuilder builder;
+    gchar *value = NULL;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
+    if (timeout) {
+        value = g_strdup_printf ("%u", timeout);
+        g_variant_builder_add (&builder, "{ss}", TLM_DBUS_REQUEST_TIMEOUT_KEY,
+                value);
+        g_free (value);
+    }
+    return g_variant_builder_end (&builder);
+}
+
+/* D-Bus name of a TlmError, as found in the results of batch calls */
+static gchar *
+_error_name (TlmError code)
+{
+    GError *error = g_error_new_literal (TLM_ERROR, code, "");
+    gchar *name = g_dbus_error_encode_gerror (error);
+
+    g_error_free (error);
+    return name;
+}
+
+static void
+_write_mock_file (
+        const gchar *name,
+        const gchar *contents,
+        gint mode)
+{
+    GError *error = NULL;
+    gchar *path = g_build_filename (mock_dir, name, NULL);
+
+    fail_if (!g_file_set_contents (path, contents, -1, &error),
+            "failed to write '%s': %s", path, error ? error->message : "");
+    fail_if (g_chmod (path, mode) != 0);
+    g_free (path);
+}
+
+static void
+_set_sessiond_hangs (gboolean hang)
+{
+    gchar *path = g_build_filename (mock_dir, "hang", NULL);
+
+    if (hang)
+        _write_mock_file ("hang", "", 0644);
+    else
+        g_unlink (path);
+    g_free (path);
+}
+
+/* runs a mock-logind command, see tests/logind/mock-logind.c */
+static gboolean
+_mock_logind_command (const gchar *command)
+{
+    gchar *line = g_strdup_printf ("%s\n", command);
+    gchar *answer = NULL;
+    gboolean ok = FALSE;
+
+    if (write (mock_logind_in, line, strlen (line)) == (ssize_t) strlen (line)
+        && g_io_channel_read_line (mock_logind_out, &answer, NULL, NULL,
+                NULL) == G_IO_STATUS_NORMAL)
+        ok = g_str_has_prefix (answer, "ok");
+    DBG ("mock-logind '%s': %s", command, answer ? answer : "(none)");
+    g_free (answer);
+    g_free (line);
+    return ok;
+}
+
+static void
+_start_mock_logind (
+        const gchar *seats,
+        guint latency,
+        gchar **address)
+{
+    GError *error = NULL;
+    gchar *argv[4];
+    gint out_fd = -1;
+
+    argv[0] = (gchar *) g_getenv ("TLM_MOCK_LOGIND");
+    argv[1] = g_strdup_printf ("--seats=%s", seats);
+    argv[2] = g_strdup_printf ("--latency=%u", latency);
+    argv[3] = NULL;
+    fail_if (argv[0] == NULL, "TLM_MOCK_LOGIND not set");
+
+    g_spawn_async_with_pipes (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+            NULL, NULL, &mock_logind_pid, &mock_logind_in, &out_fd, NULL,
+            &error);
+    g_free (argv[1]);
+    g_free (argv[2]);
+    fail_if (error != NULL, "Failed to spawn mock-logind : %s",
+            error ? error->message : "");
+
+    /* the first line is the address of its private bus */
+    mock_logind_out = g_io_channel_unix_new (out_fd);
+    g_io_channel_set_close_on_unref (mock_logind_out, TRUE);
+    fail_if (g_io_channel_read_line (mock_logind_out, address, NULL, NULL,
+            NULL) != G_IO_STATUS_NORMAL, "mock-logind did not start");
+    g_strstrip (*address);
+}
+
+/* Starts mock-logind serving @seats and tlm with @config, in which %s is
+ * replaced by the address of the mock */
+static void
+_setup_mock_daemon (
+        const gchar *seats,
+        guint latency,
+        const gchar *config,
+        gboolean sessiond_hangs)
+{
+    GError *error = NULL;
+    gchar *address = NULL;
+    gchar *contents = NULL;
+    gchar *conf_path = NULL;
+    gchar **envp = NULL;
+    gchar *argv[2];
+    gint64 deadline;
+    GDBusConnection *connection = NULL;
+
+    mock_dir = g_dir_make_tmp ("tlm-daemon-test-XXXXXX", &error);
+    fail_if (mock_dir == NULL, "failed to create directory: %s",
+            error ? error->message : "");
+    _write_mock_file ("tlm-sessiond", fake_sessiond, 0755);
+    _set_sessiond_hangs (sessiond_hangs);
+
+    _start_mock_logind (seats, latency, &address);
+    contents = g_strdup_printf (config, address);
+    _write_mock_file ("tlm.conf", contents, 0644);
+    g_free (contents);
+    g_free (address);
+
+    conf_path = g_build_filename (mock_dir, "tlm.conf", NULL);
+    envp = g_get_environ ();
+    envp = g_environ_setenv (envp, "TLM_CONF_FILE", conf_path, TRUE);
+    envp = g_environ_setenv (envp, "TLM_BIN_DIR", mock_dir, TRUE);
+    g_free (conf_path);
+
+    argv[0] = g_build_filename (g_getenv ("TLM_BIN_DIR"), "tlm", NULL);
+    argv[1] = NULL;
+    g_spawn_async (NULL, argv, envp, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+            &daemon_pid, &error);
+    g_free (argv[0]);
+    g_strfreev (envp);
+    fail_if (error != NULL, "Failed to spawn daemon : %s",
+            error ? error->message : "");
+
+    /* wait for the root socket rather than a fixed time */
+    deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+    while (!(connection = _get_root_socket_bus_connection (NULL)) &&
+           g_get_monotonic_time () < deadline)
+        g_usleep (100000);
+    fail_if (connection == NULL, "daemon did not come up");
+    g_object_unref (connection);
+}
+
+static void
+_remove_mock_dir (void)
+{
+    GDir *dir = NULL;
+    const gchar *name = NULL;
+
+    if (!mock_dir) return;
+
+    if ((dir = g_dir_open (mock_dir, 0, NULL))) {
+        while ((name = g_dir_read_name (dir))) {
+            gchar *path = g_build_filename (mock_dir, name, NULL);
+            g_unlink (path);
+            g_free (path);
+        }
+        g_dir_close (dir);
+    }
+    g_rmdir (mock_dir);
+    g_clear_pointer (&mock_dir, g_free);
+}
+
+static void
+_teardown_mock_daemon (void)
+{
+    _teardown_daemon ();
+
+    if (mock_logind_pid) {
+        kill (mock_logind_pid, SIGTERM);
+        waitpid (mock_logind_pid, NULL, 0);
+        mock_logind_pid = 0;
+    }
+    if (mock_logind_in >= 0) {
+        close (mock_logind_in);
+        mock_logind_in = -1;
+    }
+    g_clear_pointer (&mock_logind_out, g_io_channel_unref);
+    _remove_mock_dir ();
+}
+
+/* Waits until tlm has (or no longer has) @seat_id. Probing with logoutUser
+ * leaves a seat without session untouched. */
+static void
+_wait_for_seat (
+        TlmDbusLogin *login_object,
+        const gchar *seat_id,
+        gboolean present)
+{
+    GError *error = NULL;
+    gint64 deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+    gboolean found = FALSE;
+
+    for (;;) {
+        tlm_dbus_login_call_logout_user_sync (login_object, seat_id, NULL,
+                &error);
+        found = !g_error_matches (error, TLM_ERROR, TLM_ERROR_SEAT_NOT_FOUND);
+        g_clear_error (&error);
+        if (found == present || g_get_monotonic_time () > deadline)
+            break;
+        g_usleep (100000);
+    }
+    fail_unless (found == present, "seat %s is %s", seat_id,
+            found ? "still there" : "missing");
+}
+
+/* Waits until the automatic login of @seat_id is in progress */
+static void
+_wait_for_auto_login (
+        TlmDbusLogin *login_object,
+        const gchar *seat_id)
+{
+    GError *error = NULL;
+    gint64 deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+    gboolean busy = FALSE;
+
+    for (;;) {
+        tlm_dbus_login_call_login_user_sync (login_object, seat_id, "root",
+                "", _request_environment (0), NULL, &error);
+        busy = g_error_matches (error, TLM_ERROR,
+                TLM_ERROR_SESSION_ALREADY_EXISTS);
+        g_clear_error (&error);
+        if (busy || g_get_monotonic_time () > deadline)
+            break;
+        g_usleep (100000);
+    }
+    fail_unless (busy, "no automatic login on seat %s", seat_id);
+}
+
 
 static GVariant *
 _get_session_property (
@@ -274,6 +557,484 @@ START_TEST (test_login_user)
 }
 END_TEST
 
+START_TEST (test_start_login)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    GHashTable *environ = NULL;
+    GVariant *venv = NULL;
+    GVariant *vseat = NULL;
+    gchar *seat = NULL;
+    guint job_id = 0;
+
+    vseat = _get_property ("Seat");
+    fail_if (vseat == NULL);
+    g_variant_get (vseat, "(so)", &seat, NULL);
+    g_variant_unref (vseat);
+
+    connection = _get_bus_connection (seat, &error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+    g_free (seat);
+
+    login_object = _get_login_object (connection, &error);
+    fail_if (login_object == NULL, "failed to get login object: %s",
+            error ? error->message : "");
+
+    environ = g_hash_table_new_full ((GHashFunc)g_str_hash,
+            (GEqualFunc)g_str_equal,
+            (GDestroyNotify)g_free,
+            (GDestroyNotify)g_free);
+    venv = tlm_dbus_utils_hash_table_to_variant (environ);
+
+    g_hash_table_unref (environ);
+
+    /* login is not available on the user socket, no job is started */
+    fail_if (tlm_dbus_login_call_start_login_sync (login_object,
+            "seat0", "test01234567", "test1", venv, &job_id, NULL,
+            &error) == TRUE);
+    fail_if (job_id != 0);
+
+    if (error) {
+        g_error_free (error);
+        error = NULL;
+    }
+    g_object_unref (login_object);
+    g_object_unref (connection);
+}
+END_TEST
+
+START_TEST (test_cancel_request)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    GDBusConnection *connection = NULL;
+    TlmDbusLogin *login_object = NULL;
+    GVariant *vseat = NULL;
+    gchar *seat = NULL;
+
+    vseat = _get_property ("Seat");
+    fail_if (vseat == NULL);
+    g_variant_get (vseat, "(so)", &seat, NULL);
+    g_variant_unref (vseat);
+
+    connection = _get_bus_connection (seat, &error);
+    fail_if (connection == NULL, "failed to get bus connection : %s",
+            error ? error->message : "(null)");
+
+    login_object = _get_login_object (connection, &error);
+    fail_if (login_object == NULL, "failed to get login object: %s",
+            error ? error->message : "");
+
+    /* nothing in progress, cancelling is a no-op */
+    fail_unless (tlm_dbus_login_call_cancel_request_sync (login_object,
+            seat, NULL, &error) == TRUE, "cancel request failed: %s",
+            error ? error->message : "");
+
+    g_free (seat);
+    g_object_unref (login_object);
+    g_object_unref (connection);
+}
+END_TEST
+
+/*
+ * Request queue test cases, against mock-logind
+ */
+static const gchar queue_config[] =
+    "[General]\n"
+    "LOGIND_ADDRESS=%s\n"
+    "AUTO_LOGIN=0\n"
+    "PREPARE_DEFAULT=0\n"
+    "SETUP_TERMINAL=0\n"
+    "SESSIOND_POOL_SIZE=0\n";
+
+static void
+_setup_queue_daemon (void)
+{
+    TlmDbusLogin *login_object = NULL;
+
+    _setup_mock_daemon ("seat0", 0, queue_config, FALSE);
+    login_object = _get_root_login_object ();
+    _wait_for_seat (login_object, "seat0", TRUE);
+    g_object_unref (login_object);
+}
+
+START_TEST (test_relogin_throttle)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    TlmDbusLogin *login_object = NULL;
+    gint64 started;
+    guint i;
+
+    _set_sessiond_hangs (FALSE);
+    login_object = _get_root_login_object ();
+
+    /* logins in quick succession fail right away with the stand-in
+     * sessiond; past the third one they are refused by the throttle
+     * instead of being held back for 10 seconds */
+    started = g_get_monotonic_time ();
+    for (i = 0; i < 6; i++) {
+        fail_if (tlm_dbus_login_call_login_user_sync (login_object, "seat0",
+                "root", "", _request_environment (4), NULL, &error));
+        fail_unless (g_error_matches (error, TLM_ERROR, i < 3 ?
+                TLM_ERROR_SESSION_CREATION_FAILURE :
+                TLM_ERROR_SESSION_THROTTLED), "login %u: %s", i,
+                error ? error->message : "");
+        g_clear_error (&error);
+    }
+    fail_if (g_get_monotonic_time () - started > 4 * G_USEC_PER_SEC);
+
+    /* leave the throttle for the next test */
+    g_usleep (G_USEC_PER_SEC + G_USEC_PER_SEC / 10);
+
+    g_object_unref (login_object);
+}
+END_TEST
+
+/* entry @index of the results of a batch call failed with @code, or
+ * succeeded for TLM_ERROR_NONE */
+static gboolean
+_batch_result_is (
+        GVariant *results,
+        gsize index,
+        TlmError code)
+{
+    const gchar *error_name = NULL;
+    gchar *name = code ? _error_name (code) : g_strdup ("");
+    gboolean ret;
+
+    g_variant_get_child (results, index, "(&s&s&s)", NULL, &error_name,
+            NULL);
+    ret = g_strcmp0 (error_name, name) == 0;
+    g_free (name);
+    return ret;
+}
+
+START_TEST (test_queue_supersede)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    TlmDbusLogin *login_object = NULL;
+    GVariantBuilder builder;
+    GVariant *results = NULL;
+    const gchar *seats[] = { "seat0", "seat0", NULL };
+    guint i;
+
+    _set_sessiond_hangs (FALSE);
+    login_object = _get_root_login_object ();
+
+    /* the entries of a batch are queued together, so the later login
+     * replaces the earlier one before it is processed */
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sssa{ss})"));
+    for (i = 0; i < 2; i++)
+        g_variant_builder_add (&builder, "(sss@a{ss})", "seat0", "root", "",
+                _request_environment (0));
+    fail_unless (tlm_dbus_login_call_login_users_sync (login_object,
+            g_variant_builder_end (&builder), &results, NULL, &error),
+            "loginUsers failed: %s", error ? error->message : "");
+    fail_unless (g_variant_n_children (results) == 2);
+    fail_unless (_batch_result_is (results, 0,
+            TLM_ERROR_DBUS_REQ_SUPERSEDED));
+    fail_unless (_batch_result_is (results, 1,
+            TLM_ERROR_SESSION_CREATION_FAILURE));
+    g_variant_unref (results);
+
+    /* so does a later logout */
+    fail_unless (tlm_dbus_login_call_logout_users_sync (login_object,
+            seats, &results, NULL, &error),
+            "logoutUsers failed: %s", error ? error->message : "");
+    fail_unless (g_variant_n_children (results) == 2);
+    fail_unless (_batch_result_is (results, 0,
+            TLM_ERROR_DBUS_REQ_SUPERSEDED));
+    fail_unless (_batch_result_is (results, 1, TLM_ERROR_SESSION_NOT_VALID));
+    g_variant_unref (results);
+
+    g_object_unref (login_object);
+}
+END_TEST
+
+typedef struct {
+    const gchar *request;
+    GError *error;
+} TestReply;
+
+static GPtrArray *test_replies = NULL;
+static guint test_replies_pending = 0;
+
+static void
+_add_test_reply (
+        const gchar *request,
+        GError *error)
+{
+    TestReply *reply = g_new0 (TestReply, 1);
+
+    DBG ("%s answered: %s", request, error ? error->message : "ok");
+    reply->request = request;
+    reply->error = error;
+    g_ptr_array_add (test_replies, reply);
+    if (--test_replies_pending == 0)
+        g_main_loop_quit (main_loop);
+}
+
+static void
+_on_login_reply (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GError *error = NULL;
+
+    tlm_dbus_login_call_login_user_finish (TLM_DBUS_LOGIN (object), res,
+            &error);
+    _add_test_reply (user_data, error);
+}
+
+static void
+_on_logout_reply (
+        GObject *object,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GError *error = NULL;
+
+    tlm_dbus_login_call_logout_user_finish (TLM_DBUS_LOGIN (object), res,
+            &error);
+    _add_test_reply (user_data, error);
+}
+
+static gboolean
+_on_test_timeout (gpointer user_data)
+{
+    g_main_loop_quit (main_loop);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_test_reply_free (TestReply *reply)
+{
+    g_clear_error (&reply->error);
+    g_free (reply);
+}
+
+/* the @index-th answered request is @request, failed with @code */
+static void
+_check_test_reply (
+        guint index,
+        const gchar *request,
+        TlmError code)
+{
+    TestReply *reply = g_ptr_array_index (test_replies, index);
+
+    fail_unless (g_strcmp0 (reply->request, request) == 0,
+            "reply %u is for %s, expected %s", index, reply->request,
+            request);
+    fail_unless (g_error_matches (reply->error, TLM_ERROR, code),
+            "%s failed with '%s', expected error %d", request,
+            reply->error ? reply->error->message : "no error", code);
+}
+
+START_TEST (test_queue_order)
+{
+    DBG ("\n");
+    TlmDbusLogin *login_object = NULL;
+
+    _set_sessiond_hangs (TRUE);
+    login_object = _get_root_login_object ();
+    test_replies = g_ptr_array_new_with_free_func (
+            (GDestroyNotify) _test_reply_free);
+    test_replies_pending = 4;
+
+    /* login A keeps the seat busy until its deadline, the requests queued
+     * meanwhile are answered only after it */
+    tlm_dbus_login_call_login_user (login_object, "seat0", "root", "",
+            _request_environment (2), NULL, _on_login_reply, "login A");
+    g_usleep (500000);
+
+    /* B is replaced by C, the logout goes ahead of C */
+    tlm_dbus_login_call_login_user (login_object, "seat0", "root", "",
+            _request_environment (0), NULL, _on_login_reply, "login B");
+    tlm_dbus_login_call_logout_user (login_object, "seat0", NULL,
+            _on_logout_reply, "logout");
+    tlm_dbus_login_call_login_user (login_object, "seat0", "root", "",
+            _request_environment (5), NULL, _on_login_reply, "login C");
+
+    g_timeout_add_seconds (20, _on_test_timeout, NULL);
+    g_main_loop_run (main_loop);
+
+    fail_unless (test_replies->len == 4, "only %u replies",
+            test_replies->len);
+    _check_test_reply (0, "login B", TLM_ERROR_DBUS_REQ_SUPERSEDED);
+    _check_test_reply (1, "login A", TLM_ERROR_DBUS_REQ_TIMEOUT);
+    /* the aborted login A left no session behind */
+    _check_test_reply (2, "logout", TLM_ERROR_SESSION_NOT_VALID);
+    _check_test_reply (3, "login C", TLM_ERROR_DBUS_REQ_TIMEOUT);
+
+    g_ptr_array_unref (test_replies);
+    test_replies = NULL;
+    g_object_unref (login_object);
+}
+END_TEST
+
+START_TEST (test_cancel_own_requests)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    TlmDbusLogin *login_a = NULL;
+    TlmDbusLogin *login_b = NULL;
+
+    _set_sessiond_hangs (TRUE);
+    login_a = _get_root_login_object ();
+    login_b = _get_root_login_object ();
+    test_replies = g_ptr_array_new_with_free_func (
+            (GDestroyNotify) _test_reply_free);
+    test_replies_pending = 2;
+
+    /* A is in progress and B waits behind it, on separate connections */
+    tlm_dbus_login_call_login_user (login_a, "seat0", "root", "",
+            _request_environment (5), NULL, _on_login_reply, "login A");
+    g_usleep (500000);
+    tlm_dbus_login_call_login_user (login_b, "seat0", "root", "",
+            _request_environment (3), NULL, _on_login_reply, "login B");
+    g_usleep (500000);
+
+    /* cancelling through A's connection leaves B alone */
+    fail_unless (tlm_dbus_login_call_cancel_request_sync (login_a, "seat0",
+            NULL, &error), "cancel request failed: %s",
+            error ? error->message : "");
+
+    g_timeout_add_seconds (20, _on_test_timeout, NULL);
+    g_main_loop_run (main_loop);
+
+    fail_unless (test_replies->len == 2, "only %u replies",
+            test_replies->len);
+    _check_test_reply (0, "login A", TLM_ERROR_DBUS_REQ_CANCELLED);
+    _check_test_reply (1, "login B", TLM_ERROR_DBUS_REQ_TIMEOUT);
+
+    g_ptr_array_unref (test_replies);
+    test_replies = NULL;
+    g_object_unref (login_b);
+    g_object_unref (login_a);
+}
+END_TEST
+
+/*
+ * Batch test cases, against mock-logind
+ */
+static const gchar batch_config[] =
+    "[General]\n"
+    "LOGIND_ADDRESS=%s\n"
+    "AUTO_LOGIN=1\n"
+    "PREPARE_DEFAULT=0\n"
+    "SETUP_TERMINAL=0\n"
+    "SESSIOND_POOL_SIZE=0\n";
+
+static void
+_setup_batch_daemon (void)
+{
+    TlmDbusLogin *login_object = NULL;
+
+    /* the automatic logins never complete, so there is always a session
+     * in progress to log out */
+    _setup_mock_daemon ("seat0,seat1", 0, batch_config, TRUE);
+    login_object = _get_root_login_object ();
+    _wait_for_auto_login (login_object, "seat0");
+    _wait_for_auto_login (login_object, "seat1");
+    g_object_unref (login_object);
+}
+
+START_TEST (test_logout_users)
+{
+    DBG ("\n");
+    GError *error = NULL;
+    TlmDbusLogin *login_object = NULL;
+    GVariant *results = NULL;
+    const gchar *seats[] = { "seat0", "seat1", NULL };
+    guint i;
+
+    login_object = _get_root_login_object ();
+
+    /* completing a logout must not stop the connection from serving the
+     * other entries, nor later calls */
+    for (i = 0; i < 2; i++) {
+        fail_unless (tlm_dbus_login_call_logout_users_sync (login_object,
+                seats, &results, NULL, &error),
+                "logoutUsers %u failed: %s", i, error ? error->message : "");
+        fail_unless (g_variant_n_children (results) == 2);
+        fail_unless (_batch_result_is (results, 0, TLM_ERROR_NONE),
+                "logout of seat0 failed");
+        fail_unless (_batch_result_is (results, 1, TLM_ERROR_NONE),
+                "logout of seat1 failed");
+        g_variant_unref (results);
+
+        /* the seats log in again automatically */
+        _wait_for_auto_login (login_object, "seat0");
+        _wait_for_auto_login (login_object, "seat1");
+    }
+
+    g_object_unref (login_object);
+}
+END_TEST
+
+/*
+ * Seat test cases, against mock-logind
+ */
+static const gchar seat_config[] =
+    "[General]\n"
+    "LOGIND_ADDRESS=%s\n"
+    "LOGIND_TIMEOUT=500\n"
+    "LOGIND_RETRIES=20\n"
+    "AUTO_LOGIN=0\n"
+    "PREPARE_DEFAULT=0\n"
+    "SETUP_TERMINAL=0\n"
+    "SESSIOND_POOL_SIZE=0\n";
+
+static void
+_setup_seat_daemon (void)
+{
+    /* ListSeats answers slower than LOGIND_TIMEOUT until told otherwise */
+    _setup_mock_daemon ("seat0", 2000, seat_config, FALSE);
+}
+
+START_TEST (test_slow_logind)
+{
+    DBG ("\n");
+    TlmDbusLogin *login_object = NULL;
+
+    login_object = _get_root_login_object ();
+
+    /* tlm gives up on each ListSeats after LOGIND_TIMEOUT and tries again,
+     * so the seat shows up once logind answers in time */
+    _wait_for_seat (login_object, "seat0", FALSE);
+    fail_unless (_mock_logind_command ("latency 0"));
+    _wait_for_seat (login_object, "seat0", TRUE);
+
+    g_object_unref (login_object);
+}
+END_TEST
+
+START_TEST (test_seat_hotplug)
+{
+    DBG ("\n");
+    TlmDbusLogin *login_object = NULL;
+
+    login_object = _get_root_login_object ();
+    fail_unless (_mock_logind_command ("latency 0"));
+    _wait_for_seat (login_object, "seat0", TRUE);
+
+    /* seats come and go with SeatNew and SeatRemoved */
+    fail_unless (_mock_logind_command ("add-seat seat1"));
+    _wait_for_seat (login_object, "seat1", TRUE);
+    fail_unless (_mock_logind_command ("remove-seat seat1"));
+    _wait_for_seat (login_object, "seat1", FALSE);
+    _wait_for_seat (login_object, "seat0", TRUE);
+
+    g_object_unref (login_object);
+}
+END_TEST
+
 Suite* daemon_suite (void)
 {
     TCase *tc = NULL;
@@ -286,8 +1047,48 @@ Suite* daemon_suite (void)
     tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
 
     tcase_add_test (tc, test_login_user);
+    tcase_add_test (tc, test_start_login);
+    tcase_add_test (tc, test_cancel_request);
     suite_add_tcase (s, tc);
 
+#ifdef ENABLE_DEBUG
+    /* tlm only runs the stand-in sessiond (TLM_BIN_DIR) in debug builds */
+    if (geteuid () == 0) {
+        tc = tcase_create ("Request queue tests");
+        tcase_set_timeout (tc, 30);
+        tcase_add_unchecked_fixture (tc, _setup_queue_daemon,
+                _teardown_mock_daemon);
+        tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
+
+        tcase_add_test (tc, test_relogin_throttle);
+        tcase_add_test (tc, test_queue_supersede);
+        tcase_add_test (tc, test_queue_order);
+        tcase_add_test (tc, test_cancel_own_requests);
+        suite_add_tcase (s, tc);
+
+        tc = tcase_create ("Batch tests");
+        tcase_set_timeout (tc, 30);
+        tcase_add_unchecked_fixture (tc, _setup_batch_daemon,
+                _teardown_mock_daemon);
+        tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
+
+        tcase_add_test (tc, test_logout_users);
+        suite_add_tcase (s, tc);
+    }
+#endif
+
+    if (geteuid () == 0) {
+        tc = tcase_create ("Seat tests");
+        tcase_set_timeout (tc, 30);
+        tcase_add_unchecked_fixture (tc, _setup_seat_daemon,
+                _teardown_mock_daemon);
+        tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
+
+        tcase_add_test (tc, test_slow_logind);
+        tcase_add_test (tc, test_seat_hotplug);
+        suite_add_tcase (s, tc);
+    }
+
     return s;
 }
 
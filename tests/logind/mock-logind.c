@@ -0,0 +1,564 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Mock of the parts of org.freedesktop.login1 that tlm uses: ListSeats,
+ * GetSeat, GetSessionByPID and the SeatNew/SeatRemoved signals.
+ *
+ * Without --address it starts a private bus and prints its address as the
+ * first line on stdout; point tlm at it with LOGIND_ADDRESS in tlm.conf.
+ * It then reads commands from stdin, one per line, and answers each with
+ * "ok" or "error: <reason>":
+ *
+ *   add-seat <id>            export a seat and emit SeatNew
+ *   remove-seat <id>         drop a seat and emit SeatRemoved
+ *   latency <ms>             delay the replies to method calls
+ *   session <pid> <seat-id>  make GetSessionByPID find a session for <pid>
+ *   quit
+ */
+
+#include "config.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "common/tlm-log.h"
+
+#define LOGIND_BUS_NAME     "org.freedesktop.login1"
+#define LOGIND_OBJECT_PATH  "/org/freedesktop/login1"
+#define LOGIND_MANAGER_IFACE LOGIND_BUS_NAME ".Manager"
+
+static const gchar introspection_xml[] =
+    "<node>"
+    "  <interface name='org.freedesktop.login1.Manager'>"
+    "    <method name='ListSeats'>"
+    "      <arg name='seats' type='a(so)' direction='out'/>"
+    "    </method>"
+    "    <method name='GetSeat'>"
+    "      <arg name='id' type='s' direction='in'/>"
+    "      <arg name='path' type='o' direction='out'/>"
+    "    </method>"
+    "    <method name='GetSessionByPID'>"
+    "      <arg name='pid' type='u' direction='in'/>"
+    "      <arg name='path' type='o' direction='out'/>"
+    "    </method>"
+    "    <signal name='SeatNew'>"
+    "      <arg name='id' type='s'/>"
+    "      <arg name='path' type='o'/>"
+    "    </signal>"
+    "    <signal name='SeatRemoved'>"
+    "      <arg name='id' type='s'/>"
+    "      <arg name='path' type='o'/>"
+    "    </signal>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.login1.Seat'>"
+    "    <property name='Id' type='s' access='read'/>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.login1.Session'>"
+    "    <property name='Id' type='s' access='read'/>"
+    "    <property name='Seat' type='(so)' access='read'/>"
+    "    <property name='Leader' type='u' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+typedef struct {
+    gchar *id;
+    gchar *path;
+    guint registration_id;
+} MockSeat;
+
+typedef struct {
+    gchar *id;
+    gchar *path;
+    gchar *seat_id;
+    guint32 leader;
+    guint registration_id;
+} MockSession;
+
+static gchar *opt_address = NULL;
+static gchar *opt_seats = NULL;
+static guint opt_latency = 0;
+static gboolean opt_auto_sessions = FALSE;
+
+static GMainLoop *main_loop = NULL;
+static GDBusConnection *connection = NULL;
+static GDBusNodeInfo *introspection = NULL;
+static GHashTable *seats = NULL;    /* id -> MockSeat */
+static GHashTable *sessions = NULL; /* pid -> MockSession */
+static guint next_session = 1;
+
+static void
+_free_seat (MockSeat *seat)
+{
+    if (seat->registration_id)
+        g_dbus_connection_unregister_object (connection,
+                                             seat->registration_id);
+    g_free (seat->id);
+    g_free (seat->path);
+    g_slice_free (MockSeat, seat);
+}
+
+static void
+_free_session (MockSession *session)
+{
+    if (session->registration_id)
+        g_dbus_connection_unregister_object (connection,
+                                             session->registration_id);
+    g_free (session->id);
+    g_free (session->path);
+    g_free (session->seat_id);
+    g_slice_free (MockSession, session);
+}
+
+/* logind escapes ids the same way, e.g. seat-1 -> seat_2d1 */
+static gchar *
+_object_path (const gchar *prefix, const gchar *id)
+{
+    GString *path = g_string_new (prefix);
+    const gchar *c;
+
+    for (c = id; *c; c++) {
+        if (g_ascii_isalpha (*c) || (c != id && g_ascii_isdigit (*c)))
+            g_string_append_c (path, *c);
+        else
+            g_string_append_printf (path, "_%02x", (guchar) *c);
+    }
+    return g_string_free (path, FALSE);
+}
+
+static GVariant *
+_seat_get_property (GDBusConnection *bus, const gchar *sender,
+                    const gchar *object_path, const gchar *interface_name,
+                    const gchar *property_name, GError **error,
+                    gpointer user_data)
+{
+    MockSeat *seat = (MockSeat *) user_data;
+
+    if (g_strcmp0 (property_name, "Id") == 0)
+        return g_variant_new_string (seat->id);
+    return NULL;
+}
+
+static GVariant *
+_session_get_property (GDBusConnection *bus, const gchar *sender,
+                       const gchar *object_path, const gchar *interface_name,
+                       const gchar *property_name, GError **error,
+                       gpointer user_data)
+{
+    MockSession *session = (MockSession *) user_data;
+    MockSeat *seat;
+
+    if (g_strcmp0 (property_name, "Id") == 0)
+        return g_variant_new_string (session->id);
+    if (g_strcmp0 (property_name, "Leader") == 0)
+        return g_variant_new_uint32 (session->leader);
+    if (g_strcmp0 (property_name, "Seat") == 0) {
+        seat = g_hash_table_lookup (seats, session->seat_id);
+        return g_variant_new ("(so)", session->seat_id,
+                              seat ? seat->path : "/");
+    }
+    return NULL;
+}
+
+static const GDBusInterfaceVTable seat_vtable = {
+    NULL, _seat_get_property, NULL
+};
+
+static const GDBusInterfaceVTable session_vtable = {
+    NULL, _session_get_property, NULL
+};
+
+static gboolean
+_add_seat (const gchar *id, GError **error)
+{
+    MockSeat *seat;
+
+    if (g_hash_table_contains (seats, id)) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                     "seat '%s' exists", id);
+        return FALSE;
+    }
+
+    seat = g_slice_new0 (MockSeat);
+    seat->id = g_strdup (id);
+    seat->path = _object_path (LOGIND_OBJECT_PATH "/seat/", id);
+    seat->registration_id = g_dbus_connection_register_object (connection,
+            seat->path,
+            g_dbus_node_info_lookup_interface (introspection,
+                    LOGIND_BUS_NAME ".Seat"),
+            &seat_vtable, seat, NULL, error);
+    if (!seat->registration_id) {
+        _free_seat (seat);
+        return FALSE;
+    }
+    g_hash_table_insert (seats, seat->id, seat);
+
+    g_dbus_connection_emit_signal (connection, NULL, LOGIND_OBJECT_PATH,
+            LOGIND_MANAGER_IFACE, "SeatNew",
+            g_variant_new ("(so)", seat->id, seat->path), NULL);
+    return TRUE;
+}
+
+static gboolean
+_remove_seat (const gchar *id, GError **error)
+{
+    MockSeat *seat = g_hash_table_lookup (seats, id);
+
+    if (!seat) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                     "no seat '%s'", id);
+        return FALSE;
+    }
+
+    g_dbus_connection_emit_signal (connection, NULL, LOGIND_OBJECT_PATH,
+            LOGIND_MANAGER_IFACE, "SeatRemoved",
+            g_variant_new ("(so)", seat->id, seat->path), NULL);
+    g_hash_table_remove (seats, id);
+    return TRUE;
+}
+
+static MockSession *
+_add_session (guint32 pid, const gchar *seat_id, GError **error)
+{
+    MockSession *session = g_slice_new0 (MockSession);
+
+    session->id = g_strdup_printf ("%u", next_session++);
+    session->path = _object_path (LOGIND_OBJECT_PATH "/session/",
+                                  session->id);
+    session->seat_id = g_strdup (seat_id);
+    session->leader = pid;
+    session->registration_id = g_dbus_connection_register_object (
+            connection, session->path,
+            g_dbus_node_info_lookup_interface (introspection,
+                    LOGIND_BUS_NAME ".Session"),
+            &session_vtable, session, NULL, error);
+    if (!session->registration_id) {
+        _free_session (session);
+        return NULL;
+    }
+    g_hash_table_insert (sessions, GUINT_TO_POINTER (pid), session);
+    return session;
+}
+
+static GVariant *
+_list_seats (void)
+{
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    MockSeat *seat;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(so)"));
+    g_hash_table_iter_init (&iter, seats);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &seat))
+        g_variant_builder_add (&builder, "(so)", seat->id, seat->path);
+    return g_variant_new ("(a(so))", &builder);
+}
+
+static const gchar *
+_first_seat (void)
+{
+    GHashTableIter iter;
+    const gchar *id = NULL;
+
+    g_hash_table_iter_init (&iter, seats);
+    g_hash_table_iter_next (&iter, (gpointer *) &id, NULL);
+    return id;
+}
+
+static void
+_reply (GDBusMethodInvocation *invocation)
+{
+    const gchar *method = g_dbus_method_invocation_get_method_name (
+            invocation);
+    GVariant *params = g_dbus_method_invocation_get_parameters (invocation);
+    GError *error = NULL;
+
+    if (g_strcmp0 (method, "ListSeats") == 0) {
+        g_dbus_method_invocation_return_value (invocation, _list_seats ());
+    } else if (g_strcmp0 (method, "GetSeat") == 0) {
+        const gchar *id = NULL;
+        MockSeat *seat;
+
+        g_variant_get (params, "(&s)", &id);
+        if ((seat = g_hash_table_lookup (seats, id)))
+            g_dbus_method_invocation_return_value (invocation,
+                    g_variant_new ("(o)", seat->path));
+        else
+            g_dbus_method_invocation_return_dbus_error (invocation,
+                    LOGIND_BUS_NAME ".NoSuchSeat", "No such seat");
+    } else if (g_strcmp0 (method, "GetSessionByPID") == 0) {
+        guint32 pid = 0;
+        MockSession *session;
+        const gchar *seat_id;
+
+        g_variant_get (params, "(u)", &pid);
+        session = g_hash_table_lookup (sessions, GUINT_TO_POINTER (pid));
+        if (!session && opt_auto_sessions && (seat_id = _first_seat ()))
+            session = _add_session (pid, seat_id, &error);
+        if (session) {
+            g_dbus_method_invocation_return_value (invocation,
+                    g_variant_new ("(o)", session->path));
+        } else if (error) {
+            g_dbus_method_invocation_return_gerror (invocation, error);
+            g_error_free (error);
+        } else {
+            g_dbus_method_invocation_return_dbus_error (invocation,
+                    LOGIND_BUS_NAME ".NoSessionForPID",
+                    "PID does not belong to any known session");
+        }
+    }
+    g_object_unref (invocation);
+}
+
+static gboolean
+_delayed_reply (gpointer user_data)
+{
+    _reply (G_DBUS_METHOD_INVOCATION (user_data));
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_manager_method_call (GDBusConnection *bus, const gchar *sender,
+                      const gchar *object_path, const gchar *interface_name,
+                      const gchar *method_name, GVariant *parameters,
+                      GDBusMethodInvocation *invocation, gpointer user_data)
+{
+    g_object_ref (invocation);
+    if (opt_latency)
+        g_timeout_add (opt_latency, _delayed_reply, invocation);
+    else
+        _reply (invocation);
+}
+
+static const GDBusInterfaceVTable manager_vtable = {
+    _manager_method_call, NULL, NULL
+};
+
+static gboolean
+_run_command (gchar **argv, GError **error)
+{
+    guint argc = g_strv_length (argv);
+
+    if (argc == 2 && g_strcmp0 (argv[0], "add-seat") == 0)
+        return _add_seat (argv[1], error);
+    if (argc == 2 && g_strcmp0 (argv[0], "remove-seat") == 0)
+        return _remove_seat (argv[1], error);
+    if (argc == 2 && g_strcmp0 (argv[0], "latency") == 0) {
+        opt_latency = (guint) g_ascii_strtoull (argv[1], NULL, 10);
+        return TRUE;
+    }
+    if (argc == 3 && g_strcmp0 (argv[0], "session") == 0) {
+        guint32 pid = (guint32) g_ascii_strtoull (argv[1], NULL, 10);
+        g_hash_table_remove (sessions, GUINT_TO_POINTER (pid));
+        return _add_session (pid, argv[2], error) != NULL;
+    }
+    if (argc == 1 && g_strcmp0 (argv[0], "quit") == 0) {
+        g_main_loop_quit (main_loop);
+        return TRUE;
+    }
+
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 "unknown command");
+    return FALSE;
+}
+
+static gboolean
+_on_stdin (GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+    gchar *line = NULL;
+    gchar **argv;
+    GError *error = NULL;
+    GIOStatus status;
+
+    status = g_io_channel_read_line (channel, &line, NULL, NULL, NULL);
+    if (status == G_IO_STATUS_AGAIN)
+        return G_SOURCE_CONTINUE;
+    if (status != G_IO_STATUS_NORMAL) {
+        /* keep serving until terminated */
+        DBG ("stdin closed");
+        return G_SOURCE_REMOVE;
+    }
+
+    argv = g_strsplit_set (g_strstrip (line), " \t", -1);
+    if (argv[0] && *argv[0]) {
+        if (_run_command (argv, &error)) {
+            g_print ("ok\n");
+        } else {
+            g_print ("error: %s\n", error->message);
+            g_error_free (error);
+        }
+        /* the driver waits for the answer */
+        fflush (stdout);
+    }
+    g_strfreev (argv);
+    g_free (line);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+_on_name_acquired (GDBusConnection *bus, const gchar *name,
+                   gpointer user_data)
+{
+    /* publish the private bus only once tlm can find logind on it */
+    if (user_data) {
+        g_print ("%s\n", opt_address);
+        fflush (stdout);
+    }
+}
+
+static void
+_on_name_lost (GDBusConnection *bus, const gchar *name, gpointer user_data)
+{
+    WARN ("lost or could not own %s", name);
+    g_main_loop_quit (main_loop);
+}
+
+static gboolean
+_on_sigterm (gpointer user_data)
+{
+    g_main_loop_quit (main_loop);
+    return G_SOURCE_REMOVE;
+}
+
+int main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GTestDBus *bus = NULL;
+    GIOChannel *input;
+    gchar **seat_ids, **iter;
+    guint owner_id;
+    guint manager_id;
+    int ret = EXIT_FAILURE;
+
+    GOptionEntry entries[] = {
+        { "address", 'a', 0, G_OPTION_ARG_STRING, &opt_address,
+          "Message bus to serve on, default is a new private bus", "ADDR" },
+        { "seats", 's', 0, G_OPTION_ARG_STRING, &opt_seats,
+          "Comma separated initial seats, default seat0", "IDS" },
+        { "latency", 'l', 0, G_OPTION_ARG_INT, &opt_latency,
+          "Delay of the method replies in milliseconds", "MS" },
+        { "auto-sessions", 0, 0, G_OPTION_ARG_NONE, &opt_auto_sessions,
+          "Put every unknown PID in a session on the first seat", NULL },
+        { NULL }
+    };
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- mock logind for tlm tests");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        g_option_context_free (context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free (context);
+
+    if (!opt_address) {
+        bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+        g_test_dbus_up (bus);
+        opt_address = g_strdup (g_test_dbus_get_bus_address (bus));
+    }
+
+    connection = g_dbus_connection_new_for_address_sync (opt_address,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+            G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+            NULL, NULL, &error);
+    if (!connection) {
+        WARN ("cannot connect to '%s': %s", opt_address, error->message);
+        g_error_free (error);
+        goto _finished;
+    }
+
+    introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+    seats = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                   (GDestroyNotify) _free_seat);
+    sessions = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                      (GDestroyNotify) _free_session);
+
+    manager_id = g_dbus_connection_register_object (connection,
+            LOGIND_OBJECT_PATH,
+            g_dbus_node_info_lookup_interface (introspection,
+                    LOGIND_MANAGER_IFACE),
+            &manager_vtable, NULL, NULL, &error);
+    if (!manager_id) {
+        WARN ("cannot export manager: %s", error->message);
+        g_error_free (error);
+        goto _finished;
+    }
+
+    seat_ids = g_strsplit (opt_seats ? opt_seats : "seat0", ",", -1);
+    for (iter = seat_ids; *iter; iter++) {
+        if (**iter && !_add_seat (*iter, &error)) {
+            WARN ("cannot add seat '%s': %s", *iter, error->message);
+            g_clear_error (&error);
+        }
+    }
+    g_strfreev (seat_ids);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    owner_id = g_bus_own_name_on_connection (connection, LOGIND_BUS_NAME,
+            G_BUS_NAME_OWNER_FLAGS_NONE, _on_name_acquired, _on_name_lost,
+            bus, NULL);
+    g_unix_signal_add (SIGTERM, _on_sigterm, NULL);
+    g_unix_signal_add (SIGINT, _on_sigterm, NULL);
+
+    input = g_io_channel_unix_new (STDIN_FILENO);
+    g_io_add_watch (input, G_IO_IN | G_IO_HUP | G_IO_ERR, _on_stdin, NULL);
+    g_io_channel_unref (input);
+
+    g_main_loop_run (main_loop);
+
+    g_bus_unown_name (owner_id);
+    g_dbus_connection_unregister_object (connection, manager_id);
+    ret = EXIT_SUCCESS;
+
+_finished:
+    if (sessions)
+        g_hash_table_unref (sessions);
+    if (seats)
+        g_hash_table_unref (seats);
+    if (introspection)
+        g_dbus_node_info_unref (introspection);
+    g_clear_object (&connection);
+    if (bus) {
+        g_test_dbus_down (bus);
+        g_object_unref (bus);
+    }
+    if (main_loop)
+        g_main_loop_unref (main_loop);
+    g_free (opt_address);
+    g_free (opt_seats);
+
+    return ret;
+}
@@ -0,0 +1,88 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <check.h>
+#include <string.h>
+#include "tlm-timeline.h"
+
+START_TEST(test_timeline)
+{
+    TlmTimeline *timeline = tlm_timeline_new ("seat0", "user1");
+    TlmTimeline *remote = tlm_timeline_new (NULL, NULL);
+    GVariantBuilder builder;
+    GVariant *phases, *timelines;
+    const gchar *phase = NULL;
+    gint64 time = 0;
+    gchar *trace;
+
+    tlm_timeline_mark_at (timeline, TLM_PHASE_LOGIN_STARTED, 100);
+    tlm_timeline_mark_at (timeline, TLM_PHASE_LOGIN_DONE, 400);
+    tlm_timeline_mark_at (remote, TLM_PHASE_PAM_AUTHENTICATE, 300);
+    tlm_timeline_mark_at (remote, TLM_PHASE_PAM_START, 200);
+
+    /* marks from the other process end up in time order */
+    tlm_timeline_merge (timeline, tlm_timeline_get_phases (remote));
+    phases = tlm_timeline_get_phases (timeline);
+    fail_if (g_variant_n_children (phases) != 4);
+    g_variant_get_child (phases, 1, "(&sx)", &phase, &time);
+    fail_if (g_strcmp0 (phase, TLM_PHASE_PAM_START) != 0 || time != 200);
+    g_variant_unref (g_variant_ref_sink (phases));
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssa(sx))"));
+    g_variant_builder_add_value (&builder, tlm_timeline_to_variant (timeline));
+    timelines = g_variant_ref_sink (g_variant_builder_end (&builder));
+    trace = tlm_timeline_to_trace (timelines);
+    fail_if (trace == NULL);
+    fail_if (strstr (trace, "{\"name\":\"pam-authenticate\",\"cat\":\"login\","
+                     "\"ph\":\"X\",\"ts\":200,\"dur\":100,") == NULL);
+
+    g_free (trace);
+    g_variant_unref (timelines);
+    tlm_timeline_free (remote);
+    tlm_timeline_free (timeline);
+}
+END_TEST
+
+int main (void)
+{
+    int number_failed;
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+    SRunner *sr = NULL;
+    Suite *s = suite_create ("tlm timeline tests");
+    TCase *tc = NULL;
+
+    tc = tcase_create ("Timeline");
+    tcase_add_test (tc, test_timeline);
+    suite_add_tcase (s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? 0 : -1;
+}
@@ -0,0 +1,95 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <check.h>
+#include <glib/gstdio.h>
+#include "tlm-utils.h"
+
+START_TEST(test_logind_session_id)
+{
+    gchar *proc_root = g_dir_make_tmp ("tlm-proc-XXXXXX", NULL);
+    gchar *pid_dir, *cgroup_path, *tmp_str;
+
+    fail_if (proc_root == NULL);
+    pid_dir = g_build_filename (proc_root, "42", NULL);
+    cgroup_path = g_build_filename (pid_dir, "cgroup", NULL);
+    fail_if (g_mkdir (pid_dir, 0700) != 0);
+
+    /* legacy hierarchy, named systemd controller */
+    fail_if (!g_file_set_contents (cgroup_path,
+            "4:cpu,cpuacct:/user.slice\n"
+            "1:name=systemd:/user.slice/user-1000.slice/session-c1.scope\n",
+            -1, NULL));
+    tmp_str = tlm_utils_get_logind_session_id (proc_root, 42);
+    fail_if (g_strcmp0 (tmp_str, "c1") != 0);
+    g_free (tmp_str);
+
+    /* unified hierarchy */
+    fail_if (!g_file_set_contents (cgroup_path,
+            "0::/user.slice/user-1000.slice/session-3.scope\n", -1, NULL));
+    tmp_str = tlm_utils_get_logind_session_id (proc_root, 42);
+    fail_if (g_strcmp0 (tmp_str, "3") != 0);
+    g_free (tmp_str);
+
+    tmp_str = tlm_utils_logind_session_path ("3");
+    fail_if (g_strcmp0 (tmp_str, "/org/freedesktop/login1/session/_33") != 0);
+    g_free (tmp_str);
+
+    /* not part of a session */
+    fail_if (!g_file_set_contents (cgroup_path,
+            "0::/system.slice/tlm.service\n", -1, NULL));
+    fail_if (tlm_utils_get_logind_session_id (proc_root, 42) != NULL);
+    fail_if (tlm_utils_get_logind_session_id (proc_root, 43) != NULL);
+
+    g_unlink (cgroup_path);
+    g_rmdir (pid_dir);
+    g_rmdir (proc_root);
+    g_free (cgroup_path);
+    g_free (pid_dir);
+    g_free (proc_root);
+}
+END_TEST
+
+int main (void)
+{
+    int number_failed;
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+    SRunner *sr = NULL;
+    Suite *s = suite_create ("tlm utils tests");
+    TCase *tc = NULL;
+
+    tc = tcase_create ("Utils");
+    tcase_add_test (tc, test_logind_session_id);
+    suite_add_tcase (s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? 0 : -1;
+}